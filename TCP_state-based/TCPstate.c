@@ -0,0 +1,213 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// TCP で通信する state‑based CRDT "G‑Counter"
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -pthread -I../common -o TCPstate TCPstate.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c ../common/evloop.c ../common/tcp_link.c
+//   $ ./TCPstate <replica_id> <listen_port> <peer_host:port> [...]
+//
+//   例) 端末 A: ./TCPstate 0 9000 127.0.0.1:9001
+//       端末 B: ./TCPstate 1 9001 127.0.0.1:9000
+//
+//   UDPstate と同じ G‑Counter (../common/gc.h) を、つなぎっぱなしの TCP 接続
+//   (../common/tcp_link.h) の上で同期します。
+//   - 各レプリカは listen_port で待ち受け、各 peer へは自分から接続して送る
+//     (受信は相手からの接続で受ける)。
+//   - メッセージは長さ付きフレームなので BUF_SIZE で切り詰めない。
+//     extra のレプリカが増えて全状態が大きくなってもそのまま送る。
+//   - つながった (つなぎ直した) ときに全状態を送り、あとは
+//     BROADCAST_INTERVAL_MS ごとに変わった分 (delta) だけを送る。
+//     TCP は落とさないので定期的な全状態の送信はいらない。
+//   - 送信キューが詰まっている peer には送らない (dirty のまま残るので、
+//     次のタイマでまとめて送る)。
+// ------------------------------------------------------------
+// ⚠️ 本実装は学習用サンプルです。エラー処理・入力検証は簡略化しています。
+// ------------------------------------------------------------
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "evloop.h"
+#include "gc.h"
+#include "gc_wire.h"
+#include "tcp_link.h"
+
+#define BROADCAST_INTERVAL_MS 1000
+
+typedef struct Replica Replica;
+
+typedef struct {
+    Replica *r;
+    int index;
+    tcp_conn *conn; // 送信用 (自分から dial した接続)
+} Peer;
+
+struct Replica {
+    GCounter gc;
+    Peer *peers;
+    int peer_count;
+    char *msg; // 直列化用 (gc_serialize_bound に合わせて伸ばす)
+    size_t msg_cap;
+    ev_linebuf in;
+};
+
+// peer に delta (full なら全状態) を送る。送れない間は dirty のまま残す
+static void send_peer(Peer *p, int full) {
+    Replica *r = p->r;
+    if (!tcp_conn_up(p->conn) || tcp_conn_pending(p->conn) > TCP_TX_HIGH) return;
+    size_t need = gc_serialize_bound(&r->gc);
+    if (need > r->msg_cap) {
+        char *m = realloc(r->msg, need);
+        if (!m) return;
+        r->msg = m;
+        r->msg_cap = need;
+    }
+    size_t len = gc_serialize_for_peer(&r->gc, p->index, full, r->msg, r->msg_cap);
+    if (len == 0) return; // この peer に伝えることはない
+    if (tcp_conn_send(p->conn, r->msg, len) == 0) tcp_conn_flush(p->conn);
+}
+
+// -------------------- 接続のコールバック --------------------
+
+static void on_frame(tcp_conn *c, const void *buf, size_t len, void *arg) {
+    (void)c;
+    Replica *r = (Replica *)arg;
+    if (gc_merge_buf(&r->gc, buf, len) < 0) {
+        fprintf(stderr, "[Recv] malformed frame (%zu bytes)\n", len);
+        return;
+    }
+    if (gc_wire_is_binary(buf, len)) {
+        printf("[Recv] %zu bytes\n", len);
+    } else {
+        printf("[Recv] %.*s\n", (int)len, (const char *)buf);
+    }
+    printf("  → total=%lu\n", gc_total(&r->gc));
+}
+
+static void on_peer_state(tcp_conn *c, int up, void *arg) {
+    (void)c;
+    Peer *p = (Peer *)arg;
+    printf("[Peer %d] %s\n", p->index, up ? "connected" : "disconnected");
+    if (up) send_peer(p, 1); // (つなぎ直した後も) まず全状態
+}
+
+static void on_peer_drain(tcp_conn *c, void *arg) {
+    (void)c;
+    send_peer((Peer *)arg, 0); // 送信キューが空いたら待たずに送る
+}
+
+// 送信用の接続に来たフレームも同じようにマージする (相手が返してくることはないが)
+static void on_peer_frame(tcp_conn *c, const void *buf, size_t len, void *arg) {
+    on_frame(c, buf, len, ((Peer *)arg)->r);
+}
+
+static const tcp_handlers peer_handlers = {on_peer_frame, on_peer_state, on_peer_drain};
+static const tcp_handlers inbound_handlers = {on_frame, NULL, NULL};
+
+// -------------------- 入力とタイマ --------------------
+
+static void on_line(const char *line, void *arg) {
+    Replica *r = (Replica *)arg;
+    unsigned long delta = strtoul(line, NULL, 10);
+    if (delta > 0) {
+        gc_increment(&r->gc, delta);
+        printf("[Local] +%lu (total=%lu)\n", delta, gc_total(&r->gc));
+    }
+}
+
+static void on_stdin(ev_loop *l, int fd, uint32_t events, void *arg) {
+    (void)events;
+    Replica *r = (Replica *)arg;
+    if (ev_read_lines(fd, &r->in, on_line, r) != 0) {
+        ev_del_fd(l, fd); // EOF: 入力がなくなっても同期は続ける
+    }
+}
+
+static void on_broadcast(ev_loop *l, uint64_t expirations, void *arg) {
+    (void)l;
+    (void)expirations;
+    Replica *r = (Replica *)arg;
+    for (int i = 0; i < r->peer_count; ++i) send_peer(&r->peers[i], 0);
+}
+
+// -------------------- メイン --------------------
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s <replica_id> <listen_port> <peer_host:port> [...]\n", argv[0]);
+        return 1;
+    }
+
+    int replica_id = atoi(argv[1]);
+    if (replica_id < 0 || replica_id >= MAX_REPLICAS) {
+        fprintf(stderr, "replica_id must be between 0 and %d\n", MAX_REPLICAS - 1);
+        return 1;
+    }
+    int listen_port = atoi(argv[2]);
+
+    static Replica rep;
+    rep.peer_count = argc - 3;
+    if (gc_init(&rep.gc, replica_id, rep.peer_count) < 0) {
+        perror("gc_init");
+        return 1;
+    }
+    rep.peers = calloc(rep.peer_count, sizeof(Peer));
+    ev_loop *loop = ev_new();
+    if (!rep.peers || !loop) {
+        perror("init");
+        return 1;
+    }
+
+    // --- 待ち受け (受信用) ---
+    if (tcp_listen(loop, listen_port, &inbound_handlers, &rep) < 0) {
+        perror("listen");
+        return 1;
+    }
+
+    // --- 各 peer へ接続 (送信用。切れてもつなぎ直す) ---
+    for (int i = 0; i < rep.peer_count; ++i) {
+        char *hostport = argv[i + 3];
+        char *colon = strchr(hostport, ':');
+        if (!colon) {
+            fprintf(stderr, "Invalid peer format: %s\n", hostport);
+            return 1;
+        }
+        *colon = '\0';
+        struct sockaddr_in addr = {0};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((unsigned short)atoi(colon + 1));
+        if (inet_pton(AF_INET, hostport, &addr.sin_addr) <= 0) {
+            fprintf(stderr, "Invalid IP: %s\n", hostport);
+            return 1;
+        }
+        rep.peers[i].r = &rep;
+        rep.peers[i].index = i;
+        rep.peers[i].conn = tcp_dial(loop, &addr, &peer_handlers, &rep.peers[i]);
+        if (!rep.peers[i].conn) {
+            perror("tcp_dial");
+            return 1;
+        }
+    }
+
+    // --- イベントループ: 入力・接続・定期送信を 1 スレッドで ---
+    if (ev_set_nonblock(STDIN_FILENO) < 0 || ev_add_fd(loop, STDIN_FILENO, EPOLLIN, on_stdin, &rep) < 0) {
+        // 通常ファイルからのリダイレクトは epoll できないので先に全部読む
+        ev_read_lines(STDIN_FILENO, &rep.in, on_line, &rep);
+    }
+    if (ev_add_timer(loop, BROADCAST_INTERVAL_MS, on_broadcast, &rep) < 0) {
+        perror("timerfd");
+        return 1;
+    }
+    if (ev_run(loop) < 0) perror("epoll_wait");
+
+    for (int i = 0; i < rep.peer_count; ++i) tcp_conn_close(rep.peers[i].conn);
+    ev_free(loop);
+    gc_destroy(&rep.gc);
+    free(rep.peers);
+    free(rep.msg);
+    return 0;
+}
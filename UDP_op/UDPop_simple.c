@@ -1,65 +1,173 @@
 /* ./UDPop_simple <replica_id> <listen_port> <peer_host:port> */
+/* ビルド: gcc -I../common -o UDPop_simple UDPop_simple.c ../common/udp_batch.c ../common/op_reliable.c ../common/evloop.c ../common/gc_sched.c */
+/* op は op_reliable で送る: 送信元ごとの通し番号で重複を捨てて順番どおりに 1 回ずつ足し、
+   ack が来るまで再送する (損失・重複があっても合計がずれない) */
+/* 送る時刻は gc_sched で決める: opを積むか受け取ったらMIN_DELAY_MS後にまとめて送り、
+   ack待ちのopがある間はTICK_MSごとに再送を見て、何もなければIDLE_MAX_MSまで間隔を延ばす */
 
+#define _GNU_SOURCE
 #include <arpa/inet.h>
 #include <netinet/in.h>
-#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "evloop.h"
+#include "gc_sched.h"
+#include "op_reliable.h"
+#include "udp_batch.h"
+
 #define MAX_REPLICAS 256
 #define BUF_SIZE 4096
-#define BROADCAST_INTERVAL_SEC 5
+#define TICK_MS 50       /*ack待ちのopがある間、再送を見る間隔*/
+#define MIN_DELAY_MS 10  /*opを積んでからこれだけ待って、その間のopを1通にまとめる*/
+#define IDLE_MAX_MS 1000 /*何もないときの間隔の上限*/
 
 typedef struct {
     int replica_id;                 // 自分の ID
     unsigned long value; // 自レプリカのカウンタ値
-    pthread_mutex_t lock;           // 共有データ保護
-    unsigned long msg;
+    opr rel;                        // 送信中の op と peer ごとの受信状態
 } GCounter;
 
 
-/*gc_increment関数*/
-void gc_increment(GCounter *gc, unsigned long delta) {
-    pthread_mutex_lock(&gc->lock);
-    gc->value += delta;
-    pthread_mutex_unlock(&gc->lock);
+/*gc_increment関数: 自分の op として積んでから足す。積めなければ -1*/
+int gc_increment(GCounter *gc, unsigned long delta) {
+    int rc = opr_submit(&gc->rel, delta);
+    if (rc == 0) gc->value += delta;
+    return rc;
 }
 
 
-/*merge処理*/
-void gc_merge_str(GCounter *gc, unsigned long *incoming) {
-    pthread_mutex_lock(&gc->lock);
-    gc->value += *incoming;
-    pthread_mutex_unlock(&gc->lock);
+/*merge処理: op_reliableが順番どおり1回だけ渡してくるop*/
+static void gc_merge_op(void *arg, int peer, uint64_t delta) {
+    GCounter *gc = (GCounter *)arg;
+    gc->value += delta;
+    printf("[Recv] peer %d +%llu\n", peer, (unsigned long long)delta);
 }
 
 
 
-//受信スレッド起動時に起動する関数
+//イベントループのコールバック (受信・標準入力・tickタイマを1スレッドで処理するのでロックはいらない)
 
 typedef struct {
     int sockfd;
-    GCounter *gc;
-} ReceiverArgs;
-
-void *receiver_thread(void *arg) {
-    ReceiverArgs *args = (ReceiverArgs *)arg;
-    char buf[BUF_SIZE] = {0};
-    unsigned long ulbuf; /*受け取ったmsgをbufに突っ込む*/
-
-    while (1) {
-        ssize_t len = recvfrom(args->sockfd, buf, sizeof(buf), 0, NULL, NULL);
-        if (len <= 0) continue; 
-        // TODO: bufを数字に変換
-        ulbuf = atoi(buf);
-        gc_merge_str(args->gc, &ulbuf); /*gc_merge_str関数でマージ処理を行う*/
-        printf("[Recv] %lu\n", ulbuf);
-        printf("  → total=%lu\n", args->gc->value);
+    GCounter gc;
+    const struct sockaddr_in *peers;
+    int peer_count;
+    udp_rx_batch *rx; /*recvmmsgでまとめて受け取るためのバッファ*/
+    udp_tx_batch tx;
+    int used;         /*bufsの使用数*/
+    char bufs[UDP_BATCH_MAX][OPR_MTU]; /*opr_tickが作ったデータグラムはその場限りなのでコピーしてからためる*/
+    gc_sched sched;
+    ev_loop *loop;
+    int timer;
+    uint64_t due; /*timerが次に満了する時刻 (ms)*/
+    ev_linebuf in;
+} Replica;
+
+/*送信元アドレスからpeer番号を探す。知らないアドレスなら-1*/
+static int find_peer(const Replica *r, const struct sockaddr_in *src) {
+    for (int i = 0; i < r->peer_count; ++i)
+        if (r->peers[i].sin_addr.s_addr == src->sin_addr.s_addr && r->peers[i].sin_port == src->sin_port)
+            return i;
+    return -1;
+}
+
+static void queue_send(void *arg, int peer, const void *buf, size_t len) {
+    Replica *r = (Replica *)arg;
+    if (r->used == UDP_BATCH_MAX) { /*一杯になったら送ってから使い回す*/
+        udp_tx_flush(r->sockfd, &r->tx);
+        r->used = 0;
     }
+    memcpy(r->bufs[r->used], buf, len);
+    udp_tx_add(r->sockfd, &r->tx, r->bufs[r->used++], len, &r->peers[peer]);
+}
 
-    return NULL;
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/*次に送る時刻にtimerを合わせる。ack待ちのopがあればTICK_MSより先にはしない*/
+static void reschedule(Replica *r, uint64_t now) {
+    uint64_t due = gc_sched_due(&r->sched);
+    if (!opr_idle(&r->gc.rel) && due > now + TICK_MS) due = now + TICK_MS;
+    uint64_t wait = due > now ? due - now : 1; /*0だとタイマが止まる*/
+    ev_set_timer(r->loop, r->timer, wait);
+    r->due = now + wait;
+}
+
+/*送るものができた (opを積んだ・ackを返す必要がある)*/
+static void changed(Replica *r) {
+    uint64_t now = now_ms();
+    gc_sched_changed(&r->sched, now);
+    if (gc_sched_due(&r->sched) < r->due) reschedule(r, now);
+}
+
+static void on_socket(ev_loop *l, int fd, uint32_t events, void *arg) {
+    (void)l;
+    (void)events;
+    Replica *r = (Replica *)arg;
+    unsigned long before = r->gc.value;
+    int need_ack = 0; /*ackだけのmsgでは送るものはできない (gc_schedの間隔を縮めない)*/
+    for (;;) {
+        int n = udp_rx_recv(fd, r->rx, MSG_DONTWAIT); /*たまっているmsgを1回のシステムコールで受け取る*/
+        if (n <= 0) break; /*EAGAIN: 読み切った*/
+        for (int i = 0; i < n; ++i) {
+            size_t len;
+            const char *data = udp_rx_data(r->rx, i, &len);
+            int peer = find_peer(r, &r->rx->src[i]);
+            if (peer < 0) {
+                fprintf(stderr, "[Recv] dropped datagram (%zu bytes)\n", len);
+                continue;
+            }
+            int pending = r->gc.rel.peers[peer].ack_pending;
+            if (opr_recv(&r->gc.rel, peer, data, len, gc_merge_op, &r->gc) < 0)
+                fprintf(stderr, "[Recv] dropped datagram (%zu bytes)\n", len);
+            if (!pending && r->gc.rel.peers[peer].ack_pending) need_ack = 1; /*opが届いた*/
+        }
+        if (n < UDP_BATCH_MAX) break;
+    }
+    if (need_ack || r->gc.value != before) changed(r); /*ackを返す*/
+    if (r->gc.value != before) printf("  → total=%lu\n", r->gc.value);
+}
+
+/*gc_schedが決めた時刻に、たまったop・再送・ackをpeerごとにまとめて送る*/
+static void on_tick(ev_loop *l, uint64_t expirations, void *arg) {
+    (void)l;
+    (void)expirations;
+    Replica *r = (Replica *)arg;
+    uint64_t now = now_ms();
+    int full;
+    gc_sched_begin(&r->sched, now, &full); /*全状態はないのでfullは使わない。送信数も制限しない*/
+    udp_tx_init(&r->tx);
+    r->used = 0;
+    uint64_t before = r->gc.rel.stats.sent_dgrams;
+    opr_tick(&r->gc.rel, now, queue_send, r);
+    udp_tx_flush(r->sockfd, &r->tx);
+    gc_sched_end(&r->sched, now, (int)(r->gc.rel.stats.sent_dgrams - before), 0);
+    reschedule(r, now);
+}
+
+static void on_line(const char *line, void *arg) {
+    Replica *r = (Replica *)arg;
+    unsigned long delta = strtoul(line, NULL, 10); /*文字列→符号なし長整数でdeltaに格納。*/
+    if (delta == 0) return;
+    if (gc_increment(&r->gc, delta) < 0) { /*再送バッファが一杯 (peerが長く応答しない)*/
+        fprintf(stderr, "[Local] +%lu rejected: retransmit buffer full\n", delta);
+        return;
+    }
+    changed(r);
+    printf("[Local] +%lu (total=%lu)\n", delta, r->gc.value);
+}
+
+static void on_stdin(ev_loop *l, int fd, uint32_t events, void *arg) {
+    (void)events;
+    if (ev_read_lines(fd, &((Replica *)arg)->in, on_line, arg) != 0)
+        ev_del_fd(l, fd); /*標準入力が閉じても受信・再送は続ける*/
 }
 
 
@@ -108,12 +216,6 @@ int main(int argc, char *argv[]) { /*arg[]はプログラム実行時に入力
     }
 
 
-    // --- G‑Counter 初期化 ---
-    GCounter gc = {0}; /*構造体の全部の変数を０で初期化*/
-    gc.replica_id = replica_id;
-    pthread_mutex_init(&gc.lock, NULL);
-
-
     // --- Peer アドレス一覧を保存 ---
     int peer_count = argc - 3; /*peerの個数がargc-3個*/
     struct sockaddr_in *peers = calloc(peer_count, sizeof(struct sockaddr_in)); /*peer_count個ぶんのstruct sockaddr_in構造体をゼロ初期化して確保し、その先頭アドレスをpeersに格納する*/
@@ -142,42 +244,39 @@ int main(int argc, char *argv[]) { /*arg[]はプログラム実行時に入力
     }
 
 
-    // --- 受信スレッド起動 ---
-    pthread_t recv_tid;
-    ReceiverArgs rargs = {sockfd, &gc};
-    pthread_create(&recv_tid, NULL, receiver_thread, &rargs);/*スレッド生成してreceiver_thread(rargs)起動、スレッドIDはrecv_tidに保存*/
-
-
-
-    /*メインスレッド*/
-    char line[128];
-    time_t last_broadcast = 0;
-
-    while (1) { /*無限ループ*/
-        // 標準入力があれば自プロセス内で処理
-        if (fgets(line, sizeof(line), stdin)) { /*標準入力で得た値をlineに格納*/
-            unsigned long delta = strtoul(line, NULL, 10); /*文字列→符号なし長整数でdeltaに格納。*/
-            if (delta > 0) {
-                gc_increment(&gc, delta); /*gc_increment関数呼び出して自分のvalueにdelta付け足す*/
-                printf("[Local] +%lu (total=%lu)\n", delta, gc.value);
-            }
-            gc.msg += delta; /*msgにdeltaを追加*/
-        }
+    // --- G‑Counter 初期化 ---
+    static Replica rep; /*opの再送バッファや送受信バッファを持つので大きい。staticにして0で初期化*/
+    rep.sockfd = sockfd;
+    rep.peers = peers;
+    rep.peer_count = peer_count;
+    rep.gc.replica_id = replica_id;
+    rep.rx = udp_rx_new();
+    ev_loop *loop = ev_new();
+    if (!rep.rx || !loop || opr_init(&rep.gc.rel, (uint64_t)replica_id, peer_count) < 0) {
+        perror("init");
+        return 1;
+    }
 
-        // 一定間隔で状態をブロードキャスト
-        time_t now = time(NULL); /*現時間をnowに格納*/
-        if (now - last_broadcast >= BROADCAST_INTERVAL_SEC) { /*最後にブロードキャストしてからINTERVAL_SECがすぎたら、*/
-            char msg[BUF_SIZE];
-            for (int i = 0; i < peer_count; ++i) {
-                snprintf(msg, BUF_SIZE, "%lu", gc.msg);
-                sendto(sockfd, msg, strlen(msg), 0, (struct sockaddr *)&peers[i], sizeof(peers[i])); /*sockfd：自分のソケット。msgを送信*/
-            }
-            gc.msg = 0; /*msgを初期化*/
-            last_broadcast = now;
-        }
 
+    // --- イベントループ: 受信・標準入力・tickを1スレッドで待つ ---
+    ev_set_nonblock(sockfd);
+    ev_add_fd(loop, sockfd, EPOLLIN, on_socket, &rep);
+    gc_sched_config sc = {.min_delay_ms = MIN_DELAY_MS, .max_interval_ms = IDLE_MAX_MS, .full_every_ms = UINT64_MAX};
+    gc_sched_init(&rep.sched, &sc, now_ms());
+    rep.loop = loop;
+    rep.timer = ev_add_timer(loop, TICK_MS, on_tick, &rep);
+    if (rep.timer < 0) {
+        perror("timerfd");
+        return 1;
     }
-    // never reached
+    rep.due = now_ms() + TICK_MS;
+    if (ev_set_nonblock(STDIN_FILENO) < 0 || ev_add_fd(loop, STDIN_FILENO, EPOLLIN, on_stdin, &rep) < 0)
+        ev_read_lines(STDIN_FILENO, &rep.in, on_line, &rep); /*通常ファイルはepollできないので先に全部読む*/
+    if (ev_run(loop) < 0) perror("epoll_wait");
+
+    ev_free(loop);
+    udp_rx_free(rep.rx);
+    opr_free(&rep.gc.rel);
     free(peers);
     close(sockfd);
     return 0;
@@ -3,122 +3,376 @@
 // UDP で通信する state‑based CRDT "G‑Counter" の最小実装
 // ------------------------------------------------------------
 // 使い方:
-//   $ gcc -pthread -o gcounter_udp g_counter_udp.c
-//   $ ./gcounter_udp <replica_id> <listen_port> <peer_host:port> [...]
+//   $ gcc -pthread -I../common -o UDPstate UDPstate.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c ../common/udp_batch.c ../common/evloop.c ../common/uring_net.c ../common/gossip.c ../common/gc_sync.c ../common/gc_persist.c ../common/gc_metrics.c ../common/gc_stage.c ../common/udp_shard.c ../common/gc_sched.c ../common/udp_mcast.c
+//   $ ./UDPstate <replica_id> <listen_port> <peer_host:port> [...]
 //
-//   例) 端末 A: ./gcounter_udp 0 9000 127.0.0.1:9001
-//       端末 B: ./gcounter_udp 1 9001 127.0.0.1:9000
+//   例) 端末 A: ./UDPstate 0 9000 127.0.0.1:9001
+//       端末 B: ./UDPstate 1 9001 127.0.0.1:9000
 //
 //   実行中に数値を入力するとその分インクリメントし、
-//   内部状態(各レプリカのカウンタ)を UDP ブロードキャストします。
-//   受信側は JSON 風 "id=value,id=value" 形式の文字列を解析しマージします。
+//   内部状態(各レプリカのカウンタ)を UDP で peer に送ります。
+//   送る時刻は ../common/gc_sched.h が決めます: 増分があれば
+//   GC_MIN_DELAY_MS (既定 MIN_DELAY_MS) 後にその間の増分をまとめて送り、
+//   何も変わらなければ間隔を倍々に延ばして GC_INTERVAL_MS
+//   (既定 BROADCAST_INTERVAL_SEC 秒) まで下げます。GC_PPS=n を付けると
+//   送信を n パケット/秒に抑え、送り切れない peer は順番に後回しにします。
+//   GC_SCHED=fixed なら以前どおり GC_INTERVAL_MS ごとに送ります (比較用)。
+//   受信・入力・タイマは epoll の 1 スレッドで処理します (../common/evloop.h)。
+//   環境変数 GC_NET=uring を付けると送受信に io_uring を使います
+//   (../common/uring_net.h。使えないカーネルでは自動的にソケットに戻ります)。
+//   状態はバイナリ形式 (../common/gc_wire.h) で送ります。
+//   通常は前回から変わったエントリだけ (delta) を送り、
+//   GC_SYNC_FULL_EVERY 回に 1 回だけ全状態を送ります。
+//   何を誰に送るか (同期方式) は ../common/gc_sync.h にあり、ここはそれを
+//   ソケット / io_uring で送るトランスポートです
+//   (bench/bench_sim.c は同じ方式を模擬ネットワークの上で動かします)。
+//   環境変数 GC_FANOUT=k を付けるとゴシップモードになり (../common/gossip.h)、
+//   毎回全 peer に送る代わりにランダムな k 個の peer と push‑pull で
+//   全状態をやりとりします。1 ノードの送信数は peer 数によらず一定で、
+//   数十ノードを超える構成ではこちらを使ってください。
+//   環境変数 GC_MCAST=239.1.2.3:9100 を付けると、全レプリカがそのマルチキャスト
+//   グループに参加し、状態を peer ごとではなくグループ宛てに 1 回だけ送ります
+//   (../common/udp_mcast.h。delta はグループを 1 つの peer として追跡します)。
+//   インタフェースは GC_MCAST_IF (既定 127.0.0.1 = 同じホストの中だけ)。
+//   peer 一覧は受信したデータグラムの送り主を見分けるのに使います。
+//   ゴシップ (GC_FANOUT) とは一緒に使えません。
+//   環境変数 GC_STATE_DIR=<dir> を付けると、自分の状態を dir に永続化します
+//   (../common/gc_persist.h)。再起動しても自スロットが 0 に戻らないので、
+//   peer の大きい値に増分が飲み込まれません。fsync の方針は
+//   GC_FSYNC=none|group|always (既定 group: GROUP_COMMIT_MS ごとにまとめて fdatasync)。
+//   自分の値は必ずログに書いてから peer に送ります。
+//   送受信数・マージ数・peer ごとの最終受信時刻・収束遅延などを数えています
+//   (../common/gc_metrics.h)。環境変数 GC_METRICS=/gc-9000 のように名前を
+//   付けると共有メモリに置くので、./gcstat /gc-9000 で外から見られます。
+//   環境変数 GC_RECEIVERS=k (2〜UDP_SHARD_MAX) を付けると、同じポートに
+//   SO_REUSEPORT のソケットをあと k-1 本開き、それぞれを CPU に固定した
+//   受信スレッドで読みます (../common/udp_shard.h)。受信スレッドは自分の
+//   ステージにマージして、まとめて共有状態へ畳み込みます。カーネルは
+//   送信元ごとにソケットを選ぶので、peer が多いときに効きます。
+//   受信スレッドに来た分は表示せず、pull 要求にも答えません (push だけで広がる)。
+//   カーネルは peer ごとに受けるソケットを固定するので、ゴシップ (GC_FANOUT) では
+//   pull の返事をもらえない peer が出ます。一緒には使えません。
+//   受信ごとの表示は GC_PRINT=all|total|none で選べます
+//   (既定 all。total は合計が変わったときだけ、none は何も出さない)。
+//   -DGC_WIRE_TEXT を付けてビルドすると、デバッグ用に旧来の
+//   "id=value,id=value" 形式の文字列で送ります (受信側はどちらも解析可)。
 // ------------------------------------------------------------
 // ⚠️ 本実装は学習用サンプルです。エラー処理・入力検証は簡略化しています。
 // ------------------------------------------------------------
 
+#define _GNU_SOURCE
 #include <arpa/inet.h>
+#include <errno.h>
 #include <netinet/in.h>
-#include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
-#define MAX_REPLICAS 256
-#define BUF_SIZE 4096
-#define BROADCAST_INTERVAL_SEC 5
+#include "gc.h"
+#include "evloop.h"
+#include "gc_metrics.h"
+#include "gc_persist.h"
+#include "gc_sched.h"
+#include "gc_wire.h"
+#include "gc_sync.h"
+#include "gossip.h"
+#include "udp_batch.h"
+#include "udp_mcast.h"
+#include "udp_shard.h"
+#include "uring_net.h"
+
+#define BROADCAST_INTERVAL_SEC 5 // 何も変わらないときの最大の送信間隔 (GC_SCHED=fixed ならこの間隔)
+#define MIN_DELAY_MS 20           // 増分からこれだけ待って、その間の増分をまとめて送る
+#define CHECKPOINT_MS (BROADCAST_INTERVAL_SEC * 1000) // 状態ファイルに写す間隔
+#define GROUP_COMMIT_MS 10 // GC_FSYNC=group: 増分をためてこの間隔でまとめて書く
+
+enum { PRINT_ALL, PRINT_TOTAL, PRINT_NONE }; // GC_PRINT
+
+// -------------------- レプリカ (イベントループのコールバック) --------------------
+// 標準入力・ソケット・ブロードキャストのタイマを 1 本の epoll で待つ。
+// すべて同じスレッドで動くので、コールバックの間でロックはいらない。
 
 typedef struct {
-    int replica_id;                 // 自分の ID
-    unsigned long values[MAX_REPLICAS]; // 各レプリカのカウンタ値
-    pthread_mutex_t lock;           // 共有データ保護
-} GCounter;
+    int sockfd;
+    GCounter gc;
+    struct sockaddr_in *peers;
+    int peer_count;
+    int mcast;                 // GC_MCAST のとき 1 (送り先はいつも group)
+    struct sockaddr_in group;
+    udp_rx_batch *rx;
+    udp_tx_batch tx;
+    uring_net *uring; // GC_NET=uring のとき (NULL ならソケットの経路)
+    int fanout;       // GC_FANOUT=k のとき k (0 なら全 peer に送る)
+    gossip gossip;
+    gc_sync sync;
+    gc_transport transport;           // sync が送るのに使う (下の net_*)
+    int adaptive;          // GC_SCHED=adaptive (既定)。0 なら一定間隔
+    gc_sched sched;
+    int sync_timer;
+    uint64_t sync_due;     // sync_timer が次に満了する時刻 (ms)
+    uint64_t checkpoint_at; // 最後に状態ファイルに写した時刻 (ms)
+    const struct sockaddr_in *reply_to; // gc_sync_reply 中のメッセージの送り主 (それ以外は NULL)
+    gc_persist *persist; // GC_STATE_DIR のとき (NULL なら永続化しない)
+    int commit_timer;    // GROUP のグループコミット (ためているときだけ動かす)
+    int commit_armed;
+    gc_metrics metrics;
+    gc_metrics_thread *mt; // イベントループのスレッドのカウンタ
+    int print;             // PRINT_*
+    ev_loop *loop;
+    ev_linebuf in;
+} Replica;
+
+// 送信元アドレスから peer の番号を引く (peer 一覧にいなければ -1)
+static int peer_of(const Replica *r, const struct sockaddr_in *src) {
+    for (int i = 0; i < r->peer_count; ++i) {
+        if (r->peers[i].sin_port == src->sin_port && r->peers[i].sin_addr.s_addr == src->sin_addr.s_addr) return i;
+    }
+    return -1;
+}
 
+// ためた送信をまとめて送り、送れた数・バイト数・送れなかった数を数える。
+// udp_tx_add がたまりきって自分で flush した分もここで拾う
+static void tx_flush(Replica *r) {
+    udp_tx_flush(r->sockfd, &r->tx);
+    gc_metrics_add(r->mt, GC_M_TX_PACKETS, r->tx.sent);
+    gc_metrics_add(r->mt, GC_M_TX_BYTES, r->tx.bytes);
+    gc_metrics_add(r->mt, GC_M_TX_DROPPED, r->tx.dropped);
+    r->tx.sent = r->tx.dropped = r->tx.bytes = 0;
+}
 
+// 送信の途中で uring_net_poll は呼ばない (受信のコールバックからここに来ることがあり、
+// poll は入れ子にできない)。uring_net_send は CQ の先頭に続く送信の完了だけを回収するので、
+// それでも枠が空かなければ落とす (UDP の損失と同じく次の full sync で回復)
+static void uring_send(Replica *r, const void *buf, size_t len, const struct sockaddr_in *dst) {
+    if (uring_net_send(r->uring, buf, len, dst) < 0) {
+        gc_metrics_add(r->mt, GC_M_TX_DROPPED, 1);
+        return;
+    }
+    gc_metrics_add(r->mt, GC_M_TX_PACKETS, 1);
+    gc_metrics_add(r->mt, GC_M_TX_BYTES, len);
+}
 
-// -------------------- ユーティリティ関数 --------------------
-unsigned long gc_total(GCounter *gc) {
-    unsigned long sum = 0;
-    for (int i = 0; i < MAX_REPLICAS; ++i) {
-        sum += gc->values[i];
+// 自分の値を送る前に、ログにためている分をディスクに書く。
+// 書けなければ送らない (送った値より小さい値で再起動すると増分が消えるため)
+static int persist_before_send(Replica *r) {
+    if (!r->persist || !gc_persist_dirty(r->persist)) return 0;
+    if (gc_persist_commit(r->persist) < 0) {
+        perror("[Persist] commit");
+        return -1;
     }
-    return sum;
+    return 0;
 }
 
-void gc_increment(GCounter *gc, unsigned long delta) {
-    pthread_mutex_lock(&gc->lock);
-    gc->values[gc->replica_id] += delta;
-    pthread_mutex_unlock(&gc->lock);
+// -------------------- トランスポート (gc_sync.h) --------------------
+// ソケットなら sendmmsg 用にためて flush でまとめて送り、io_uring なら SQE を積む
+
+static Replica *replica_of(gc_transport *t) {
+    return (Replica *)((char *)t - offsetof(Replica, transport));
 }
 
-/* merge処理：incoming="id1=value1,id2=value2,..." */
-void gc_merge_str(GCounter *gc, const char *incoming) {
-    pthread_mutex_lock(&gc->lock); /*ロックをとる*/
-    char tmp[BUF_SIZE];
-    strncpy(tmp, incoming, sizeof(tmp) - 1); /*incoming[]から最大sizeof(tmp) - 1分をtmp[]にコピーする*/
-    tmp[sizeof(tmp) - 1] = '\0'; /*コピーした最後の文字を終端文字にする*/
+static void net_send_to(Replica *r, const void *buf, size_t len, const struct sockaddr_in *dst) {
+    if (r->uring) {
+        uring_send(r, buf, len, dst);
+    } else {
+        udp_tx_add(r->sockfd, &r->tx, buf, len, dst); /*sockfd：自分のソケット*/
+    }
+}
 
-    char *token = strtok(tmp, ","); /* strtokで、tmp[]の中の文字列を,ごとに区切ってtoken返す */
-    while (token) {
-        int id;
-        unsigned long val;
-        if (sscanf(token, "%d=%lu", &id, &val) == 2 && id >= 0 && id < MAX_REPLICAS) { /*token内のそれぞれのidとvalが適切な値なら*/
-            if (val > gc->values[id]) { /*受け取った値の方が大きければ、*/
-                gc->values[id] = val; /*各レプリカのカウンタ値を置き換える*/
-            }
-        }
-        token = strtok(NULL, ",");
+static int net_send(gc_transport *t, int peer, const void *buf, size_t len) {
+    Replica *r = replica_of(t);
+    net_send_to(r, buf, len, r->mcast ? &r->group : &r->peers[peer]); // マルチキャストなら peer は 0 だけ
+    return 0;
+}
+
+static int net_reply(gc_transport *t, int msg, const void *buf, size_t len) {
+    Replica *r = replica_of(t);
+    if (!r->reply_to) return -1; // gc_sync_reply の外からは返せない
+    net_send_to(r, buf, len, &r->reply_to[msg]);
+    return 0;
+}
+
+static void net_flush(gc_transport *t) {
+    Replica *r = replica_of(t);
+    if (r->uring) {
+        uring_net_flush(r->uring); // 積んだ SQE を 1 回の io_uring_enter で投げる
+    } else {
+        // non‑blocking なので送信バッファが一杯なら落ちる (UDP の損失と同じく次の full sync で回復)
+        tx_flush(r);
     }
-    pthread_mutex_unlock(&gc->lock);
 }
 
+static uint64_t now_ms(void) {
+    return gc_metrics_now() / 1000000u;
+}
+
+// gc_sched の次の時刻に sync_timer を合わせる (ev_set_timer は周期タイマなので満了ごとに合わせ直す)
+static void reschedule(Replica *r, uint64_t now) {
+    uint64_t due = gc_sched_due(&r->sched);
+    uint64_t wait = due > now ? due - now : 1; // 0 だとタイマが止まる
+    ev_set_timer(r->loop, r->sync_timer, wait);
+    r->sync_due = now + wait;
+}
+
+// 値が変わった: 今のタイマより早く送る番になるならタイマを早める
+static void sync_changed(Replica *r) {
+    if (!r->adaptive) return;
+    uint64_t now = now_ms();
+    gc_sched_changed(&r->sched, now);
+    if (gc_sched_due(&r->sched) < r->sync_due) reschedule(r, now);
+}
 
-// 自身の状態を文字列化 → "id=val,id=val,..."
-size_t gc_serialize(GCounter *gc, char *out, size_t out_size) {
-    size_t used = 0;
-    pthread_mutex_lock(&gc->lock);
-    for (int i = 0; i < MAX_REPLICAS; ++i) {
-        if (gc->values[i] == 0) continue; // 0 のエントリは送らない
-        int n = snprintf(out + used, out_size - used, "%d=%lu,", i, gc->values[i]);
-        if (n < 0 || used + (size_t)n >= out_size) {
-            break; // 余裕なし
+static void merge_datagrams(Replica *r, const void *const bufs[], const size_t lens[],
+                            const struct sockaddr_in *srcs, int n) {
+    uint64_t now = gc_metrics_now();
+    unsigned long start = gc_total(&r->gc), total = start;
+    int bad = 0, changed = 0;
+    for (int i = 0; i < n; ++i) {
+        int p = peer_of(r, &srcs[i]);
+        // マルチキャストでは delta を追跡する peer はグループ 1 つなので、送り主は分からないことにする
+        if (gc_merge_buf_from(&r->gc, bufs[i], lens[i], r->mcast ? -1 : p) < 0) bad++;
+        unsigned long after = gc_total(&r->gc);
+        changed += after != total;
+        if (p >= 0) {
+            gc_metrics_heard(&r->metrics, p, now, after != total);
+            uint64_t mine;
+            if (gc_metrics_ack_pending(&r->metrics, p) &&
+                gc_wire_find(bufs[i], lens[i], (uint64_t)r->gc.replica_id, &mine) > 0) {
+                gc_metrics_ack(&r->metrics, p, mine, now); // peer に自分の増分が届いていた
+            }
+        }
+        total = after;
+        gc_metrics_add(r->mt, GC_M_RX_BYTES, lens[i]);
+    }
+    gc_metrics_add(r->mt, GC_M_RX_PACKETS, (uint64_t)n);
+    gc_metrics_add(r->mt, GC_M_MERGES, (uint64_t)(n - bad));
+    gc_metrics_add(r->mt, GC_M_MERGES_CHANGED, (uint64_t)changed);
+    if (bad > 0) {
+        gc_metrics_add(r->mt, GC_M_PARSE_ERRORS, (uint64_t)bad);
+        fprintf(stderr, "[Recv] %d malformed datagram(s)\n", bad);
+    }
+    // ゴシップでは受け取った分も自分から広げないと届かない peer がいる
+    // (broadcast では送り主が全 peer に送っているので、転送は間隔どおりでよい)
+    if (r->fanout > 0 && total != start) sync_changed(r);
+    if (r->fanout > 0 && persist_before_send(r) == 0) { // pull 要求にマージ後の状態で答える
+        // reply_to はこの呼び出しの間だけ srcs を指す (抜けたら前の値に戻す)
+        const struct sockaddr_in *outer = r->reply_to;
+        r->reply_to = srcs;
+        gc_sync_reply(&r->sync, &r->transport, bufs, lens, n);
+        r->reply_to = outer;
+    }
+    if (r->print == PRINT_ALL) {
+        for (int i = 0; i < n; ++i) {
+            if (gc_wire_is_binary(bufs[i], lens[i])) {
+                printf("[Recv] %zu bytes\n", lens[i]);
+            } else {
+                printf("[Recv] %.*s\n", (int)lens[i], (const char *)bufs[i]);
+            }
         }
-        used += (size_t)n;
     }
-    pthread_mutex_unlock(&gc->lock);
+    if (r->print == PRINT_ALL || (r->print == PRINT_TOTAL && total != start)) {
+        printf("  → total=%lu\n", total);
+    }
+}
 
-    if (used > 0 && out[used - 1] == ',') {
-        out[used - 1] = '\0'; // 末尾のカンマを削除
-        --used;
+// 届いているデータグラムを読み切ってマージする (ソケットは non‑blocking)
+static void on_socket(ev_loop *l, int fd, uint32_t events, void *arg) {
+    (void)l;
+    (void)events;
+    Replica *r = (Replica *)arg;
+    const void *bufs[UDP_BATCH_MAX];
+    size_t lens[UDP_BATCH_MAX];
+
+    for (;;) {
+        // 1 回の recvmmsg でたまっているデータグラムを取り出し、まとめてマージ
+        int n = udp_rx_recv(fd, r->rx, MSG_DONTWAIT);
+        if (n <= 0) break; // EAGAIN: 読み切った
+        for (int i = 0; i < n; ++i) {
+            bufs[i] = udp_rx_data(r->rx, i, &lens[i]);
+        }
+        merge_datagrams(r, bufs, lens, r->rx->src, n);
+        if (n < UDP_BATCH_MAX) break;
     }
-    return used;
 }
 
-// -------------------- 通信スレッド --------------------
+static void on_uring_rx(void *arg, const void *const bufs[], const size_t lens[],
+                        const struct sockaddr_in *srcs, int n) {
+    merge_datagrams((Replica *)arg, bufs, lens, srcs, n);
+}
 
-typedef struct {
-    int sockfd;
-    GCounter *gc;
-} ReceiverArgs;
+// io_uring: 完了キューにたまった受信 (と送信の完了) を回収する。システムコールなし
+static void on_uring(ev_loop *l, int fd, uint32_t events, void *arg) {
+    (void)l;
+    (void)fd;
+    (void)events;
+    Replica *r = (Replica *)arg;
+    uring_net_poll(r->uring, on_uring_rx, r);
+}
 
-void *receiver_thread(void *arg) {
-    ReceiverArgs *args = (ReceiverArgs *)arg;
-    char buf[BUF_SIZE];
-    struct sockaddr_in src;
-    socklen_t srclen = sizeof(src);
+static void on_line(const char *line, void *arg) {
+    Replica *r = (Replica *)arg;
+    unsigned long delta = strtoul(line, NULL, 10);
+    if (delta > 0) {
+        gc_increment(&r->gc, delta);
+        gc_metrics_local_write(&r->metrics, gc_value_of(&r->gc, r->gc.replica_id), gc_metrics_now());
+        if (r->persist) {
+            if (gc_persist_log(r->persist, &r->gc) < 0) perror("[Persist] log");
+            if (gc_persist_dirty(r->persist) && !r->commit_armed) {
+                // 最初にためた増分から GROUP_COMMIT_MS 以内に書く (増分ごとに延ばさない)
+                ev_set_timer(r->loop, r->commit_timer, GROUP_COMMIT_MS);
+                r->commit_armed = 1;
+            }
+        }
+        sync_changed(r);
+        printf("[Local] +%lu (total=%lu)\n", delta, gc_total(&r->gc));
+    }
+}
+
+static void on_commit(ev_loop *l, uint64_t expirations, void *arg) {
+    (void)expirations;
+    Replica *r = (Replica *)arg;
+    if (gc_persist_commit(r->persist) < 0) perror("[Persist] commit");
+    ev_set_timer(l, r->commit_timer, 0); // 次に増分が来るまで止める
+    r->commit_armed = 0;
+}
 
-    while (1) {
-        ssize_t len = recvfrom(args->sockfd, buf, sizeof(buf) - 1, 0, (struct sockaddr *)&src, &srclen);
-        if (len <= 0) continue;
-        buf[len] = '\0';
-        gc_merge_str(args->gc, buf);
-        printf("[Recv] %s\n", buf);
-        printf("  → total=%lu\n", gc_total(args->gc));
+static void on_stdin(ev_loop *l, int fd, uint32_t events, void *arg) {
+    (void)events;
+    Replica *r = (Replica *)arg;
+    if (ev_read_lines(fd, &r->in, on_line, r) != 0) {
+        ev_del_fd(l, fd); // EOF: 入力がなくなっても同期は続ける
     }
+}
 
-    /*通信を定期的にオンオフする*/
+// 送る (中身は gc_sync.h の方式で、時刻と数は gc_sched.h で決まる)
+static void broadcast(Replica *r) {
+    if (persist_before_send(r) < 0) return;
+    if (!r->adaptive) {
+        gc_sync_tick(&r->sync, &r->transport);
+        return;
+    }
+    uint64_t now = now_ms();
+    int full, more;
+    int budget = gc_sched_begin(&r->sched, now, &full);
+    int sent = gc_sync_paced(&r->sync, &r->transport, full, budget, &more);
+    gc_sched_end(&r->sched, now, sent, more);
+    reschedule(r, now);
+}
 
-    return NULL;
+static void on_broadcast(ev_loop *l, uint64_t expirations, void *arg) {
+    (void)l;
+    (void)expirations; // 遅れて複数回分満了しても送るのは 1 回
+    Replica *r = (Replica *)arg;
+    broadcast(r);
+    // 受け取った peer の値も含めて状態ファイルに写し、ログを空にする
+    // (送る間隔は短くなることがあるので、写すのは CHECKPOINT_MS ごと)
+    uint64_t now = now_ms();
+    if (r->persist && now - r->checkpoint_at >= CHECKPOINT_MS) {
+        if (gc_persist_checkpoint(r->persist, &r->gc) < 0) perror("[Persist] checkpoint");
+        r->checkpoint_at = now;
+    }
 }
 
 // -------------------- メイン --------------------
@@ -136,6 +390,7 @@ int main(int argc, char *argv[]) {
     }
 
     int listen_port = atoi(argv[2]);
+    setvbuf(stdout, NULL, _IOLBF, 0); // パイプにつないでも 1 行ずつ出す (bench_suite が読む)
 
     // --- ソケット作成 & バインド (UDP) ---
 
@@ -146,6 +401,22 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // GC_RECEIVERS: このソケットも受信スレッドたちと同じポートを分け合う
+    int receivers = 1;
+    const char *rv = getenv("GC_RECEIVERS");
+    if (rv) {
+        receivers = atoi(rv);
+        if (receivers < 1 || receivers > UDP_SHARD_MAX) {
+            fprintf(stderr, "GC_RECEIVERS must be between 1 and %d\n", UDP_SHARD_MAX);
+            return 1;
+        }
+    }
+    int one = 1;
+    if (receivers > 1 && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        perror("SO_REUSEPORT");
+        return 1;
+    }
+
     /*ソケットの設定を作成*/
     struct sockaddr_in addr = {0};
     addr.sin_family = AF_INET;
@@ -159,13 +430,88 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    // --- G‑Counter 初期化 ---
-    GCounter gc = {0}; /*構造体の全部の変数を０で初期化*/
-    gc.replica_id = replica_id;
-    pthread_mutex_init(&gc.lock, NULL);
+    // --- G‑Counter 初期化 (peer ごとに delta を追跡。ゴシップでは全状態を送るので追跡しない) ---
+    int peer_count = argc - 3;
+    static Replica rep; // 受信バッファ等を含むので static
+    rep.sockfd = sockfd;
+    udp_tx_init(&rep.tx);
+    rep.peer_count = peer_count;
+    const char *print = getenv("GC_PRINT");
+    if (print && strcmp(print, "total") == 0) {
+        rep.print = PRINT_TOTAL;
+    } else if (print && strcmp(print, "none") == 0) {
+        rep.print = PRINT_NONE;
+    } else if (print && strcmp(print, "all") != 0) {
+        fprintf(stderr, "GC_PRINT must be all, total or none\n");
+        return 1;
+    }
+    // メトリクス: GC_METRICS があれば共有メモリに (前回の同名のものは作り直す)
+    const char *metrics_name = getenv("GC_METRICS");
+    if (gc_metrics_open(&rep.metrics, metrics_name, replica_id, peer_count) < 0 ||
+        !(rep.mt = gc_metrics_thread_claim(&rep.metrics, "loop"))) {
+        perror(metrics_name ? metrics_name : "gc_metrics_open");
+        close(sockfd);
+        return 1;
+    }
+    const char *fanout = getenv("GC_FANOUT");
+    if (fanout) {
+        rep.fanout = atoi(fanout);
+    }
+    if (rep.fanout > GC_SYNC_BATCH) rep.fanout = GC_SYNC_BATCH;
+    const char *mcast = getenv("GC_MCAST");
+    struct in_addr mcast_if = {htonl(INADDR_LOOPBACK)};
+    if (mcast) {
+        const char *mi = getenv("GC_MCAST_IF");
+        if (udp_mcast_parse(mcast, &rep.group) < 0 || (mi && inet_pton(AF_INET, mi, &mcast_if) <= 0)) {
+            fprintf(stderr, "GC_MCAST must be <multicast_ip:port> and GC_MCAST_IF an IPv4 address\n");
+            return 1;
+        }
+        if (rep.fanout > 0) {
+            fprintf(stderr, "GC_MCAST and GC_FANOUT cannot be used together\n");
+            return 1;
+        }
+        rep.mcast = 1;
+    }
+    // 受信スレッドは pull に答えないので、そちらに振り分けられた peer は返事をもらえない
+    if (rep.fanout > 0 && receivers > 1) {
+        fprintf(stderr, "GC_RECEIVERS and GC_FANOUT cannot be used together\n");
+        return 1;
+    }
+    int sync_peers = rep.mcast ? 1 : peer_count; // マルチキャストではグループが 1 つの peer
+    if (rep.fanout > 0 && gossip_init(&rep.gossip, peer_count, (uint64_t)replica_id ^ (uint64_t)time(NULL)) < 0) {
+        perror("gossip_init");
+        close(sockfd);
+        return 1;
+    }
+    if (gc_init(&rep.gc, replica_id, rep.fanout > 0 ? 0 : sync_peers) < 0) {
+        perror("gc_init");
+        close(sockfd);
+        return 1;
+    }
+    gc_set_relay(&rep.gc, rep.fanout > 0); // 受け取った delta を送り直すのはゴシップのときだけ
+    rep.sync = (gc_sync){.gc = &rep.gc, .peer_count = sync_peers, .fanout = rep.fanout, .gossip = &rep.gossip};
+    rep.transport = (gc_transport){.send = net_send, .reply = net_reply, .flush = net_flush};
+
+    // --- 永続化: 前回の状態を戻してから始める ---
+    static gc_persist persist;
+    const char *state_dir = getenv("GC_STATE_DIR");
+    if (state_dir) {
+        gc_fsync_policy policy = GC_FSYNC_GROUP;
+        const char *fs = getenv("GC_FSYNC");
+        if (fs && gc_fsync_parse(fs, &policy) < 0) {
+            fprintf(stderr, "GC_FSYNC must be none, group or always\n");
+            return 1;
+        }
+        if (gc_persist_open(&persist, state_dir, &rep.gc, policy) < 0) {
+            perror("gc_persist_open");
+            return 1;
+        }
+        rep.persist = &persist;
+        printf("[Persist] restored own=%lu total=%lu (%lu log records)\n",
+               gc_value_of(&rep.gc, replica_id), gc_total(&rep.gc), persist.st.recovered_records);
+    }
 
     // --- Peer アドレス一覧を保存 ---
-    int peer_count = argc - 3;
     struct sockaddr_in *peers = calloc(peer_count, sizeof(struct sockaddr_in));
     if (!peers) {
         perror("calloc");
@@ -192,40 +538,109 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    // --- 受信スレッド起動 ---
-    pthread_t recv_tid;
-    ReceiverArgs rargs = {sockfd, &gc};
-    pthread_create(&recv_tid, NULL, receiver_thread, &rargs);
-
-    // --- メインループ: 入力受付 & 定期ブロードキャスト ---
-    char line[128];
-    time_t last_broadcast = 0;
-    uint i = 0;
-
-    while (1) { /*無限ループ*/
-        // 標準入力があれば処理
-        if (fgets(line, sizeof(line), stdin)) {
-            unsigned long delta = strtoul(line, NULL, 10);
-            if (delta > 0) {
-                gc_increment(&gc, delta);
-                printf("[Local] +%lu (total=%lu)\n", delta, gc_total(&gc));
-            }
+    rep.peers = peers;
+
+    // --- 受信スレッド (GC_RECEIVERS)。イベントループのスレッドが CPU 0 側を使う ---
+    static udp_shard shards[UDP_SHARD_MAX];
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i < receivers; ++i) {
+        udp_shard *sh = &shards[i];
+        char name[16];
+        snprintf(name, sizeof(name), "rx%d", i);
+        sh->fd = udp_shard_socket(listen_port);
+        sh->cpu = ncpu > 1 ? (int)(i % ncpu) : -1;
+        sh->gc = &rep.gc;
+        sh->metrics = &rep.metrics;
+        sh->mt = gc_metrics_thread_claim(&rep.metrics, name);
+        sh->peers = peers;
+        sh->peer_count = peer_count;
+        if (sh->fd < 0 || udp_shard_start(sh) < 0) {
+            perror("udp_shard");
+            return 1;
         }
+    }
 
-        // 一定間隔で状態をブロードキャスト
-        time_t now = time(NULL);
-        if (now - last_broadcast >= BROADCAST_INTERVAL_SEC) {
-            char msg[BUF_SIZE];
-            gc_serialize(&gc, msg, sizeof(msg));
-            for (int i = 0; i < peer_count; ++i) {
-                sendto(sockfd, msg, strlen(msg), 0, (struct sockaddr *)&peers[i], sizeof(peers[i])); /*sockfd：自分のソケット*/
-            }
-            last_broadcast = now;
+    rep.rx = udp_rx_new();
+    ev_loop *loop = ev_new();
+    if (!rep.rx || !loop) {
+        perror("init");
+        return 1;
+    }
+    rep.loop = loop;
+    if (rep.persist) {
+        rep.commit_timer = ev_add_timer(loop, GROUP_COMMIT_MS, on_commit, &rep);
+        if (rep.commit_timer < 0) {
+            perror("timerfd");
+            return 1;
         }
-
+        ev_set_timer(loop, rep.commit_timer, 0);
     }
 
-    // never reached
+    // --- イベントループ: 受信・入力・定期ブロードキャストを 1 スレッドで ---
+    ev_set_nonblock(sockfd);
+    const char *net = getenv("GC_NET");
+    if (net && strcmp(net, "uring") == 0) {
+        rep.uring = uring_net_new(sockfd);
+        if (!rep.uring) {
+            fprintf(stderr, "io_uring unavailable (%s); using sockets\n", strerror(errno));
+        }
+    }
+    if (rep.uring) {
+        ev_add_fd(loop, uring_net_fd(rep.uring), EPOLLIN, on_uring, &rep);
+    } else {
+        ev_add_fd(loop, sockfd, EPOLLIN, on_socket, &rep);
+    }
+    int mcast_fd = -1;
+    if (rep.mcast) { // グループ宛ては別のソケットで受ける (自分の送信も返ってくるが、マージは何も変えない)
+        mcast_fd = udp_mcast_join(&rep.group, mcast_if);
+        if (mcast_fd < 0 || udp_mcast_sender(sockfd, mcast_if) < 0 || ev_set_nonblock(mcast_fd) < 0 ||
+            ev_add_fd(loop, mcast_fd, EPOLLIN, on_socket, &rep) < 0) {
+            perror("multicast");
+            return 1;
+        }
+    }
+    if (ev_set_nonblock(STDIN_FILENO) < 0 || ev_add_fd(loop, STDIN_FILENO, EPOLLIN, on_stdin, &rep) < 0) {
+        // 通常ファイルからのリダイレクトは epoll できないので先に全部読む
+        ev_read_lines(STDIN_FILENO, &rep.in, on_line, &rep);
+    }
+    uint64_t interval_ms = BROADCAST_INTERVAL_SEC * 1000;
+    const char *iv = getenv("GC_INTERVAL_MS");
+    if (iv && atoi(iv) > 0) interval_ms = (uint64_t)atoi(iv);
+    const char *sched = getenv("GC_SCHED");
+    rep.adaptive = !sched || strcmp(sched, "adaptive") == 0;
+    if (sched && !rep.adaptive && strcmp(sched, "fixed") != 0) {
+        fprintf(stderr, "GC_SCHED must be adaptive or fixed\n");
+        return 1;
+    }
+    gc_sched_config sc = {.min_delay_ms = MIN_DELAY_MS, .max_interval_ms = interval_ms,
+                          .full_every_ms = interval_ms * GC_SYNC_FULL_EVERY, .burst = 1};
+    const char *md = getenv("GC_MIN_DELAY_MS");
+    if (md && atoi(md) > 0) sc.min_delay_ms = (uint64_t)atoi(md);
+    const char *pps = getenv("GC_PPS");
+    if (pps && atof(pps) > 0) {
+        sc.pps = atof(pps);
+        sc.burst = sc.pps / 10 > 1 ? sc.pps / 10 : 1; // 0.1 秒分までまとめて送れる
+    }
+    rep.checkpoint_at = now_ms();
+    gc_sched_init(&rep.sched, &sc, rep.checkpoint_at);
+    rep.sync_timer = ev_add_timer(loop, interval_ms, on_broadcast, &rep);
+    if (rep.sync_timer < 0) {
+        perror("timerfd");
+        return 1;
+    }
+    broadcast(&rep); // 起動直後に 1 回 (全状態。adaptive ならここでタイマを合わせる)
+    if (ev_run(loop) < 0) perror("epoll_wait");
+
+    for (int i = 1; i < receivers; ++i) udp_shard_stop(&shards[i]);
+
+    if (rep.persist) gc_persist_close(rep.persist);
+    gc_metrics_close(&rep.metrics);
+    ev_free(loop);
+    uring_net_free(rep.uring);
+    udp_rx_free(rep.rx);
+    if (mcast_fd >= 0) close(mcast_fd);
+    gc_destroy(&rep.gc);
+    if (rep.fanout > 0) gossip_free(&rep.gossip);
     free(peers);
     close(sockfd);
     return 0;
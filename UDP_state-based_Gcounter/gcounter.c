@@ -1,13 +1,18 @@
+// ビルド: gcc -I../common -o gcounter gcounter.c ../common/gc_simd.c
+#include <inttypes.h>
+#include <stdint.h>
 #include <stdio.h>
 
+#include "gc_simd.h"  // 要素ごとの max / 総和 (AVX2/AVX-512 を実行時に選ぶ)
+
 #define MAX_NODES 10  // ノード数の上限
 
 // G-Counterの構造体
-struct GCounter{
+typedef struct GCounter{
     int node_id;                // 自分のノード番号
     int num_nodes;              // 全体のノード数
-    int state[MAX_NODES];       // 状態ベクトル
-} g;
+    uint64_t state[MAX_NODES];  // 状態ベクトル
+} GCounter;
 
 // G-Counterの初期化
 void gcounter_init(GCounter *gc, int node_id, int num_nodes) {
@@ -23,28 +28,27 @@ void gcounter_increment(GCounter *gc) {
 }
 
 // 受信した状態とマージ
-void gcounter_merge(GCounter *gc, int *received_state) {
-    for(int i = 0; i < gc->num_nodes; i++) {
-        if(received_state[i] > gc->state[i])
-            gc->state[i] = received_state[i];
-    }
+void gcounter_merge(GCounter *gc, const uint64_t *received_state) {
+    gc_vec_max_u64(gc->state, received_state, (size_t)gc->num_nodes);
+}
+
+// 受信した k 個の状態をまとめてマージ (state を 1 回なめるだけ)
+void gcounter_merge_batch(GCounter *gc, const uint64_t *const received[], size_t k) {
+    gc_vec_max_batch_u64(gc->state, received, k, (size_t)gc->num_nodes);
 }
 
 // カウンタの合計値取得
-int gcounter_value(GCounter *gc) {
-    int sum = 0;
-    for(int i = 0; i < gc->num_nodes; i++)
-        sum += gc->state[i];
-    return sum;
+uint64_t gcounter_value(GCounter *gc) {
+    return gc_vec_sum_u64(gc->state, (size_t)gc->num_nodes);
 }
 
 // 状態を表示（デバッグ用）
 void gcounter_print_state(GCounter *gc) {
     printf("State [ ");
     for(int i = 0; i < gc->num_nodes; i++) {
-        printf("%d ", gc->state[i]);
+        printf("%" PRIu64 " ", gc->state[i]);
     }
-    printf("]  Total: %d\n", gcounter_value(gc));
+    printf("]  Total: %" PRIu64 "\n", gcounter_value(gc));
 }
 
 
@@ -60,7 +64,7 @@ int main() {
     gcounter_print_state(&gc);
 
     // 他ノードから受信した状態（仮）をマージ
-    int other_state[3] = {1, 2, 1};
+    uint64_t other_state[3] = {1, 2, 1};
     gcounter_merge(&gc, other_state);
     printf("After merge:\n");
     gcounter_print_state(&gc);
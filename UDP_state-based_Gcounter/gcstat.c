@@ -0,0 +1,91 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// UDPstate のメトリクスを外から読む (../common/gc_metrics.h)
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -I../common -o gcstat gcstat.c ../common/gc_metrics.c
+//   $ GC_METRICS=/gc-9000 ./UDPstate 0 9000 127.0.0.1:9001   (別の端末で)
+//   $ ./gcstat /gc-9000 [interval_sec]
+//
+//   共有メモリを読み取り専用でつなぐだけなので、UDPstate には何もさせない。
+//   interval_sec を付けるとその間隔で表示し直し、前回からの 1 秒あたりの
+//   量も出します。
+//   staleness は peer から最後に受け取ってからの時間、lag は自分の増分が
+//   peer の状態に反映されたと分かるまでの時間 (p50 / p99 はバケットの上限)。
+// ------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "gc_metrics.h"
+
+static void show(const gc_metrics_seg *seg, const uint64_t *prev, double dt) {
+    gc_metrics_seg *s = (gc_metrics_seg *)seg;
+    uint64_t now = gc_metrics_now();
+    printf("replica %d  up %.1fs\n", seg->replica_id, (now - seg->started_ns) * 1e-9);
+    for (int k = 0; k < GC_M_COUNT; ++k) {
+        uint64_t v = gc_metrics_sum(seg, k);
+        printf("  %-16s %12llu", gc_metrics_names[k], (unsigned long long)v);
+        if (prev) printf("  %10.1f/s", (double)(v - prev[k]) / dt);
+        printf("\n");
+    }
+    for (int i = 0; i < GC_METRICS_THREADS; ++i) {
+        const gc_metrics_thread *t = &seg->thread[i];
+        if (!t->name[0]) continue;
+        printf("  thread %-8.15s rx %llu tx %llu merges %llu\n", t->name,
+               (unsigned long long)atomic_load(&s->thread[i].c[GC_M_RX_PACKETS]),
+               (unsigned long long)atomic_load(&s->thread[i].c[GC_M_TX_PACKETS]),
+               (unsigned long long)atomic_load(&s->thread[i].c[GC_M_MERGES]));
+    }
+
+    uint64_t lags = 0;
+    for (int i = 0; i < GC_METRICS_LAG_BUCKETS; ++i) lags += atomic_load(&s->lag[i]);
+    if (lags > 0) {
+        printf("  lag  n=%llu  mean %.2fms  p50 <%.2fms  p99 <%.2fms\n", (unsigned long long)lags,
+               (double)atomic_load(&s->lag_sum_ns) / (double)lags * 1e-6,
+               gc_metrics_lag_quantile(seg, 0.50) * 1e-6, gc_metrics_lag_quantile(seg, 0.99) * 1e-6);
+    } else {
+        printf("  lag  (no samples yet)\n");
+    }
+
+    printf("  %-5s %12s %10s %10s %12s\n", "peer", "staleness", "rx", "changed", "acked");
+    for (uint32_t i = 0; i < seg->npeers; ++i) {
+        gc_metrics_peer *p = &s->peer[i];
+        uint64_t heard = atomic_load(&p->last_heard_ns);
+        char stale[32];
+        if (heard) {
+            snprintf(stale, sizeof(stale), "%.3fs", (now - heard) * 1e-9);
+        } else {
+            snprintf(stale, sizeof(stale), "never");
+        }
+        printf("  %-5u %12s %10llu %10llu %12llu\n", i, stale, (unsigned long long)atomic_load(&p->rx_packets),
+               (unsigned long long)atomic_load(&p->changed), (unsigned long long)atomic_load(&p->acked));
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <metrics_name> [interval_sec]\n", argv[0]);
+        return 1;
+    }
+    gc_metrics m;
+    if (gc_metrics_attach(&m, argv[1]) < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    double interval = argc > 2 ? atof(argv[2]) : 0;
+    if (interval <= 0) {
+        show(m.seg, NULL, 0);
+        gc_metrics_close(&m);
+        return 0;
+    }
+    uint64_t prev[GC_M_COUNT];
+    for (;;) {
+        for (int k = 0; k < GC_M_COUNT; ++k) prev[k] = gc_metrics_sum(m.seg, k);
+        usleep((useconds_t)(interval * 1e6));
+        show(m.seg, prev, interval);
+    }
+}
@@ -0,0 +1,144 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// recvfrom/sendto vs recvmmsg/sendmmsg のスループット比較 (loopback)
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -I../common -o bench_batch bench_batch.c ../common/udp_batch.c
+//   $ ./bench_batch [rounds] [peers]
+//
+//   受信: ソケットにデータグラムをためてから、1 個ずつ recvfrom する場合と
+//         recvmmsg でまとめて取り出す場合の CPU 時間を測る。
+//   送信: 同じメッセージを peers 個の peer へ sendto で送る場合と
+//         sendmmsg 1 回で送る場合の CPU 時間を測る。
+//   どちらも「CPU 1 秒あたりのデータグラム数」(= 1 コアあたり) で表示する。
+// ------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "udp_batch.h"
+
+#define FILL 128      // 受信側に 1 ラウンドでためる数
+#define MSG_LEN 100   // delta 1 個分くらいの大きさ
+
+static double cpu_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int udp_socket(struct sockaddr_in *bound) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return -1;
+    int rcvbuf = 4 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(*bound);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(fd, (struct sockaddr *)bound, &len) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void drain(int fd) {
+    char buf[UDP_BATCH_DGRAM];
+    while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+    }
+}
+
+// ためた FILL 個を取り出すのにかかった CPU 時間を合計する
+static double bench_recv(int batched, int rounds, long *got) {
+    struct sockaddr_in tx_addr, rx_addr;
+    int tx = udp_socket(&tx_addr);
+    int rx = udp_socket(&rx_addr);
+    udp_rx_batch *b = udp_rx_new();
+    char msg[MSG_LEN] = {0};
+    char buf[UDP_BATCH_DGRAM];
+    double total = 0;
+    *got = 0;
+
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < FILL; ++i) {
+            sendto(tx, msg, sizeof(msg), 0, (struct sockaddr *)&rx_addr, sizeof(rx_addr));
+        }
+        double t0 = cpu_sec();
+        if (batched) {
+            int n;
+            while ((n = udp_rx_recv(rx, b, MSG_DONTWAIT)) > 0) *got += n;
+        } else {
+            struct sockaddr_in src;
+            socklen_t srclen = sizeof(src);
+            while (recvfrom(rx, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr *)&src, &srclen) > 0) {
+                (*got)++;
+            }
+        }
+        total += cpu_sec() - t0;
+    }
+    udp_rx_free(b);
+    close(tx);
+    close(rx);
+    return total;
+}
+
+static double bench_send(int batched, int rounds, int npeers, long *sent) {
+    struct sockaddr_in tx_addr;
+    int tx = udp_socket(&tx_addr);
+    int *fds = calloc((size_t)npeers, sizeof(int));
+    struct sockaddr_in *peers = calloc((size_t)npeers, sizeof(*peers));
+    for (int i = 0; i < npeers; ++i) fds[i] = udp_socket(&peers[i]);
+    char msg[MSG_LEN] = {0};
+    double total = 0;
+    *sent = 0;
+
+    for (int r = 0; r < rounds; ++r) {
+        double t0 = cpu_sec();
+        for (int k = 0; k < FILL / npeers + 1; ++k) {
+            if (batched) {
+                *sent += udp_send_fanout(tx, msg, sizeof(msg), peers, npeers);
+            } else {
+                for (int i = 0; i < npeers; ++i) {
+                    if (sendto(tx, msg, sizeof(msg), 0, (struct sockaddr *)&peers[i], sizeof(peers[i])) > 0) {
+                        (*sent)++;
+                    }
+                }
+            }
+        }
+        total += cpu_sec() - t0;
+        for (int i = 0; i < npeers; ++i) drain(fds[i]); // 受信側の片付けは計測しない
+    }
+    for (int i = 0; i < npeers; ++i) close(fds[i]);
+    free(fds);
+    free(peers);
+    close(tx);
+    return total;
+}
+
+int main(int argc, char *argv[]) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+    int npeers = argc > 2 ? atoi(argv[2]) : 16;
+    long n;
+    double t;
+
+    printf("%-22s %12s %16s\n", "path", "datagrams", "dgrams/cpu-sec");
+    t = bench_recv(0, rounds, &n);
+    printf("%-22s %12ld %16.0f\n", "recv: recvfrom", n, n / t);
+    t = bench_recv(1, rounds, &n);
+    printf("%-22s %12ld %16.0f\n", "recv: recvmmsg", n, n / t);
+    t = bench_send(0, rounds, npeers, &n);
+    printf("%-22s %12ld %16.0f\n", "send: sendto", n, n / t);
+    t = bench_send(1, rounds, npeers, &n);
+    printf("%-22s %12ld %16.0f\n", "send: sendmmsg", n, n / t);
+    printf("(%d datagrams of %d bytes per round, %d peers for fan-out)\n", FILL, MSG_LEN, npeers);
+    return 0;
+}
@@ -0,0 +1,144 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 全状態ブロードキャスト vs delta‑state の送信バイト数比較 (loopback)
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -pthread -I../common -o bench_delta bench_delta.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c
+//   $ ./bench_delta [ticks] [changes_per_tick]
+//
+//   256 スロットが埋まった送信側レプリカ A から 127.0.0.1 上の受信側 B へ、
+//   毎 tick 状態を送る。各 tick で A の数スロットだけが変化する (自スロットと、
+//   他レプリカから A と B の両方に届いた更新)。
+//   全状態を毎回送る場合と、delta + 12 tick ごとの全状態送信の場合で
+//   送信バイト数を比べ、最後に B が A と一致することを確認する。
+// ------------------------------------------------------------
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gc.h"
+#include "gc_wire.h"
+
+#define FULL_SYNC_EVERY 12
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static int udp_socket(struct sockaddr_in *bound) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0; // 空いているポート
+    socklen_t len = sizeof(addr);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(fd, (struct sockaddr *)bound, &len) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 受信済みのデータグラムをすべてマージする
+static void drain(int fd, GCounter *gc) {
+    char buf[BUF_SIZE];
+    ssize_t len;
+    while ((len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        gc_merge_buf(gc, buf, (size_t)len);
+    }
+}
+
+static int run(int use_delta, int ticks, int changes, unsigned long *bytes, unsigned long *packets) {
+    struct sockaddr_in a_addr, b_addr;
+    int a_fd = udp_socket(&a_addr);
+    int b_fd = udp_socket(&b_addr);
+    if (a_fd < 0 || b_fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    GCounter a, b;
+    gc_init(&a, 0, 1);
+    gc_init(&b, 1, 0);
+
+    // クラスタ全体の状態を持った A を用意 (他レプリカから受け取った想定)
+    char seed[BUF_SIZE];
+    unsigned long init[MAX_REPLICAS];
+    for (int i = 0; i < MAX_REPLICAS; ++i) init[i] = 1000000 + rng() % 1000000;
+    size_t seed_len = gc_wire_encode(seed, sizeof(seed), 99, 0, init, MAX_REPLICAS);
+    gc_merge_buf(&a, seed, seed_len);
+
+    *bytes = 0;
+    *packets = 0;
+    char msg[BUF_SIZE];
+    for (int t = 0; t < ticks; ++t) {
+        // 自分のインクリメント + 他レプリカ由来の少数スロットの更新。
+        // 他レプリカは B にも直接送るので、A は受け取った分を送り直さない (delta は自分の分だけ)
+        gc_increment(&a, 1 + rng() % 10);
+        for (int c = 1; c < changes; ++c) {
+            char upd[64];
+            int id = 1 + (int)(rng() % (MAX_REPLICAS - 1));
+            int n = snprintf(upd, sizeof(upd), "%d=%lu", id, gc_value_of(&a, id) + 1 + rng() % 100);
+            gc_merge_buf(&a, upd, (size_t)n);
+            gc_merge_buf(&b, upd, (size_t)n);
+        }
+
+        size_t len;
+        if (use_delta) {
+            len = gc_serialize_for_peer(&a, 0, t % FULL_SYNC_EVERY == 0, msg, sizeof(msg));
+        } else {
+            len = gc_serialize(&a, msg, sizeof(msg));
+        }
+        if (len > 0) {
+            sendto(a_fd, msg, len, 0, (struct sockaddr *)&b_addr, sizeof(b_addr));
+            *bytes += len;
+            *packets += 1;
+        }
+        drain(b_fd, &b);
+    }
+    usleep(10000);
+    drain(b_fd, &b);
+
+    int same = 1;
+    for (int i = 0; i < MAX_REPLICAS; ++i) {
+        if (gc_value_of(&a, i) != gc_value_of(&b, i)) same = 0;
+    }
+    gc_destroy(&a);
+    gc_destroy(&b);
+    close(a_fd);
+    close(b_fd);
+    if (!same) {
+        fprintf(stderr, "%s: receiver did not converge\n", use_delta ? "delta" : "full");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int ticks = argc > 1 ? atoi(argv[1]) : 1200;
+    int changes = argc > 2 ? atoi(argv[2]) : 2;
+    unsigned long full_bytes, full_pkts, delta_bytes, delta_pkts;
+
+    if (run(0, ticks, changes, &full_bytes, &full_pkts) < 0) return 1;
+    if (run(1, ticks, changes, &delta_bytes, &delta_pkts) < 0) return 1;
+
+    printf("%d ticks, %d changed slots/tick, %d replicas, full sync every %d ticks\n",
+           ticks, changes, MAX_REPLICAS, FULL_SYNC_EVERY);
+    printf("%-6s %10s %8s %12s\n", "mode", "bytes", "packets", "bytes/tick");
+    printf("%-6s %10lu %8lu %12.1f\n", "full", full_bytes, full_pkts, (double)full_bytes / ticks);
+    printf("%-6s %10lu %8lu %12.1f\n", "delta", delta_bytes, delta_pkts, (double)delta_bytes / ticks);
+    printf("reduction: %.1fx, receiver converged in both modes\n", (double)full_bytes / delta_bytes);
+    return 0;
+}
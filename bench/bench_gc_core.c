@@ -0,0 +1,212 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// ロックフリー G‑Counter コア (gc_core.h) のストレス検証 & 競合ベンチ
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -pthread -I../common -o bench_gc_core bench_gc_core.c
+//   $ ./bench_gc_core [seconds]
+//
+//   1. ストレス: 複数スレッドが古い値・新しい値を混ぜて同じスロットに
+//      マージし続け、読み手スレッドが「値が一度も減らない」ことを確認する。
+//      最後に各スロットが「マージされた値の最大」と一致することも確認する。
+//      比較のため、旧 gcounter_merge_raw と同じ load → store 版で
+//      観測された巻き戻りの回数も表示する。
+//   2. 競合ベンチ: 1 本の mutex で守る旧 GCounter と、ロックフリー版で
+//      increment + merge の混在負荷を 1〜8 スレッドで比べる。
+// ------------------------------------------------------------
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gc_core.h"
+
+#define NSLOTS 8
+#define MAX_THREADS 8
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline uint64_t xorshift(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+// -------------------- 1. ストレス --------------------
+
+static gc_slot slots[NSLOTS];
+static atomic_int stop;
+static int racy_mode; // 1 なら旧来の load → store でマージする
+
+typedef struct {
+    uint64_t seed;
+    uint64_t max_merged[NSLOTS]; // このスレッドがマージした最大値
+    long regressions;            // 読み手が観測した巻き戻り
+    long ops;
+} StressArgs;
+
+static void racy_store_max(gc_slot *s, uint64_t v) {
+    uint64_t local = atomic_load_explicit(&s->v, memory_order_relaxed);
+    if (v > local) {
+        for (volatile int spin = 0; spin < 16; ++spin) { // 隙間を広げて競合を起こしやすくする
+        }
+        atomic_store_explicit(&s->v, v, memory_order_relaxed);
+    }
+}
+
+static void *stress_writer(void *arg) {
+    StressArgs *a = arg;
+    uint64_t hi = 1;
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        int id = (int)(xorshift(&a->seed) % NSLOTS);
+        hi += xorshift(&a->seed) % 4;
+        // 半分は新しい値、半分は少し古い値 (遅れて届いた状態) を送る
+        uint64_t v = (xorshift(&a->seed) & 1) ? hi : hi - xorshift(&a->seed) % hi;
+        if (racy_mode) {
+            racy_store_max(&slots[id], v);
+        } else {
+            gc_slot_store_max(&slots[id], v);
+        }
+        if (v > a->max_merged[id]) a->max_merged[id] = v;
+        a->ops++;
+    }
+    return NULL;
+}
+
+static void *stress_reader(void *arg) {
+    StressArgs *a = arg;
+    uint64_t last[NSLOTS] = {0};
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        for (int i = 0; i < NSLOTS; ++i) {
+            uint64_t v = gc_slot_load(&slots[i]);
+            if (v < last[i]) a->regressions++;
+            last[i] = v;
+        }
+        a->ops++;
+    }
+    return NULL;
+}
+
+// 巻き戻りの観測回数を返す。最終値が最大値と合わなければ -1
+static long run_stress(int racy, int writers, int readers, double seconds) {
+    pthread_t tids[MAX_THREADS * 2];
+    StressArgs args[MAX_THREADS * 2];
+    memset(slots, 0, sizeof(slots));
+    memset(args, 0, sizeof(args));
+    racy_mode = racy;
+    atomic_store(&stop, 0);
+
+    int n = writers + readers;
+    for (int i = 0; i < n; ++i) {
+        args[i].seed = 0x2545F4914F6CDD1DULL * (uint64_t)(i + 1);
+        pthread_create(&tids[i], NULL, i < writers ? stress_writer : stress_reader, &args[i]);
+    }
+    struct timespec ts = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+    nanosleep(&ts, NULL);
+    atomic_store(&stop, 1);
+    for (int i = 0; i < n; ++i) pthread_join(tids[i], NULL);
+
+    long regressions = 0;
+    for (int i = writers; i < n; ++i) regressions += args[i].regressions;
+    int final_ok = 1;
+    for (int s = 0; s < NSLOTS; ++s) {
+        uint64_t want = 0;
+        for (int i = 0; i < writers; ++i) {
+            if (args[i].max_merged[s] > want) want = args[i].max_merged[s];
+        }
+        if (gc_slot_load(&slots[s]) != want) final_ok = 0;
+    }
+    printf("%-14s writers=%d readers=%d regressions=%ld final=%s\n",
+           racy ? "load+store" : "cas store-max", writers, readers, regressions,
+           final_ok ? "max" : "LOST");
+    return final_ok ? regressions : -1;
+}
+
+// -------------------- 2. 競合ベンチ --------------------
+
+typedef struct {
+    unsigned long values[NSLOTS];
+    pthread_mutex_t lock;
+} MutexCounter;
+
+static MutexCounter mcounter;
+static gc_slot lfcounter[NSLOTS];
+static int use_lockfree;
+
+typedef struct {
+    uint64_t seed;
+    long ops;
+    int self;
+} BenchArgs;
+
+static void *bench_worker(void *arg) {
+    BenchArgs *a = arg;
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        for (int k = 0; k < 256; ++k) {
+            uint64_t r = xorshift(&a->seed);
+            int id = (int)(r % NSLOTS);
+            if (use_lockfree) {
+                if (k & 1) gc_slot_add(&lfcounter[a->self], 1);
+                else gc_slot_store_max(&lfcounter[id], r >> 40);
+            } else {
+                pthread_mutex_lock(&mcounter.lock);
+                if (k & 1) mcounter.values[a->self] += 1;
+                else if ((r >> 40) > mcounter.values[id]) mcounter.values[id] = r >> 40;
+                pthread_mutex_unlock(&mcounter.lock);
+            }
+        }
+        a->ops += 256;
+    }
+    return NULL;
+}
+
+static double run_bench(int lockfree, int threads, double seconds) {
+    pthread_t tids[MAX_THREADS];
+    BenchArgs args[MAX_THREADS];
+    memset(&mcounter.values, 0, sizeof(mcounter.values));
+    memset(lfcounter, 0, sizeof(lfcounter));
+    use_lockfree = lockfree;
+    atomic_store(&stop, 0);
+    for (int i = 0; i < threads; ++i) {
+        args[i] = (BenchArgs){.seed = 88172645463325252ULL + (uint64_t)i, .ops = 0, .self = i % NSLOTS};
+        pthread_create(&tids[i], NULL, bench_worker, &args[i]);
+    }
+    double t0 = now_sec();
+    struct timespec ts = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+    nanosleep(&ts, NULL);
+    atomic_store(&stop, 1);
+    long ops = 0;
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(tids[i], NULL);
+        ops += args[i].ops;
+    }
+    return ops / (now_sec() - t0);
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+
+    if (run_stress(0, 4, 2, seconds) != 0) {
+        fprintf(stderr, "FAIL: lock-free slots went backwards or lost a merge\n");
+        return 1;
+    }
+    run_stress(1, 4, 2, seconds); // 参考: 旧実装は巻き戻ることがある
+
+    pthread_mutex_init(&mcounter.lock, NULL);
+    printf("\n%-8s %16s %16s\n", "threads", "mutex ops/s", "lock-free ops/s");
+    for (int t = 1; t <= MAX_THREADS; t *= 2) {
+        double m = run_bench(0, t, seconds / 2);
+        double l = run_bench(1, t, seconds / 2);
+        printf("%-8d %16.0f %16.0f\n", t, m, l);
+    }
+    return 0;
+}
@@ -0,0 +1,184 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// ゴシップ (fanout + push‑pull) と全 peer への送信の比較 (模擬レプリカ)
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -pthread -DMAX_REPLICAS=1024 -I../common -o bench_gossip bench_gossip.c ../common/gossip.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c -lm
+//   $ ./bench_gossip
+//
+// N 個 (10〜1000) の GCounter をメモリ上に並べ (自分の ID は密なスロットに
+// 置くので MAX_REPLICAS を 1024 に広げてビルドする)、ラウンド単位で同期させる。
+// 最初に全ノードが自分のスロットを 1 増やし、全ノードの合計が N になる
+// (全員が全員の更新を知る) までのラウンド数と、1 ノード 1 ラウンドあたりの
+// 送信メッセージ数・バイト数と、収束後 (全員が全状態を持つ) の 1 ラウンドの
+// バイト数を出す。方式は
+//   broadcast : 毎ラウンド全 peer に全状態 (UDPstate の元の方式)
+//   push k    : ランダムな k 個の peer に全状態を送るだけ
+//   push-pull k: 同じく送り、受け取った側は送り主より新しい分を返す
+// ラウンドの最初に全ノードの送信内容を作り、それを順に配る (返信はすぐ届く)。
+// loss を付けた行はメッセージ (返信も) を確率 10% で落とす。
+// push-pull が 4 log2(N) + 10 ラウンド以内に収束しなければ exit 1。
+// ------------------------------------------------------------
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gc.h"
+#include "gc_wire.h"
+#include "gossip.h"
+
+#define MAX_ROUNDS 200
+
+typedef struct {
+    const char *name;
+    int fanout;   // 0: 全 peer
+    int pull;
+    double loss;
+} mode;
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+static double rnd(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (double)(rng_state >> 11) / (double)(1ULL << 53);
+}
+
+typedef struct {
+    int rounds;
+    double msgs, bytes; // 収束までの 1 ノード 1 ラウンドあたり
+    double steady;      // 収束後 (全員が全状態を持つ) の 1 ノード 1 ラウンドあたりのバイト数
+} result;
+
+typedef struct {
+    int n;
+    GCounter *gc;
+    gossip *g;
+    char **push;      // ラウンドの最初に作る各ノードの送信内容
+    size_t *push_len;
+    int *picked;
+    char *reply;
+    size_t cap;
+    unsigned long long msgs, bytes;
+} sim;
+
+static void sim_round(sim *x, const mode *m) {
+    int n = x->n;
+    for (int i = 0; i < n; ++i) {
+        x->push_len[i] = m->pull ? gc_serialize_pull(&x->gc[i], x->push[i], x->cap)
+                                 : gc_serialize(&x->gc[i], x->push[i], x->cap);
+    }
+    for (int i = 0; i < n; ++i) {
+        int k;
+        if (m->fanout == 0) {
+            k = n - 1;
+            for (int j = 0; j < k; ++j) x->picked[j] = j;
+        } else {
+            k = gossip_pick(&x->g[i], m->fanout, x->picked);
+        }
+        for (int j = 0; j < k; ++j) {
+            int t = x->picked[j] < i ? x->picked[j] : x->picked[j] + 1; // 自分を飛ばした番号
+            x->msgs++;
+            x->bytes += x->push_len[i];
+            if (rnd() < m->loss) continue;
+            gc_merge_buf(&x->gc[t], x->push[i], x->push_len[i]);
+            if (!m->pull) continue;
+            size_t len = gc_serialize_newer(&x->gc[t], x->push[i], x->push_len[i], x->reply, x->cap);
+            if (len == 0) continue;
+            x->msgs++;
+            x->bytes += len;
+            if (rnd() < m->loss) continue;
+            gc_merge_buf(&x->gc[i], x->reply, len);
+        }
+    }
+}
+
+static int run(int n, const mode *m, result *res) {
+    sim x = {0};
+    x.n = n;
+    x.gc = malloc((size_t)n * sizeof(GCounter));
+    x.g = malloc((size_t)n * sizeof(gossip));
+    x.push = calloc((size_t)n, sizeof(char *));
+    x.push_len = malloc((size_t)n * sizeof(size_t));
+    x.picked = malloc((size_t)n * sizeof(int));
+    x.cap = GC_WIRE_HDR_MAX + (size_t)n * GC_WIRE_ENTRY_MAX;
+    x.reply = malloc(x.cap);
+    if (!x.gc || !x.g || !x.push || !x.push_len || !x.picked || !x.reply) return -1;
+    for (int i = 0; i < n; ++i) {
+        // ゴシップは全状態を送るので peer ごとの delta は追跡しない
+        if (gc_init(&x.gc[i], i, 0) < 0 || gossip_init(&x.g[i], n - 1, (uint64_t)i + 1) < 0) return -1;
+        x.push[i] = malloc(x.cap);
+        if (!x.push[i]) return -1;
+        gc_increment(&x.gc[i], 1);
+    }
+
+    int round = 0, converged = 0;
+    while (!converged && round < MAX_ROUNDS) {
+        round++;
+        sim_round(&x, m);
+        converged = 1;
+        for (int i = 0; i < n && converged; ++i) converged = gc_total(&x.gc[i]) == (unsigned long)n;
+    }
+    res->rounds = converged ? round : -1;
+    res->msgs = (double)x.msgs / n / round;
+    res->bytes = (double)x.bytes / n / round;
+    unsigned long long before = x.bytes;
+    sim_round(&x, m); // 収束後のラウンドを 1 回測る
+    res->steady = (double)(x.bytes - before) / n;
+
+    for (int i = 0; i < n; ++i) {
+        gc_destroy(&x.gc[i]);
+        gossip_free(&x.g[i]);
+        free(x.push[i]);
+    }
+    free(x.gc);
+    free(x.g);
+    free(x.push);
+    free(x.push_len);
+    free(x.picked);
+    free(x.reply);
+    return 0;
+}
+
+int main(void) {
+#if MAX_REPLICAS < 1000
+#error "-DMAX_REPLICAS=1024 を付けてビルドすること"
+#endif
+    static const int sizes[] = {10, 30, 100, 300, 1000};
+    static const mode modes[] = {
+        {"broadcast", 0, 0, 0.0},
+        {"push 2", 2, 0, 0.0},
+        {"push-pull 1", 1, 1, 0.0},
+        {"push-pull 2", 2, 1, 0.0},
+        {"push-pull 3", 3, 1, 0.0},
+        {"push-pull 2 loss", 2, 1, 0.1},
+    };
+    int fail = 0;
+    printf("%6s  %-18s %7s %10s %11s %13s\n", "N", "mode", "rounds", "msgs/node", "bytes/node",
+           "steady bytes");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        int n = sizes[s];
+        int limit = (int)(4 * log2(n)) + 10;
+        for (size_t k = 0; k < sizeof(modes) / sizeof(modes[0]); ++k) {
+            result r;
+            if (run(n, &modes[k], &r) < 0) {
+                perror("run");
+                return 1;
+            }
+            int bad = modes[k].pull && (r.rounds < 0 || r.rounds > limit);
+            fail |= bad;
+            printf("%6d  %-18s %7d %10.1f %11.0f %13.0f%s\n", n, modes[k].name, r.rounds, r.msgs,
+                   r.bytes, r.steady, bad ? "  SLOW" : "");
+        }
+    }
+    printf("(msgs/node, bytes/node: 収束までの 1 ノード 1 ラウンドあたり。steady bytes: 収束後の\n"
+           " 1 ラウンドあたり。rounds=-1 は %d ラウンドで未収束)\n", MAX_ROUNDS);
+    if (fail) {
+        printf("FAILED\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,226 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// unicast で全 peer に送るのとマルチキャスト 1 回の比較 (loopback)
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -pthread -I../common -o bench_mcast bench_mcast.c ../common/udp_mcast.c ../common/udp_batch.c ../common/evloop.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c
+//   $ ./bench_mcast [seconds]
+//
+// 受信ソケットを N 個 (4 / 16 / 64) 開き、送信スレッドが STATE_IDS 個の
+// スロットを持つ全状態 (gc_serialize) を送り続ける。
+//   unicast : 1 回ごとに N 個の peer に sendmmsg 1 回 (udp_send_fanout。
+//             UDPstate の既定の経路で、内容が同じだけ実際より有利)
+//   mcast   : 1 回ごとにグループ宛てに sendto 1 回 (UDPstate の GC_MCAST)
+// 出すもの:
+//   rounds/s  : 送信スレッドが全 peer に 1 回送り終えた回数 / 秒
+//   cpu/round : 送信スレッドの CPU 時間 (CLOCK_THREAD_CPUTIME_ID) / 回。
+//               loopback では受信ソケットへの配送も送信側のシステムコールの
+//               中で走ることが多いので、その分も含む
+//   delivered : 受信スレッドが受け取ったデータグラム / 秒
+//   loss      : 受信バッファがあふれて届かなかった割合 (送信が受信より速いと増える)
+// マルチキャストが使えない (グループに参加できない) 環境なら mcast は飛ばす。
+// ------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "evloop.h"
+#include "gc.h"
+#include "udp_batch.h"
+#include "udp_mcast.h"
+
+#define MAX_RX 64
+#define STATE_IDS 64        // 送る全状態のスロット数
+#define BASE_PORT 31000
+#define GROUP "239.255.77.1" // ポートは BASE_PORT から決める
+
+typedef struct {
+    int fds[MAX_RX];
+    int n;
+    _Atomic int *stop;
+    uint64_t got;
+} receiver;
+
+typedef struct {
+    int fd;
+    int mcast;
+    const struct sockaddr_in *dst; // unicast: peers[n], mcast: group
+    int n;
+    const char *msg;
+    size_t len;
+    _Atomic int *stop;
+    uint64_t rounds, sent;
+    double cpu_sec;
+} sender;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double thread_cpu_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// 全ソケットを読み切ることをくり返す (届いた数だけ数える)
+static void *receiver_main(void *arg) {
+    receiver *r = arg;
+    udp_rx_batch *rx = udp_rx_new();
+    if (!rx) return NULL;
+    while (!atomic_load_explicit(r->stop, memory_order_relaxed)) {
+        int idle = 1;
+        for (int i = 0; i < r->n; ++i) {
+            int got = udp_rx_recv(r->fds[i], rx, MSG_DONTWAIT);
+            if (got > 0) {
+                r->got += (uint64_t)got;
+                idle = 0;
+            }
+        }
+        if (idle) sched_yield(); // 送信スレッドに回す (1 コアでも進むように)
+    }
+    udp_rx_free(rx);
+    return NULL;
+}
+
+static void *sender_main(void *arg) {
+    sender *s = arg;
+    double c0 = thread_cpu_sec();
+    while (!atomic_load_explicit(s->stop, memory_order_relaxed)) {
+        if (s->mcast) {
+            if (sendto(s->fd, s->msg, s->len, 0, (const struct sockaddr *)s->dst, sizeof(*s->dst)) > 0) s->sent++;
+        } else {
+            s->sent += (uint64_t)udp_send_fanout(s->fd, s->msg, s->len, s->dst, s->n);
+        }
+        s->rounds++;
+    }
+    s->cpu_sec = thread_cpu_sec() - c0;
+    return NULL;
+}
+
+typedef struct {
+    double rounds, cpu_us, delivered, loss;
+} result;
+
+// 受信ソケットを n 個開く。mcast なら group に参加、そうでなければ peers[i] に bind
+static int open_receivers(receiver *r, int n, int mcast, const struct sockaddr_in *group, struct sockaddr_in *peers) {
+    struct in_addr lo = {htonl(INADDR_LOOPBACK)};
+    int rcvbuf = 1 << 20;
+    r->n = 0;
+    for (int i = 0; i < n; ++i) {
+        int fd;
+        if (mcast) {
+            fd = udp_mcast_join(group, lo);
+        } else {
+            fd = socket(AF_INET, SOCK_DGRAM, 0);
+            if (fd >= 0 && bind(fd, (const struct sockaddr *)&peers[i], sizeof(peers[i])) < 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        if (fd < 0) return -1;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        ev_set_nonblock(fd);
+        r->fds[r->n++] = fd;
+    }
+    return 0;
+}
+
+static int run(int n, int mcast, double secs, const char *msg, size_t len, result *res) {
+    struct sockaddr_in peers[MAX_RX], group;
+    for (int i = 0; i < n; ++i) {
+        memset(&peers[i], 0, sizeof(peers[i]));
+        peers[i].sin_family = AF_INET;
+        peers[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        peers[i].sin_port = htons((unsigned short)(BASE_PORT + 1 + i));
+    }
+    char gs[32];
+    snprintf(gs, sizeof(gs), "%s:%d", GROUP, BASE_PORT);
+    if (udp_mcast_parse(gs, &group) < 0) return -1;
+
+    _Atomic int stop = 0;
+    receiver r = {.stop = &stop};
+    if (open_receivers(&r, n, mcast, &group, peers) < 0) {
+        for (int i = 0; i < r.n; ++i) close(r.fds[i]);
+        return -1;
+    }
+    sender s = {.mcast = mcast, .dst = mcast ? &group : peers, .n = n, .msg = msg, .len = len, .stop = &stop};
+    s.fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct in_addr lo = {htonl(INADDR_LOOPBACK)};
+    if (s.fd < 0 || (mcast && udp_mcast_sender(s.fd, lo) < 0)) return -1;
+
+    pthread_t rt, st;
+    pthread_create(&rt, NULL, receiver_main, &r);
+    double t0 = now_sec();
+    pthread_create(&st, NULL, sender_main, &s);
+    usleep((useconds_t)(secs * 1e6));
+    atomic_store(&stop, 1);
+    pthread_join(st, NULL);
+    double dt = now_sec() - t0;
+    pthread_join(rt, NULL);
+
+    uint64_t expected = mcast ? s.sent * (uint64_t)n : s.sent; // マルチキャストは 1 通で n 個に届く
+    res->rounds = (double)s.rounds / dt;
+    res->cpu_us = s.rounds ? s.cpu_sec * 1e6 / (double)s.rounds : 0;
+    res->delivered = (double)r.got / dt;
+    res->loss = expected ? 1.0 - (double)r.got / (double)expected : 0;
+    for (int i = 0; i < r.n; ++i) close(r.fds[i]);
+    close(s.fd);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    double secs = argc > 1 ? atof(argv[1]) : 1.0;
+    static GCounter gc;
+    if (gc_init(&gc, 0, 0) < 0) {
+        perror("gc_init");
+        return 1;
+    }
+    for (int i = 0; i < STATE_IDS; ++i) {
+        char kv[32];
+        snprintf(kv, sizeof(kv), "%d=%d", i, 1000 + i);
+        gc_merge_str(&gc, kv);
+    }
+    char msg[BUF_SIZE];
+    size_t len = gc_serialize(&gc, msg, sizeof(msg));
+
+    static const int counts[] = {4, 16, 64};
+    printf("%ld CPUs, %zu-byte state (%d slots), %.1fs per run\n", sysconf(_SC_NPROCESSORS_ONLN), len, STATE_IDS,
+           secs);
+    printf("%-6s %-8s %12s %12s %14s %8s\n", "peers", "mode", "rounds/s", "cpu/round", "delivered/s", "loss");
+    printf("%-6s %-8s %12s %12s %14s %8s\n", "", "", "", "(us)", "", "");
+    int mcast_ok = 1;
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        for (int mcast = 0; mcast <= 1; ++mcast) {
+            if (mcast && !mcast_ok) continue;
+            result r;
+            if (run(counts[i], mcast, secs, msg, len, &r) < 0) {
+                if (!mcast) {
+                    perror("unicast");
+                    return 1;
+                }
+                fprintf(stderr, "multicast unavailable (%s); skipping mcast rows\n", strerror(errno));
+                mcast_ok = 0;
+                continue;
+            }
+            printf("%-6d %-8s %12.0f %12.2f %14.0f %7.1f%%\n", counts[i], mcast ? "mcast" : "unicast", r.rounds,
+                   r.cpu_us, r.delivered, r.loss * 100);
+            fflush(stdout);
+        }
+    }
+    gc_destroy(&gc);
+    return 0;
+}
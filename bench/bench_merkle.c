@@ -0,0 +1,194 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// Merkle anti‑entropy (pn_store_ae_*) の通信量 vs 食い違いの割合
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -I../common -o bench_merkle bench_merkle.c ../common/pn_store.c
+//   $ ./bench_merkle            # 20 万キー
+//   $ ./bench_merkle 1000000
+//
+//   同じ n 個のキーを持つ 2 レプリカを作り、キーの割合 f だけを
+//   片方ずつで更新して食い違わせる。そこから根の比較で始まる anti‑entropy を
+//   メモリ上で (損失なしで) 走らせ、
+//     - やり取りしたメッセージ数・往復数・バイト数
+//     - 全状態を互いに送る場合のバイト数との比
+//   を出す。終わったあと根のダイジェストと全キーの値が一致することを確認する。
+//   最初に、1 データグラムに入らないキーが同期されることも確認する。
+// ------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pn_store.h"
+
+static uint64_t rng_state = 0x9b05688c2b3e6c1fULL;
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+#define KEY_W 16
+
+typedef struct {
+    int to;   // 0 = a, 1 = b
+    int wave; // 何往復目 (片道で 1)
+    size_t len;
+    uint8_t *buf;
+} msg;
+
+typedef struct {
+    msg *q;
+    size_t head, n, cap;
+    int to, wave;     // 今処理しているメッセージの返信先と段
+    size_t bytes, msgs;
+    int max_wave;
+} net;
+
+static void net_push(net *nt, int to, int wave, const void *buf, size_t len) {
+    if (nt->n == nt->cap) {
+        nt->cap = nt->cap ? nt->cap * 2 : 256;
+        nt->q = realloc(nt->q, nt->cap * sizeof(msg));
+    }
+    msg *m = &nt->q[nt->n++];
+    m->to = to;
+    m->wave = wave;
+    m->len = len;
+    m->buf = malloc(len);
+    memcpy(m->buf, buf, len);
+    nt->bytes += len;
+    nt->msgs++;
+    if (wave > nt->max_wave) nt->max_wave = wave;
+}
+
+static void on_send(void *arg, const void *buf, size_t len) {
+    net *nt = arg;
+    net_push(nt, nt->to, nt->wave, buf, len);
+}
+
+// a から始めて、送るものがなくなるまで回す
+static int run_session(pn_store *a, pn_store *b, net *nt) {
+    pn_store *side[2] = {a, b};
+    uint8_t first[64];
+    net_push(nt, 1, 1, first, pn_store_ae_start(a, first, sizeof(first)));
+    while (nt->head < nt->n) {
+        msg m = nt->q[nt->head++];
+        nt->to = !m.to;
+        nt->wave = m.wave + 1;
+        int rc = pn_store_ae_handle(side[m.to], m.buf, m.len, on_send, nt);
+        free(m.buf);
+        if (rc < 0) return -1;
+    }
+    return 0;
+}
+
+static size_t full_bytes; // 全キーを 1 方向に送るバイト数 (初期状態から測る)
+
+static pn_store *build_base(size_t n, const char *keys, const uint32_t *klen, pn_store **pb) {
+    pn_store *a = pn_store_new(1), *b = pn_store_new(2);
+    for (size_t i = 0; i < n; ++i) pn_store_add(a, keys + i * KEY_W, klen[i], 1 + (int64_t)(i % 5));
+    uint8_t pkt[PN_STORE_MTU];
+    size_t len, total = 0;
+    while ((len = pn_store_pack_deltas(a, pkt, sizeof(pkt))) > 0) {
+        pn_store_merge_packet(b, pkt, len);
+        total += len;
+    }
+    pn_store_clear_dirty(b);
+    full_bytes = total;
+    *pb = b;
+    return a;
+}
+
+static int trial(size_t n, const char *keys, const uint32_t *klen, double frac) {
+    pn_store *b, *a = build_base(n, keys, klen, &b);
+    if (pn_store_root(a) != pn_store_root(b)) return -1;
+
+    size_t diff = (size_t)(frac * (double)n + 0.5);
+    for (size_t i = 0; i < diff; ++i) {
+        size_t k = rng() % n;
+        int64_t d = (int64_t)(rng() % 9) - 4;
+        pn_store_add((i & 1) ? a : b, keys + k * KEY_W, klen[k], d ? d : 1);
+    }
+    pn_store_clear_dirty(a);
+    pn_store_clear_dirty(b);
+
+    net nt = {0};
+    if (run_session(a, b, &nt) < 0) return -1;
+    pn_store_clear_dirty(a);
+    pn_store_clear_dirty(b);
+
+    if (pn_store_root(a) != pn_store_root(b)) {
+        fprintf(stderr, "roots differ after session (f=%g)\n", frac);
+        return -1;
+    }
+    for (size_t k = 0; k < n; ++k) {
+        int64_t va = pn_store_get(a, keys + k * KEY_W, klen[k], NULL);
+        int64_t vb = pn_store_get(b, keys + k * KEY_W, klen[k], NULL);
+        if (va != vb) {
+            fprintf(stderr, "key %zu: a=%lld b=%lld (f=%g)\n", k, (long long)va, (long long)vb, frac);
+            return -1;
+        }
+    }
+    if (diff == 0 && nt.msgs != 1) return -1; // 同じなら根の比較 1 通で終わる
+
+    double full = 2.0 * (double)full_bytes; // 互いに全状態を送る
+    printf("%9.4f %9zu %8zu %7d %12zu %11.1f %8.4f\n", frac, diff, nt.msgs, nt.max_wave, nt.bytes,
+           diff ? (double)nt.bytes / (double)diff : 0.0, (double)nt.bytes / full);
+    free(nt.q);
+    pn_store_free(a);
+    pn_store_free(b);
+    return 0;
+}
+
+// 1 データグラムに入らないキー (レプリカ 120 個分のエントリ) も anti‑entropy で届く
+static int check_big(void) {
+    static const char big[] = "big";
+    pn_store *a = pn_store_new(1), *b = pn_store_new(2);
+    pn_store_add(b, big, sizeof(big) - 1, 3);
+    for (uint64_t rid = 100; rid < 220; ++rid) {
+        pn_store_merge_entry(a, big, sizeof(big) - 1, rid, (UINT64_C(1) << 60) + rid, 1u << 20);
+    }
+    pn_store_clear_dirty(a);
+    pn_store_clear_dirty(b);
+    net nt = {0};
+    int rc = run_session(a, b, &nt);
+    if (rc == 0 && (pn_store_root(a) != pn_store_root(b) ||
+                    pn_store_get(a, big, sizeof(big) - 1, NULL) != pn_store_get(b, big, sizeof(big) - 1, NULL))) {
+        fprintf(stderr, "oversized key did not converge\n");
+        rc = -1;
+    }
+    free(nt.q);
+    pn_store_free(a);
+    pn_store_free(b);
+    return rc;
+}
+
+int main(int argc, char **argv) {
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 200000;
+    uint32_t *klen = malloc(n * sizeof(uint32_t));
+    char *keys = malloc(n * KEY_W);
+    for (size_t i = 0; i < n; ++i) klen[i] = (uint32_t)snprintf(keys + i * KEY_W, KEY_W, "user:%zu", i);
+
+    if (check_big() < 0) {
+        fprintf(stderr, "FAIL\n");
+        return 1;
+    }
+    printf("%zu keys\n", n);
+    printf("%9s %9s %8s %7s %12s %11s %8s\n", "diff frac", "updates", "msgs", "waves", "bytes", "bytes/upd",
+           "vs full");
+    const double fracs[] = {0, 0.00001, 0.0001, 0.001, 0.01, 0.05, 0.1, 0.25, 0.5, 1.0};
+    for (size_t i = 0; i < sizeof(fracs) / sizeof(fracs[0]); ++i) {
+        if (trial(n, keys, klen, fracs[i]) < 0) {
+            fprintf(stderr, "FAIL\n");
+            return 1;
+        }
+    }
+    printf("\n(vs full = bytes / both replicas sending their whole state once, %zu bytes each way)\n",
+           full_bytes);
+    free(keys);
+    free(klen);
+    return 0;
+}
@@ -0,0 +1,303 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// op_reliable の損失・重複・並べ替えに対する収束テスト
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -I../common -o bench_op_reliable bench_op_reliable.c ../common/op_reliable.c
+//   $ ./bench_op_reliable
+//
+// 4 レプリカをメモリ上の模擬ネットワークでつなぎ、各レプリカが 2 秒間
+// ランダムな増分を出し続ける。ネットワークはデータグラムを確率 loss で落とし、
+// 確率 dup で 2 回届け、1〜30ms のランダムな遅延で並べ替える。
+// 全レプリカの合計がすべての増分の和にぴったり一致するまで回し、
+// 収束時間・データグラム数・バイト数・再送回数を出す。
+// 比較のため、元の UDPop_simple の方式 (増分をそのまま送って足す) を
+// 同じ条件で流したときの合計のずれも出す。一致しなければ exit 1。
+// 最初に、ack が落ちて巻き戻ったあとに送信済みの op へ足し込まないことも確かめる。
+// ------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "op_reliable.h"
+
+#define NODES 4
+#define TICK_MS 10
+#define OPS_MS 2000      // この時間まで op を出す
+#define LIMIT_MS 120000  // これを超えたら失敗
+
+static uint64_t rng_state = 0x3c6ef372fe94f82bULL;
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+static double rnd(void) {
+    return (double)(rng() >> 11) / (double)(1ULL << 53);
+}
+
+// -------------------- 模擬ネットワーク (到着時刻順のヒープ) --------------------
+
+typedef struct {
+    uint64_t at, order;
+    int from, to;
+    size_t len;
+    uint8_t *buf;
+} event;
+
+typedef struct {
+    event *h;
+    size_t n, cap;
+    uint64_t order;
+    double loss, dup;
+} simnet;
+
+static int ev_less(const event *a, const event *b) {
+    return a->at != b->at ? a->at < b->at : a->order < b->order;
+}
+
+static void heap_push(simnet *s, event e) {
+    if (s->n == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 1024;
+        s->h = realloc(s->h, s->cap * sizeof(event));
+    }
+    size_t i = s->n++;
+    while (i > 0 && ev_less(&e, &s->h[(i - 1) / 2])) {
+        s->h[i] = s->h[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    s->h[i] = e;
+}
+
+static event heap_pop(simnet *s) {
+    event top = s->h[0], last = s->h[--s->n];
+    size_t i = 0;
+    for (;;) {
+        size_t c = 2 * i + 1;
+        if (c >= s->n) break;
+        if (c + 1 < s->n && ev_less(&s->h[c + 1], &s->h[c])) c++;
+        if (!ev_less(&s->h[c], &last)) break;
+        s->h[i] = s->h[c];
+        i = c;
+    }
+    if (s->n) s->h[i] = last;
+    return top;
+}
+
+static uint64_t now;
+
+static void sim_send(simnet *s, int from, int to, const void *buf, size_t len) {
+    if (rnd() < s->loss) return;
+    int copies = rnd() < s->dup ? 2 : 1;
+    for (int c = 0; c < copies; c++) {
+        event e = {now + 1 + rng() % 30, s->order++, from, to, len, malloc(len)};
+        memcpy(e.buf, buf, len);
+        heap_push(s, e);
+    }
+}
+
+// -------------------- レプリカ --------------------
+
+typedef struct {
+    opr o;
+    uint64_t total;
+    simnet *net;
+    int id;
+} node;
+
+static node nodes[NODES];
+
+// peer 番号 i は自分以外のレプリカを順に並べたもの
+static int peer_node(int self, int i) {
+    return i < self ? i : i + 1;
+}
+static int node_peer(int self, int n) {
+    return n < self ? n : n - 1;
+}
+
+static void on_send(void *arg, int peer, const void *buf, size_t len) {
+    node *nd = arg;
+    sim_send(nd->net, nd->id, peer_node(nd->id, peer), buf, len);
+}
+
+static void on_deliver(void *arg, int peer, uint64_t delta) {
+    (void)peer;
+    ((node *)arg)->total += delta;
+}
+
+static int run(double loss, double dup) {
+    simnet net = {0};
+    net.loss = loss;
+    net.dup = dup;
+    uint64_t expect = 0, local[NODES] = {0};
+    for (int i = 0; i < NODES; i++) {
+        nodes[i].id = i;
+        nodes[i].net = &net;
+        nodes[i].total = 0;
+        opr_init(&nodes[i].o, 100 + i, NODES - 1);
+    }
+
+    int converged = 0;
+    for (now = 0; now < LIMIT_MS && !converged; now += TICK_MS) {
+        // この tick までに届くデータグラム
+        while (net.n && net.h[0].at <= now) {
+            event e = heap_pop(&net);
+            node *nd = &nodes[e.to];
+            opr_recv(&nd->o, node_peer(e.to, e.from), e.buf, e.len, on_deliver, nd);
+            free(e.buf);
+        }
+        for (int i = 0; i < NODES; i++) {
+            if (now < OPS_MS) {
+                int k = (int)(rng() % 8);
+                for (int j = 0; j < k; j++) {
+                    uint64_t d = 1 + rng() % 100;
+                    if (opr_submit(&nodes[i].o, d) == 0) {
+                        nodes[i].total += d; // 自分の op はその場で反映
+                        local[i] += d;
+                        expect += d;
+                    }
+                }
+            }
+            opr_tick(&nodes[i].o, now, on_send, &nodes[i]);
+        }
+        if (now >= OPS_MS) {
+            converged = 1;
+            for (int i = 0; i < NODES; i++)
+                if (nodes[i].total != expect || !opr_idle(&nodes[i].o)) converged = 0;
+        }
+    }
+
+    opr_stats st = {0};
+    for (int i = 0; i < NODES; i++) {
+        const opr_stats *s = &nodes[i].o.stats;
+        st.sent_dgrams += s->sent_dgrams;
+        st.sent_bytes += s->sent_bytes;
+        st.sent_ops += s->sent_ops;
+        st.retransmits += s->retransmits;
+        st.dup_ops += s->dup_ops;
+        st.delivered_ops += s->delivered_ops;
+    }
+    printf("%5.2f %5.2f %9s %8llu %9llu %10llu %8.1f %8llu %8llu\n", loss, dup,
+           converged ? "yes" : "NO", (unsigned long long)(now - OPS_MS),
+           (unsigned long long)st.sent_dgrams, (unsigned long long)st.sent_bytes,
+           st.sent_dgrams ? (double)st.sent_ops / (double)st.sent_dgrams : 0.0,
+           (unsigned long long)st.retransmits, (unsigned long long)st.dup_ops);
+    (void)local;
+
+    for (int i = 0; i < NODES; i++) opr_free(&nodes[i].o);
+    while (net.n) free(heap_pop(&net).buf);
+    free(net.h);
+    return converged ? 0 : -1;
+}
+
+// ログが一杯の状態で、全部届いたが ack が全部落ちて RTO で巻き戻ったあとの
+// opr_submit は、送信済みの op に足し込んではいけない (再送は重複として捨てられる)
+typedef struct {
+    opr *to;
+    int up;          // 0 なら落とす
+    uint64_t total;  // to が適用した合計
+} link;
+
+static void link_deliver(void *arg, int peer, uint64_t delta) {
+    (void)peer;
+    ((link *)arg)->total += delta;
+}
+
+static void link_send(void *arg, int peer, const void *buf, size_t len) {
+    (void)peer;
+    link *l = arg;
+    if (l->up) opr_recv(l->to, 0, buf, len, link_deliver, l);
+}
+
+static int check_rewind(void) {
+    static opr a, b;
+    opr_init(&a, 1, 1);
+    opr_init(&b, 2, 1);
+    link ab = {&b, 1, 0}, ba = {&a, 0, 0}; // b からの ack は全部落とす
+    uint64_t accepted = 0;
+    // 大きめの増分にして、巻き戻した tick の再送ではログの途中までしか送れないようにする
+    const uint64_t d = UINT64_C(1) << 40;
+    for (int i = 0; i < OPR_LOG; i++)
+        if (opr_submit(&a, d) == 0) accepted += d;
+    uint64_t t = 1; // progress_ms の 0 は「未設定」
+    while (a.peers[0].next_send <= a.head) opr_tick(&a, t, link_send, &ab);
+    opr_tick(&b, t, link_send, &ba);
+    opr_tick(&a, t + OPR_RTO_MIN_MS, link_send, &ab); // 巻き戻して送り直す (全部重複)
+    if (opr_submit(&a, 1000) == 0) accepted += 1000;
+    ba.up = 1;
+    for (t += 2 * OPR_RTO_MIN_MS; t < LIMIT_MS && !opr_idle(&a); t += TICK_MS) {
+        opr_tick(&a, t, link_send, &ab);
+        opr_tick(&b, t, link_send, &ba);
+    }
+    int ok = opr_idle(&a) && ab.total == accepted;
+    if (!ok) {
+        fprintf(stderr, "rewind: accepted %llu, delivered %llu\n", (unsigned long long)accepted,
+                (unsigned long long)ab.total);
+    }
+    opr_free(&a);
+    opr_free(&b);
+    return ok ? 0 : -1;
+}
+
+// 元の方式: 5 秒ごとではなく毎 tick、たまった増分を text で送って足すだけ
+static void run_naive(double loss, double dup) {
+    simnet net = {0};
+    net.loss = loss;
+    net.dup = dup;
+    uint64_t total[NODES] = {0}, pending[NODES] = {0}, expect = 0;
+    for (now = 0; now < OPS_MS + 1000; now += TICK_MS) {
+        while (net.n && net.h[0].at <= now) {
+            event e = heap_pop(&net);
+            char num[32];
+            size_t l = e.len < sizeof(num) - 1 ? e.len : sizeof(num) - 1;
+            memcpy(num, e.buf, l);
+            num[l] = '\0';
+            total[e.to] += strtoull(num, NULL, 10);
+            free(e.buf);
+        }
+        for (int i = 0; i < NODES; i++) {
+            if (now < OPS_MS) {
+                int k = (int)(rng() % 8);
+                for (int j = 0; j < k; j++) {
+                    uint64_t d = 1 + rng() % 100;
+                    total[i] += d;
+                    pending[i] += d;
+                    expect += d;
+                }
+            }
+            if (pending[i]) {
+                char msg[32];
+                int len = snprintf(msg, sizeof(msg), "%llu", (unsigned long long)pending[i]);
+                for (int p = 0; p < NODES; p++)
+                    if (p != i) sim_send(&net, i, p, msg, (size_t)len);
+                pending[i] = 0;
+            }
+        }
+    }
+    printf("  naive %4.2f/%4.2f: expected %llu, replicas", loss, dup, (unsigned long long)expect);
+    for (int i = 0; i < NODES; i++) printf(" %+lld", (long long)(total[i] - expect));
+    printf("\n");
+    while (net.n) free(heap_pop(&net).buf);
+    free(net.h);
+}
+
+int main(void) {
+    const double cases[][2] = {{0, 0}, {0.01, 0}, {0, 0.1}, {0.05, 0.05}, {0.1, 0.1}, {0.3, 0.2}, {0.5, 0.5}};
+    const int ncases = (int)(sizeof(cases) / sizeof(cases[0]));
+    int fail = check_rewind() < 0;
+    printf("%d replicas, ops for %d ms, 1-30 ms random latency\n\n", NODES, OPS_MS);
+    printf("%5s %5s %9s %8s %9s %10s %8s %8s %8s\n", "loss", "dup", "converged", "after ms", "dgrams",
+           "bytes", "ops/dgr", "rexmit", "dup ops");
+    for (int c = 0; c < ncases; c++)
+        if (run(cases[c][0], cases[c][1]) < 0) fail = 1;
+    printf("\nbare deltas (old UDPop_simple scheme), final total - expected per replica:\n");
+    for (int c = 0; c < ncases; c++) run_naive(cases[c][0], cases[c][1]);
+    if (fail) {
+        fprintf(stderr, "FAIL\n");
+        return 1;
+    }
+    return 0;
+}
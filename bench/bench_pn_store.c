@@ -0,0 +1,223 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// キー付き PN‑Counter ストア (pn_store) のスループットとメモリ
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -I../common -o bench_pn_store bench_pn_store.c ../common/pn_store.c
+//   $ ./bench_pn_store            # 100 万キー
+//   $ ./bench_pn_store 10000000   # 1000 万キー (2 ストアで 2GB 程度使う)
+//
+//   1. 2 レプリカが同じキーをランダムに増減し、MTU サイズのデータグラムで
+//      delta を交換したあと、両方が全キーで期待値に収束することを確認する。
+//      1 データグラムに入らないキー (エントリ 120 個) も収束することを確認する
+//   2. n 個のキーについて
+//      - 挿入 (pn_store_add_batch)
+//      - 既存キーへのランダムな増分 (1 件ずつ / バッチ)
+//      - delta のパック (MTU 1400 バイト)
+//      - 別レプリカへのマージ (キーが新規のとき / 既知のとき)
+//      の秒あたり件数と、キーあたりのメモリを出す。
+// ------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pn_store.h"
+
+static uint64_t rng_state = 0x510e527fade682d1ULL;
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#define KEY_W 16 // キー 1 個分の枠 ("user:" + 10 桁まで)
+
+static char *make_keys(size_t n, uint32_t *klen) {
+    char *keys = malloc(n * KEY_W);
+    for (size_t i = 0; i < n; ++i) klen[i] = (uint32_t)snprintf(keys + i * KEY_W, KEY_W, "user:%zu", i);
+    return keys;
+}
+
+// a の dirty を全部 b に送る
+static void exchange(pn_store *a, pn_store *b) {
+    uint8_t pkt[PN_STORE_MTU];
+    size_t len;
+    while ((len = pn_store_pack_deltas(a, pkt, sizeof(pkt))) > 0) pn_store_merge_packet(b, pkt, len);
+}
+
+static int check(void) {
+    enum { NK = 2000 };
+    static uint32_t klen[NK];
+    static int64_t expect[NK];
+    char *keys = make_keys(NK, klen);
+    pn_store *a = pn_store_new(1), *b = pn_store_new(2);
+
+    for (int round = 0; round < 20; ++round) {
+        for (int i = 0; i < 5000; ++i) {
+            size_t k = rng() % NK;
+            int64_t d = (int64_t)(rng() % 21) - 10;
+            pn_store *s = (rng() & 1) ? a : b;
+            pn_store_add(s, keys + k * KEY_W, klen[k], d);
+            expect[k] += d;
+        }
+        // 送る順番も毎回変える。delta は冪等なので重複しても構わない
+        if (round & 1) {
+            exchange(a, b);
+            exchange(b, a);
+        } else {
+            exchange(b, a);
+            exchange(a, b);
+            exchange(b, a);
+        }
+        exchange(a, b); // b がマージで dirty にしたキーを a が受け取った後の残り
+        exchange(b, a);
+        for (size_t k = 0; k < NK; ++k) {
+            int fa, fb;
+            int64_t va = pn_store_get(a, keys + k * KEY_W, klen[k], &fa);
+            int64_t vb = pn_store_get(b, keys + k * KEY_W, klen[k], &fb);
+            if (va != expect[k] || vb != expect[k]) {
+                fprintf(stderr, "round %d key %zu: a=%lld b=%lld want %lld\n", round, k, (long long)va,
+                        (long long)vb, (long long)expect[k]);
+                return -1;
+            }
+        }
+    }
+    if (pn_store_dirty_count(a) || pn_store_dirty_count(b)) return -1;
+
+    // 1 データグラムに入らないキー (レプリカ 120 個分のエントリ) はエントリの途中で
+    // 切って送る。1 個目を送ったあとに、送り済みの範囲のエントリも増やす
+    static const char big[] = "big";
+    for (uint64_t rid = 100; rid < 220; ++rid) {
+        pn_store_merge_entry(a, big, sizeof(big) - 1, rid, (UINT64_C(1) << 60) + rid, 1u << 20);
+    }
+    uint8_t pkt[PN_STORE_MTU];
+    size_t len = pn_store_pack_deltas(a, pkt, sizeof(pkt));
+    if (len == 0 || pn_store_dirty_count(a) != 1) return -1; // まだ残りがある
+    pn_store_merge_packet(b, pkt, len);
+    pn_store_merge_entry(a, big, sizeof(big) - 1, 100, (UINT64_C(1) << 61), 0);
+    exchange(a, b);
+    exchange(b, a);
+    int fa, fb;
+    if (pn_store_get(a, big, sizeof(big) - 1, &fa) != pn_store_get(b, big, sizeof(big) - 1, &fb) || !fa || !fb ||
+        pn_store_root(a) != pn_store_root(b)) {
+        fprintf(stderr, "oversized key did not converge\n");
+        return -1;
+    }
+
+    // 壊れたデータグラムは -1
+    uint8_t bad[] = {PN_STORE_MAGIC, PN_STORE_VERSION, 0, 1, 5, 'a', 'b'};
+    if (pn_store_merge_packet(a, bad, sizeof(bad)) != -1) return -1;
+    pn_store_free(a);
+    pn_store_free(b);
+    free(keys);
+    return 0;
+}
+
+static void bench(size_t n) {
+    uint32_t *klen = malloc(n * sizeof(uint32_t));
+    char *keys = make_keys(n, klen);
+    pn_op *ops = malloc(n * sizeof(pn_op));
+    pn_store *a = pn_store_new(1);
+
+    // 挿入
+    for (size_t i = 0; i < n; ++i) ops[i] = (pn_op){keys + i * KEY_W, klen[i], (i % 4) ? 1 : -1};
+    double t0 = now_sec();
+    pn_store_add_batch(a, ops, n);
+    double t_insert = now_sec() - t0;
+    double per_key_a = (double)pn_store_bytes(a) / (double)n;
+
+    // 既存キーへのランダムな増分
+    size_t m = n < 4000000 ? 4000000 : n;
+    pn_op *rops = malloc(m * sizeof(pn_op));
+    for (size_t i = 0; i < m; ++i) {
+        size_t k = rng() % n;
+        rops[i] = (pn_op){keys + k * KEY_W, klen[k], 1};
+    }
+    t0 = now_sec();
+    for (size_t i = 0; i < m; ++i) pn_store_add(a, rops[i].key, rops[i].klen, 1);
+    double t_single = now_sec() - t0;
+    t0 = now_sec();
+    pn_store_add_batch(a, rops, m);
+    double t_batch = now_sec() - t0;
+
+    // パック
+    size_t dirty = pn_store_dirty_count(a);
+    size_t cap = dirty * 40 + PN_STORE_MTU;
+    uint8_t *wire = malloc(cap);
+    size_t npkt = 0, maxpkt = dirty + 1, used = 0;
+    size_t *off = malloc(maxpkt * sizeof(size_t)), *lens = malloc(maxpkt * sizeof(size_t));
+    t0 = now_sec();
+    size_t len;
+    while (used + PN_STORE_MTU <= cap && (len = pn_store_pack_deltas(a, wire + used, PN_STORE_MTU)) > 0) {
+        off[npkt] = used;
+        lens[npkt++] = len;
+        used += len;
+    }
+    double t_pack = now_sec() - t0;
+
+    // マージ: 新規キー / 既知キー
+    pn_store *b = pn_store_new(2);
+    t0 = now_sec();
+    for (size_t i = 0; i < npkt; ++i) pn_store_merge_packet(b, wire + off[i], lens[i]);
+    double t_merge_new = now_sec() - t0;
+    double per_key_b = (double)pn_store_bytes(b) / (double)pn_store_keys(b);
+    // 既知キー: a の全キーを進めてからもう一度送る
+    pn_store_add_batch(a, ops, n);
+    npkt = used = 0;
+    while (used + PN_STORE_MTU <= cap && (len = pn_store_pack_deltas(a, wire + used, PN_STORE_MTU)) > 0) {
+        off[npkt] = used;
+        lens[npkt++] = len;
+        used += len;
+    }
+    t0 = now_sec();
+    for (size_t i = 0; i < npkt; ++i) pn_store_merge_packet(b, wire + off[i], lens[i]);
+    double t_merge_known = now_sec() - t0;
+
+    int found;
+    size_t probe = n / 2;
+    int64_t va = pn_store_get(a, keys + probe * KEY_W, klen[probe], NULL);
+    int64_t vb = pn_store_get(b, keys + probe * KEY_W, klen[probe], &found);
+    if (!found || va != vb) fprintf(stderr, "warning: key %zu a=%lld b=%lld\n", probe, (long long)va, (long long)vb);
+
+    printf("keys                 %zu\n", n);
+    printf("insert               %8.2f M keys/s\n", n / t_insert / 1e6);
+    printf("add (single)         %8.2f M ops/s\n", m / t_single / 1e6);
+    printf("add (batch)          %8.2f M ops/s\n", m / t_batch / 1e6);
+    printf("pack                 %8.2f M keys/s  (%zu datagrams, %.1f keys/datagram)\n", dirty / t_pack / 1e6, npkt,
+           (double)dirty / (double)npkt);
+    printf("merge (new keys)     %8.2f M keys/s\n", n / t_merge_new / 1e6);
+    printf("merge (known keys)   %8.2f M keys/s\n", n / t_merge_known / 1e6);
+    printf("memory (local)       %8.1f bytes/key\n", per_key_a);
+    printf("memory (merged)      %8.1f bytes/key\n", per_key_b);
+
+    pn_store_free(a);
+    pn_store_free(b);
+    free(off);
+    free(lens);
+    free(wire);
+    free(rops);
+    free(ops);
+    free(keys);
+    free(klen);
+}
+
+int main(int argc, char **argv) {
+    if (check() < 0) {
+        fprintf(stderr, "FAIL\n");
+        return 1;
+    }
+    printf("two replicas converge over MTU-sized deltas\n\n");
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    bench(n);
+    return 0;
+}
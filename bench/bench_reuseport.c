@@ -0,0 +1,170 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// SO_REUSEPORT の受信スレッド数と受信マージのスループット (loopback)
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -pthread -I../common -o bench_reuseport bench_reuseport.c ../common/udp_shard.c ../common/gc_stage.c ../common/gc_metrics.c ../common/udp_batch.c ../common/evloop.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c
+//   $ ./bench_reuseport [seconds]
+//
+// 受信スレッド (../common/udp_shard.h) を 1〜16 本立て、送信スレッドが
+// FLOWS 個の送信元ポートから delta (8 エントリ) を sendmmsg で送り続ける。
+// 受信スレッドがマージできたデータグラム数 / 秒を、
+//   staged : スレッドごとのステージにためて畳み込む (UDPstate の GC_RECEIVERS)
+//   direct : 受け取るたびに共有の GCounter へ直接マージする
+// の両方で出す。共有の GCounter は broadcast と同じく PEERS 個の peer の
+// dirty を追跡する (マージのたびに fetch_or が走る)。
+// 受信スレッドは CPU に固定するので、コア数より多い本数では頭打ちになる
+// (1 コアの環境では送信と受信が同じコアを取り合うので増えない)。
+// 終わったあと合計 (total) と全スロットの和が一致しなければ exit 1。
+// ------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gc.h"
+#include "gc_metrics.h"
+#include "gc_wire.h"
+#include "udp_batch.h"
+#include "udp_shard.h"
+
+#define FLOWS 64      // 送信元ポートの数 (カーネルはこれで受信ソケットを選ぶ)
+#define SENDERS 2
+#define PEERS 16
+#define IDS 64        // delta に載る ID の範囲
+#define ENTRIES 8
+#define BASE_PORT 29000
+
+typedef struct {
+    int port;
+    int fds[FLOWS / SENDERS];
+    _Atomic int *stop;
+    uint64_t seed, sent;
+} sender;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// ID 昇順に ENTRIES 個を選び、値は送信ごとに増やす (受信側で本当に増える)
+static size_t make_delta(sender *s, uint64_t round, char *out, size_t cap) {
+    gc_wire_writer w;
+    gc_wire_writer_init(&w, out, cap, s->seed, 0x01);
+    uint64_t x = s->seed ^ (round * 0x9e3779b97f4a7c15ULL);
+    int start = (int)(x % (IDS - ENTRIES));
+    for (int k = 0; k < ENTRIES; ++k) gc_wire_put(&w, (uint64_t)(start + k), round * SENDERS + s->seed);
+    return gc_wire_finish(&w);
+}
+
+static void *sender_main(void *arg) {
+    sender *s = arg;
+    static _Thread_local char msgs[UDP_BATCH_MAX][64];
+    struct sockaddr_in dst = {0};
+    dst.sin_family = AF_INET;
+    dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    dst.sin_port = htons((unsigned short)s->port);
+    uint64_t round = 1;
+    udp_tx_batch tx;
+    while (!atomic_load_explicit(s->stop, memory_order_relaxed)) {
+        // flow ごとにたまったら 1 回の sendmmsg
+        for (int f = 0; f < FLOWS / SENDERS; ++f) {
+            udp_tx_init(&tx);
+            for (int i = 0; i < UDP_BATCH_MAX; ++i) {
+                size_t len = make_delta(s, round++, msgs[i], sizeof(msgs[i]));
+                udp_tx_add(s->fds[f], &tx, msgs[i], len, &dst);
+            }
+            s->sent += (uint64_t)udp_tx_flush(s->fds[f], &tx);
+        }
+    }
+    return NULL;
+}
+
+static int run(int receivers, int direct, double secs, int port, double *rate, double *loss) {
+    static GCounter gc;
+    gc_metrics m;
+    if (gc_init(&gc, 0, PEERS) < 0 || gc_metrics_open(&m, NULL, 0, 0) < 0) return -1;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    udp_shard shards[UDP_SHARD_MAX];
+    memset(shards, 0, sizeof(shards));
+    for (int i = 0; i < receivers; ++i) {
+        udp_shard *sh = &shards[i];
+        sh->fd = udp_shard_socket(port);
+        int rcvbuf = 4 << 20;
+        setsockopt(sh->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        sh->cpu = ncpu > 1 ? (int)(i % ncpu) : -1;
+        sh->gc = &gc;
+        sh->direct = direct;
+        sh->metrics = &m;
+        sh->mt = gc_metrics_thread_claim(&m, "rx");
+        if (sh->fd < 0 || !sh->mt || udp_shard_start(sh) < 0) return -1;
+    }
+
+    _Atomic int stop = 0;
+    sender senders[SENDERS];
+    pthread_t th[SENDERS];
+    for (int s = 0; s < SENDERS; ++s) {
+        senders[s] = (sender){.port = port, .stop = &stop, .seed = (uint64_t)s + 1};
+        for (int f = 0; f < FLOWS / SENDERS; ++f) {
+            senders[s].fds[f] = socket(AF_INET, SOCK_DGRAM, 0); // 送信元ポートはそれぞれ別
+            if (senders[s].fds[f] < 0) return -1;
+        }
+        pthread_create(&th[s], NULL, sender_main, &senders[s]);
+    }
+    double t0 = now_sec();
+    uint64_t m0 = gc_metrics_sum(m.seg, GC_M_MERGES);
+    usleep((useconds_t)(secs * 1e6));
+    uint64_t merged = gc_metrics_sum(m.seg, GC_M_MERGES) - m0;
+    double dt = now_sec() - t0;
+    atomic_store(&stop, 1);
+    uint64_t sent = 0;
+    for (int s = 0; s < SENDERS; ++s) {
+        pthread_join(th[s], NULL);
+        sent += senders[s].sent;
+        for (int f = 0; f < FLOWS / SENDERS; ++f) close(senders[s].fds[f]);
+    }
+    for (int i = 0; i < receivers; ++i) udp_shard_stop(&shards[i]);
+
+    *rate = (double)merged / dt;
+    uint64_t got = gc_metrics_sum(m.seg, GC_M_MERGES);
+    *loss = sent ? 1.0 - (double)got / (double)sent : 0;
+    int ok = gc_total(&gc) == gc_total_recompute(&gc); // 畳み込みで合計がずれていないか
+    gc_metrics_close(&m);
+    gc_destroy(&gc);
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    double secs = argc > 1 ? atof(argv[1]) : 1.0;
+    static const int counts[] = {1, 2, 4, 8, 16};
+    printf("%ld CPUs, %d flows, %d senders, %d entries/delta, %d tracked peers, %.1fs per run\n",
+           sysconf(_SC_NPROCESSORS_ONLN), FLOWS, SENDERS, ENTRIES, PEERS, secs);
+    printf("%-10s %14s %8s %14s %8s\n", "receivers", "staged/s", "loss", "direct/s", "loss");
+    int port = BASE_PORT + (int)(getpid() % 1000) * 2;
+    int fail = 0;
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        double staged, sloss, direct, dloss;
+        int rc = run(counts[i], 0, secs, port, &staged, &sloss);
+        rc |= run(counts[i], 1, secs, port + 1, &direct, &dloss);
+        if (rc < 0) {
+            perror("run");
+            return 1;
+        }
+        if (rc) {
+            fprintf(stderr, "FAIL: total drifted from the slot sum with %d receivers\n", counts[i]);
+            fail = 1;
+        }
+        printf("%-10d %14.0f %7.1f%% %14.0f %7.1f%%\n", counts[i], staged, sloss * 100, direct, dloss * 100);
+        fflush(stdout);
+    }
+    return fail;
+}
@@ -0,0 +1,327 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 送信スケジュールごとの収束遅延とパケット数 (固定間隔 vs gc_sched)
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -pthread -I../common -o bench_sched bench_sched.c ../common/netsim.c ../common/gc_sync.c ../common/gc_sched.c ../common/gossip.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c
+//   $ ./bench_sched [--seed S] [--n N]
+//
+// N 個のレプリカ (既定 32、全 peer に delta を送る broadcast) を模擬ネットワーク
+// (../common/netsim.h) の上で動かす。最初の ACTIVE_US の間、各レプリカには
+// 平均 BURST_GAP_US ごとに 1〜BURST_MAX 回の +1 が 1ms おきに来る。
+// そのあと IDLE_US の間は何も起きない。
+//   fixed T     : UDPstate の GC_SCHED=fixed と同じく T ごとに gc_sync_tick
+//   adaptive    : gc_sched.h (GC_SCHED=adaptive) で gc_sync_paced。
+//                 min / max は UDPstate の既定値、pps は GC_PPS
+// 出すもの:
+//   p50 / p99 / max : 増分 1 回ごとに、起きてから他の全レプリカの値に
+//                     入るまでの模擬時間 (ms)
+//   pkt/s active    : 増分のある間の 1 ノードあたりの送信パケット/秒
+//   pkt/s idle      : 何も起きない間の送信パケット/秒 (full sync の分)
+//   wake/s idle     : 何も起きない間に送信処理で起きた回数/秒
+// 全部の増分が全員に届かなければ exit 1。
+// ------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gc.h"
+#include "gc_sched.h"
+#include "gc_sync.h"
+#include "netsim.h"
+
+#define ACTIVE_US 20000000ULL  // 増分が来る時間
+#define IDLE_US 60000000ULL    // そのあと何も起きない時間 (full sync が 1 回は入る)
+#define BURST_GAP_US 2000000ULL // バーストの間隔の平均 (0〜2 倍の一様分布)
+#define BURST_MAX 20
+#define MAX_DELAY_MS 5000      // UDPstate の BROADCAST_INTERVAL_SEC
+#define MIN_DELAY_MS 20        // UDPstate の MIN_DELAY_MS
+
+typedef struct {
+    const char *name;
+    uint64_t fixed_ms;      // 0 なら adaptive
+    double pps;             // adaptive の送信上限 (0 なら無制限)
+} strategy;
+
+typedef struct {
+    uint64_t *value, *at;   // 自分の増分の後の値と時刻 (µs)
+    int *reached;           // その増分が入った他レプリカの数
+    int count, cap;
+} incs;
+
+typedef struct {
+    gc_transport t; // 先頭に置く (gc_transport * から戻すため)
+    netsim *sim;
+    int id;
+    GCounter gc;
+    gc_sync sync;
+    gc_sched sched;
+    uint64_t next_tick;  // fixed
+    uint64_t next_inc;   // 次の増分 (UINT64_MAX ならもうない)
+    int burst_left;
+    uint64_t own;        // 自分の値
+    uint64_t armed;      // 登録してあるタイマの時刻
+    int *idx;            // origin ごとに、まだ自分に入っていない最初の増分
+    incs inc;
+} node;
+
+typedef struct {
+    const strategy *st;
+    node *nodes;
+    int n;
+    uint64_t *lat;       // 届いた増分の遅延 (µs)
+    size_t nlat, total_incs;
+    uint64_t wakeups;
+} world;
+
+typedef struct {
+    double p50, p99, max;
+    double pps_active, pps_idle, wake_idle;
+    size_t undelivered;
+    double wall_ms;
+} result;
+
+// -------------------- 模擬ネットワークのトランスポート --------------------
+
+static int peer_node(const node *nd, int peer) {
+    return peer < nd->id ? peer : peer + 1; // peer 番号は自分を飛ばした番号
+}
+
+static int sim_send(gc_transport *t, int peer, const void *buf, size_t len) {
+    node *nd = (node *)t;
+    return netsim_send(nd->sim, nd->id, peer_node(nd, peer), buf, len);
+}
+
+static int sim_reply(gc_transport *t, int msg, const void *buf, size_t len) {
+    (void)t; // broadcast だけなので返信はしない
+    (void)msg;
+    (void)buf;
+    (void)len;
+    return -1;
+}
+
+static void sim_flush(gc_transport *t) {
+    (void)t;
+}
+
+// -------------------- レプリカ --------------------
+
+static int record_inc(node *nd, uint64_t now) {
+    incs *in = &nd->inc;
+    if (in->count == in->cap) {
+        int cap = in->cap ? in->cap * 2 : 64;
+        uint64_t *v = realloc(in->value, (size_t)cap * sizeof(uint64_t));
+        if (v) in->value = v;
+        uint64_t *a = realloc(in->at, (size_t)cap * sizeof(uint64_t));
+        if (a) in->at = a;
+        int *r = realloc(in->reached, (size_t)cap * sizeof(int));
+        if (r) in->reached = r;
+        if (!v || !a || !r) return -1;
+        in->cap = cap;
+    }
+    in->value[in->count] = nd->own;
+    in->at[in->count] = now;
+    in->reached[in->count] = 0;
+    in->count++;
+    return 0;
+}
+
+static void next_burst(netsim *s, node *nd, uint64_t now) {
+    uint64_t at = now + netsim_rand(s) % (2 * BURST_GAP_US);
+    nd->next_inc = at < ACTIVE_US ? at : UINT64_MAX;
+    nd->burst_left = 1 + (int)(netsim_rand(s) % BURST_MAX);
+}
+
+static uint64_t send_due(const world *w, const node *nd) {
+    return w->st->fixed_ms ? nd->next_tick : gc_sched_due(&nd->sched) * 1000;
+}
+
+static void on_timer(netsim *s, int id, void *arg) {
+    world *w = arg;
+    node *nd = &w->nodes[id];
+    uint64_t now = netsim_now(s);
+    while (nd->next_inc <= now) {
+        gc_increment(&nd->gc, 1);
+        nd->own++;
+        if (record_inc(nd, now) < 0) abort();
+        w->total_incs++;
+        if (!w->st->fixed_ms) gc_sched_changed(&nd->sched, now / 1000);
+        if (--nd->burst_left > 0) {
+            nd->next_inc += 1000;
+        } else {
+            next_burst(s, nd, now);
+        }
+    }
+    if (now >= send_due(w, nd)) {
+        w->wakeups++;
+        if (w->st->fixed_ms) {
+            gc_sync_tick(&nd->sync, &nd->t);
+            nd->next_tick += w->st->fixed_ms * 1000;
+        } else {
+            int full, more;
+            int budget = gc_sched_begin(&nd->sched, now / 1000, &full);
+            int sent = gc_sync_paced(&nd->sync, &nd->t, full, budget, &more);
+            gc_sched_end(&nd->sched, now / 1000, sent, more);
+        }
+    }
+    uint64_t next = send_due(w, nd);
+    if (nd->next_inc < next) next = nd->next_inc;
+    if (next <= now) next = now + 1;
+    // 同じ時刻に 2 本登録しない (早める分だけ足す。古い方は空振りする)
+    if (nd->armed <= now || next < nd->armed) {
+        netsim_timer(s, id, next);
+        nd->armed = next;
+    }
+}
+
+static void on_recv(netsim *s, int id, int from, const void *buf, size_t len, void *arg) {
+    (void)from;
+    world *w = arg;
+    node *nd = &w->nodes[id];
+    gc_merge_buf(&nd->gc, buf, len);
+    uint64_t now = netsim_now(s);
+    for (int j = 0; j < w->n; ++j) {
+        if (j == id) continue;
+        incs *in = &w->nodes[j].inc;
+        uint64_t v = gc_value_of(&nd->gc, j);
+        while (nd->idx[j] < in->count && in->value[nd->idx[j]] <= v) {
+            int k = nd->idx[j]++;
+            if (++in->reached[k] == w->n - 1) w->lat[w->nlat++] = now - in->at[k];
+        }
+    }
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int run(const strategy *st, int n, uint64_t seed, result *res) {
+    struct timespec w0, w1;
+    clock_gettime(CLOCK_MONOTONIC, &w0);
+    world w = {.st = st, .n = n};
+    netsim_config net = {.latency_us = 500, .jitter_us = 200, .seed = seed};
+    netsim_handlers h = {on_timer, on_recv};
+    netsim *sim = netsim_new(n, &net, &h, &w);
+    w.nodes = calloc((size_t)n, sizeof(node));
+    // 増分の数の上限: 1 レプリカに 1ms に 1 回より多くは来ない
+    size_t max_incs = (size_t)n * (ACTIVE_US / 1000 + 1);
+    w.lat = malloc(max_incs * sizeof(uint64_t));
+    if (!sim || !w.nodes || !w.lat) return -1;
+
+    gc_sched_config sc = {.min_delay_ms = MIN_DELAY_MS, .max_interval_ms = MAX_DELAY_MS,
+                          .full_every_ms = (uint64_t)MAX_DELAY_MS * GC_SYNC_FULL_EVERY, .burst = 1};
+    if (st->pps > 0) {
+        sc.pps = st->pps;
+        sc.burst = st->pps / 10 > 1 ? st->pps / 10 : 1; // UDPstate と同じ
+    }
+    for (int i = 0; i < n; ++i) {
+        node *nd = &w.nodes[i];
+        nd->t = (gc_transport){.send = sim_send, .reply = sim_reply, .flush = sim_flush};
+        nd->sim = sim;
+        nd->id = i;
+        nd->idx = calloc((size_t)n, sizeof(int));
+        if (!nd->idx || gc_init(&nd->gc, i, n - 1) < 0) return -1;
+        nd->sync = (gc_sync){.gc = &nd->gc, .peer_count = n - 1};
+        // 起動時刻 (位相) はばらばら。最初の送信は起動直後 (全状態)
+        uint64_t start = netsim_rand(sim) % (st->fixed_ms ? st->fixed_ms * 1000 : 100000);
+        nd->next_tick = start;
+        gc_sched_init(&nd->sched, &sc, start / 1000);
+        next_burst(sim, nd, start);
+        nd->armed = start < nd->next_inc ? start : nd->next_inc;
+        netsim_timer(sim, i, nd->armed);
+    }
+
+    netsim_run(sim, ACTIVE_US);
+    netsim_stats active = *netsim_get_stats(sim);
+    // 最後の増分が届くまでの分を idle に数えないよう、MAX_DELAY_MS 待ってから数え始める
+    uint64_t idle_from = ACTIVE_US + (uint64_t)MAX_DELAY_MS * 1000 * 2;
+    netsim_run(sim, idle_from);
+    netsim_stats settled = *netsim_get_stats(sim);
+    uint64_t wake_settled = w.wakeups;
+    netsim_run(sim, ACTIVE_US + IDLE_US);
+    const netsim_stats *end = netsim_get_stats(sim);
+
+    clock_gettime(CLOCK_MONOTONIC, &w1);
+    res->wall_ms = (w1.tv_sec - w0.tv_sec) * 1e3 + (w1.tv_nsec - w0.tv_nsec) * 1e-6;
+    double idle_sec = (double)(ACTIVE_US + IDLE_US - idle_from) / 1e6;
+    res->pps_active = (double)active.sent / n / (ACTIVE_US / 1e6);
+    res->pps_idle = (double)(end->sent - settled.sent) / n / idle_sec;
+    res->wake_idle = (double)(w.wakeups - wake_settled) / n / idle_sec;
+    res->undelivered = w.total_incs - w.nlat;
+    qsort(w.lat, w.nlat, sizeof(uint64_t), cmp_u64);
+    res->p50 = res->p99 = res->max = -1;
+    if (w.nlat > 0) {
+        res->p50 = w.lat[w.nlat / 2] / 1e3;
+        res->p99 = w.lat[w.nlat * 99 / 100] / 1e3;
+        res->max = w.lat[w.nlat - 1] / 1e3;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        node *nd = &w.nodes[i];
+        gc_destroy(&nd->gc);
+        free(nd->idx);
+        free(nd->inc.value);
+        free(nd->inc.at);
+        free(nd->inc.reached);
+    }
+    free(w.nodes);
+    free(w.lat);
+    netsim_free(sim);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t seed = 1;
+    int n = 32;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--n") == 0 && i + 1 < argc) {
+            n = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--seed S] [--n N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (n < 2 || n > MAX_REPLICAS) {
+        fprintf(stderr, "N must be between 2 and %d\n", MAX_REPLICAS);
+        return 1;
+    }
+
+    const strategy strategies[] = {
+        {"fixed 5000", 5000, 0},
+        {"fixed 100", 100, 0},
+        {"adaptive", 0, 0},
+        {"adaptive 200pps", 0, 200},
+        {"adaptive 50pps", 0, 50},
+    };
+    int fail = 0;
+
+    printf("seed %llu, N %d broadcast, %llus of bursts then %llus idle, latency = sim time from an increment "
+           "to every other replica\n",
+           (unsigned long long)seed, n, ACTIVE_US / 1000000, IDLE_US / 1000000);
+    printf("%-16s %9s %9s %9s %10s %10s %10s %8s\n", "strategy", "p50", "p99", "max", "pkt/s", "pkt/s",
+           "wake/s", "wall");
+    printf("%-16s %9s %9s %9s %10s %10s %10s %8s\n", "", "(ms)", "(ms)", "(ms)", "active", "idle", "idle",
+           "(ms)");
+    for (size_t i = 0; i < sizeof(strategies) / sizeof(strategies[0]); ++i) {
+        result r;
+        if (run(&strategies[i], n, seed, &r) < 0) {
+            perror("run");
+            return 1;
+        }
+        printf("%-16s %9.1f %9.1f %9.1f %10.2f %10.3f %10.3f %8.0f\n", strategies[i].name, r.p50, r.p99, r.max,
+               r.pps_active, r.pps_idle, r.wake_idle, r.wall_ms);
+        fflush(stdout);
+        if (r.undelivered > 0) {
+            fprintf(stderr, "FAIL: %s: %zu increment(s) did not reach every replica\n", strategies[i].name,
+                    r.undelivered);
+            fail = 1;
+        }
+    }
+    return fail;
+}
@@ -0,0 +1,214 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 共有メモリ (gc_shm) とパイプでのスナップショット転送の比較
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -pthread -I../common -o bench_shm bench_shm.c ../common/gc_shm.c
+//   $ ./bench_shm
+//
+// NPROC 個の子プロセスがそれぞれ INCS 回インクリメントする間、親は
+// できるだけ頻繁に全体の値を集計する。
+//   pipe: kekeho の gcounter.c と同じく、子は自分の G‑Counter を持ち、
+//         親の要求 (1 バイト) を受けたら uint64_t snap[NPROC] をパイプで返す。
+//         親は全員分を読んでマージする。子は 4096 回ごとに要求を見る。
+//   shm : 子は共有メモリの自分のスロットに直接足し (seqlock)、親は
+//         gc_shm_snapshot で全スロットを直接読む。
+// 集計 / 秒、1 回の集計にかかる時間、子の増分 / 秒を出す。
+// 最後の集計値が NPROC * INCS でなければ exit 1。
+// 書き途中で死んだ書き手のスロットも読めること (止まらないこと) を確かめる。
+// ------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gc_core.h"
+#include "gc_shm.h"
+
+#define NPROC 4
+#define INCS 20000000L
+#define POLL_EVERY 4096
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, unsigned long aggs, double t, uint64_t total) {
+    printf("  %-5s %10.0f aggregations/s  %8.2f us/aggregation  %7.1f M inc/s  total %llu%s\n", name,
+           aggs / t, t / aggs * 1e6, NPROC * (double)INCS / t / 1e6, (unsigned long long)total,
+           total == (uint64_t)NPROC * INCS ? "" : "  MISMATCH");
+}
+
+// -------------------- pipe --------------------
+
+// 子: snap[NPROC] と「終わった」印を返す
+typedef struct {
+    uint64_t snap[NPROC];
+    uint64_t done;
+} reply;
+
+static void pipe_child(int id, int req, int rep) {
+    gc_slot state[NPROC] = {0};
+    reply r;
+    char c;
+    fcntl(req, F_SETFL, O_NONBLOCK);
+    for (long k = 0; k < INCS; ++k) {
+        gc_slot_add(&state[id], 1);
+        if (k % POLL_EVERY == 0 && read(req, &c, 1) == 1) { // 要求が来ていれば答える
+            gc_slots_snapshot(state, r.snap, NPROC);
+            r.done = 0;
+            if (write(rep, &r, sizeof(r)) != sizeof(r)) _exit(1);
+        }
+    }
+    fcntl(req, F_SETFL, 0);
+    while (read(req, &c, 1) == 1) { // 終わったあとも親が閉じるまで答える
+        gc_slots_snapshot(state, r.snap, NPROC);
+        r.done = 1;
+        if (write(rep, &r, sizeof(r)) != sizeof(r)) _exit(1);
+    }
+    _exit(0);
+}
+
+static int bench_pipe(void) {
+    int req[NPROC][2], rep[NPROC][2];
+    pid_t pids[NPROC];
+    for (int i = 0; i < NPROC; ++i) {
+        if (pipe(req[i]) < 0 || pipe(rep[i]) < 0) return -1;
+    }
+    double t0 = now_sec();
+    for (int i = 0; i < NPROC; ++i) {
+        pids[i] = fork();
+        if (pids[i] < 0) return -1;
+        if (pids[i] == 0) {
+            for (int j = 0; j < NPROC; ++j) {
+                close(req[j][1]);
+                close(rep[j][0]);
+                if (j != i) {
+                    close(req[j][0]);
+                    close(rep[j][1]);
+                }
+            }
+            pipe_child(i, req[i][0], rep[i][1]);
+        }
+        close(req[i][0]);
+        close(rep[i][1]);
+    }
+
+    unsigned long aggs = 0;
+    uint64_t total = 0;
+    for (int all_done = 0; !all_done;) {
+        gc_slot agg[NPROC] = {0};
+        for (int i = 0; i < NPROC; ++i) {
+            if (write(req[i][1], "?", 1) != 1) return -1;
+        }
+        all_done = 1;
+        for (int i = 0; i < NPROC; ++i) { // 全員の返事を読んでマージする
+            reply r;
+            size_t got = 0;
+            while (got < sizeof(r)) {
+                ssize_t n = read(rep[i][0], (char *)&r + got, sizeof(r) - got);
+                if (n <= 0) return -1;
+                got += (size_t)n;
+            }
+            gc_slots_merge(agg, r.snap, NPROC);
+            all_done &= r.done == 1;
+        }
+        total = gc_slots_sum(agg, NPROC);
+        aggs++;
+    }
+    for (int i = 0; i < NPROC; ++i) close(req[i][1]);
+    for (int i = 0; i < NPROC; ++i) {
+        waitpid(pids[i], NULL, 0);
+        close(rep[i][0]);
+    }
+    report("pipe", aggs, now_sec() - t0, total);
+    return total == (uint64_t)NPROC * INCS ? 0 : -1;
+}
+
+// -------------------- shm --------------------
+
+static int bench_shm(void) {
+    char name[64];
+    snprintf(name, sizeof(name), "/gc-bench-%d", (int)getpid());
+    gc_shm shm;
+    if (gc_shm_create(&shm, name, NPROC) < 0) return -1;
+    gc_shm_unlink(name);
+
+    double t0 = now_sec();
+    for (int i = 0; i < NPROC; ++i) {
+        pid_t pid = fork();
+        if (pid < 0) return -1;
+        if (pid == 0) {
+            int id = gc_shm_claim(&shm, (int32_t)getpid());
+            for (long k = 0; k < INCS; ++k) gc_shm_add(&shm, id, 1);
+            _exit(0);
+        }
+    }
+
+    unsigned long aggs = 0, inconsistent = 0;
+    uint64_t snap[NPROC], total = 0;
+    int running = NPROC;
+    while (running > 0) {
+        for (int k = 0; k < 1024; ++k) {
+            inconsistent += (unsigned long)gc_shm_snapshot(&shm, snap);
+            aggs++;
+        }
+        while (running > 0 && waitpid(-1, NULL, WNOHANG) > 0) running--;
+    }
+    // 全員終わったあとの最後の集計
+    gc_shm_snapshot(&shm, snap);
+    aggs++;
+    total = 0;
+    for (int i = 0; i < NPROC; ++i) total += snap[i];
+    report("shm", aggs, now_sec() - t0, total);
+    printf("        (%lu of %lu snapshots fell back to per-slot values)\n", inconsistent, aggs);
+    gc_shm_detach(&shm);
+    return total == (uint64_t)NPROC * INCS ? 0 : -1;
+}
+
+// 書き手が seq を奇数にしたまま死んでも、読み手は止まらずにその値を読めるか
+static int check_dead_writer(void) {
+    char name[64];
+    snprintf(name, sizeof(name), "/gc-bench-dead-%d", (int)getpid());
+    gc_shm shm;
+    if (gc_shm_create(&shm, name, NPROC) < 0) return -1;
+    gc_shm_unlink(name);
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int id = gc_shm_claim(&shm, (int32_t)getpid());
+        gc_shm_add(&shm, id, 5);
+        atomic_fetch_add(&shm.seg->slot[id].seq, 1); // gc_shm_add の途中で死んだことにする
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+    uint64_t snap[NPROC];
+    int rc = gc_shm_snapshot(&shm, snap);
+    uint64_t v = gc_shm_value(&shm);
+    gc_shm_detach(&shm);
+    printf("  dead writer: snapshot %s, value %llu\n", rc ? "inconsistent" : "consistent",
+           (unsigned long long)v);
+    return rc == 1 && v == 5 && snap[0] == 5 ? 0 : -1;
+}
+
+int main(void) {
+    printf("%d processes x %ld increments\n", NPROC, INCS);
+    int fail = 0;
+    fail |= bench_pipe() < 0;
+    fail |= bench_shm() < 0;
+    fail |= check_dead_writer() < 0;
+    if (fail) {
+        printf("FAILED\n");
+        return 1;
+    }
+    return 0;
+}
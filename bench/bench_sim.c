@@ -0,0 +1,278 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 同期方式ごとの収束時間とメッセージ量 (決定的なネットワークシミュレータ)
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -pthread -DMAX_REPLICAS=1024 -I../common -o bench_sim bench_sim.c ../common/netsim.c ../common/gc_sync.c ../common/gossip.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c
+//   $ ./bench_sim [--seed S] [--n N]
+//
+// UDPstate を何十個も手で起動する代わりに、N 個のレプリカを 1 プロセスの中で
+// 動かす (../common/netsim.h)。各レプリカは UDPstate と同じ同期方式
+// (../common/gc_sync.h) と同じマージ・直列化 (gc.c) を、模擬ネットワークの
+// トランスポートの上で動かす。時刻は模擬なので 1000 レプリカで何十秒分でも
+// 数秒で終わり、同じ seed なら結果は毎回同じになる。
+//
+// 各レプリカは SYNC_INTERVAL_US ごと (位相はばらばら) に gc_sync_tick を呼び、
+// 最初の 1 間隔のうちのランダムな時刻に自分を 1 増やす。最後の増分
+// (分断があるなら分断が解けた時刻の遅い方) から、全レプリカの合計が N に
+// なるまでの模擬時間 (converge) と、それまでに送った 1 ノードあたりの
+// メッセージ数・バイト数を出す。
+//   broadcast : 全 peer に delta (GC_SYNC_FULL_EVERY 回に 1 回全状態)。
+//               1 ラウンド N^2 通なので N = 100 だけ (1000 だと 1 分近くかかる)
+//   gossip k  : ランダムな k 個と push‑pull
+// 障害は loss / dup / reorder / jitter と、前半と後半のノードの分断 (2 秒間)。
+// 最初のシナリオは同じ seed で 2 回動かし、結果が同じでなければ exit 1。
+// 収束しないシナリオがあっても exit 1。
+// 自分の ID は密なスロットに置くので N <= MAX_REPLICAS でビルドすること。
+// ------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gc.h"
+#include "gc_sync.h"
+#include "gossip.h"
+#include "netsim.h"
+
+#define SYNC_INTERVAL_US 100000ULL // 100ms ごとに同期
+#define LIMIT_US 60000000ULL       // 60 秒 (模擬時間) で収束しなければ失敗
+#define PARTITION_US 2000000ULL
+
+typedef struct {
+    gc_transport t;  // 先頭に置く (gc_transport * から戻すため)
+    netsim *sim;
+    int id;
+    int from;        // 受信中のメッセージの送り主 (返信先)
+    GCounter gc;
+    gossip g;
+    gc_sync sync;
+    uint64_t inc_at, next_tick;
+    int incremented, done;
+} node;
+
+typedef struct {
+    const char *name;
+    int n;
+    int fanout;             // 0: broadcast
+    netsim_config net;
+    int partition;          // 前半と後半を PARTITION_US の間分ける
+} scenario;
+
+typedef struct {
+    double converge_ms;     // 収束しなければ -1
+    double msgs, bytes;     // 収束までの 1 ノードあたり
+    netsim_stats st;
+    double wall_ms;
+} result;
+
+typedef struct {
+    node *nodes;
+    int n, done;
+    uint64_t start;        // 最後の増分 / 分断が解けた時刻
+    uint64_t converged_at;
+    netsim_stats at_converge;
+    netsim *sim;
+} world;
+
+// -------------------- 模擬ネットワークのトランスポート --------------------
+
+static int peer_node(const node *nd, int peer) {
+    return peer < nd->id ? peer : peer + 1; // peer 番号は自分を飛ばした番号
+}
+
+static int sim_send(gc_transport *t, int peer, const void *buf, size_t len) {
+    node *nd = (node *)t;
+    return netsim_send(nd->sim, nd->id, peer_node(nd, peer), buf, len);
+}
+
+static int sim_reply(gc_transport *t, int msg, const void *buf, size_t len) {
+    (void)msg; // 1 通ずつ渡すので送り主は 1 人
+    node *nd = (node *)t;
+    return netsim_send(nd->sim, nd->id, nd->from, buf, len);
+}
+
+static void sim_flush(gc_transport *t) {
+    (void)t; // netsim_send でもう送っている
+}
+
+// -------------------- レプリカ --------------------
+
+static void check_done(world *w, node *nd) {
+    if (nd->done || gc_total(&nd->gc) != (unsigned long)w->n) return;
+    nd->done = 1;
+    if (++w->done == w->n) {
+        w->converged_at = netsim_now(w->sim);
+        w->at_converge = *netsim_get_stats(w->sim);
+    }
+}
+
+static void on_timer(netsim *s, int id, void *arg) {
+    world *w = arg;
+    node *nd = &w->nodes[id];
+    uint64_t now = netsim_now(s);
+    if (!nd->incremented && now >= nd->inc_at) {
+        gc_increment(&nd->gc, 1);
+        nd->incremented = 1;
+        check_done(w, nd);
+    }
+    if (now >= nd->next_tick) {
+        gc_sync_tick(&nd->sync, &nd->t);
+        nd->next_tick += SYNC_INTERVAL_US;
+    }
+    uint64_t next = nd->next_tick;
+    if (!nd->incremented && nd->inc_at < next) next = nd->inc_at;
+    netsim_timer(s, id, next);
+}
+
+static void on_recv(netsim *s, int id, int from, const void *buf, size_t len, void *arg) {
+    (void)s;
+    world *w = arg;
+    node *nd = &w->nodes[id];
+    gc_merge_buf(&nd->gc, buf, len);
+    nd->from = from;
+    const void *bufs[1] = {buf};
+    size_t lens[1] = {len};
+    gc_sync_reply(&nd->sync, &nd->t, bufs, lens, 1);
+    check_done(w, nd);
+}
+
+static int run(const scenario *sc, uint64_t seed, result *res) {
+    struct timespec w0, w1;
+    clock_gettime(CLOCK_MONOTONIC, &w0);
+    int n = sc->n;
+    world w = {.n = n};
+    netsim_config net = sc->net;
+    net.seed = seed;
+    netsim_handlers h = {on_timer, on_recv};
+    w.sim = netsim_new(n, &net, &h, &w);
+    w.nodes = calloc((size_t)n, sizeof(node));
+    if (!w.sim || !w.nodes) return -1;
+
+    for (int i = 0; i < n; ++i) {
+        node *nd = &w.nodes[i];
+        nd->t = (gc_transport){.send = sim_send, .reply = sim_reply, .flush = sim_flush};
+        nd->sim = w.sim;
+        nd->id = i;
+        // broadcast は peer ごとの delta を追跡し、ゴシップは全状態を送るので追跡しない
+        if (gc_init(&nd->gc, i, sc->fanout > 0 ? 0 : n - 1) < 0) return -1;
+        if (sc->fanout > 0 && gossip_init(&nd->g, n - 1, netsim_rand(w.sim)) < 0) return -1;
+        nd->sync = (gc_sync){.gc = &nd->gc, .peer_count = n - 1, .fanout = sc->fanout, .gossip = &nd->g};
+        nd->inc_at = netsim_rand(w.sim) % SYNC_INTERVAL_US;
+        nd->next_tick = netsim_rand(w.sim) % SYNC_INTERVAL_US;
+        if (nd->inc_at > w.start) w.start = nd->inc_at;
+        netsim_timer(w.sim, i, nd->inc_at < nd->next_tick ? nd->inc_at : nd->next_tick);
+    }
+    if (sc->partition) {
+        int *group = malloc((size_t)n * sizeof(int));
+        if (!group) return -1;
+        for (int i = 0; i < n; ++i) group[i] = i >= n / 2;
+        if (netsim_partition(w.sim, 0, PARTITION_US, group) < 0) return -1;
+        free(group);
+        if (PARTITION_US > w.start) w.start = PARTITION_US;
+    }
+
+    while (w.done < n && netsim_now(w.sim) < LIMIT_US) {
+        if (!netsim_step(w.sim)) break;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &w1);
+    res->wall_ms = (w1.tv_sec - w0.tv_sec) * 1e3 + (w1.tv_nsec - w0.tv_nsec) * 1e-6;
+    if (w.done == n) {
+        // 分断中に収束はしないので converged_at >= start
+        res->converge_ms = (double)(w.converged_at - w.start) / 1e3;
+        res->st = w.at_converge;
+    } else {
+        res->converge_ms = -1;
+        res->st = *netsim_get_stats(w.sim);
+    }
+    res->msgs = (double)res->st.sent / n;
+    res->bytes = (double)res->st.sent_bytes / n;
+
+    for (int i = 0; i < n; ++i) {
+        gc_destroy(&w.nodes[i].gc);
+        if (sc->fanout > 0) gossip_free(&w.nodes[i].g);
+    }
+    free(w.nodes);
+    netsim_free(w.sim);
+    return 0;
+}
+
+static void print_row(const scenario *sc, const result *r) {
+    char strat[24];
+    if (sc->fanout > 0) {
+        snprintf(strat, sizeof(strat), "gossip %d", sc->fanout);
+    } else {
+        snprintf(strat, sizeof(strat), "broadcast");
+    }
+    printf("%-12s %5d  %-10s %10.1f %10.1f %11.0f %9llu %9llu %9.0f\n", sc->name, sc->n, strat, r->converge_ms,
+           r->msgs, r->bytes, (unsigned long long)r->st.lost, (unsigned long long)r->st.partitioned, r->wall_ms);
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t seed = 1;
+    int big = 1000;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--n") == 0 && i + 1 < argc) {
+            big = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--seed S] [--n N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (big < 2 || big > MAX_REPLICAS) {
+        fprintf(stderr, "N must be between 2 and %d (build with a larger -DMAX_REPLICAS)\n", MAX_REPLICAS);
+        return 1;
+    }
+
+    const netsim_config lan = {.latency_us = 500, .jitter_us = 200};
+    const netsim_config faulty = {.latency_us = 2000, .jitter_us = 3000, .loss = 0.10, .dup = 0.05,
+                                  .reorder = 0.20, .reorder_us = 50000};
+    const scenario scenarios[] = {
+        {"lan", 100, 0, lan, 0},
+        {"lan", 100, 1, lan, 0},
+        {"lan", 100, 2, lan, 0},
+        {"lan", 100, 3, lan, 0},
+        {"faulty", 100, 0, faulty, 0},
+        {"faulty", 100, 2, faulty, 0},
+        {"lan", big, 1, lan, 0},
+        {"lan", big, 2, lan, 0},
+        {"lan", big, 3, lan, 0},
+        {"faulty", big, 2, faulty, 0},
+        {"partition", big, 2, lan, 1},
+        {"partition", big, 2, faulty, 1},
+    };
+    int fail = 0;
+
+    printf("seed %llu, sync every %llums, converge = sim time from the last increment (or heal) to all totals == N\n",
+           (unsigned long long)seed, SYNC_INTERVAL_US / 1000);
+    printf("%-12s %5s  %-10s %10s %10s %11s %9s %9s %9s\n", "scenario", "N", "strategy", "converge", "msgs/node",
+           "bytes/node", "lost", "cut", "wall");
+    printf("%-12s %5s  %-10s %10s %10s %11s %9s %9s %9s\n", "", "", "", "(ms)", "", "", "", "", "(ms)");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+        result r;
+        if (run(&scenarios[i], seed, &r) < 0) {
+            perror("run");
+            return 1;
+        }
+        print_row(&scenarios[i], &r);
+        fflush(stdout);
+        if (r.converge_ms < 0) {
+            fprintf(stderr, "FAIL: %s did not converge within %llus\n", scenarios[i].name, LIMIT_US / 1000000);
+            fail = 1;
+        }
+        if (i == 0) { // 同じ seed なら同じ結果になるはず
+            result again;
+            if (run(&scenarios[i], seed, &again) < 0) return 1;
+            if (again.converge_ms != r.converge_ms || memcmp(&again.st, &r.st, sizeof(r.st)) != 0) {
+                fprintf(stderr, "FAIL: two runs with seed %llu differ\n", (unsigned long long)seed);
+                fail = 1;
+            }
+        }
+    }
+    return fail;
+}
@@ -0,0 +1,127 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// gc_simd のカーネル比較 (スカラ / AVX2 / AVX‑512 × レプリカ数)
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -I../common -o bench_simd bench_simd.c ../common/gc_simd.c
+//   $ ./bench_simd [batch_k]
+//
+//   各実装の結果 (増えた量の戻り値も含む) がスカラ版と一致することを確認してから、
+//   max マージ / 総和 / K 個まとめたマージ (batch) の 1 ベクタあたりの
+//   時間と、1 秒あたりにマージできる状態数を表示する。
+// ------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gc_simd.h"
+
+#define MAX_K 64
+
+static const char *impls[] = {"scalar", "avx2", "avx512"};
+static const size_t widths[] = {8, 64, 256, 1024, 4096};
+
+static uint64_t rng_state = 0x853c49e6748fea9bULL;
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static volatile uint64_t sink;
+
+// 全実装がスカラ版と同じ結果を返すか (端数の長さも含めて)
+static int check(void) {
+    uint64_t a[67], b[67], ref[67], out[67];
+    const uint64_t *srcs[3] = {a, b, ref};
+    for (size_t n = 0; n <= 67; ++n) {
+        for (size_t i = 0; i < 67; ++i) {
+            a[i] = rng();
+            b[i] = (i & 1) ? rng() : a[i] ^ 0x8000000000000000ULL; // 符号ビットをまたぐ比較
+            ref[i] = rng() >> (i % 64);
+        }
+        gc_simd_select("scalar");
+        uint64_t want_sum = gc_vec_sum_u64(a, n);
+        uint64_t want_max[67], want_batch[67];
+        memcpy(want_max, a, sizeof(a));
+        uint64_t want_grown = gc_vec_max_u64(want_max, b, n);
+        memcpy(want_batch, b, sizeof(b));
+        uint64_t want_bgrown = gc_vec_max_batch_u64(want_batch, srcs, 3, n);
+
+        for (size_t m = 1; m < sizeof(impls) / sizeof(impls[0]); ++m) {
+            if (gc_simd_select(impls[m]) < 0) continue;
+            memcpy(out, a, sizeof(a));
+            uint64_t grown = gc_vec_max_u64(out, b, n);
+            if (memcmp(out, want_max, sizeof(out)) != 0 || grown != want_grown ||
+                gc_vec_sum_u64(a, n) != want_sum) {
+                fprintf(stderr, "%s: mismatch at n=%zu\n", impls[m], n);
+                return -1;
+            }
+            memcpy(out, b, sizeof(b));
+            grown = gc_vec_max_batch_u64(out, srcs, 3, n);
+            if (memcmp(out, want_batch, sizeof(out)) != 0 || grown != want_bgrown) {
+                fprintf(stderr, "%s: batch mismatch at n=%zu\n", impls[m], n);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t k = argc > 1 ? (size_t)atoi(argv[1]) : 16;
+    if (k < 1 || k > MAX_K) k = 16;
+    if (check() < 0) return 1;
+    printf("kernels agree with scalar reference\n\n");
+
+    printf("%-7s %6s %12s %12s %14s %16s\n", "impl", "slots", "max ns", "sum ns",
+           "batch ns/vec", "merges/sec");
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+        size_t n = widths[w];
+        uint64_t *dst = malloc(n * sizeof(uint64_t));
+        uint64_t *srcs[MAX_K];
+        for (size_t j = 0; j < k; ++j) {
+            srcs[j] = malloc(n * sizeof(uint64_t));
+            for (size_t i = 0; i < n; ++i) srcs[j][i] = rng() >> 8;
+        }
+        memset(dst, 0, n * sizeof(uint64_t));
+        long iters = (long)(2e8 / (double)(n * k)) + 1;
+
+        for (size_t m = 0; m < sizeof(impls) / sizeof(impls[0]); ++m) {
+            if (gc_simd_select(impls[m]) < 0) continue;
+
+            double t0 = now_sec();
+            for (long it = 0; it < iters; ++it) {
+                for (size_t j = 0; j < k; ++j) gc_vec_max_u64(dst, srcs[j], n);
+            }
+            double t_max = (now_sec() - t0) / ((double)iters * k);
+
+            t0 = now_sec();
+            for (long it = 0; it < iters * (long)k; ++it) sink += gc_vec_sum_u64(srcs[it % k], n);
+            double t_sum = (now_sec() - t0) / ((double)iters * k);
+
+            t0 = now_sec();
+            for (long it = 0; it < iters; ++it) {
+                gc_vec_max_batch_u64(dst, (const uint64_t *const *)srcs, k, n);
+            }
+            double t_batch = (now_sec() - t0) / ((double)iters * k);
+
+            printf("%-7s %6zu %12.1f %12.1f %14.1f %16.0f\n", impls[m], n, t_max * 1e9, t_sum * 1e9,
+                   t_batch * 1e9, 1.0 / t_batch);
+        }
+        free(dst);
+        for (size_t j = 0; j < k; ++j) free(srcs[j]);
+    }
+    printf("\n(batch = %zu vectors merged per pass; merges/sec uses the batch path)\n", k);
+    return 0;
+}
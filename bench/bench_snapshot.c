@@ -0,0 +1,179 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 読み手 (直列化・監視) がいるときの書き手 (マージ) の遅延
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -pthread -I../common -o bench_snapshot bench_snapshot.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c
+//   $ ./bench_snapshot
+//
+// WRITERS 本の書き手が OPS 回ずつ gc_merge_dense で 2 スロットを増やす間、
+// 読み手 0 / 1 / 2 / 4 本が全状態のテキスト直列化をくり返す。
+//   mutex    : 以前の設計のように 1 本の mutex で守る。書き手はマージの間、
+//              読み手は直列化 (書式化を含む) の間ずっと持つ
+//   snapshot : 書き手はロックなし。読み手は gc_serialize_text
+//              (gc_snapshot でコピーしてからロックの外で書式化)
+// 書き手 1 回ごとの時間 (ns) の p50 / p99 / p99.9 / max と、読み手の
+// 直列化 / 秒、スナップショットが GC_SNAP_TRIES 回で取れなかった割合を出す。
+// 書き手は 1 回のマージでペア (a < b) の両方を 1 ずつ増やすので、ある瞬間の
+// 状態なら必ず values[a] >= values[b]。成功したスナップショットでこれが
+// 破れていたら exit 1。
+// ------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gc.h"
+
+#define WRITERS 2
+#define PAIRS 16       // 書き手ごとのスロットの組の数
+#define OPS 200000     // 書き手 1 本の回数
+#define MAX_READERS 4
+
+typedef struct {
+    GCounter *gc;
+    pthread_mutex_t *mtx; // NULL ならロックなし
+    int id;
+    uint32_t *lat;        // OPS 個
+} writer;
+
+typedef struct {
+    GCounter *gc;
+    pthread_mutex_t *mtx;
+    _Atomic int *stop;
+    uint64_t reads, fallbacks, torn;
+} reader;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void *writer_main(void *arg) {
+    writer *w = arg;
+    static _Thread_local uint64_t values[MAX_REPLICAS];
+    for (int k = 0; k < OPS; ++k) {
+        // 書き手 id の組 p は (id * PAIRS + p) * 2 と +1 のスロット
+        int a = (w->id * PAIRS + k % PAIRS) * 2, b = a + 1;
+        uint64_t mask[GC_DENSE_WORDS] = {0};
+        mask[a / 64] |= 1ULL << (a % 64);
+        mask[b / 64] |= 1ULL << (b % 64);
+        values[a]++;
+        values[b]++;
+        uint64_t t0 = now_ns();
+        if (w->mtx) pthread_mutex_lock(w->mtx);
+        gc_merge_dense(w->gc, values, mask); // id 昇順なので a が先に増える
+        if (w->mtx) pthread_mutex_unlock(w->mtx);
+        uint64_t dt = now_ns() - t0;
+        w->lat[k] = dt > UINT32_MAX ? UINT32_MAX : (uint32_t)dt;
+    }
+    return NULL;
+}
+
+static void *reader_main(void *arg) {
+    reader *r = arg;
+    char out[BUF_SIZE * 4];
+    gc_snap snap;
+    gc_snap_init(&snap);
+    while (!atomic_load_explicit(r->stop, memory_order_relaxed)) {
+        if (r->mtx) {
+            pthread_mutex_lock(r->mtx);
+            gc_serialize_text(r->gc, out, sizeof(out));
+            pthread_mutex_unlock(r->mtx);
+        } else {
+            gc_serialize_text(r->gc, out, sizeof(out));
+            // 監視用の読み手: 一貫しているか確かめる
+            int rc = gc_snapshot(r->gc, &snap);
+            if (rc != 0) {
+                r->fallbacks++;
+            } else {
+                for (int i = 0; i < WRITERS * PAIRS * 2; i += 2) {
+                    if (snap.values[i] < snap.values[i + 1]) r->torn++;
+                }
+            }
+        }
+        r->reads++;
+    }
+    gc_snap_free(&snap);
+    return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int run(int locked, int nreaders, int *torn) {
+    static GCounter gc;
+    if (gc_init(&gc, 0, 0) < 0) return -1;
+    pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+    _Atomic int stop = 0;
+    writer ws[WRITERS];
+    reader rs[MAX_READERS];
+    pthread_t wt[WRITERS], rt[MAX_READERS];
+    static uint32_t lat[WRITERS * OPS];
+
+    for (int i = 0; i < nreaders; ++i) {
+        rs[i] = (reader){.gc = &gc, .mtx = locked ? &mtx : NULL, .stop = &stop};
+        pthread_create(&rt[i], NULL, reader_main, &rs[i]);
+    }
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < WRITERS; ++i) {
+        ws[i] = (writer){.gc = &gc, .mtx = locked ? &mtx : NULL, .id = i, .lat = lat + (size_t)i * OPS};
+        pthread_create(&wt[i], NULL, writer_main, &ws[i]);
+    }
+    for (int i = 0; i < WRITERS; ++i) pthread_join(wt[i], NULL);
+    double sec = (now_ns() - t0) / 1e9;
+    atomic_store(&stop, 1);
+    uint64_t reads = 0, fallbacks = 0;
+    for (int i = 0; i < nreaders; ++i) {
+        pthread_join(rt[i], NULL);
+        reads += rs[i].reads;
+        fallbacks += rs[i].fallbacks;
+        *torn += (int)rs[i].torn;
+    }
+
+    size_t n = (size_t)WRITERS * OPS;
+    qsort(lat, n, sizeof(lat[0]), cmp_u32);
+    printf("%-9s %7d %9u %9u %9u %11u %12.0f %9.2f%%\n", locked ? "mutex" : "snapshot", nreaders, lat[n / 2],
+           lat[n * 99 / 100], lat[n * 999 / 1000], lat[n - 1], reads / sec,
+           reads && !locked ? 100.0 * (double)fallbacks / (double)reads : 0.0);
+    fflush(stdout);
+    int ok = gc_total(&gc) == (unsigned long)WRITERS * OPS * 2 && gc_total(&gc) == gc_total_recompute(&gc);
+    gc_destroy(&gc);
+    return ok ? 0 : 1;
+}
+
+int main(void) {
+    static const int readers[] = {0, 1, 2, 4};
+    printf("%d writers x %d merges (2 slots each), readers serialize the full state as text\n", WRITERS, OPS);
+    printf("%-9s %7s %9s %9s %9s %11s %12s %10s\n", "mode", "readers", "p50", "p99", "p99.9", "max",
+           "reads/s", "fallback");
+    printf("%-9s %7s %9s %9s %9s %11s %12s %10s\n", "", "", "(ns)", "(ns)", "(ns)", "(ns)", "", "");
+    int fail = 0, torn = 0;
+    for (size_t i = 0; i < sizeof(readers) / sizeof(readers[0]); ++i) {
+        for (int locked = 1; locked >= 0; --locked) {
+            int rc = run(locked, readers[i], &torn);
+            if (rc < 0) {
+                perror("run");
+                return 1;
+            }
+            if (rc) {
+                fprintf(stderr, "FAIL: total drifted (%s, %d readers)\n", locked ? "mutex" : "snapshot",
+                        readers[i]);
+                fail = 1;
+            }
+        }
+    }
+    if (torn) {
+        fprintf(stderr, "FAIL: %d torn pair(s) in consistent snapshots\n", torn);
+        fail = 1;
+    }
+    return fail;
+}
@@ -0,0 +1,200 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 疎な G‑Counter (gc_sparse) のマージ性能とメモリ (密 / 疎なメンバーシップ)
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -I../common -o bench_sparse bench_sparse.c ../common/gc_sparse.c ../common/gc_wire.c ../common/gc_simd.c
+//   $ ./bench_sparse
+//
+//   dense : レプリカ ID が 0..n-1 (今の固定長配列と同じ並び)
+//   sparse: レプリカ ID がランダムな 64bit 値
+//   それぞれ n = 256 / 4096 / 100000 で
+//     - 既知の ID だけを更新するマージ (定常状態)
+//     - 1 割が新しい ID のマージ (メンバー追加)
+//     - ワイヤ形式からのマージ
+//   の時間と、1 レプリカあたりのメモリを測る。dense では比較のため
+//   固定長配列 + gc_vec_max_u64 のマージ時間も出す。
+//   最初に、マージ結果が 1 件ずつ store_max した結果と一致することを確認する。
+// ------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gc_simd.h"
+#include "gc_sparse.h"
+#include "gc_wire.h"
+
+static uint64_t rng_state = 0x6a09e667f3bcc909ULL;
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int check(void) {
+    for (int round = 0; round < 200; ++round) {
+        gc_sparse a, b, ref;
+        gc_sparse_init(&a);
+        gc_sparse_init(&b);
+        gc_sparse_init(&ref);
+        int na = (int)(rng() % 300), nb = (int)(rng() % 300);
+        for (int i = 0; i < na; ++i) {
+            uint64_t id = rng() % 500, v = 1 + rng() % 1000;
+            gc_sparse_store_max(&a, id, v);
+            gc_sparse_store_max(&ref, id, v);
+        }
+        for (int i = 0; i < nb; ++i) gc_sparse_store_max(&b, rng() % 500, 1 + rng() % 1000);
+
+        uint64_t before = gc_sparse_value(&a), grown;
+        if (round & 1) {
+            gc_sparse_merge(&a, &b, &grown);
+        } else {
+            static uint8_t buf[1 << 16];
+            gc_wire_writer w;
+            gc_wire_writer_init(&w, buf, sizeof(buf), 7, 0);
+            for (size_t i = 0; i < b.n; ++i) gc_wire_put(&w, b.e[i].id, b.e[i].value);
+            gc_sparse_merge_wire(&a, buf, gc_wire_finish(&w), 0, &grown);
+        }
+        for (size_t i = 0; i < b.n; ++i) gc_sparse_store_max(&ref, b.e[i].id, b.e[i].value);
+
+        uint64_t sum = 0;
+        for (size_t i = 0; i < a.n; ++i) {
+            sum += a.e[i].value;
+            if (i > 0 && a.e[i].id <= a.e[i - 1].id) return -1;
+        }
+        if (a.n != ref.n || memcmp(a.e, ref.e, a.n * sizeof(a.e[0])) != 0 ||
+            gc_sparse_value(&a) != sum || gc_sparse_value(&a) - before != grown) {
+            fprintf(stderr, "merge mismatch in round %d\n", round);
+            return -1;
+        }
+        gc_sparse_free(&a);
+        gc_sparse_free(&b);
+        gc_sparse_free(&ref);
+    }
+    return 0;
+}
+
+static void fill(gc_sparse *s, const uint64_t *ids, size_t n, uint64_t base) {
+    for (size_t i = 0; i < n; ++i) gc_sparse_store_max(s, ids[i], base + rng() % 1000);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench(const char *label, int sparse, size_t n) {
+    uint64_t *ids = malloc(n * sizeof(uint64_t) * 2);
+    for (size_t i = 0; i < 2 * n; ++i) ids[i] = sparse ? rng() : i;
+    if (sparse) qsort(ids, 2 * n, sizeof(uint64_t), cmp_u64); // 挿入を昇順にして構築を速く
+
+    gc_sparse base, upd, fresh;
+    gc_sparse_init(&base);
+    gc_sparse_init(&upd);
+    gc_sparse_init(&fresh);
+    fill(&base, ids, n, 1);
+    fill(&upd, ids, n, 2000);                       // 同じ ID でより大きい値
+    for (size_t i = 0; i < n; ++i) {                // 1 割を未知の ID に差し替え
+        uint64_t id = (i % 10 == 0) ? ids[n + i] : ids[i];
+        gc_sparse_store_max(&fresh, id, 5000 + i);
+    }
+
+    size_t cap = 16 + n * 20;
+    uint8_t *wire = malloc(cap);
+    gc_wire_writer w;
+    gc_wire_writer_init(&w, wire, cap, 1, 0);
+    for (size_t i = 0; i < upd.n; ++i) gc_wire_put(&w, upd.e[i].id, upd.e[i].value);
+    size_t wire_len = gc_wire_finish(&w);
+
+    long iters = (long)(2e7 / (double)n) + 1;
+    uint64_t grown;
+    gc_sparse work;
+
+    // 定常状態: 既知 ID だけ
+    double t = 0;
+    for (long it = 0; it < iters; ++it) {
+        gc_sparse_init(&work);
+        gc_sparse_merge(&work, &base, &grown);
+        double t0 = now_sec();
+        gc_sparse_merge(&work, &upd, &grown);
+        t += now_sec() - t0;
+        gc_sparse_free(&work);
+    }
+    double t_known = t / iters;
+
+    t = 0;
+    for (long it = 0; it < iters; ++it) {
+        gc_sparse_init(&work);
+        gc_sparse_merge(&work, &base, &grown);
+        double t0 = now_sec();
+        gc_sparse_merge(&work, &fresh, &grown);
+        t += now_sec() - t0;
+        gc_sparse_free(&work);
+    }
+    double t_fresh = t / iters;
+
+    t = 0;
+    for (long it = 0; it < iters; ++it) {
+        gc_sparse_init(&work);
+        gc_sparse_merge(&work, &base, &grown);
+        double t0 = now_sec();
+        gc_sparse_merge_wire(&work, wire, wire_len, 0, &grown);
+        t += now_sec() - t0;
+        gc_sparse_free(&work);
+    }
+    double t_wire = t / iters;
+
+    // 比較: 固定長の密な配列 (dense のときだけ意味がある)
+    double t_array = 0;
+    if (!sparse) {
+        uint64_t *a = calloc(n, sizeof(uint64_t)), *b = calloc(n, sizeof(uint64_t));
+        for (size_t i = 0; i < n; ++i) b[i] = upd.e[i].value;
+        double t0 = now_sec();
+        for (long it = 0; it < iters; ++it) gc_vec_max_u64(a, b, n);
+        t_array = (now_sec() - t0) / iters;
+        free(a);
+        free(b);
+    }
+
+    // メモリ: 作業領域込みで 1 度マージした後の状態
+    gc_sparse_init(&work);
+    gc_sparse_merge(&work, &base, &grown);
+    gc_sparse_merge(&work, &fresh, &grown);
+    double bytes_per = (double)gc_sparse_bytes(&work) / (double)work.n;
+
+    char array_col[32] = "n/a"; // ランダムな 64bit ID は配列にできない
+    if (!sparse) snprintf(array_col, sizeof(array_col), "%.2f", t_array * 1e9 / n);
+    printf("%-7s %7zu %11.1f %11.1f %11.1f %11s %10.1f\n", label, n, t_known * 1e9 / n, t_fresh * 1e9 / n,
+           t_wire * 1e9 / n, array_col, bytes_per);
+    gc_sparse_free(&work);
+    gc_sparse_free(&base);
+    gc_sparse_free(&upd);
+    gc_sparse_free(&fresh);
+    free(wire);
+    free(ids);
+}
+
+int main(void) {
+    if (check() < 0) {
+        fprintf(stderr, "FAIL\n");
+        return 1;
+    }
+    printf("merge-join matches per-entry store_max\n\n");
+    printf("%-7s %7s %11s %11s %11s %11s %10s\n", "ids", "n", "known ns/e", "+10% ns/e", "wire ns/e",
+           "array ns/e", "bytes/rep");
+    const size_t sizes[] = {256, 4096, 100000};
+    for (size_t i = 0; i < 3; ++i) bench("dense", 0, sizes[i]);
+    for (size_t i = 0; i < 3; ++i) bench("sparse", 1, sizes[i]);
+    printf("\n(ns/e = nanoseconds per entry merged; array = fixed uint64_t[n] with gc_vec_max_u64)\n");
+    return 0;
+}
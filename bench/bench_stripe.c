@@ -0,0 +1,101 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 自レプリカへの同時インクリメントのスケーリング (1〜64 スレッド)
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -pthread -I../common -o bench_stripe bench_stripe.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c
+//   $ ./bench_stripe [seconds_per_point]
+//
+//   mutex:   旧 gc_increment と同じく 1 本の mutex で values[replica_id] を増やす
+//   atomic:  1 個の atomic スロットへの fetch_add (全スレッドが同じライン)
+//   striped: gc_increment (スレッドごとのセルに足し、読むときに畳み込む)
+//   最後に、striped の合計が全スレッドのインクリメント数と一致することを確認する。
+// ------------------------------------------------------------
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "gc.h"
+
+#define MAX_THREADS 64
+
+enum { MODE_MUTEX, MODE_ATOMIC, MODE_STRIPED };
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long mutex_value;
+static gc_slot atomic_value;
+static GCounter gc;
+static atomic_int stop;
+static int mode;
+
+static void *worker(void *arg) {
+    long *ops = arg;
+    long n = 0;
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        for (int k = 0; k < 1024; ++k) {
+            switch (mode) {
+            case MODE_MUTEX:
+                pthread_mutex_lock(&lock);
+                mutex_value += 1;
+                pthread_mutex_unlock(&lock);
+                break;
+            case MODE_ATOMIC:
+                gc_slot_add(&atomic_value, 1);
+                break;
+            default:
+                gc_increment(&gc, 1);
+                break;
+            }
+        }
+        n += 1024;
+    }
+    *ops = n;
+    return NULL;
+}
+
+static double run(int m, int threads, double seconds, long *total) {
+    pthread_t tids[MAX_THREADS];
+    long ops[MAX_THREADS];
+    mode = m;
+    atomic_store(&stop, 0);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < threads; ++i) pthread_create(&tids[i], NULL, worker, &ops[i]);
+    struct timespec ts = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+    nanosleep(&ts, NULL);
+    atomic_store(&stop, 1);
+    *total = 0;
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(tids[i], NULL);
+        *total += ops[i];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return *total / ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9);
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 0.3;
+    gc_init(&gc, 0, 1);
+
+    long expected = 0, n;
+    printf("%-8s %14s %14s %14s\n", "threads", "mutex inc/s", "atomic inc/s", "striped inc/s");
+    for (int t = 1; t <= MAX_THREADS; t *= 2) {
+        double m = run(MODE_MUTEX, t, seconds, &n);
+        double a = run(MODE_ATOMIC, t, seconds, &n);
+        double s = run(MODE_STRIPED, t, seconds, &n);
+        expected += n;
+        printf("%-8d %14.0f %14.0f %14.0f\n", t, m, a, s);
+    }
+
+    unsigned long total = gc_total(&gc);
+    if (total != (unsigned long)expected) {
+        fprintf(stderr, "FAIL: striped total %lu != %ld increments\n", total, expected);
+        return 1;
+    }
+    printf("striped total = %lu matches increments\n", total);
+    gc_destroy(&gc);
+    return 0;
+}
@@ -0,0 +1,332 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// CRDT カウンタのベンチマークスイート (結果は JSON)
+// ------------------------------------------------------------
+// 使い方:
+//   $ (cd ../UDP_state-based_Gcounter && gcc -O2 -pthread -I../common -o UDPstate UDPstate.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c ../common/udp_batch.c ../common/evloop.c ../common/uring_net.c ../common/gossip.c ../common/gc_sync.c ../common/gc_persist.c ../common/gc_metrics.c ../common/gc_stage.c ../common/udp_shard.c ../common/gc_sched.c ../common/udp_mcast.c)
+//   $ gcc -O2 -pthread -I../common -o bench_suite bench_suite.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c ../common/gc_simd.c ../common/gc_shm.c
+//   $ ./bench_suite [--quick] [--out results.json] [--udpstate PATH]
+//
+// micro: 1 操作あたりの時間 (ns) を、レプリカ数ごとに測る
+//   - kekeho の pn_increment / pn_merge / pn_value / gcounter_merge_raw
+//     (レプリカ数はコンパイル時定数なので bench_suite_inst.h で 8 / 64 / 256 の
+//      3 通りを取り込む)
+//   - common/gc.c の gc_increment / gc_serialize / gc_merge_str / gc_merge_buf
+//     (replicas = 値を持っているスロット数)
+// macro: UDPstate を N 個 (2〜16) loopback で起動し (GC_INTERVAL_MS=100)、
+//   - 1 秒間、各レプリカに 10ms ごとに +1 を入れ続けたときの
+//     マージ (受信データグラム) / 秒と受信バイト / 秒
+//   - 全レプリカに +1 を BURST 回ずつ一度に入れてから、全員の合計が
+//     そろうまでの時間
+//   を測る。UDPstate の出力 ("[Recv] n bytes" と "total=") を読んで数える。
+//   UDPstate が見つからなければ macro は飛ばす ("skipped")。
+// JSON は stdout (--out があればそのファイル) に、経過は stderr に出す。
+// キーはリリース間で比べられるように変えないこと (schema を上げる)。
+// ------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gc.h"
+#include "gc_wire.h"
+
+#define SUITE_SCHEMA 1
+#define MIN_SEC 0.05          // 1 項目をこれ以上の時間くり返す
+#define MACRO_INTERVAL_MS 100 // UDPstate の送信間隔
+#define MACRO_LOAD_SEC 1.0
+#define MACRO_BURST 1000
+#define MACRO_TIMEOUT_SEC 10.0
+#define MACRO_MAX 16
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static volatile uint64_t sink; // 測定対象を最適化で消させない
+static FILE *out;
+static int first_row;
+static double min_sec = MIN_SEC;
+
+static void micro_row(const char *op, int replicas, double ns, uint64_t iters) {
+    fprintf(out, "%s\n    {\"op\": \"%s\", \"replicas\": %d, \"ns_per_op\": %.3f, \"ops_per_sec\": %.0f, \"iters\": %llu}",
+            first_row ? "" : ",", op, replicas, ns, 1e9 / ns, (unsigned long long)iters);
+    first_row = 0;
+    fprintf(stderr, "  %-20s %4d replicas %10.2f ns/op\n", op, replicas, ns);
+}
+
+// body を min_sec 以上かかるまで回数を倍にしながらくり返す (it_ が回数)
+#define MEASURE(op, replicas, body)                                                  \
+    do {                                                                             \
+        uint64_t iters_ = 1024;                                                      \
+        double t_;                                                                   \
+        for (;;) {                                                                   \
+            double t0_ = now_sec();                                                  \
+            for (uint64_t it_ = 0; it_ < iters_; ++it_) {                            \
+                body;                                                                \
+            }                                                                        \
+            t_ = now_sec() - t0_;                                                    \
+            if (t_ >= min_sec) break;                                                \
+            iters_ *= 2;                                                             \
+        }                                                                            \
+        micro_row(op, replicas, t_ * 1e9 / (double)iters_, iters_);                  \
+    } while (0)
+
+// kekeho の実装をレプリカ数ごとに取り込む
+#define SUITE_N 8
+#include "bench_suite_inst.h"
+#undef SUITE_N
+#define SUITE_N 64
+#include "bench_suite_inst.h"
+#undef SUITE_N
+#define SUITE_N 256
+#include "bench_suite_inst.h"
+#undef SUITE_N
+
+// -------------------- micro: common/gc.c --------------------
+
+static void suite_gc(int n) {
+    static GCounter gc;
+    static char buf[BUF_SIZE], text[BUF_SIZE], bin[BUF_SIZE];
+    gc_init(&gc, 0, 0);
+    // n 個のスロットに値を持たせた状態と、同じ内容のテキスト / バイナリ
+    size_t used = 0;
+    for (int i = 0; i < n; ++i) {
+        used += (size_t)snprintf(text + used, sizeof(text) - used, "%s%d=%d", i ? "," : "", i, 1000 + i);
+    }
+    gc_merge_str(&gc, text);
+    size_t bin_len = gc_serialize(&gc, bin, sizeof(bin));
+
+    MEASURE("gc_increment", n, gc_increment(&gc, 1));
+    MEASURE("gc_serialize", n, sink += gc_serialize(&gc, buf, sizeof(buf)));
+    MEASURE("gc_merge_str", n, gc_merge_str(&gc, text));
+    MEASURE("gc_merge_buf", n, sink += (uint64_t)gc_merge_buf(&gc, bin, bin_len));
+    sink += gc_total(&gc);
+    gc_destroy(&gc);
+}
+
+// -------------------- macro: UDPstate を loopback で --------------------
+
+typedef struct {
+    pid_t pid;
+    int in, out;          // 子の stdin / stdout
+    char line[512];
+    size_t len;
+    unsigned long total;  // 最後に表示した合計
+} child;
+
+typedef struct {
+    child c[MACRO_MAX];
+    int n;
+    unsigned long merges;
+    unsigned long long bytes;
+} cluster;
+
+static void on_line(cluster *cl, child *c, const char *line) {
+    unsigned long long b;
+    if (sscanf(line, "[Recv] %llu bytes", &b) == 1) {
+        cl->merges++;
+        cl->bytes += b;
+    }
+    const char *t = strstr(line, "total=");
+    if (t) c->total = strtoul(t + 6, NULL, 10);
+}
+
+// 子の出力を timeout 秒まで読む
+static void pump(cluster *cl, double timeout) {
+    struct pollfd pfd[MACRO_MAX];
+    for (int i = 0; i < cl->n; ++i) pfd[i] = (struct pollfd){.fd = cl->c[i].out, .events = POLLIN};
+    if (poll(pfd, (nfds_t)cl->n, (int)(timeout * 1000)) <= 0) return;
+    for (int i = 0; i < cl->n; ++i) {
+        if (!(pfd[i].revents & (POLLIN | POLLHUP))) continue;
+        child *c = &cl->c[i];
+        ssize_t r = read(c->out, c->line + c->len, sizeof(c->line) - 1 - c->len);
+        if (r <= 0) continue;
+        c->len += (size_t)r;
+        char *start = c->line, *nl;
+        while ((nl = memchr(start, '\n', c->len - (size_t)(start - c->line)))) {
+            *nl = '\0';
+            on_line(cl, c, start);
+            start = nl + 1;
+        }
+        c->len -= (size_t)(start - c->line);
+        memmove(c->line, start, c->len);
+        if (c->len == sizeof(c->line) - 1) c->len = 0; // 長すぎる行は捨てる
+    }
+}
+
+static int converged(const cluster *cl, unsigned long expect) {
+    for (int i = 0; i < cl->n; ++i) {
+        if (cl->c[i].total != expect) return 0;
+    }
+    return 1;
+}
+
+static void feed(cluster *cl, int times) {
+    static char ones[2 * MACRO_BURST];
+    for (int k = 0; k < times; ++k) memcpy(ones + 2 * k, "1\n", 2);
+    for (int i = 0; i < cl->n; ++i) {
+        if (write(cl->c[i].in, ones, (size_t)(2 * times)) < 0) perror("write");
+    }
+}
+
+static int start_cluster(cluster *cl, const char *path, int n, int base_port) {
+    memset(cl, 0, sizeof(*cl));
+    char interval[16];
+    snprintf(interval, sizeof(interval), "%d", MACRO_INTERVAL_MS);
+    for (int i = 0; i < n; ++i) {
+        int pin[2], pout[2];
+        if (pipe(pin) < 0 || pipe(pout) < 0) return -1;
+        pid_t pid = fork();
+        if (pid < 0) return -1;
+        if (pid == 0) {
+            dup2(pin[0], STDIN_FILENO);
+            dup2(pout[1], STDOUT_FILENO);
+            close(pin[0]);
+            close(pin[1]);
+            close(pout[0]);
+            close(pout[1]);
+            static char args[MACRO_MAX + 3][32];
+            char *argv[MACRO_MAX + 4];
+            int a = 0;
+            snprintf(args[a], 32, "UDPstate");
+            argv[a] = args[a], a++;
+            snprintf(args[a], 32, "%d", i);
+            argv[a] = args[a], a++;
+            snprintf(args[a], 32, "%d", base_port + i);
+            argv[a] = args[a], a++;
+            for (int j = 0; j < n; ++j) {
+                if (j == i) continue;
+                snprintf(args[a], 32, "127.0.0.1:%d", base_port + j);
+                argv[a] = args[a], a++;
+            }
+            argv[a] = NULL;
+            setenv("GC_INTERVAL_MS", interval, 1);
+            execv(path, argv);
+            _exit(127);
+        }
+        close(pin[0]);
+        close(pout[1]);
+        cl->c[i] = (child){.pid = pid, .in = pin[1], .out = pout[0]};
+        cl->n++;
+    }
+    return 0;
+}
+
+static void stop_cluster(cluster *cl) {
+    for (int i = 0; i < cl->n; ++i) {
+        kill(cl->c[i].pid, SIGTERM);
+        close(cl->c[i].in);
+    }
+    for (int i = 0; i < cl->n; ++i) {
+        waitpid(cl->c[i].pid, NULL, 0);
+        close(cl->c[i].out);
+    }
+}
+
+static int macro_run(const char *path, int n, int base_port, int first) {
+    cluster cl;
+    if (start_cluster(&cl, path, n, base_port) < 0) return -1;
+    double t = now_sec();
+    while (now_sec() - t < 0.3) pump(&cl, 0.05); // 全員が bind するまで
+
+    // 負荷をかけ続けたときのマージ数とバイト数
+    unsigned long expect = 0;
+    cl.merges = 0;
+    cl.bytes = 0;
+    double t0 = now_sec(), next = t0;
+    while ((t = now_sec()) - t0 < MACRO_LOAD_SEC) {
+        if (t >= next) {
+            feed(&cl, 1);
+            expect += (unsigned long)n;
+            next += 0.010;
+        }
+        pump(&cl, next - t > 0 ? next - t : 0);
+    }
+    double load_t = now_sec() - t0;
+    unsigned long merges = cl.merges;
+    unsigned long long bytes = cl.bytes;
+    t = now_sec();
+    while (!converged(&cl, expect) && now_sec() - t < MACRO_TIMEOUT_SEC) pump(&cl, 0.05);
+
+    // バーストから収束まで
+    feed(&cl, MACRO_BURST);
+    expect += (unsigned long)n * MACRO_BURST;
+    t0 = now_sec();
+    while (!converged(&cl, expect) && now_sec() - t0 < MACRO_TIMEOUT_SEC) pump(&cl, 0.01);
+    double conv = converged(&cl, expect) ? (now_sec() - t0) * 1e3 : -1;
+    stop_cluster(&cl);
+
+    fprintf(out, "%s\n    {\"scenario\": \"udpstate_loopback\", \"replicas\": %d, \"interval_ms\": %d, "
+                 "\"merges_per_sec\": %.1f, \"bytes_per_sec\": %.1f, \"burst\": %d, \"converge_ms\": %.1f}",
+            first ? "" : ",", n, MACRO_INTERVAL_MS, merges / load_t, bytes / load_t, MACRO_BURST, conv);
+    fprintf(stderr, "  udpstate x%-3d %8.1f merges/s %10.1f bytes/s  converge %.1f ms\n", n, merges / load_t,
+            bytes / load_t, conv);
+    return conv < 0 ? -1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *out_path = NULL, *udpstate = "../UDP_state-based_Gcounter/UDPstate";
+    int quick = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--quick") == 0) quick = 1;
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) out_path = argv[++i];
+        else if (strcmp(argv[i], "--udpstate") == 0 && i + 1 < argc) udpstate = argv[++i];
+        else {
+            fprintf(stderr, "Usage: %s [--quick] [--out FILE] [--udpstate PATH]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (quick) min_sec = MIN_SEC / 5;
+    out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN); // 落ちたレプリカへの書き込みで止まらない
+
+    char stamp[32];
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    fprintf(out, "{\n  \"suite\": \"crdt-counters\",\n  \"schema\": %d,\n  \"time\": \"%s\",\n", SUITE_SCHEMA, stamp);
+    fprintf(out, "  \"host\": {\"cpus\": %ld, \"compiler\": \"%s\"},\n", sysconf(_SC_NPROCESSORS_ONLN), __VERSION__);
+
+    fprintf(stderr, "micro\n");
+    fprintf(out, "  \"micro\": [");
+    first_row = 1;
+    suite_kekeho_8();
+    suite_kekeho_64();
+    suite_kekeho_256();
+    static const int gc_sizes[] = {8, 64, 256};
+    for (size_t i = 0; i < sizeof(gc_sizes) / sizeof(gc_sizes[0]); ++i) suite_gc(gc_sizes[i]);
+    fprintf(out, "\n  ],\n");
+
+    int fail = 0;
+    fprintf(stderr, "macro\n");
+    if (access(udpstate, X_OK) != 0) {
+        fprintf(stderr, "  %s: %s (skipped)\n", udpstate, strerror(errno));
+        fprintf(out, "  \"macro\": {\"skipped\": \"UDPstate not found\"}\n}\n");
+    } else {
+        fprintf(out, "  \"macro\": [");
+        static const int sizes[] = {2, 4, 8, 16};
+        int nsizes = quick ? 2 : (int)(sizeof(sizes) / sizeof(sizes[0]));
+        int base_port = 20000 + (int)(getpid() % 20000);
+        for (int i = 0; i < nsizes; ++i) {
+            fail |= macro_run(udpstate, sizes[i], base_port, i == 0) < 0;
+            base_port += MACRO_MAX;
+        }
+        fprintf(out, "\n  ]\n}\n");
+    }
+    if (out != stdout) fclose(out);
+    return fail;
+}
@@ -0,0 +1,77 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// bench_suite.c 用: kekeho の PN-Counter.c / gcounter.c をレプリカ数 SUITE_N で
+// 取り込み、マイクロベンチ suite_kekeho_<SUITE_N>() を作る
+// ------------------------------------------------------------
+// どちらもレプリカ数がコンパイル時定数 (MAX_REPLICAS / N_REPLICAS) なので、
+// 型と関数に _<SUITE_N> を付けた別名で何度でも取り込めるようにする
+// (インクルードガードはない。SUITE_N を変えて include し直すこと)。
+// common/gc.h の MAX_REPLICAS と GCounter は push_macro / 別名でよける。
+// ------------------------------------------------------------
+
+#define SUITE_CAT_(a, b) a##_##b
+#define SUITE_CAT(a, b) SUITE_CAT_(a, b)
+
+#pragma push_macro("MAX_REPLICAS")
+#undef MAX_REPLICAS
+#define MAX_REPLICAS SUITE_N
+#define N_REPLICAS SUITE_N
+#define PN_COUNTER_LIB
+#define GCOUNTER_LIB
+
+#define pn_counter SUITE_CAT(pn_counter, SUITE_N)
+#define pn_init SUITE_CAT(pn_init, SUITE_N)
+#define pn_increment SUITE_CAT(pn_increment, SUITE_N)
+#define pn_decrement SUITE_CAT(pn_decrement, SUITE_N)
+#define pn_merge SUITE_CAT(pn_merge, SUITE_N)
+#define pn_merge_batch SUITE_CAT(pn_merge_batch, SUITE_N)
+#define pn_value SUITE_CAT(pn_value, SUITE_N)
+#define pn_value_recompute SUITE_CAT(pn_value_recompute, SUITE_N)
+#define GCounter SUITE_CAT(kk_gcounter, SUITE_N)
+#define gcounter_inc SUITE_CAT(gcounter_inc, SUITE_N)
+#define gcounter_snapshot SUITE_CAT(gcounter_snapshot, SUITE_N)
+#define gcounter_merge_raw SUITE_CAT(gcounter_merge_raw, SUITE_N)
+#define gcounter_value SUITE_CAT(gcounter_value, SUITE_N)
+
+#include "../kekeho_CRDTcounter/PN-Counter.c"
+#include "../kekeho_CRDTcounter/gcounter.c"
+
+static void SUITE_CAT(suite_kekeho, SUITE_N)(void) {
+    static pn_counter a, b[8];
+    static GCounter g = {.id = 0};
+    static uint64_t snaps[8][SUITE_N];
+    pn_init(&a);
+    for (int k = 0; k < 8; ++k) {
+        pn_init(&b[k]);
+        for (uint32_t r = 0; r < SUITE_N; ++r) {
+            pn_increment(&b[k], r, (uint64_t)(k + 1) * (r + 1));
+            pn_decrement(&b[k], r, (uint64_t)k * r);
+            snaps[k][r] = (uint64_t)(k + 1) * (r + 1);
+        }
+    }
+
+    MEASURE("pn_increment", SUITE_N, pn_increment(&a, (uint32_t)(it_ % SUITE_N), 1));
+    MEASURE("pn_merge", SUITE_N, pn_merge(&a, &b[it_ & 7]));
+    MEASURE("pn_value", SUITE_N, sink += (uint64_t)pn_value(&a));
+    MEASURE("gcounter_merge_raw", SUITE_N, gcounter_merge_raw(&g, snaps[it_ & 7]));
+    sink += gcounter_value(&g);
+}
+
+#undef pn_counter
+#undef pn_init
+#undef pn_increment
+#undef pn_decrement
+#undef pn_merge
+#undef pn_merge_batch
+#undef pn_value
+#undef pn_value_recompute
+#undef GCounter
+#undef gcounter_inc
+#undef gcounter_snapshot
+#undef gcounter_merge_raw
+#undef gcounter_value
+#undef PN_COUNTER_LIB
+#undef GCOUNTER_LIB
+#undef N_REPLICAS
+#undef MAX_REPLICAS
+#pragma pop_macro("MAX_REPLICAS")
@@ -0,0 +1,290 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// tcp_link のスループット (loopback, 1 スレッドの evloop)
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -pthread -I../common -o bench_tcp bench_tcp.c ../common/tcp_link.c ../common/evloop.c ../common/pn_store.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c
+//   $ ./bench_tcp
+//
+// 同じループの中で tcp_dial した接続から tcp_listen した側へ流す。
+// (a) 100 バイトのフレームを 200 万個。1 フレームごとに flush する場合
+//     (パイプライン化しない) と、積めるだけ積んでから writev する場合
+//     (iov 1 個 / 64 個) で、フレーム / 秒と writev の回数を比べる。
+// (b) 100 万キーの pn_store を 64KB のフレームに詰めて流し、相手でマージする。
+//     キー / 秒・MB / 秒と、UDP (PN_STORE_MTU) で送った場合のデータグラム数を出す。
+// (c) extra に 5000 レプリカを持つ G‑Counter の全状態 (4096 バイトを超える) を
+//     1 フレームで送る。BUF_SIZE で直列化すると切り詰められることも示す。
+// 受信側の内容が送信側と一致しなければ exit 1。
+// ------------------------------------------------------------
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include "evloop.h"
+#include "gc.h"
+#include "gc_wire.h"
+#include "pn_store.h"
+#include "tcp_link.h"
+
+#define FRAMES 2000000
+#define FRAME_LEN 100
+#define PN_KEYS 1000000
+#define PN_FRAME (64u << 10)
+#define EXTRA_IDS 5000
+#define BUF_SIZE 4096 // UDPstate のバッファ
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// port 0 で待ち受けて、割り当てられたアドレスを返す
+static int listen_any(ev_loop *l, const tcp_handlers *h, void *arg, struct sockaddr_in *addr) {
+    int fd = tcp_listen(l, 0, h, arg);
+    socklen_t alen = sizeof(*addr);
+    if (fd < 0 || getsockname(fd, (struct sockaddr *)addr, &alen) < 0) return -1;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return 0;
+}
+
+// -------------------- (a) 小さいフレーム --------------------
+
+typedef struct {
+    ev_loop *l;
+    int flush_each; // 1 フレームごとに flush する (パイプライン化しない)
+    long sent, got, bad;
+} frames_ctx;
+
+static void frames_pump(tcp_conn *c, frames_ctx *x) {
+    char buf[FRAME_LEN];
+    memset(buf, 0xab, sizeof(buf));
+    while (x->sent < FRAMES) {
+        memcpy(buf, &x->sent, sizeof(x->sent));
+        if (tcp_conn_send(c, buf, sizeof(buf)) < 0) return; // 背圧: on_drain で再開
+        x->sent++;
+        if (x->flush_each) tcp_conn_flush(c);
+    }
+    tcp_conn_flush(c);
+}
+
+static void frames_state(tcp_conn *c, int up, void *arg) {
+    if (up) frames_pump(c, arg);
+}
+static void frames_drain(tcp_conn *c, void *arg) {
+    frames_pump(c, arg);
+}
+static void frames_recv(tcp_conn *c, const void *buf, size_t len, void *arg) {
+    (void)c;
+    frames_ctx *x = arg;
+    long seq;
+    memcpy(&seq, buf, sizeof(seq));
+    if (len != FRAME_LEN || seq != x->got) x->bad++;
+    if (++x->got == FRAMES) ev_stop(x->l);
+}
+
+static int bench_frames(const char *name, int flush_each, int iov_max) {
+    ev_loop *l = ev_new();
+    frames_ctx x = {l, flush_each, 0, 0, 0};
+    tcp_handlers rx = {frames_recv, NULL, NULL}, tx = {NULL, frames_state, frames_drain};
+    struct sockaddr_in addr;
+    if (!l || listen_any(l, &rx, &x, &addr) < 0) return -1;
+    tcp_conn *c = tcp_dial(l, &addr, &tx, &x);
+    if (!c) return -1;
+    tcp_conn_set_iov_max(c, iov_max);
+
+    double t0 = now_sec();
+    ev_run(l);
+    double t = now_sec() - t0;
+    const tcp_stats *st = tcp_conn_stats(c);
+    printf("  %-22s %7.2f M frames/s  %9lu writev (%.1f frames/call)\n", name,
+           x.got / t / 1e6, st->writev_calls, (double)x.got / (double)st->writev_calls);
+    tcp_conn_close(c);
+    ev_free(l);
+    return x.bad == 0 && x.got == FRAMES ? 0 : -1;
+}
+
+// -------------------- (b) pn_store のスナップショット --------------------
+
+typedef struct {
+    ev_loop *l;
+    pn_store *src, *dst;
+    uint8_t *buf;
+    size_t held; // 送れずに持っているフレームの長さ
+    int sent_end;
+    long frames, bad;
+    unsigned long long bytes;
+} snap_ctx;
+
+static void snap_pump(tcp_conn *c, snap_ctx *x) {
+    for (;;) {
+        if (x->held == 0) x->held = pn_store_pack_deltas(x->src, x->buf, PN_FRAME);
+        if (x->held == 0) break;
+        // 断られたら詰めたフレームを持ったまま on_drain を待つ
+        // (pack 済みのキーはもう dirty ではないので捨てられない)
+        if (tcp_conn_send(c, x->buf, x->held) < 0) return;
+        x->frames++;
+        x->bytes += x->held;
+        x->held = 0;
+    }
+    if (!x->sent_end && tcp_conn_send(c, "E", 1) == 0) x->sent_end = 1; // 終わりの印
+    tcp_conn_flush(c);
+}
+
+static void snap_state(tcp_conn *c, int up, void *arg) {
+    if (up) snap_pump(c, arg);
+}
+static void snap_drain(tcp_conn *c, void *arg) {
+    snap_pump(c, arg);
+}
+static void snap_recv(tcp_conn *c, const void *buf, size_t len, void *arg) {
+    (void)c;
+    snap_ctx *x = arg;
+    if (len == 1) {
+        ev_stop(x->l);
+        return;
+    }
+    if (pn_store_merge_packet(x->dst, buf, len) < 0) x->bad++;
+}
+
+typedef struct {
+    const pn_store *other;
+    long mismatch;
+} cmp_ctx;
+
+static int cmp_key(void *arg, const char *key, size_t klen, int64_t value) {
+    cmp_ctx *m = arg;
+    int found;
+    if (pn_store_get(m->other, key, klen, &found) != value || !found) m->mismatch++;
+    return 0;
+}
+
+static int bench_snapshot(void) {
+    snap_ctx x = {0};
+    x.l = ev_new();
+    x.src = pn_store_new(1);
+    x.dst = pn_store_new(2);
+    x.buf = malloc(PN_FRAME);
+    if (!x.l || !x.src || !x.dst || !x.buf) return -1;
+    char key[32];
+    for (long i = 0; i < PN_KEYS; ++i) {
+        int klen = snprintf(key, sizeof(key), "user:%ld", i);
+        int64_t d = (int64_t)(i % 1000) + 1;
+        pn_store_add(x.src, key, (size_t)klen, i & 1 ? -d : d);
+    }
+
+    tcp_handlers rx = {snap_recv, NULL, NULL}, tx = {NULL, snap_state, snap_drain};
+    struct sockaddr_in addr;
+    if (listen_any(x.l, &rx, &x, &addr) < 0) return -1;
+    tcp_conn *c = tcp_dial(x.l, &addr, &tx, &x);
+    if (!c) return -1;
+    double t0 = now_sec();
+    ev_run(x.l);
+    double t = now_sec() - t0;
+
+    cmp_ctx m = {x.dst, 0};
+    pn_store_foreach(x.src, cmp_key, &m);
+    int ok = x.bad == 0 && m.mismatch == 0 && pn_store_keys(x.dst) == PN_KEYS &&
+             pn_store_root(x.src) == pn_store_root(x.dst);
+
+    // 同じ内容を UDP 用に詰めたときのデータグラム数 (マージしたキーは dirty になっている)
+    long dgrams = 0;
+    while (pn_store_pack_deltas(x.dst, x.buf, PN_STORE_MTU) > 0) dgrams++;
+
+    printf("  %ld keys in %.3f s: %.2f M keys/s, %.1f MB/s, %ld frames (UDP: %ld datagrams)%s\n",
+           (long)PN_KEYS, t, PN_KEYS / t / 1e6, x.bytes / t / 1e6, x.frames, dgrams,
+           ok ? "" : "  MISMATCH");
+    tcp_conn_close(c);
+    ev_free(x.l);
+    pn_store_free(x.src);
+    pn_store_free(x.dst);
+    free(x.buf);
+    return ok ? 0 : -1;
+}
+
+// -------------------- (c) 大きい G‑Counter の全状態 --------------------
+
+typedef struct {
+    ev_loop *l;
+    GCounter *dst;
+    const char *msg;
+    size_t len;
+    int bad;
+} gc_ctx;
+
+static void gc_state(tcp_conn *c, int up, void *arg) {
+    gc_ctx *x = arg;
+    if (up && (tcp_conn_send(c, x->msg, x->len) < 0 || tcp_conn_flush(c) < 0)) {
+        x->bad++;
+        ev_stop(x->l);
+    }
+}
+
+static void gc_recv(tcp_conn *c, const void *buf, size_t len, void *arg) {
+    (void)c;
+    gc_ctx *x = arg;
+    if (gc_merge_buf(x->dst, buf, len) < 0) x->bad++;
+    ev_stop(x->l);
+}
+
+static int bench_gcounter(void) {
+    static GCounter src, dst;
+    if (gc_init(&src, 0, 1) < 0 || gc_init(&dst, 1, 1) < 0) return -1;
+    gc_increment(&src, 7);
+
+    // ID 1000.. のレプリカ 5000 個分を extra に入れる
+    size_t cap = GC_WIRE_HDR_MAX + EXTRA_IDS * 20;
+    char *msg = malloc(cap);
+    gc_wire_writer w;
+    if (!msg || gc_wire_writer_init(&w, msg, cap, 99, 0) < 0) return -1;
+    for (uint64_t i = 0; i < EXTRA_IDS; ++i) gc_wire_put(&w, 1000 + i * 3, 1 + i);
+    if (gc_merge_buf(&src, msg, gc_wire_finish(&w)) < 0) return -1;
+    free(msg);
+
+    char small[BUF_SIZE];
+    size_t small_len = gc_serialize(&src, small, sizeof(small));
+    cap = gc_serialize_bound(&src);
+    msg = malloc(cap);
+    size_t len = msg ? gc_serialize(&src, msg, cap) : 0;
+
+    ev_loop *l = ev_new();
+    gc_ctx x = {l, &dst, msg, len, 0};
+    tcp_handlers rx = {gc_recv, NULL, NULL}, tx = {NULL, gc_state, NULL};
+    struct sockaddr_in addr;
+    if (!l || !msg || listen_any(l, &rx, &x, &addr) < 0) return -1;
+    tcp_conn *c = tcp_dial(l, &addr, &tx, &x);
+    if (!c) return -1;
+    ev_run(l);
+
+    int ok = x.bad == 0 && gc_total(&dst) == gc_total(&src);
+    printf("  full state %zu bytes (BUF_SIZE gives %zu bytes), total %lu -> %lu%s\n", len,
+           small_len, gc_total(&src), gc_total(&dst), ok ? "" : "  MISMATCH");
+    tcp_conn_close(c);
+    ev_free(l);
+    free(msg);
+    gc_destroy(&src);
+    gc_destroy(&dst);
+    return ok ? 0 : -1;
+}
+
+int main(void) {
+    int fail = 0;
+    printf("(a) %d frames of %d bytes\n", FRAMES, FRAME_LEN);
+    fail |= bench_frames("flush every frame", 1, 64) < 0;
+    fail |= bench_frames("pipelined, iov 1", 0, 1) < 0;
+    fail |= bench_frames("pipelined, iov 64", 0, 64) < 0;
+    printf("(b) pn_store snapshot in %u KB frames\n", PN_FRAME >> 10);
+    fail |= bench_snapshot() < 0;
+    printf("(c) G-Counter with %d extra replicas\n", EXTRA_IDS);
+    fail |= bench_gcounter() < 0;
+    if (fail) {
+        printf("FAILED\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,151 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 差分で維持している合計値 (GCounter.total / pn_counter.sum_*) の検算とコスト
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -pthread -I../common -o bench_total bench_total.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c ../common/gc_simd.c
+//   $ ./bench_total [seconds]
+//
+//   1. GCounter: マージ用スレッド 2 本 + インクリメント用 2 本を走らせ、
+//      読み手は gc_total が減らないことを確認する。止めた後に
+//      gc_total と全スロットの足し直し (gc_total_recompute) が一致することを確認する。
+//   2. pn_counter: ランダムな増減とマージ (単体 / batch) のたびに
+//      pn_value と pn_value_recompute が一致することを確認する。
+//   3. gc_total と全スロット足し直しの 1 回あたりの時間を比べる。
+// ------------------------------------------------------------
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "gc.h"
+#include "gc_wire.h"
+
+#define PN_COUNTER_LIB
+#include "../kekeho_CRDTcounter/PN-Counter.c"
+
+static GCounter gc;
+static atomic_int stop;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline uint64_t xorshift(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+// 他レプリカの状態を少しずつ進めながら、新旧混ぜてマージする
+static void *merger(void *arg) {
+    uint64_t seed = (uint64_t)(uintptr_t)arg;
+    unsigned long state[MAX_REPLICAS] = {0};
+    char buf[BUF_SIZE];
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        for (int k = 0; k < 8; ++k) {
+            int id = 1 + (int)(xorshift(&seed) % (MAX_REPLICAS - 1));
+            state[id] += xorshift(&seed) % 50;
+        }
+        size_t len = gc_wire_encode(buf, sizeof(buf), 1, 0, state, MAX_REPLICAS);
+        gc_merge_buf(&gc, buf, len);
+    }
+    return NULL;
+}
+
+static void *incrementer(void *arg) {
+    (void)arg;
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        for (int k = 0; k < 64; ++k) gc_increment(&gc, 3);
+    }
+    return NULL;
+}
+
+static void *reader(void *arg) {
+    long *regressions = arg;
+    unsigned long last = 0;
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        unsigned long t = gc_total(&gc);
+        if (t < last) (*regressions)++;
+        last = t;
+    }
+    return NULL;
+}
+
+static int check_gcounter(double seconds) {
+    pthread_t tids[5];
+    long regressions = 0;
+    gc_init(&gc, 0, 2);
+    pthread_create(&tids[0], NULL, merger, (void *)(uintptr_t)0x1234567);
+    pthread_create(&tids[1], NULL, merger, (void *)(uintptr_t)0x89abcdef);
+    pthread_create(&tids[2], NULL, incrementer, NULL);
+    pthread_create(&tids[3], NULL, incrementer, NULL);
+    pthread_create(&tids[4], NULL, reader, &regressions);
+
+    // 走らせている間は読み手が単調性を見て、最後に静止状態で検算する
+    struct timespec ts = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+    nanosleep(&ts, NULL);
+    atomic_store(&stop, 1);
+    for (int i = 0; i < 5; ++i) pthread_join(tids[i], NULL);
+
+    unsigned long cached = gc_total(&gc), full = gc_total_recompute(&gc);
+    printf("gcounter: cached=%lu recomputed=%lu reader regressions=%ld\n", cached, full, regressions);
+    return cached == full && regressions == 0 ? 0 : -1;
+}
+
+static int check_pn(int rounds) {
+    enum { N = 4 };
+    pn_counter c[N];
+    uint64_t seed = 42;
+    for (int i = 0; i < N; ++i) pn_init(&c[i]);
+    for (int r = 0; r < rounds; ++r) {
+        int i = (int)(xorshift(&seed) % N);
+        uint32_t rep = (uint32_t)(xorshift(&seed) % MAX_REPLICAS);
+        switch (xorshift(&seed) % 4) {
+        case 0: pn_increment(&c[i], rep, xorshift(&seed) % 100); break;
+        case 1: pn_decrement(&c[i], rep, xorshift(&seed) % 100); break;
+        case 2: pn_merge(&c[i], &c[(i + 1) % N]); break;
+        default: {
+            const pn_counter *others[N - 1];
+            for (int j = 1; j < N; ++j) others[j - 1] = &c[(i + j) % N];
+            pn_merge_batch(&c[i], others, N - 1);
+        }
+        }
+        if (pn_value(&c[i]) != pn_value_recompute(&c[i])) {
+            fprintf(stderr, "pn: cached value diverged at round %d\n", r);
+            return -1;
+        }
+    }
+    printf("pn_counter: %d random ops, cached value always equal to recomputation\n", rounds);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+    if (check_gcounter(seconds) < 0 || check_pn(200000) < 0) {
+        fprintf(stderr, "FAIL\n");
+        return 1;
+    }
+
+    // 読み出しコスト
+    volatile unsigned long sink = 0;
+    long iters = 2000000;
+    double t0 = now_sec();
+    for (long i = 0; i < iters; ++i) sink += gc_total(&gc);
+    double t_cached = now_sec() - t0;
+    t0 = now_sec();
+    for (long i = 0; i < iters; ++i) sink += gc_total_recompute(&gc);
+    double t_full = now_sec() - t0;
+    printf("\n%-22s %10s\n", "read path", "ns/call");
+    printf("%-22s %10.1f\n", "gc_total (cached)", t_cached * 1e9 / iters);
+    printf("%-22s %10.1f\n", "re-sum 256 slots", t_full * 1e9 / iters);
+    (void)sink;
+    gc_destroy(&gc);
+    return 0;
+}
@@ -0,0 +1,216 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 値が変わるのを待つ側: ループで読むのと gc_wait_change / gc_watch_fd の比較
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -pthread -I../common -o bench_watch bench_watch.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c
+//   $ ./bench_watch [events]
+//
+// 書き手は GAP_US だけ休んでは gc_increment(1) をくり返す (events 回)。
+// 見張る側 1 本は次のどれかで変更を待つ。
+//   spin    : gc_total をループで読む (kekeho_CRDTcounter/thread_2.c の以前の reader)
+//   futex   : gc_wait_change
+//   eventfd : gc_watch_fd を epoll_wait で待ち、gc_watch_fd_consume
+// 出すもの:
+//   wake p50 / p99 : 書き手が増やす直前から、見張る側が新しい値を読むまで (us)
+//   cpu/wall       : 見張る側のスレッド CPU 時間 (CLOCK_THREAD_CPUTIME_ID) / 経過時間
+//   missed         : 見張る側が見落とした (まとめて読んだ) 変更の数
+// 最後に、見張る人 0 本 / 1 本 (gc_wait_at_least で届かない値を待つ) /
+// eventfd 1 本のときの gc_increment 1 回の時間 (ns) を出す。
+// 1 コアの環境では spin が書き手と CPU を取り合うので、wake も書き手も遅くなる。
+// ------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gc.h"
+
+#define GAP_US 500          // 書き手が変更の間に休む時間
+#define COST_OPS 2000000    // gc_increment の時間を測る回数
+
+enum { SPIN, FUTEX, EVFD };
+static const char *mode_name[] = {"spin", "futex", "eventfd"};
+
+typedef struct {
+    GCounter *gc;
+    int mode;
+    int events;
+    _Atomic uint64_t *stamp; // stamp[k]: k 回目の変更の直前の時刻 (ns)
+    uint32_t *lat;           // 見張る側が読んだ値ごとの遅延 (ns)
+    int nlat;
+    double cpu_sec, wall_sec;
+} watcher;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static double thread_cpu_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// 新しい値 val を読んだ時刻 t を記録する (val 回目の変更の遅延)
+static void record(watcher *w, unsigned long val, uint64_t t) {
+    uint64_t s = atomic_load_explicit(&w->stamp[val], memory_order_acquire);
+    uint64_t dt = t > s ? t - s : 0;
+    w->lat[w->nlat++] = dt > UINT32_MAX ? UINT32_MAX : (uint32_t)dt;
+}
+
+static void *watcher_main(void *arg) {
+    watcher *w = arg;
+    unsigned long seen = 0, target = (unsigned long)w->events;
+    int ep = -1, fd = -1;
+    if (w->mode == EVFD) {
+        fd = gc_watch_fd(w->gc);
+        ep = epoll_create1(EPOLL_CLOEXEC);
+        struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+        if (fd < 0 || ep < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("eventfd");
+            exit(1);
+        }
+    }
+    double c0 = thread_cpu_sec();
+    uint64_t t0 = now_ns();
+    while (seen < target) {
+        unsigned long val = seen;
+        switch (w->mode) {
+        case SPIN:
+            while ((val = gc_total(w->gc)) == seen) {
+            }
+            break;
+        case FUTEX:
+            gc_wait_change(w->gc, &val, -1);
+            break;
+        case EVFD: {
+            struct epoll_event ev;
+            if (epoll_wait(ep, &ev, 1, -1) < 1) continue;
+            val = gc_watch_fd_consume(w->gc, fd);
+            break;
+        }
+        }
+        if (val == seen) continue;
+        record(w, val, now_ns());
+        seen = val;
+    }
+    w->wall_sec = (now_ns() - t0) / 1e9;
+    w->cpu_sec = thread_cpu_sec() - c0;
+    if (w->mode == EVFD) {
+        gc_unwatch_fd(w->gc, fd);
+        close(ep);
+    }
+    return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int run_wake(int mode, int events) {
+    static GCounter gc;
+    if (gc_init(&gc, 0, 0) < 0) return -1;
+    _Atomic uint64_t *stamp = calloc((size_t)events + 1, sizeof(*stamp));
+    uint32_t *lat = calloc((size_t)events, sizeof(*lat));
+    if (!stamp || !lat) return -1;
+    watcher w = {.gc = &gc, .mode = mode, .events = events, .stamp = stamp, .lat = lat};
+    pthread_t t;
+    pthread_create(&t, NULL, watcher_main, &w);
+    usleep(10000); // 見張る側が待ち始めるまで
+    for (int k = 1; k <= events; ++k) {
+        usleep(GAP_US);
+        atomic_store_explicit(&stamp[k], now_ns(), memory_order_release);
+        gc_increment(&gc, 1);
+    }
+    pthread_join(t, NULL);
+
+    qsort(lat, (size_t)w.nlat, sizeof(lat[0]), cmp_u32);
+    printf("%-8s %10.1f %10.1f %10.1f%% %8d\n", mode_name[mode], lat[w.nlat / 2] / 1e3,
+           lat[(size_t)w.nlat * 99 / 100] / 1e3, 100.0 * w.cpu_sec / w.wall_sec, events - w.nlat);
+    fflush(stdout);
+    free(stamp);
+    free(lat);
+    int ok = gc_total(&gc) == (unsigned long)events;
+    gc_destroy(&gc);
+    return ok ? 0 : 1;
+}
+
+typedef struct {
+    GCounter *gc;
+    _Atomic int *stop;
+} idle_watcher;
+
+// 届かない値を待ち続ける (合計が閾値に届くまで起こされない。10 ms ごとに時間切れで眠り直す)
+static void *idle_main(void *arg) {
+    idle_watcher *iw = arg;
+    unsigned long total;
+    while (!atomic_load_explicit(iw->stop, memory_order_relaxed)) {
+        gc_wait_at_least(iw->gc, ~0UL, &total, 10);
+    }
+    return NULL;
+}
+
+static double increment_ns(int watchers) {
+    static GCounter gc;
+    if (gc_init(&gc, 0, 0) < 0) return -1;
+    _Atomic int stop = 0;
+    idle_watcher iw = {.gc = &gc, .stop = &stop};
+    pthread_t t;
+    int fd = -1;
+    if (watchers == 1) {
+        pthread_create(&t, NULL, idle_main, &iw);
+        usleep(10000);
+    } else if (watchers == 2) {
+        fd = gc_watch_fd(&gc); // 読まないので、書くのは最初の 1 回だけ
+    }
+    uint64_t t0 = now_ns();
+    for (int k = 0; k < COST_OPS; ++k) gc_increment(&gc, 1);
+    double ns = (double)(now_ns() - t0) / COST_OPS;
+    atomic_store(&stop, 1);
+    if (watchers == 1) pthread_join(t, NULL);
+    if (fd >= 0) gc_unwatch_fd(&gc, fd);
+    int ok = gc_total(&gc) == COST_OPS;
+    gc_destroy(&gc);
+    return ok ? ns : -1;
+}
+
+int main(int argc, char *argv[]) {
+    int events = argc > 1 ? atoi(argv[1]) : 2000;
+    if (events < 1) events = 1;
+    printf("%ld CPUs, %d changes, %d us apart\n", sysconf(_SC_NPROCESSORS_ONLN), events, GAP_US);
+    printf("%-8s %10s %10s %11s %8s\n", "mode", "wake p50", "wake p99", "cpu/wall", "missed");
+    printf("%-8s %10s %10s %11s %8s\n", "", "(us)", "(us)", "", "");
+    int fail = 0;
+    for (int mode = SPIN; mode <= EVFD; ++mode) {
+        int rc = run_wake(mode, events);
+        if (rc < 0) {
+            perror("run");
+            return 1;
+        }
+        fail |= rc;
+    }
+    static const char *cost_name[] = {"none", "futex", "eventfd"};
+    printf("\ngc_increment with watchers (%d ops)\n", COST_OPS);
+    printf("%-8s %10s\n", "watcher", "ns/op");
+    for (int watchers = 0; watchers <= 2; ++watchers) {
+        double ns = increment_ns(watchers);
+        if (ns < 0) {
+            fprintf(stderr, "FAIL: total drifted (%s)\n", cost_name[watchers]);
+            fail = 1;
+            continue;
+        }
+        printf("%-8s %10.1f\n", cost_name[watchers], ns);
+    }
+    return fail;
+}
@@ -0,0 +1,170 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// G‑Counter ワイヤフォーマットの検証 & パース性能ベンチ
+// ------------------------------------------------------------
+// 使い方:
+//   $ gcc -O2 -pthread -I../common -o bench_wire bench_wire.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c
+//   $ ./bench_wire [iterations]
+//
+//   1. ランダムな状態ベクタでバイナリ形式の往復 (encode → decode) を確認
+//   2. ランダムに壊したバイト列をデコードしても範囲外アクセスしないことを確認
+//   3. 256 レプリカ全部が埋まった状態で、テキスト形式 (gc_merge_str) と
+//      バイナリ形式 (gc_merge_buf) のマージ速度・サイズを比較
+// ------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gc.h"
+#include "gc_wire.h"
+
+static uint64_t rng_state = 88172645463325252ULL;
+static uint64_t rng(void) { // xorshift64
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void random_values(unsigned long *v, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        switch (rng() % 4) {
+        case 0: v[i] = 0; break;
+        case 1: v[i] = rng() % 128; break;
+        case 2: v[i] = rng() % 1000000; break;
+        default: v[i] = (unsigned long)rng(); break;
+        }
+    }
+}
+
+static int check_roundtrip(int rounds) {
+    uint8_t buf[BUF_SIZE * 2];
+    unsigned long in[MAX_REPLICAS], out[MAX_REPLICAS];
+    for (int r = 0; r < rounds; ++r) {
+        random_values(in, MAX_REPLICAS);
+        uint64_t sender = rng() % MAX_REPLICAS;
+        size_t len = gc_wire_encode(buf, sizeof(buf), sender, 0, in, MAX_REPLICAS);
+
+        gc_wire_reader rd;
+        gc_wire_header hdr;
+        if (gc_wire_reader_init(&rd, buf, len, &hdr) < 0 || hdr.sender != sender) {
+            fprintf(stderr, "roundtrip: bad header (round %d)\n", r);
+            return -1;
+        }
+        memset(out, 0, sizeof(out));
+        uint64_t id, val;
+        int rc;
+        while ((rc = gc_wire_next(&rd, &id, &val)) > 0) {
+            if (id >= MAX_REPLICAS) {
+                fprintf(stderr, "roundtrip: id %llu out of range\n", (unsigned long long)id);
+                return -1;
+            }
+            out[id] = val;
+        }
+        if (rc < 0 || memcmp(in, out, sizeof(in)) != 0) {
+            fprintf(stderr, "roundtrip: mismatch (round %d)\n", r);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 壊れた入力に対してデコーダが [buf, buf+len) の外を読まないこと
+static int check_fuzz(int rounds) {
+    uint8_t buf[BUF_SIZE];
+    unsigned long v[MAX_REPLICAS];
+    long accepted = 0, rejected = 0;
+    for (int r = 0; r < rounds; ++r) {
+        random_values(v, MAX_REPLICAS);
+        size_t len = gc_wire_encode(buf, sizeof(buf), rng() % 1000, 0, v, MAX_REPLICAS);
+        int mutations = 1 + (int)(rng() % 8);
+        for (int m = 0; m < mutations; ++m) {
+            buf[rng() % len] ^= (uint8_t)(1u << (rng() % 8));
+        }
+        len = 1 + rng() % len; // 途中で切る
+
+        // ちょうど len バイトの領域にコピーして、はみ出し読みを ASan で検出できるようにする
+        uint8_t *exact = malloc(len);
+        memcpy(exact, buf, len);
+        gc_wire_reader rd;
+        int rc = -1;
+        if (gc_wire_reader_init(&rd, exact, len, NULL) == 0) {
+            uint64_t id, val, prev = 0;
+            int first = 1;
+            while ((rc = gc_wire_next(&rd, &id, &val)) > 0) {
+                if (!first && id <= prev) {
+                    fprintf(stderr, "fuzz: ids not ascending\n");
+                    free(exact);
+                    return -1;
+                }
+                prev = id;
+                first = 0;
+            }
+        }
+        if (rc == 0) accepted++; else rejected++;
+
+        static GCounter gc;
+        gc_init(&gc, 0, 0);
+        gc_merge_buf(&gc, exact, len); // テキスト扱いになる場合も含めて落ちないこと
+        gc_destroy(&gc);
+        free(exact);
+    }
+    printf("fuzz: %d inputs, %ld decoded cleanly, %ld rejected\n", rounds, accepted, rejected);
+    return 0;
+}
+
+static void bench_parse(long iters) {
+    static GCounter src, dst;
+    unsigned long values[MAX_REPLICAS];
+    gc_init(&src, 0, 0);
+    for (int i = 0; i < MAX_REPLICAS; ++i) {
+        values[i] = 1000000 + (unsigned long)(rng() % 100000000);
+    }
+
+    char text[BUF_SIZE * 2];
+    char bin[BUF_SIZE];
+    size_t bin_len = gc_wire_encode(bin, sizeof(bin), 0, 0, values, MAX_REPLICAS);
+    gc_merge_buf(&src, bin, bin_len);
+    size_t text_len = gc_serialize_text(&src, text, sizeof(text));
+
+    gc_init(&dst, 1, 0);
+
+    double t0 = now_sec();
+    for (long i = 0; i < iters; ++i) {
+        gc_merge_str(&dst, text);
+    }
+    double t_text = now_sec() - t0;
+
+    gc_init(&dst, 1, 0);
+    t0 = now_sec();
+    for (long i = 0; i < iters; ++i) {
+        gc_merge_buf(&dst, bin, bin_len);
+    }
+    double t_bin = now_sec() - t0;
+
+    printf("%-8s %8s %14s %12s\n", "format", "bytes", "merges/sec", "ns/merge");
+    printf("%-8s %8zu %14.0f %12.1f\n", "text", text_len, iters / t_text, t_text * 1e9 / iters);
+    printf("%-8s %8zu %14.0f %12.1f\n", "binary", bin_len, iters / t_bin, t_bin * 1e9 / iters);
+    if (text_len >= BUF_SIZE - 1) {
+        printf("(note: text state exceeds BUF_SIZE=%d and is truncated on the wire)\n", BUF_SIZE);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    long iters = argc > 1 ? atol(argv[1]) : 20000;
+
+    if (check_roundtrip(10000) < 0) return 1;
+    printf("roundtrip: ok\n");
+    if (check_fuzz(100000) < 0) return 1;
+    bench_parse(iters);
+    return 0;
+}
@@ -0,0 +1,253 @@
+// -*- coding: utf-8 -*-
+// epoll + timerfd のイベントループ (説明は evloop.h)
+
+#define _GNU_SOURCE
+#include "evloop.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#define EV_MAX_EVENTS 64
+
+typedef struct {
+    int fd;          // -1 = 空き
+    int is_timer;
+    ev_io_fn io;
+    ev_timer_fn timer;
+    void *arg;
+    int parked;      // 処理中のバッチで消された。バッチが終わるまで再利用しない
+} ev_handler;
+
+struct ev_loop {
+    int epfd;
+    int running;
+    ev_handler *h; // epoll_event.data.u32 はこの添字
+    int nh, cap;
+    int in_batch;  // ev_run が epoll_wait の結果を配っている最中
+    int nparked;   // parked の立っている h の数
+};
+
+ev_loop *ev_new(void) {
+    ev_loop *l = calloc(1, sizeof(*l));
+    if (!l) return NULL;
+    l->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (l->epfd < 0) {
+        free(l);
+        return NULL;
+    }
+    return l;
+}
+
+void ev_free(ev_loop *l) {
+    if (!l) return;
+    for (int i = 0; i < l->nh; i++)
+        if (l->h[i].fd >= 0 && l->h[i].is_timer) close(l->h[i].fd);
+    close(l->epfd);
+    free(l->h);
+    free(l);
+}
+
+static int slot_new(ev_loop *l) {
+    for (int i = 0; i < l->nh; i++)
+        if (l->h[i].fd < 0 && !l->h[i].parked) return i;
+    if (l->nh == l->cap) {
+        int ncap = l->cap ? l->cap * 2 : 8;
+        ev_handler *p = realloc(l->h, (size_t)ncap * sizeof(*p));
+        if (!p) return -1;
+        l->h = p;
+        l->cap = ncap;
+    }
+    l->h[l->nh].fd = -1;
+    l->h[l->nh].parked = 0;
+    return l->nh++;
+}
+
+// 登録を消す。同じ epoll_wait の残りのイベントはまだこの添字を指しているので、
+// バッチの途中なら空きにせず預けておく (すぐ使い回すと新しいハンドラに届いてしまう)
+static void slot_free(ev_loop *l, int i) {
+    l->h[i].fd = -1;
+    if (l->in_batch) {
+        l->h[i].parked = 1;
+        l->nparked++;
+    }
+}
+
+static void slot_unpark(ev_loop *l) {
+    for (int i = 0; i < l->nh && l->nparked; i++)
+        if (l->h[i].parked) {
+            l->h[i].parked = 0;
+            l->nparked--;
+        }
+}
+
+static int slot_of(const ev_loop *l, int fd) {
+    for (int i = 0; i < l->nh; i++)
+        if (l->h[i].fd == fd) return i;
+    return -1;
+}
+
+static int watch(ev_loop *l, int i, int op, uint32_t events) {
+    struct epoll_event ev = {.events = events, .data.u32 = (uint32_t)i};
+    return epoll_ctl(l->epfd, op, l->h[i].fd, &ev);
+}
+
+int ev_add_fd(ev_loop *l, int fd, uint32_t events, ev_io_fn cb, void *arg) {
+    int i = slot_new(l);
+    if (i < 0) return -1;
+    l->h[i] = (ev_handler){fd, 0, cb, NULL, arg};
+    if (watch(l, i, EPOLL_CTL_ADD, events) < 0) {
+        l->h[i].fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int ev_mod_fd(ev_loop *l, int fd, uint32_t events) {
+    int i = slot_of(l, fd);
+    if (i < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    return watch(l, i, EPOLL_CTL_MOD, events);
+}
+
+int ev_del_fd(ev_loop *l, int fd) {
+    int i = slot_of(l, fd);
+    if (i < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    epoll_ctl(l->epfd, EPOLL_CTL_DEL, fd, NULL);
+    slot_free(l, i); // 同じ epoll_wait の残りのイベントは ev_run が fd < 0 を見て捨てる
+    return 0;
+}
+
+int ev_set_timer(ev_loop *l, int timer, uint64_t interval_ms) {
+    if (timer < 0 || timer >= l->nh || !l->h[timer].is_timer || l->h[timer].fd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    struct itimerspec its = {0};
+    its.it_interval.tv_sec = (time_t)(interval_ms / 1000);
+    its.it_interval.tv_nsec = (long)(interval_ms % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+    return timerfd_settime(l->h[timer].fd, 0, &its, NULL);
+}
+
+int ev_del_timer(ev_loop *l, int timer) {
+    if (timer < 0 || timer >= l->nh || !l->h[timer].is_timer || l->h[timer].fd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    epoll_ctl(l->epfd, EPOLL_CTL_DEL, l->h[timer].fd, NULL);
+    close(l->h[timer].fd);
+    slot_free(l, timer);
+    return 0;
+}
+
+int ev_add_timer(ev_loop *l, uint64_t interval_ms, ev_timer_fn cb, void *arg) {
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd < 0) return -1;
+    int i = slot_new(l);
+    if (i < 0) {
+        close(tfd);
+        return -1;
+    }
+    l->h[i] = (ev_handler){tfd, 1, NULL, cb, arg};
+    if (watch(l, i, EPOLL_CTL_ADD, EPOLLIN) < 0 || ev_set_timer(l, i, interval_ms) < 0) {
+        close(tfd);
+        l->h[i].fd = -1;
+        return -1;
+    }
+    return i;
+}
+
+int ev_run(ev_loop *l) {
+    struct epoll_event evs[EV_MAX_EVENTS];
+    l->running = 1;
+    while (l->running) {
+        int n = epoll_wait(l->epfd, evs, EV_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        l->in_batch = 1;
+        for (int k = 0; k < n && l->running; k++) {
+            int i = (int)evs[k].data.u32;
+            // コールバック中に登録が変わって h が動くことがあるので毎回引き直す
+            if (i >= l->nh || l->h[i].fd < 0) continue;
+            ev_handler h = l->h[i];
+            if (h.is_timer) {
+                uint64_t exp;
+                if (read(h.fd, &exp, sizeof(exp)) != sizeof(exp)) continue; // EAGAIN: 設定し直された
+                h.timer(l, exp, h.arg);
+            } else {
+                h.io(l, h.fd, evs[k].events, h.arg);
+            }
+        }
+        l->in_batch = 0;
+        slot_unpark(l);
+    }
+    return 0;
+}
+
+void ev_stop(ev_loop *l) {
+    l->running = 0;
+}
+
+int ev_read_lines(int fd, ev_linebuf *lb, void (*cb)(const char *line, void *arg), void *arg) {
+    for (;;) {
+        ssize_t r = read(fd, lb->buf + lb->len, sizeof(lb->buf) - 1 - lb->len);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        if (r == 0) {
+            if (lb->len) {
+                lb->buf[lb->len] = '\0';
+                lb->len = 0;
+                cb(lb->buf, arg);
+            }
+            return 1;
+        }
+        lb->len += (size_t)r;
+        size_t start = 0;
+        for (size_t i = 0; i < lb->len; i++) {
+            if (lb->buf[i] != '\n') continue;
+            lb->buf[i] = '\0';
+            cb(lb->buf + start, arg);
+            start = i + 1;
+        }
+        memmove(lb->buf, lb->buf + start, lb->len - start);
+        lb->len -= start;
+        if (lb->len == sizeof(lb->buf) - 1) { // 改行のない長い行は切って渡す
+            lb->buf[lb->len] = '\0';
+            lb->len = 0;
+            cb(lb->buf, arg);
+        }
+    }
+}
+
+int ev_set_nonblock(int fd) {
+    int fl = fcntl(fd, F_GETFL);
+    if (fl < 0) return -1;
+    return fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+}
+
+int ev_pin_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc) {
+        errno = rc;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// epoll + timerfd による単一スレッドのイベントループ
+// ------------------------------------------------------------
+// fd (ソケット・標準入力など) の読み書き可能と、周期タイマを 1 本の
+// epoll_wait で待つ。コールバックはすべてループを回しているスレッドで呼ばれる
+// ので、ループが持つ状態にはロックがいらない。
+//
+// ループはグローバルな状態を持たないので、N コアで N 個のループを
+// それぞれのスレッドで回せる (ev_pin_cpu でコアに固定し、ソケットは
+// SO_REUSEPORT で分けるなど、ループ間で fd や状態を共有しないこと)。
+// ------------------------------------------------------------
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+typedef struct ev_loop ev_loop;
+
+// fd が events (EPOLLIN など) になったとき
+typedef void (*ev_io_fn)(ev_loop *l, int fd, uint32_t events, void *arg);
+// タイマが満了したとき。expirations は前回から満了した回数 (遅れると 2 以上)
+typedef void (*ev_timer_fn)(ev_loop *l, uint64_t expirations, void *arg);
+
+ev_loop *ev_new(void);
+void ev_free(ev_loop *l); // 登録したタイマの fd も閉じる (ほかの fd は閉じない)
+
+// fd を監視する。成功なら 0、失敗なら -1 (errno。通常ファイルは EPERM)
+int ev_add_fd(ev_loop *l, int fd, uint32_t events, ev_io_fn cb, void *arg);
+int ev_mod_fd(ev_loop *l, int fd, uint32_t events);
+int ev_del_fd(ev_loop *l, int fd);
+
+// interval_ms ごとの周期タイマ (CLOCK_MONOTONIC)。最初の満了は interval_ms 後。
+// タイマ ID (>= 0) を返す。失敗なら -1
+int ev_add_timer(ev_loop *l, uint64_t interval_ms, ev_timer_fn cb, void *arg);
+// 周期を変える (0 なら止める)。次の満了は now + interval_ms
+int ev_set_timer(ev_loop *l, int timer, uint64_t interval_ms);
+// タイマを外して fd を閉じる
+int ev_del_timer(ev_loop *l, int timer);
+
+// ev_stop が呼ばれるまで回す。epoll_wait のエラーなら -1
+int ev_run(ev_loop *l);
+void ev_stop(ev_loop *l);
+
+// 標準入力などを行単位で読むためのバッファ
+#define EV_LINE_MAX 256
+typedef struct {
+    char buf[EV_LINE_MAX];
+    size_t len;
+} ev_linebuf;
+
+// fd から今読めるだけ読み、完全な行ごとに cb を呼ぶ (改行は除く。長すぎる行は切る)。
+// EOF なら 1 (残りの半端な行も渡す)、まだ続くなら 0、エラーなら -1
+int ev_read_lines(int fd, ev_linebuf *lb, void (*cb)(const char *line, void *arg), void *arg);
+
+// fd を O_NONBLOCK にする
+int ev_set_nonblock(int fd);
+// 呼び出したスレッドを cpu に固定する
+int ev_pin_cpu(int cpu);
+
+#endif // EVLOOP_H
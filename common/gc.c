@@ -0,0 +1,522 @@
+// -*- coding: utf-8 -*-
+// UDPstate 用 G‑Counter 本体 (説明は gc.h)
+
+#include "gc.h"
+#include "gc_wire.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// -------------------- 初期化 --------------------
+int gc_init(GCounter *gc, int replica_id, int peer_count) {
+    memset(gc, 0, sizeof(*gc));
+    gc->replica_id = replica_id;
+    if (peer_count > 0) {
+        gc->dirty = calloc((size_t)peer_count, sizeof(*gc->dirty));
+        if (!gc->dirty) return -1;
+        gc->peer_count = peer_count;
+    }
+    pthread_mutex_init(&gc->extra_lock, NULL);
+    gc_sparse_init(&gc->extra);
+    gc_watch_init(&gc->watch);
+    return 0;
+}
+
+void gc_set_relay(GCounter *gc, int relay) {
+    gc->relay = relay;
+}
+
+void gc_destroy(GCounter *gc) {
+    pthread_mutex_destroy(&gc->extra_lock);
+    gc_sparse_free(&gc->extra);
+    gc_watch_destroy(&gc->watch);
+    free(gc->dirty);
+    gc->dirty = NULL;
+    gc->peer_count = 0;
+}
+
+// スロット id が変わったことを全 peer に記録する。
+// 値を書いた後に release で立てるので、ビットを見た送信側は新しい値を読める
+static inline void gc_mark_dirty(GCounter *gc, int id) {
+    uint64_t bit = 1ULL << (id % 64);
+    for (int p = 0; p < gc->peer_count; ++p) {
+        atomic_fetch_or_explicit(&gc->dirty[p][id / 64], bit, memory_order_release);
+    }
+}
+
+// マージで増えた他レプリカの分を dirty にする (word は dirty のワード番号、bit はその中のビット)。
+// ブロードキャストでは送り主が全 peer に直接送っているので送り直さない
+// (落ちた分は定期的な全状態で直る)。中継が要るとき (relay) だけ、送り主 from 以外に記録する
+static inline void gc_mark_relay(GCounter *gc, int word, uint64_t bit, int from) {
+    if (!gc->relay) return;
+    for (int p = 0; p < gc->peer_count; ++p) {
+        if (p != from) atomic_fetch_or_explicit(&gc->dirty[p][word], bit, memory_order_release);
+    }
+}
+
+// extra が grown だけ増えたときの後始末
+static inline void gc_extra_grown(GCounter *gc, uint64_t grown, int from) {
+    if (grown > 0) {
+        atomic_fetch_add_explicit(&gc->total, grown, memory_order_seq_cst); // 表を変えた後 (gc_snapshot, gc_watch)
+        gc_mark_relay(gc, GC_DIRTY_EXTRA, 1, from);
+    }
+}
+
+// スロット id を val で max マージし、増えたら dirty にする。増えた量を返す
+static inline uint64_t gc_merge_one(GCounter *gc, int id, uint64_t val, int from) {
+    uint64_t grown = gc_slot_store_max(&gc->values[id], val);
+    if (grown > 0) {
+        atomic_fetch_add_explicit(&gc->total, grown, memory_order_seq_cst); /*増えた分だけ合計に足す (スロットの後。gc_snapshot, gc_watch)*/
+        if (id == gc->replica_id) gc_mark_dirty(gc, id); /*自分の値 (復元など) はいつも全 peer に伝える*/
+        else gc_mark_relay(gc, id / 64, 1ULL << (id % 64), from);
+    }
+    return grown;
+}
+
+// -------------------- ユーティリティ関数 --------------------
+void gc_fold_local(GCounter *gc) {
+    uint64_t folded = gc_stripes_fold(&gc->local, &gc->values[gc->replica_id]);
+    if (folded > 0) {
+        atomic_fetch_add_explicit(&gc->total, folded, memory_order_seq_cst);
+        gc_mark_dirty(gc, gc->replica_id);
+        gc_watch_changed(&gc->watch, &gc->total);
+    }
+}
+
+unsigned long gc_total(GCounter *gc) {
+    gc_fold_local(gc);
+    return atomic_load_explicit(&gc->total, memory_order_relaxed);
+}
+
+unsigned long gc_total_recompute(GCounter *gc) {
+    gc_fold_local(gc);
+    uint64_t extra = 0;
+    pthread_mutex_lock(&gc->extra_lock);
+    for (size_t i = 0; i < gc->extra.n; ++i) extra += gc->extra.e[i].value;
+    pthread_mutex_unlock(&gc->extra_lock);
+    return gc_slots_sum(gc->values, MAX_REPLICAS) + extra;
+}
+
+unsigned long gc_value_of(GCounter *gc, int id) {
+    if (id == gc->replica_id) gc_fold_local(gc);
+    return gc_slot_load(&gc->values[id]);
+}
+
+unsigned long gc_value_of_id(GCounter *gc, uint64_t id) {
+    if (id < MAX_REPLICAS) return gc_value_of(gc, (int)id);
+    pthread_mutex_lock(&gc->extra_lock);
+    uint64_t v = gc_sparse_get(&gc->extra, id);
+    pthread_mutex_unlock(&gc->extra_lock);
+    return v;
+}
+
+void gc_increment(GCounter *gc, unsigned long delta) {
+    if (delta == 0) return;
+    gc_stripes_add(&gc->local, delta); // dirty は畳み込むときに立てる
+    if (gc_watch_active(&gc->watch)) gc_fold_local(gc); // 見張りがいれば合計に入れて知らせる
+}
+
+// -------------------- 変更を待つ --------------------
+// 合計は増えるだけなので「変わった」は「seen + 1 以上になった」と同じ
+
+// change なら変わるたびに起こされる seq で、そうでなければ threshold に届いたときだけ
+// 起こされる tseq で待つ
+static int gc_wait_total(GCounter *gc, unsigned long threshold, unsigned long *total, int timeout_ms,
+                         int change) {
+    struct timespec deadline, *dl = NULL;
+    if (timeout_ms >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        dl = &deadline;
+    }
+    int rc = 0;
+    gc_watch_enter(&gc->watch);
+    for (;;) {
+        // 値より先に読む (この後の変更は seq も変える。need に届けば tseq も変わる)
+        uint32_t seq = change ? gc_watch_seq(&gc->watch) : gc_watch_tseq(&gc->watch);
+        if (!change) gc_watch_need(&gc->watch, threshold); // 起こされるたびに空になるので毎回
+        *total = gc_total(gc);
+        if (*total >= threshold) break;
+        int slept = change ? gc_watch_sleep(&gc->watch, seq, dl) : gc_watch_sleep_need(&gc->watch, seq, dl);
+        if (slept < 0) {
+            *total = gc_total(gc);
+            rc = *total >= threshold ? 0 : -1;
+            break;
+        }
+    }
+    gc_watch_leave(&gc->watch);
+    return rc;
+}
+
+int gc_wait_at_least(GCounter *gc, unsigned long threshold, unsigned long *total, int timeout_ms) {
+    return gc_wait_total(gc, threshold, total, timeout_ms, 0);
+}
+
+int gc_wait_change(GCounter *gc, unsigned long *seen, int timeout_ms) {
+    return gc_wait_total(gc, *seen + 1, seen, timeout_ms, 1);
+}
+
+int gc_watch_fd(GCounter *gc) {
+    return gc_watch_fd_add(&gc->watch);
+}
+
+int gc_unwatch_fd(GCounter *gc, int fd) {
+    return gc_watch_fd_remove(&gc->watch, fd);
+}
+
+unsigned long gc_watch_fd_consume(GCounter *gc, int fd) {
+    gc_watch_fd_ack(&gc->watch, fd);
+    return gc_total(gc);
+}
+
+/* テキスト形式のマージ本体：incoming="id1=value1,id2=value2,..." */
+static void gc_merge_text(GCounter *gc, const char *incoming, size_t len, int from) {
+    char tmp[BUF_SIZE];
+    if (len >= sizeof(tmp)) len = sizeof(tmp) - 1;
+    memcpy(tmp, incoming, len); /*incoming[]から最大sizeof(tmp) - 1分をtmp[]にコピーする*/
+    tmp[len] = '\0'; /*コピーした最後の文字を終端文字にする*/
+
+    uint64_t grown = 0;
+    char *save;
+    char *token = strtok_r(tmp, ",", &save); /* tmp[]の中の文字列を,ごとに区切ってtoken返す (受信スレッドが複数でも安全な strtok_r) */
+    while (token) {
+        uint64_t id;
+        unsigned long val;
+        if (token[0] != '-' && sscanf(token, "%" SCNu64 "=%lu", &id, &val) == 2 &&
+            id <= GC_WIRE_ID_MAX) { /*token内のそれぞれのidとvalが適切な値なら (バイナリ形式で送れない id は受け取らない)*/
+            if (id < MAX_REPLICAS) {
+                grown += gc_merge_one(gc, (int)id, val, from); /*受け取った値の方が大きければ置き換える*/
+            } else {
+                pthread_mutex_lock(&gc->extra_lock); /*範囲外の ID は疎な表へ*/
+                uint64_t g = gc_sparse_store_max(&gc->extra, id, val);
+                pthread_mutex_unlock(&gc->extra_lock);
+                gc_extra_grown(gc, g, from);
+                grown += g;
+            }
+        }
+        token = strtok_r(NULL, ",", &save);
+    }
+    if (grown > 0) gc_watch_changed(&gc->watch, &gc->total); /*1 データグラムで 1 回だけ知らせる*/
+}
+
+/* バイナリ形式のマージ本体。バッファを直接読むのでコピーも strtok もしない */
+static int gc_merge_bin(GCounter *gc, const void *buf, size_t len, int from) {
+    gc_wire_reader r;
+    if (gc_wire_reader_init(&r, buf, len, NULL) < 0) return -1;
+
+    uint64_t id, val, grown = 0;
+    int rc;
+    while ((rc = gc_wire_next(&r, &id, &val)) > 0) {
+        if (id >= MAX_REPLICAS) {
+            // ID は昇順なので、ここから先は全部 extra 行き。マージジョインでまとめて入れる
+            uint64_t g;
+            pthread_mutex_lock(&gc->extra_lock);
+            rc = gc_sparse_merge_wire(&gc->extra, buf, len, MAX_REPLICAS, &g);
+            pthread_mutex_unlock(&gc->extra_lock);
+            gc_extra_grown(gc, g, from);
+            grown += g;
+            break;
+        }
+        grown += gc_merge_one(gc, (int)id, val, from);
+    }
+    if (grown > 0) gc_watch_changed(&gc->watch, &gc->total); // 1 データグラムで 1 回だけ知らせる
+    // 壊れていても途中までのエントリは正しい値なのでマージ済みのままでよい
+    return rc < 0 ? -1 : 0;
+}
+
+/* merge処理：incoming="id1=value1,id2=value2,..." */
+void gc_merge_str(GCounter *gc, const char *incoming) {
+    gc_merge_text(gc, incoming, strlen(incoming), -1);
+}
+
+int gc_merge_buf(GCounter *gc, const void *buf, size_t len) {
+    return gc_merge_buf_from(gc, buf, len, -1);
+}
+
+int gc_merge_buf_from(GCounter *gc, const void *buf, size_t len, int from) {
+    if (gc_wire_is_binary(buf, len)) {
+        return gc_merge_bin(gc, buf, len, from);
+    }
+    gc_merge_text(gc, buf, len, from);
+    return 0;
+}
+
+int gc_merge_many(GCounter *gc, const void *const bufs[], const size_t lens[], int n) {
+    int bad = 0;
+    for (int i = 0; i < n; ++i) {
+        if (gc_merge_buf(gc, bufs[i], lens[i]) < 0) bad++;
+    }
+    return bad;
+}
+
+uint64_t gc_merge_dense(GCounter *gc, const uint64_t *values, const uint64_t *mask) {
+    uint64_t grown = 0;
+    for (int w = 0; w < GC_DENSE_WORDS; ++w) {
+        for (uint64_t bits = mask[w]; bits; bits &= bits - 1) {
+            int id = w * 64 + __builtin_ctzll(bits);
+            grown += gc_merge_one(gc, id, values[id], -1);
+        }
+    }
+    if (grown > 0) gc_watch_changed(&gc->watch, &gc->total);
+    return grown;
+}
+
+
+// -------------------- スナップショット --------------------
+void gc_snap_init(gc_snap *s) {
+    gc_sparse_init(&s->extra);
+}
+
+void gc_snap_free(gc_snap *s) {
+    gc_sparse_free(&s->extra);
+}
+
+int gc_snapshot(GCounter *gc, gc_snap *s) {
+    gc_fold_local(gc);
+    for (int t = 0; t < GC_SNAP_TRIES; ++t) {
+        // この total に入っている変更はスロットにもう書かれている (release / acquire)
+        uint64_t total = atomic_load_explicit(&gc->total, memory_order_acquire);
+        gc_slots_snapshot(gc->values, s->values, MAX_REPLICAS);
+        pthread_mutex_lock(&gc->extra_lock); // 稀な経路。コピーする間だけ
+        int rc = gc_sparse_copy(&s->extra, &gc->extra);
+        pthread_mutex_unlock(&gc->extra_lock);
+        if (rc < 0) return -1;
+        uint64_t sum = gc_sparse_value(&s->extra);
+        for (int i = 0; i < MAX_REPLICAS; ++i) sum += s->values[i];
+        s->total = sum;
+        // 値は単調に増えるので sum >= total。等しければ total の瞬間の状態そのもの
+        if (sum == total) return 0;
+    }
+    return 1; // スロットごとには正しい (書き手が止まらなかった)
+}
+
+// スナップショットを文字列化 → "id=val,id=val,..."
+size_t gc_snap_serialize_text(const gc_snap *s, char *out, size_t out_size) {
+    size_t used = 0;
+    if (out_size == 0) return 0;
+    out[0] = '\0';
+    for (int i = 0; i < MAX_REPLICAS; ++i) {
+        unsigned long v = s->values[i];
+        if (v == 0) continue; // 0 のエントリは送らない
+        int n = snprintf(out + used, out_size - used, "%d=%lu,", i, v);
+        if (n < 0 || used + (size_t)n >= out_size) {
+            out[used] = '\0';
+            break; // 余裕なし
+        }
+        used += (size_t)n;
+    }
+    for (size_t i = 0; i < s->extra.n && used < out_size; ++i) {
+        int n = snprintf(out + used, out_size - used, "%" PRIu64 "=%" PRIu64 ",",
+                         s->extra.e[i].id, s->extra.e[i].value);
+        if (n < 0 || used + (size_t)n >= out_size) {
+            out[used] = '\0';
+            break; // 余裕なし
+        }
+        used += (size_t)n;
+    }
+
+    if (used > 0 && out[used - 1] == ',') {
+        out[used - 1] = '\0'; // 末尾のカンマを削除
+        --used;
+    }
+    return used;
+}
+
+#ifndef GC_WIRE_TEXT
+// スナップショットのバイナリ直列化 (flags だけ違う)
+static size_t gc_snap_serialize_bin(const gc_snap *s, int replica_id, uint8_t flags, char *out, size_t out_size) {
+    gc_wire_writer w;
+    if (gc_wire_writer_init(&w, out, out_size, (uint64_t)replica_id, flags) < 0) return 0;
+    for (int i = 0; i < MAX_REPLICAS; ++i) {
+        uint64_t v = s->values[i];
+        if (v == 0) continue; // 0 のエントリは送らない
+        if (gc_wire_put(&w, (uint64_t)i, v) < 0) return gc_wire_finish(&w); // 余裕なし
+    }
+    for (size_t i = 0; i < s->extra.n; ++i) {
+        if (gc_wire_put(&w, s->extra.e[i].id, s->extra.e[i].value) < 0) break;
+    }
+    return gc_wire_finish(&w);
+}
+#endif
+
+size_t gc_snap_serialize(const gc_snap *s, int replica_id, char *out, size_t out_size) {
+#ifdef GC_WIRE_TEXT
+    (void)replica_id;
+    return gc_snap_serialize_text(s, out, out_size);
+#else
+    return gc_snap_serialize_bin(s, replica_id, 0, out, out_size);
+#endif
+}
+
+// -------------------- 直列化 --------------------
+// 全状態はスナップショットをとってから書式化する (書き手を止めず、ロックの外で)
+
+size_t gc_serialize_text(GCounter *gc, char *out, size_t out_size) {
+    gc_snap snap;
+    gc_snap_init(&snap);
+    size_t used = gc_snapshot(gc, &snap) < 0 ? 0 : gc_snap_serialize_text(&snap, out, out_size);
+    gc_snap_free(&snap);
+    if (used == 0 && out_size > 0) out[0] = '\0';
+    return used;
+}
+
+#ifndef GC_WIRE_TEXT
+static size_t gc_serialize_bin(GCounter *gc, uint8_t flags, char *out, size_t out_size) {
+    gc_snap snap;
+    gc_snap_init(&snap);
+    size_t used = gc_snapshot(gc, &snap) < 0 ? 0 : gc_snap_serialize_bin(&snap, gc->replica_id, flags, out, out_size);
+    gc_snap_free(&snap);
+    return used;
+}
+#endif
+
+// 自身の状態を送信用に直列化
+size_t gc_serialize(GCounter *gc, char *out, size_t out_size) {
+#ifdef GC_WIRE_TEXT
+    return gc_serialize_text(gc, out, out_size);
+#else
+    return gc_serialize_bin(gc, 0, out, out_size);
+#endif
+}
+
+size_t gc_serialize_pull(GCounter *gc, char *out, size_t out_size) {
+#ifdef GC_WIRE_TEXT
+    return gc_serialize_text(gc, out, out_size);
+#else
+    return gc_serialize_bin(gc, GC_WIRE_F_PULL, out, out_size);
+#endif
+}
+
+// 相手の全状態 (id 昇順) と自分のスロットを突き合わせ、自分の方が大きいものだけ書く
+size_t gc_serialize_newer(GCounter *gc, const void *buf, size_t len, char *out, size_t out_size) {
+    gc_wire_reader r;
+    gc_wire_header hdr;
+    if (!gc_wire_is_binary(buf, len) || gc_wire_reader_init(&r, buf, len, &hdr) < 0 ||
+        !(hdr.flags & GC_WIRE_F_PULL)) {
+        return 0;
+    }
+    gc_fold_local(gc);
+    gc_wire_writer w;
+    if (gc_wire_writer_init(&w, out, out_size, (uint64_t)gc->replica_id, GC_WIRE_F_DELTA) < 0) return 0;
+
+    uint64_t id = 0, theirs = 0;
+    int rc = gc_wire_next(&r, &id, &theirs);
+    for (int i = 0; i < MAX_REPLICAS; ++i) {
+        while (rc > 0 && id < (uint64_t)i) rc = gc_wire_next(&r, &id, &theirs);
+        uint64_t v = gc_slot_load(&gc->values[i]);
+        if (v > (rc > 0 && id == (uint64_t)i ? theirs : 0) && gc_wire_put(&w, (uint64_t)i, v) < 0) {
+            return gc_wire_finish(&w); // 入りきらない分は次のゴシップで
+        }
+    }
+    pthread_mutex_lock(&gc->extra_lock);
+    for (size_t k = 0; k < gc->extra.n; ++k) {
+        const gc_sparse_entry *e = &gc->extra.e[k];
+        while (rc > 0 && id < e->id) rc = gc_wire_next(&r, &id, &theirs);
+        if (e->value > (rc > 0 && id == e->id ? theirs : 0) && gc_wire_put(&w, e->id, e->value) < 0) break;
+    }
+    pthread_mutex_unlock(&gc->extra_lock);
+    if (rc < 0) return 0; // 壊れた全状態には答えない
+    return w.count > 0 ? gc_wire_finish(&w) : 0;
+}
+
+size_t gc_serialize_bound(GCounter *gc) {
+    pthread_mutex_lock(&gc->extra_lock);
+    size_t n = MAX_REPLICAS + gc->extra.n;
+    pthread_mutex_unlock(&gc->extra_lock);
+    // テキストでも "," + 20 桁 + "=" + 20 桁 + 終端に収まる
+    return GC_WIRE_HDR_MAX + n * 44 + 1;
+}
+
+// peer 宛ての直列化 (delta / 全状態)
+size_t gc_serialize_for_peer(GCounter *gc, int peer, int full, char *out, size_t out_size) {
+    if (peer < 0 || peer >= gc->peer_count) {
+        return full ? gc_serialize(gc, out, out_size) : 0;
+    }
+    gc_fold_local(gc);
+    // 先に dirty を取り出してから値を読む。読んだ後に変わったスロットは
+    // ビットが立ち直るので次回送られる
+    uint64_t pending[GC_DIRTY_WORDS];
+    for (int w = 0; w < GC_DIRTY_WORDS; ++w) {
+        pending[w] = atomic_exchange_explicit(&gc->dirty[peer][w], 0, memory_order_acquire);
+    }
+
+    size_t used = 0;
+    int written = 0;
+    int i = 0;
+#ifdef GC_WIRE_TEXT
+    if (out_size > 0) out[0] = '\0';
+    for (; i < MAX_REPLICAS; ++i) {
+        uint64_t bit = 1ULL << (i % 64);
+        if (!full && !(pending[i / 64] & bit)) continue;
+        unsigned long v = gc_slot_load(&gc->values[i]);
+        if (v == 0) continue;
+        int n = snprintf(out + used, out_size - used, "%s%d=%lu", written ? "," : "", i, v);
+        if (n < 0 || used + (size_t)n >= out_size) {
+            out[used] = '\0';
+            break; // 残りは次回の delta で送る
+        }
+        used += (size_t)n;
+        pending[i / 64] &= ~bit;
+        written++;
+    }
+    if (i == MAX_REPLICAS && (full || pending[GC_DIRTY_EXTRA])) {
+        // extra は変更があれば丸ごと送る。入りきらなければ次回もう一度
+        size_t k = 0;
+        pthread_mutex_lock(&gc->extra_lock);
+        for (; k < gc->extra.n; ++k) {
+            int n = snprintf(out + used, out_size - used, "%s%" PRIu64 "=%" PRIu64, written ? "," : "",
+                             gc->extra.e[k].id, gc->extra.e[k].value);
+            if (n < 0 || used + (size_t)n >= out_size) {
+                out[used] = '\0';
+                break;
+            }
+            used += (size_t)n;
+            written++;
+        }
+        if (k == gc->extra.n) pending[GC_DIRTY_EXTRA] = 0;
+        pthread_mutex_unlock(&gc->extra_lock);
+    }
+#else
+    gc_wire_writer w;
+    if (gc_wire_writer_init(&w, out, out_size, (uint64_t)gc->replica_id,
+                            full ? 0 : GC_WIRE_F_DELTA) == 0) {
+        for (; i < MAX_REPLICAS; ++i) {
+            uint64_t bit = 1ULL << (i % 64);
+            if (!full && !(pending[i / 64] & bit)) continue;
+            uint64_t v = gc_slot_load(&gc->values[i]);
+            if (v == 0) continue;
+            if (gc_wire_put(&w, (uint64_t)i, v) < 0) {
+                break; // 残りは次回の delta で送る
+            }
+            pending[i / 64] &= ~bit;
+            written++;
+        }
+        if (i == MAX_REPLICAS && (full || pending[GC_DIRTY_EXTRA])) {
+            // extra は変更があれば丸ごと送る。入りきらなければ次回もう一度
+            size_t k = 0;
+            pthread_mutex_lock(&gc->extra_lock);
+            for (; k < gc->extra.n; ++k) {
+                if (gc_wire_put(&w, gc->extra.e[k].id, gc->extra.e[k].value) < 0) break;
+                written++;
+            }
+            if (k == gc->extra.n) pending[GC_DIRTY_EXTRA] = 0;
+            pthread_mutex_unlock(&gc->extra_lock);
+        }
+    }
+    used = gc_wire_finish(&w);
+#endif
+
+    // 入りきらなかったスロットは dirty に戻す
+    for (int k = 0; k < GC_DIRTY_WORDS; ++k) {
+        if (pending[k]) atomic_fetch_or_explicit(&gc->dirty[peer][k], pending[k], memory_order_relaxed);
+    }
+    return written > 0 ? used : 0;
+}
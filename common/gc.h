@@ -0,0 +1,155 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// UDPstate 用 state‑based G‑Counter 本体
+// ------------------------------------------------------------
+// 状態の送受信はバイナリ形式 (gc_wire.h) が既定。
+// -DGC_WIRE_TEXT でビルドすると旧来の "id=val,id=val" テキスト形式で送る
+// (デバッグ用)。受信側はどちらの形式も自動判別してマージする。
+//
+// delta‑state: 値が増えたスロットを peer ごとのビットマップで記録し、
+// gc_serialize_for_peer() はその peer にまだ送っていないスロットだけを送る。
+// max マージは冪等なので、受信側は delta も全状態も同じように扱える。
+//
+// スロットは gc_core.h のロックフリー実装で、増分もマージも直列化も
+// ロックをとらない (マージは CAS による store‑max)。
+// 自レプリカへの増分はスレッドごとのセル (gc_stripe.h) に入れておき、
+// gc_total / gc_value_of / 直列化のときに自スロットへ畳み込む。
+// 合計値 total は増分・マージでスロットが増えた量だけ足して維持するので、
+// gc_total は全スロットを足し直さない。
+//
+// ID が MAX_REPLICAS 以上のレプリカ (64bit まで) は捨てずに疎な表 extra
+// (gc_sparse.h) に入れる。こちらは稀な経路なので小さな mutex で守る。
+//
+// スロットを 1 つずつ読むと、読んでいる間に別のスロットが増えるので、
+// 全スロットの組はどの瞬間の状態でもないことがある (値はそれぞれ正しい下限)。
+// gc_snapshot は total を seqlock の番号の代わりに使って、ある瞬間の全状態を
+// コピーする: total を acquire で読み、全スロット (と extra) をコピーして、
+// コピーの和が読んだ total と等しければ成功。書き手はスロットを増やして
+// から total に release で足すので、コピーには読んだ total に入っている
+// 変更が必ず含まれる。和が等しいのは、それ以外の変更 (書き途中を含む) が
+// 1 つも入っていないときだけである。書き手は何も余分にせず、待ちもしない。
+// 全状態の直列化はスナップショットをとってから、ロックの外で書式化する。
+//
+// 値が変わるのを待つ側は、合計をループで読む代わりに gc_wait_change /
+// gc_wait_at_least で眠るか、gc_watch_fd の eventfd を自分のイベントループで
+// 待つ (gc_watch.h)。増分・マージで合計が増えたときに起こされる。見張る人が
+// いない間、書き手の追加コストはほとんど書き換わらないワードを 1 回読むだけ。
+// 自分の増分はふだんスレッドごとのセルにたまるが、見張る人がいれば増分の
+// たびに合計へ畳み込んで知らせる。
+// ------------------------------------------------------------
+#ifndef GC_H
+#define GC_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gc_core.h"
+#include "gc_sparse.h"
+#include "gc_stripe.h"
+#include "gc_watch.h"
+
+#ifndef MAX_REPLICAS
+#define MAX_REPLICAS 256 // 自レプリカ ID の上限 (密なスロット数)。-DMAX_REPLICAS=... で変えられる
+#endif
+#define BUF_SIZE 4096
+#define GC_DENSE_WORDS ((MAX_REPLICAS + 63) / 64)
+#define GC_DIRTY_EXTRA GC_DENSE_WORDS   // dirty の最後のワード: extra に変更あり
+#define GC_DIRTY_WORDS (GC_DENSE_WORDS + 1)
+#define GC_SNAP_TRIES 64 // 一貫したスナップショットを試す回数
+
+typedef struct {
+    int replica_id;                 // 自分の ID
+    gc_slot values[MAX_REPLICAS];   // 各レプリカのカウンタ値 (1 スロット 1 キャッシュライン)
+    gc_stripes local;               // まだ values[replica_id] に畳み込んでいない自分の増分
+    _Alignas(GC_CACHELINE) _Atomic uint64_t total; // Σ values[i] (スロットが増えた量だけ足す)
+    int peer_count;                 // dirty を追跡する peer 数 (0 なら追跡しない)
+    _Atomic uint64_t (*dirty)[GC_DIRTY_WORDS]; // peer ごとの「未送信の変更あり」ビットマップ
+    int relay;                      // マージで増えた他レプリカの分も peer に送り直す (gc_set_relay)
+    pthread_mutex_t extra_lock;     // extra を守る
+    gc_sparse extra;                // ID >= MAX_REPLICAS のレプリカ (ID 昇順の疎な表)
+    gc_watch watch;                 // 合計が増えるのを待っているスレッド / eventfd
+} GCounter;
+
+// ある瞬間の全状態のコピー (gc_snapshot で埋める)
+typedef struct {
+    uint64_t values[MAX_REPLICAS];
+    gc_sparse extra;                // ID >= MAX_REPLICAS (領域は使い回す)
+    uint64_t total;                 // Σ values + extra の合計
+} gc_snap;
+
+// peer_count 個の peer について delta を追跡する。失敗なら -1
+int gc_init(GCounter *gc, int replica_id, int peer_count);
+void gc_destroy(GCounter *gc);
+// マージで増えた他レプリカのスロットも dirty にするか (既定 0)。
+// ブロードキャスト (全 peer に直接送る) では 0: 送り主がもう全員に送っている。
+// peer が一部にしか送らない構成 (ゴシップなど) で中継が要るときだけ 1 にする
+void gc_set_relay(GCounter *gc, int relay);
+
+// 合計値。自分の増分を畳み込んでから、保持している合計を返す (スロット数によらない)
+unsigned long gc_total(GCounter *gc);
+// 全スロットを足し直した合計 (total の検算用)
+unsigned long gc_total_recompute(GCounter *gc);
+// レプリカ id のスロットの現在値
+unsigned long gc_value_of(GCounter *gc, int id);
+// 任意の 64bit ID の現在値 (MAX_REPLICAS 以上なら extra を引く)
+unsigned long gc_value_of_id(GCounter *gc, uint64_t id);
+// 自スロットに増分を加える。多数のスレッドから同時に呼んでも共有ラインを触らない
+void gc_increment(GCounter *gc, unsigned long delta);
+// たまっている自分の増分を values[replica_id] に反映する (読み出し系は自動で呼ぶ)
+void gc_fold_local(GCounter *gc);
+
+// 合計が threshold 以上になるまで待ち、*total にそのときの合計を入れる。
+// timeout_ms < 0 なら無期限。時間切れなら -1 (*total は最新の合計)
+int gc_wait_at_least(GCounter *gc, unsigned long threshold, unsigned long *total, int timeout_ms);
+// 合計が *seen から変わるまで待ち、*seen を新しい合計にする。時間切れなら -1
+int gc_wait_change(GCounter *gc, unsigned long *seen, int timeout_ms);
+// 合計が増えると読めるようになる eventfd (non‑blocking) を返す。失敗なら -1
+int gc_watch_fd(GCounter *gc);
+int gc_unwatch_fd(GCounter *gc, int fd);
+// fd が読めたら呼ぶ: fd を空にして次の変更を待つ状態に戻し、今の合計を返す
+unsigned long gc_watch_fd_consume(GCounter *gc, int fd);
+
+// テキスト形式 "id1=value1,id2=value2,..." をマージ
+void gc_merge_str(GCounter *gc, const char *incoming);
+// 受信データグラムをマージ (形式は自動判別)。壊れていれば -1
+int gc_merge_buf(GCounter *gc, const void *buf, size_t len);
+// peer 番号 from から届いたデータグラムをマージ (relay のとき from には送り返さない。
+// 分からなければ -1)。壊れていれば -1
+int gc_merge_buf_from(GCounter *gc, const void *buf, size_t len, int from);
+// n 個のデータグラムをまとめてマージ。壊れていた数を返す
+int gc_merge_many(GCounter *gc, const void *const bufs[], const size_t lens[], int n);
+// 密な配列 values[MAX_REPLICAS] のうち mask[GC_DENSE_WORDS] のビットが立った
+// スロットだけを max マージする (gc_stage.h の畳み込み)。合計が増えた量を返す
+uint64_t gc_merge_dense(GCounter *gc, const uint64_t *values, const uint64_t *mask);
+
+void gc_snap_init(gc_snap *s);
+void gc_snap_free(gc_snap *s);
+// 全状態を s にコピーする。成功なら 0。GC_SNAP_TRIES 回やっても書き手が
+// 止まらなければ、スロットごとには正しい値 (下限) を入れて 1。メモリ不足なら -1
+int gc_snapshot(GCounter *gc, gc_snap *s);
+// スナップショットを直列化する (GCounter には触らない)。replica_id は送り主
+size_t gc_snap_serialize_text(const gc_snap *s, char *out, size_t out_size);
+size_t gc_snap_serialize(const gc_snap *s, int replica_id, char *out, size_t out_size);
+
+// 自身の状態を "id=val,id=val,..." に文字列化
+size_t gc_serialize_text(GCounter *gc, char *out, size_t out_size);
+// 自身の状態を送信用に直列化 (既定はバイナリ, -DGC_WIRE_TEXT でテキスト)
+size_t gc_serialize(GCounter *gc, char *out, size_t out_size);
+// peer 宛てに直列化する。full=0 ならその peer に未送信のスロットだけ (delta)、
+// full=1 なら 0 以外の全スロット (anti‑entropy)。書けたスロットは送信済みになる。
+// 送るものが何もなければ 0 を返す。
+size_t gc_serialize_for_peer(GCounter *gc, int peer, int full, char *out, size_t out_size);
+// push‑pull ゴシップ (gossip.h) の push: 全状態に GC_WIRE_F_PULL を付けて直列化する
+// (テキスト形式では gc_serialize と同じで、pull は起きない)
+size_t gc_serialize_pull(GCounter *gc, char *out, size_t out_size);
+// pull への返信: buf (GC_WIRE_F_PULL 付きの全状態) の送り主が持っていない、
+// または古いエントリだけを直列化する。pull 要求でない / 壊れている /
+// 返すものがなければ 0
+size_t gc_serialize_newer(GCounter *gc, const void *buf, size_t len, char *out, size_t out_size);
+// 全状態を切り詰めずに直列化するのに足りるバッファの大きさ (TCP など
+// 大きいメッセージを送れる経路用。extra が増えると大きくなる)
+size_t gc_serialize_bound(GCounter *gc);
+
+#endif // GC_H
@@ -0,0 +1,65 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// ロックフリーな G‑Counter スロット (UDPstate / kekeho 共通)
+// ------------------------------------------------------------
+// - 各スロットは 64bit atomic で、1 キャッシュラインに 1 個だけ置く
+//   (別スロットを触るスレッド同士が false sharing しない)
+// - 自分のスロットへの加算は relaxed の fetch_add
+// - マージは compare‑exchange による store‑max ループなので、
+//   load → store の隙間に他スレッドがより大きい値を書いても巻き戻らない
+// - 読み手も書き手もブロックしない
+// ------------------------------------------------------------
+#ifndef GC_CORE_H
+#define GC_CORE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define GC_CACHELINE 64
+
+typedef struct {
+    _Alignas(GC_CACHELINE) _Atomic uint64_t v;
+} gc_slot;
+
+_Static_assert(sizeof(gc_slot) == GC_CACHELINE, "gc_slot must fill exactly one cache line");
+
+static inline uint64_t gc_slot_load(const gc_slot *s) {
+    return atomic_load_explicit(&((gc_slot *)s)->v, memory_order_relaxed);
+}
+
+static inline void gc_slot_add(gc_slot *s, uint64_t delta) {
+    atomic_fetch_add_explicit(&s->v, delta, memory_order_relaxed);
+}
+
+// s := max(s, v)。増えた量 (増えなければ 0) を返す
+static inline uint64_t gc_slot_store_max(gc_slot *s, uint64_t v) {
+    uint64_t cur = atomic_load_explicit(&s->v, memory_order_relaxed);
+    while (v > cur) {
+        // 失敗したら cur が最新値に更新されるので、そのまま比較し直す
+        if (atomic_compare_exchange_weak_explicit(&s->v, &cur, v, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+            return v - cur;
+        }
+    }
+    return 0;
+}
+
+// 配列全体の操作
+static inline void gc_slots_snapshot(const gc_slot *slots, uint64_t *out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = gc_slot_load(&slots[i]);
+}
+
+static inline uint64_t gc_slots_merge(gc_slot *slots, const uint64_t *in, size_t n) {
+    uint64_t grown = 0;
+    for (size_t i = 0; i < n; ++i) grown += gc_slot_store_max(&slots[i], in[i]);
+    return grown;
+}
+
+static inline uint64_t gc_slots_sum(const gc_slot *slots, size_t n) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; ++i) sum += gc_slot_load(&slots[i]);
+    return sum;
+}
+
+#endif // GC_CORE_H
@@ -0,0 +1,179 @@
+// -*- coding: utf-8 -*-
+// レプリカのメトリクス (説明は gc_metrics.h)
+
+#define _GNU_SOURCE
+#include "gc_metrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char *const gc_metrics_names[GC_M_COUNT] = {
+    "rx_packets", "rx_bytes", "tx_packets", "tx_bytes",
+    "tx_dropped", "parse_errors", "merges", "merges_changed",
+};
+
+static size_t seg_len(int npeers) {
+    return sizeof(gc_metrics_seg) + (size_t)npeers * sizeof(gc_metrics_peer);
+}
+
+int gc_metrics_open(gc_metrics *m, const char *name, int replica_id, int npeers) {
+    memset(m, 0, sizeof(*m));
+    size_t len = seg_len(npeers);
+    void *p;
+    if (name) {
+        if (strlen(name) >= sizeof(m->name)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        shm_unlink(name); // 前回の実行が残したもの
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) return -1;
+        if (ftruncate(fd, (off_t)len) < 0) {
+            int e = errno;
+            close(fd);
+            shm_unlink(name);
+            errno = e;
+            return -1;
+        }
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            shm_unlink(name);
+            return -1;
+        }
+        snprintf(m->name, sizeof(m->name), "%s", name);
+    } else {
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) return -1;
+    }
+    m->seg = p; // 0 で埋まっている
+    m->len = len;
+    m->owner = 1;
+    m->seg->replica_id = replica_id;
+    m->seg->npeers = (uint32_t)npeers;
+    m->seg->started_ns = gc_metrics_now();
+    m->seg->version = GC_METRICS_VERSION;
+    atomic_thread_fence(memory_order_release);
+    m->seg->magic = GC_METRICS_MAGIC; // 最後に書く (読み手はこれで準備完了を知る)
+    return 0;
+}
+
+int gc_metrics_attach(gc_metrics *m, const char *name) {
+    memset(m, 0, sizeof(*m));
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return -1;
+    struct stat sb;
+    if (fstat(fd, &sb) < 0 || (size_t)sb.st_size < sizeof(gc_metrics_seg)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *p = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+    m->seg = p;
+    m->len = (size_t)sb.st_size;
+    if (m->seg->magic != GC_METRICS_MAGIC || m->seg->version != GC_METRICS_VERSION ||
+        seg_len((int)m->seg->npeers) > m->len) {
+        gc_metrics_close(m);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+void gc_metrics_close(gc_metrics *m) {
+    if (m->seg) munmap(m->seg, m->len);
+    if (m->owner && m->name[0]) shm_unlink(m->name);
+    m->seg = NULL;
+    m->len = 0;
+    m->owner = 0;
+}
+
+gc_metrics_thread *gc_metrics_thread_claim(gc_metrics *m, const char *name) {
+    for (int i = 0; i < GC_METRICS_THREADS; ++i) {
+        gc_metrics_thread *t = &m->seg->thread[i];
+        // 割り当ては起動時だけなので、名前の先頭バイトを CAS して取り合う
+        char expect = 0;
+        if (atomic_compare_exchange_strong((_Atomic char *)&t->name[0], &expect, name[0] ? name[0] : '?')) {
+            snprintf(t->name + 1, sizeof(t->name) - 1, "%s", name[0] ? name + 1 : "");
+            return t;
+        }
+    }
+    errno = ENOSPC;
+    return NULL;
+}
+
+static inline void bump(_Atomic uint64_t *c, uint64_t delta) {
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+void gc_metrics_heard(gc_metrics *m, int peer, uint64_t now, int changed) {
+    gc_metrics_peer *p = &m->seg->peer[peer];
+    atomic_store_explicit(&p->last_heard_ns, now, memory_order_relaxed);
+    // 受信スレッドが複数 (udp_shard.h) だと同じ peer を別スレッドが数えることがある
+    atomic_fetch_add_explicit(&p->rx_packets, 1, memory_order_relaxed);
+    if (changed) atomic_fetch_add_explicit(&p->changed, 1, memory_order_relaxed);
+}
+
+void gc_metrics_local_write(gc_metrics *m, uint64_t value, uint64_t now) {
+    // 一杯なら一番古いものを上書きする (それを待っている peer の分は測らない)
+    unsigned i = m->w_head++ % GC_METRICS_WRITES;
+    m->w_value[i] = value;
+    m->w_ns[i] = now;
+}
+
+static int lag_bucket(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    if (us == 0) return 0;
+    int b = 64 - __builtin_clzll(us);
+    return b < GC_METRICS_LAG_BUCKETS ? b : GC_METRICS_LAG_BUCKETS - 1;
+}
+
+void gc_metrics_ack(gc_metrics *m, int peer, uint64_t value, uint64_t now) {
+    gc_metrics_peer *p = &m->seg->peer[peer];
+    uint64_t acked = atomic_load_explicit(&p->acked, memory_order_relaxed);
+    if (value <= acked) return;
+    // リングに残っている増分のうち、今回初めて peer に含まれたもの
+    unsigned n = m->w_head < GC_METRICS_WRITES ? m->w_head : GC_METRICS_WRITES;
+    for (unsigned k = 0; k < n; ++k) {
+        unsigned i = (m->w_head - 1 - k) % GC_METRICS_WRITES; // 新しい順
+        if (m->w_value[i] <= acked) break;
+        if (m->w_value[i] > value) continue;
+        uint64_t lag = now > m->w_ns[i] ? now - m->w_ns[i] : 0;
+        bump(&m->seg->lag[lag_bucket(lag)], 1);
+        bump(&m->seg->lag_sum_ns, lag);
+    }
+    atomic_store_explicit(&p->acked, value, memory_order_relaxed);
+}
+
+uint64_t gc_metrics_sum(const gc_metrics_seg *seg, int k) {
+    gc_metrics_seg *s = (gc_metrics_seg *)seg;
+    uint64_t sum = 0;
+    for (int i = 0; i < GC_METRICS_THREADS; ++i) {
+        sum += atomic_load_explicit(&s->thread[i].c[k], memory_order_relaxed);
+    }
+    return sum;
+}
+
+uint64_t gc_metrics_lag_quantile(const gc_metrics_seg *seg, double q) {
+    gc_metrics_seg *s = (gc_metrics_seg *)seg;
+    uint64_t counts[GC_METRICS_LAG_BUCKETS], total = 0;
+    for (int i = 0; i < GC_METRICS_LAG_BUCKETS; ++i) {
+        counts[i] = atomic_load_explicit(&s->lag[i], memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) return 0;
+    uint64_t want = (uint64_t)(q * (double)total), seen = 0;
+    if (want >= total) want = total - 1;
+    for (int i = 0; i < GC_METRICS_LAG_BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen > want) return (1ull << i) * 1000; // バケット i の上限
+    }
+    return (1ull << (GC_METRICS_LAG_BUCKETS - 1)) * 1000;
+}
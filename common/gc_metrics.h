@@ -0,0 +1,129 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// レプリカの同期の健全性を外から見るためのメトリクス
+// ------------------------------------------------------------
+// カウンタはすべて 1 つのセグメント (gc_metrics_seg) に置き、書き手は
+// その場で数を足すだけ。GC_METRICS=<名前> を付けて起動すると名前付きの
+// 共有メモリ (shm_open) に置くので、別プロセス (UDP_state-based_Gcounter/gcstat)
+// がコピーもシステムコールもなしに読める。名前がなければ無名の mmap に置く。
+//
+//   - スレッドごとのカウンタ (gc_metrics_thread, 1 スレッド 1 キャッシュライン以上):
+//     送受信したパケット・バイト、送れなかった数、壊れていたデータグラム、
+//     マージした数と、そのうち状態が変わった数。書き手はそのスレッドだけなので
+//     atomic の RMW はいらず、relaxed の load + store で足す
+//   - peer ごと: 最後に受け取った時刻 (staleness = 今 - これ)、受信数、
+//     状態を変えた受信数、peer が知っている自分の値
+//   - 収束遅延のヒストグラム: 自分の増分から、それを含む状態が peer から
+//     返ってくる (peer の状態に反映されたことがわかる) までの時間。
+//     同じ時計で測れるので時刻合わせはいらない。バケット i は [2^(i-1), 2^i) µs
+//
+// peer の受信数はどのスレッドから数えてもよい (fetch_add)。ack と
+// ヒストグラムを書くのは自分の増分を知っているスレッド 1 つだけとする。
+// 読み手は値ごとに atomic に読むので、カウンタどうしは少しずれうる。
+// ------------------------------------------------------------
+#ifndef GC_METRICS_H
+#define GC_METRICS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "gc_core.h"
+
+#define GC_METRICS_MAGIC 0x5254454du // "METR"
+#define GC_METRICS_VERSION 2         // 配置を変えたら上げる (2: GC_METRICS_THREADS 8 → 32)
+#define GC_METRICS_THREADS 32        // カウンタを持てるスレッド数 (受信スレッド 16 本 + 本体で足りる)
+#define GC_METRICS_LAG_BUCKETS 32    // 2^31 µs (約 36 分) まで
+#define GC_METRICS_WRITES 64         // 遅延を測るために覚えておく自分の増分
+
+enum {
+    GC_M_RX_PACKETS,
+    GC_M_RX_BYTES,
+    GC_M_TX_PACKETS,
+    GC_M_TX_BYTES,
+    GC_M_TX_DROPPED,   // 送信バッファが一杯などで送れなかった
+    GC_M_PARSE_ERRORS,
+    GC_M_MERGES,
+    GC_M_MERGES_CHANGED, // マージで状態 (合計) が増えた
+    GC_M_COUNT
+};
+
+// GC_M_* の名前 (表示用)
+extern const char *const gc_metrics_names[GC_M_COUNT];
+
+typedef struct {
+    _Alignas(GC_CACHELINE) char name[16]; // 空なら未使用
+    _Atomic uint64_t c[GC_M_COUNT];
+} gc_metrics_thread;
+
+typedef struct {
+    _Atomic uint64_t last_heard_ns; // CLOCK_MONOTONIC (0 ならまだ何も受け取っていない)
+    _Atomic uint64_t rx_packets;
+    _Atomic uint64_t changed;       // このうち状態を変えた数
+    _Atomic uint64_t acked;         // peer が知っている自分の値
+} gc_metrics_peer;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t replica_id;
+    uint32_t npeers;
+    uint64_t started_ns;            // CLOCK_MONOTONIC
+    gc_metrics_thread thread[GC_METRICS_THREADS];
+    _Alignas(GC_CACHELINE) _Atomic uint64_t lag[GC_METRICS_LAG_BUCKETS];
+    _Atomic uint64_t lag_sum_ns;
+    gc_metrics_peer peer[];
+} gc_metrics_seg;
+
+typedef struct {
+    gc_metrics_seg *seg;
+    size_t len;
+    char name[64];                  // 共有メモリの名前 (無名なら "")
+    int owner;                      // open した側 (close で名前を消す)
+    // 自分の増分の (値, 時刻) のリング。peer の ack で遅延を測る
+    uint64_t w_value[GC_METRICS_WRITES];
+    uint64_t w_ns[GC_METRICS_WRITES];
+    unsigned w_head;
+} gc_metrics;
+
+static inline uint64_t gc_metrics_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// npeers 個の peer の表を持つセグメントを作る。name が NULL なら無名
+// (前回の同名のセグメントが残っていれば作り直す)。失敗なら -1
+int gc_metrics_open(gc_metrics *m, const char *name, int replica_id, int npeers);
+// 読み手として既存のセグメントにつなぐ (読み取り専用)。失敗なら -1
+int gc_metrics_attach(gc_metrics *m, const char *name);
+void gc_metrics_close(gc_metrics *m);
+
+// このスレッド用のカウンタを割り当てる。空きがなければ NULL
+gc_metrics_thread *gc_metrics_thread_claim(gc_metrics *m, const char *name);
+
+static inline void gc_metrics_add(gc_metrics_thread *t, int k, uint64_t delta) {
+    uint64_t v = atomic_load_explicit(&t->c[k], memory_order_relaxed);
+    atomic_store_explicit(&t->c[k], v + delta, memory_order_relaxed);
+}
+
+// peer からデータグラムを 1 つ受け取った (changed: 状態が変わった)。どのスレッドからでも
+void gc_metrics_heard(gc_metrics *m, int peer, uint64_t now, int changed);
+// 自分の値が value になった (増分したとき)
+void gc_metrics_local_write(gc_metrics *m, uint64_t value, uint64_t now);
+// peer の状態が自分の値 value を含んでいた。新しく含まれた増分の遅延を記録する
+void gc_metrics_ack(gc_metrics *m, int peer, uint64_t value, uint64_t now);
+// peer がまだ知らない自分の増分があるか (なければ ack を探さなくてよい)
+static inline int gc_metrics_ack_pending(const gc_metrics *m, int peer) {
+    if (m->w_head == 0) return 0;
+    uint64_t last = m->w_value[(m->w_head - 1) % GC_METRICS_WRITES];
+    return last > atomic_load_explicit(&m->seg->peer[peer].acked, memory_order_relaxed);
+}
+
+// 全スレッドの GC_M_k の合計
+uint64_t gc_metrics_sum(const gc_metrics_seg *seg, int k);
+// 遅延の q 分位 (0..1) の上限 (ns)。サンプルがなければ 0
+uint64_t gc_metrics_lag_quantile(const gc_metrics_seg *seg, double q);
+
+#endif // GC_METRICS_H
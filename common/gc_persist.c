@@ -0,0 +1,224 @@
+// -*- coding: utf-8 -*-
+// G‑Counter の永続化 (説明は gc_persist.h)
+
+#include "gc_persist.h"
+#include "gc_wire.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int gc_fsync_parse(const char *s, gc_fsync_policy *out) {
+    if (strcmp(s, "none") == 0) *out = GC_FSYNC_NONE;
+    else if (strcmp(s, "group") == 0) *out = GC_FSYNC_GROUP;
+    else if (strcmp(s, "always") == 0) *out = GC_FSYNC_ALWAYS;
+    else return -1;
+    return 0;
+}
+
+// -------------------- ログのレコード --------------------
+// [value 8][seq 4][check 4] (ホストのバイト順。ファイルは他のマシンと共有しない)
+
+static uint32_t rec_check(uint64_t value, uint32_t seq, int replica_id) {
+    uint64_t x = value ^ ((uint64_t)seq << 32) ^ (uint64_t)(uint32_t)replica_id ^ 0x9e3779b97f4a7c15ULL;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (uint32_t)x;
+}
+
+static void rec_put(uint8_t *rec, uint64_t value, uint32_t seq, int replica_id) {
+    uint32_t check = rec_check(value, seq, replica_id);
+    memcpy(rec, &value, 8);
+    memcpy(rec + 8, &seq, 4);
+    memcpy(rec + 12, &check, 4);
+}
+
+// 正しいレコードなら 1
+static int rec_get(const uint8_t *rec, int replica_id, uint64_t *value, uint32_t *seq) {
+    uint32_t check;
+    memcpy(value, rec, 8);
+    memcpy(seq, rec + 8, 4);
+    memcpy(&check, rec + 12, 4);
+    return check == rec_check(*value, *seq, replica_id);
+}
+
+// -------------------- 復元 --------------------
+
+// スロットの値の並びを受信データと同じようにマージする (max なので何度やってもよい)
+static int merge_values(GCounter *gc, const uint64_t *values, int n) {
+    size_t cap = GC_WIRE_HDR_MAX + (size_t)n * GC_WIRE_ENTRY_MAX;
+    uint8_t *msg = malloc(cap);
+    if (!msg) return -1;
+    gc_wire_writer w;
+    gc_wire_writer_init(&w, msg, cap, (uint64_t)gc->replica_id, 0);
+    for (int i = 0; i < n; ++i) {
+        if (values[i]) gc_wire_put(&w, (uint64_t)i, values[i]);
+    }
+    int rc = gc_merge_buf(gc, msg, gc_wire_finish(&w));
+    free(msg);
+    return rc;
+}
+
+static int open_state(gc_persist *p, const char *dir, GCounter *gc) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/gc-%d.state", dir, p->replica_id);
+    p->state_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (p->state_fd < 0) return -1;
+    p->map_len = sizeof(gc_state_file) + MAX_REPLICAS * sizeof(uint64_t);
+    struct stat sb;
+    if (fstat(p->state_fd, &sb) < 0) return -1;
+    if ((size_t)sb.st_size < p->map_len && ftruncate(p->state_fd, (off_t)p->map_len) < 0) return -1;
+    void *m = mmap(NULL, p->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, p->state_fd, 0);
+    if (m == MAP_FAILED) return -1;
+    p->map = m;
+
+    if (p->map->magic == 0) { // 新しいファイル
+        p->map->magic = GC_PERSIST_MAGIC;
+        p->map->version = GC_PERSIST_VERSION;
+        p->map->replica_id = (uint32_t)p->replica_id;
+        p->map->slots = MAX_REPLICAS;
+        return 0;
+    }
+    if (p->map->magic != GC_PERSIST_MAGIC || p->map->version != GC_PERSIST_VERSION ||
+        p->map->replica_id != (uint32_t)p->replica_id || p->map->slots != MAX_REPLICAS) {
+        errno = EINVAL; // 別のレプリカ / 別のビルドのファイル
+        return -1;
+    }
+    return merge_values(gc, p->map->values, MAX_REPLICAS);
+}
+
+static int open_log(gc_persist *p, const char *dir, GCounter *gc) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/gc-%d.log", dir, p->replica_id);
+    p->log_fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (p->log_fd < 0) return -1;
+
+    // 先頭から正しいレコードが続く限り読み、最大値をとる
+    uint8_t buf[256 * GC_PERSIST_REC];
+    off_t good = 0;
+    uint64_t max = 0;
+    uint32_t next_seq = 0;
+    int first = 1, torn = 0;
+    ssize_t n;
+    size_t have = 0;
+    while (!torn && (n = pread(p->log_fd, buf + have, sizeof(buf) - have, good + (off_t)have)) > 0) {
+        have += (size_t)n;
+        size_t off = 0;
+        for (; off + GC_PERSIST_REC <= have; off += GC_PERSIST_REC) {
+            uint64_t v;
+            uint32_t seq;
+            if (!rec_get(buf + off, p->replica_id, &v, &seq) || (!first && seq != next_seq)) {
+                torn = 1; // 書きかけ (またはゴミ)。ここから後ろは捨てる
+                break;
+            }
+            first = 0;
+            next_seq = seq + 1;
+            if (v > max) max = v;
+            p->st.recovered_records++;
+        }
+        good += (off_t)off;
+        memmove(buf, buf + off, have - off);
+        have -= off;
+    }
+    if (n < 0) return -1;
+    struct stat sb;
+    if (fstat(p->log_fd, &sb) < 0) return -1;
+    if (sb.st_size != good && ftruncate(p->log_fd, good) < 0) return -1; // 続きから追記できるように
+    p->seq = next_seq;
+
+    if (max > 0) {
+        uint64_t values[MAX_REPLICAS] = {0};
+        values[p->replica_id] = max;
+        if (merge_values(gc, values, MAX_REPLICAS) < 0) return -1;
+    }
+    return 0;
+}
+
+int gc_persist_open(gc_persist *p, const char *dir, GCounter *gc, gc_fsync_policy policy) {
+    memset(p, 0, sizeof(*p));
+    p->state_fd = p->log_fd = -1;
+    p->policy = policy;
+    p->replica_id = gc->replica_id;
+    if (open_state(p, dir, gc) < 0 || open_log(p, dir, gc) < 0) {
+        int e = errno;
+        if (p->map) munmap(p->map, p->map_len);
+        if (p->state_fd >= 0) close(p->state_fd);
+        if (p->log_fd >= 0) close(p->log_fd);
+        p->map = NULL;
+        errno = e;
+        return -1;
+    }
+    p->logged = gc_value_of(gc, gc->replica_id);
+    return 0;
+}
+
+// -------------------- 書き込み --------------------
+
+static int write_all(int fd, const uint8_t *buf, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, buf, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+int gc_persist_commit(gc_persist *p) {
+    if (p->pending_n == 0) return 0;
+    if (write_all(p->log_fd, p->pending, GC_PERSIST_REC) < 0) return -1;
+    p->st.writes++;
+    p->pending_n = 0;
+    if (p->policy != GC_FSYNC_NONE) {
+        if (fdatasync(p->log_fd) < 0) return -1;
+        p->st.fsyncs++;
+    }
+    return 0;
+}
+
+int gc_persist_log(gc_persist *p, GCounter *gc) {
+    uint64_t v = gc_value_of(gc, gc->replica_id);
+    if (v <= p->logged) return 0;
+    // 値は絶対値なので、GROUP で次の commit までにたまる分は最後の 1 件で足りる (上書き)
+    if (p->pending_n == 0) p->seq++;
+    rec_put(p->pending, v, p->seq - 1, p->replica_id);
+    p->pending_n = 1;
+    p->logged = v;
+    p->st.logged++;
+    return p->policy == GC_FSYNC_GROUP ? 0 : gc_persist_commit(p);
+}
+
+int gc_persist_checkpoint(gc_persist *p, GCounter *gc) {
+    gc_fold_local(gc);
+    for (int i = 0; i < MAX_REPLICAS; ++i) p->map->values[i] = gc_value_of(gc, i);
+    if (p->policy != GC_FSYNC_NONE && msync(p->map, p->map_len, MS_SYNC) < 0) return -1;
+    // 状態ファイルが自スロットの値を持ったので、ログはもういらない
+    if (ftruncate(p->log_fd, 0) < 0) return -1;
+    p->pending_n = 0;
+    if (p->map->values[p->replica_id] > p->logged) p->logged = p->map->values[p->replica_id];
+    p->st.checkpoints++;
+    return 0;
+}
+
+void gc_persist_close(gc_persist *p) {
+    if (p->log_fd >= 0) {
+        gc_persist_commit(p);
+        close(p->log_fd);
+    }
+    if (p->map) {
+        if (p->policy != GC_FSYNC_NONE) msync(p->map, p->map_len, MS_SYNC);
+        munmap(p->map, p->map_len);
+    }
+    if (p->state_fd >= 0) close(p->state_fd);
+    p->map = NULL;
+    p->state_fd = p->log_fd = -1;
+}
@@ -0,0 +1,90 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// G‑Counter のローカル状態の永続化 (mmap した状態ファイル + 追記ログ)
+// ------------------------------------------------------------
+// 再起動で自スロット values[replica_id] が 0 に戻ると、peer の持っている
+// 大きい値に追いつくまで新しい増分が max マージに飲み込まれて消える。
+// それを防ぐため、自分の値を peer に送る前に必ずディスクに書いておく。
+//
+//   <dir>/gc-<id>.state  全スロットのスナップショット (mmap して直接書く)
+//   <dir>/gc-<id>.log    自スロットの値の追記ログ (GC_PERSIST_REC バイトのレコード)
+//
+// ログのレコードは増分ではなく「その時点の自スロットの値」なので、
+// 復元は max をとるだけ (何度読んでも同じ)。末尾が途中まで書かれた
+// レコードはチェック値で見分けて捨てる。チェックポイントで状態ファイルに
+// 全スロットを写して msync してからログを空にする。復元は状態ファイルを
+// map してログの残りを読むだけで、peer からの再送を待たない。
+// 値は単調に増えるだけなので、チェックポイントの途中で落ちても
+// 各スロットは新旧どちらかの (正しい下限の) 値になる。
+//
+// fsync の方針 (gc_fsync_policy):
+//   NONE   増分ごとに write するが fsync しない (プロセスが落ちても残るが、
+//          電源断では OS がまだ書いていない分を失う)
+//   GROUP  増分はためておき、gc_persist_commit() でまとめて 1 回 write + fdatasync
+//          (グループコミット。呼び出し側が短い間隔と送信前に commit する)。
+//          ためている間は最後のレコードを上書きするので、1 回の commit は 1 レコード
+//   ALWAYS 増分ごとに write + fdatasync
+// スレッドセーフではない (イベントループの 1 スレッドから使う)。
+// ------------------------------------------------------------
+#ifndef GC_PERSIST_H
+#define GC_PERSIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gc.h"
+
+#define GC_PERSIST_MAGIC 0x54534347u // "GCST"
+#define GC_PERSIST_VERSION 1
+#define GC_PERSIST_REC 16            // ログ 1 レコードのバイト数
+
+typedef enum { GC_FSYNC_NONE, GC_FSYNC_GROUP, GC_FSYNC_ALWAYS } gc_fsync_policy;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t replica_id;
+    uint32_t slots;       // MAX_REPLICAS
+    uint64_t values[];    // slots 個
+} gc_state_file;
+
+typedef struct {
+    unsigned long logged, writes, fsyncs, checkpoints;
+    unsigned long recovered_records; // 復元時に読んだログのレコード数
+} gc_persist_stats;
+
+typedef struct {
+    int state_fd, log_fd;
+    gc_state_file *map;
+    size_t map_len;
+    gc_fsync_policy policy;
+    int replica_id;
+    uint32_t seq;              // 次のログレコードの番号
+    uint64_t logged;           // ログに積んだ最後の自スロットの値
+    uint8_t pending[GC_PERSIST_REC]; // まだ書いていないレコード (GROUP で上書きしていく)
+    size_t pending_n;          // 書いていないレコード数 (0 か 1)
+    gc_persist_stats st;
+} gc_persist;
+
+// "none" / "group" / "always" を読む。不明なら -1
+int gc_fsync_parse(const char *s, gc_fsync_policy *out);
+
+// dir にある gc の状態を開く (なければ作る)。残っていた状態とログを gc に
+// マージする (gc は gc_init 済みで、まだ増分もマージもしていないこと)。失敗なら -1
+int gc_persist_open(gc_persist *p, const char *dir, GCounter *gc, gc_fsync_policy policy);
+// 自スロットの今の値をログに積む (変わっていなければ何もしない)。
+// ALWAYS / NONE ならその場で書く。失敗なら -1
+int gc_persist_log(gc_persist *p, GCounter *gc);
+// 積んであるレコードを 1 回の write で書き、方針に従って fdatasync する。
+// 自分の値を peer に送る前に必ず呼ぶこと。失敗なら -1
+int gc_persist_commit(gc_persist *p);
+// まだ書いていないレコードがあるか
+static inline int gc_persist_dirty(const gc_persist *p) {
+    return p->pending_n > 0;
+}
+// 全スロットを状態ファイルに写し (NONE 以外は msync)、ログを空にする。失敗なら -1
+int gc_persist_checkpoint(gc_persist *p, GCounter *gc);
+// commit して閉じる
+void gc_persist_close(gc_persist *p);
+
+#endif // GC_PERSIST_H
@@ -0,0 +1,63 @@
+// -*- coding: utf-8 -*-
+// 変更に応じた送信スケジューラ (説明は gc_sched.h)
+
+#include "gc_sched.h"
+
+void gc_sched_init(gc_sched *s, const gc_sched_config *cfg, uint64_t now) {
+    s->cfg = *cfg;
+    if (s->cfg.min_delay_ms == 0) s->cfg.min_delay_ms = 1;
+    if (s->cfg.max_interval_ms < s->cfg.min_delay_ms) s->cfg.max_interval_ms = s->cfg.min_delay_ms;
+    if (s->cfg.burst < 1) s->cfg.burst = 1;
+    s->changed_at = UINT64_MAX;
+    s->idle_interval = s->cfg.min_delay_ms;
+    s->next_idle = now; // 起動直後に 1 回 (全状態)
+    s->last_full = UINT64_MAX; // まだ送っていない
+    s->more = 0;
+    s->tokens = s->cfg.burst;
+    s->tokens_at = now;
+}
+
+void gc_sched_changed(gc_sched *s, uint64_t now) {
+    if (s->changed_at == UINT64_MAX) s->changed_at = now; // 最初の変更から数える (延ばさない)
+    s->idle_interval = s->cfg.min_delay_ms;
+}
+
+static void refill(gc_sched *s, uint64_t now) {
+    if (s->cfg.pps <= 0 || now <= s->tokens_at) return;
+    s->tokens += (double)(now - s->tokens_at) * s->cfg.pps / 1000.0;
+    if (s->tokens > s->cfg.burst) s->tokens = s->cfg.burst;
+    s->tokens_at = now;
+}
+
+uint64_t gc_sched_due(const gc_sched *s) {
+    if (s->more) { // トークンが 1 個たまる時刻
+        if (s->cfg.pps <= 0 || s->tokens >= 1) return s->tokens_at;
+        return s->tokens_at + (uint64_t)((1 - s->tokens) * 1000.0 / s->cfg.pps) + 1;
+    }
+    uint64_t due = s->next_idle;
+    if (s->changed_at != UINT64_MAX && s->changed_at + s->cfg.min_delay_ms < due) {
+        due = s->changed_at + s->cfg.min_delay_ms;
+    }
+    return due;
+}
+
+int gc_sched_begin(gc_sched *s, uint64_t now, int *full) {
+    refill(s, now);
+    int budget = s->cfg.pps > 0 ? (int)s->tokens : INT32_MAX;
+    *full = !s->more && budget > 0 && (s->last_full == UINT64_MAX || now - s->last_full >= s->cfg.full_every_ms);
+    if (*full) s->last_full = now;
+    return budget;
+}
+
+void gc_sched_end(gc_sched *s, uint64_t now, int sent, int more) {
+    if (s->cfg.pps > 0) s->tokens -= sent;
+    s->more = more;
+    if (more) return; // 残りはトークンがたまりしだい
+    if (s->changed_at == UINT64_MAX) {
+        // 変更のない回: 次はもっと先でよい
+        s->idle_interval *= 2;
+        if (s->idle_interval > s->cfg.max_interval_ms) s->idle_interval = s->cfg.max_interval_ms;
+    }
+    s->changed_at = UINT64_MAX;
+    s->next_idle = now + s->idle_interval;
+}
@@ -0,0 +1,52 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 変更に応じて送る時刻を決めるスケジューラ
+// ------------------------------------------------------------
+// 固定間隔 (UDPstate の BROADCAST_INTERVAL_SEC) だと、増分から peer に届くまで
+// 最大 1 間隔待たされ、何も変わっていなくても毎回起きる。代わりに
+//   - 自分の値が変わったら min_delay_ms 後に送る。その間の増分はまとめて
+//     1 回で送る (Nagle と同じ考え方。バーストが何通にもならない)
+//   - 変更がなければ、送る間隔を min_delay_ms から倍々に max_interval_ms まで延ばす
+//     (peer から受け取った分の転送はこの間隔で)
+//   - full_every_ms ごとに全状態を送る (anti‑entropy)
+//   - 送信はトークンバケツで pps パケット/秒 (最大 burst 個まとめて) に抑え、
+//     足りなければ残りの peer は次にトークンがたまったときに送る
+//     (gc_sync_paced が peer を順番に回るので、どの peer も飢えない)
+// 時刻はすべて呼び出し側が渡す ms (実時間でも模擬時間でもよい)。I/O はしない。
+// ------------------------------------------------------------
+#ifndef GC_SCHED_H
+#define GC_SCHED_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint64_t min_delay_ms;    // 変更からこれだけ待ってまとめて送る
+    uint64_t max_interval_ms; // 変更がなくても少なくともこの間隔で送る
+    uint64_t full_every_ms;   // 全状態を送る間隔
+    double pps;               // 送信パケット/秒の上限 (0 なら無制限)
+    double burst;             // 一度に送れる数の上限 (トークンの上限)
+} gc_sched_config;
+
+typedef struct {
+    gc_sched_config cfg;
+    uint64_t changed_at;    // まだ送っていない変更が最初に起きた時刻 (UINT64_MAX ならなし)
+    uint64_t next_idle;     // 変更がないときに次に送る時刻
+    uint64_t idle_interval; // いまの間隔 (変更のたびに min_delay_ms に戻る)
+    uint64_t last_full;     // 最後に全状態を送った時刻 (UINT64_MAX ならまだ)
+    int more;               // トークンが足りず送り残した
+    double tokens;
+    uint64_t tokens_at;
+} gc_sched;
+
+void gc_sched_init(gc_sched *s, const gc_sched_config *cfg, uint64_t now);
+// 自分の値が変わった
+void gc_sched_changed(gc_sched *s, uint64_t now);
+// 次に gc_sched_begin を呼ぶべき時刻
+uint64_t gc_sched_due(const gc_sched *s);
+// 送る直前に呼ぶ。今回送ってよいパケット数 (無制限なら INT32_MAX) を返し、
+// 全状態を送る番なら *full = 1 (送り残しを送っている途中は 0。次の回に回す)
+int gc_sched_begin(gc_sched *s, uint64_t now, int *full);
+// 送ったあとに呼ぶ。sent: 送った数、more: 送り残しがある
+void gc_sched_end(gc_sched *s, uint64_t now, int sent, int more);
+
+#endif // GC_SCHED_H
@@ -0,0 +1,139 @@
+// -*- coding: utf-8 -*-
+// 共有メモリの G‑Counter (説明は gc_shm.h)
+
+#define _GNU_SOURCE
+#include "gc_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t seg_len(int nslots) {
+    return sizeof(gc_shm_seg) + (size_t)nslots * sizeof(gc_shm_slot);
+}
+
+static int map_seg(gc_shm *s, int fd, size_t len) {
+    void *m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // マップしたあとは fd はいらない
+    if (m == MAP_FAILED) return -1;
+    s->seg = m;
+    s->len = len;
+    return 0;
+}
+
+int gc_shm_create(gc_shm *s, const char *name, int nslots) {
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) return -1;
+    size_t len = seg_len(nslots);
+    if (ftruncate(fd, (off_t)len) < 0 || map_seg(s, fd, len) < 0) { // 0 で埋まっている
+        int e = errno;
+        shm_unlink(name);
+        errno = e;
+        return -1;
+    }
+    s->seg->nslots = (uint32_t)nslots;
+    s->seg->version = GC_SHM_VERSION;
+    atomic_thread_fence(memory_order_release);
+    s->seg->magic = GC_SHM_MAGIC; // 最後に書く (attach 側はこれで準備完了を知る)
+    s->nslots = nslots;
+    return 0;
+}
+
+int gc_shm_attach(gc_shm *s, const char *name) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) return -1;
+    struct stat sb;
+    if (fstat(fd, &sb) < 0 || (size_t)sb.st_size < sizeof(gc_shm_seg)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    if (map_seg(s, fd, (size_t)sb.st_size) < 0) return -1;
+    if (s->seg->magic != GC_SHM_MAGIC || s->seg->version != GC_SHM_VERSION ||
+        seg_len((int)s->seg->nslots) > s->len) {
+        gc_shm_detach(s);
+        errno = EINVAL;
+        return -1;
+    }
+    s->nslots = (int)s->seg->nslots;
+    return 0;
+}
+
+void gc_shm_detach(gc_shm *s) {
+    if (s->seg) munmap(s->seg, s->len);
+    s->seg = NULL;
+    s->len = 0;
+    s->nslots = 0;
+}
+
+int gc_shm_unlink(const char *name) {
+    return shm_unlink(name);
+}
+
+int gc_shm_claim(gc_shm *s, int32_t pid) {
+    for (int i = 0; i < s->nslots; ++i) {
+        int32_t free_owner = 0;
+        if (atomic_compare_exchange_strong(&s->seg->slot[i].owner, &free_owner, pid)) return i;
+    }
+    errno = ENOSPC;
+    return -1;
+}
+
+void gc_shm_release(gc_shm *s, int id) {
+    atomic_store(&s->seg->slot[id].owner, 0);
+}
+
+// seqlock の読み: 偶数の seq を読み、値を読み、seq が同じなら成功 (1)。
+// GC_SHM_SLOT_TRIES 回読んでも書き途中なら (書き手が奇数の seq のまま死んだなど)
+// あきらめて 0。値そのものは atomic なので、*v には足す前か後の値が入っている
+static inline int read_slot(const gc_shm_slot *sl, uint64_t *v, uint64_t *seq) {
+    gc_shm_slot *w = (gc_shm_slot *)sl;
+    for (int t = 0; t < GC_SHM_SLOT_TRIES; ++t) {
+        uint64_t s1 = atomic_load_explicit(&w->seq, memory_order_acquire);
+        *v = atomic_load_explicit(&w->value, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire); // 値の読みを seq の読み直しより前に
+        uint64_t s2 = atomic_load_explicit(&w->seq, memory_order_relaxed);
+        if (s1 == s2 && !(s1 & 1)) {
+            *seq = s1;
+            return 1;
+        }
+    }
+    *v = atomic_load_explicit(&w->value, memory_order_relaxed);
+    return 0;
+}
+
+uint64_t gc_shm_load(const gc_shm *s, int id) {
+    uint64_t v, seq;
+    read_slot(&s->seg->slot[id], &v, &seq);
+    return v;
+}
+
+uint64_t gc_shm_value(const gc_shm *s) {
+    uint64_t sum = 0, v, seq;
+    for (int i = 0; i < s->nslots; ++i) {
+        read_slot(&s->seg->slot[i], &v, &seq);
+        sum += v;
+    }
+    return sum;
+}
+
+int gc_shm_snapshot(const gc_shm *s, uint64_t *out) {
+    uint64_t seqs[s->nslots];
+    for (int t = 0; t < GC_SHM_TRIES; ++t) {
+        int stuck = 0;
+        for (int i = 0; i < s->nslots; ++i) stuck |= !read_slot(&s->seg->slot[i], &out[i], &seqs[i]);
+        if (stuck) return 1; // 書き途中のまま止まったスロットがある: 待っても終わらない
+        atomic_thread_fence(memory_order_acquire);
+        int same = 1;
+        for (int i = 0; i < s->nslots && same; ++i) {
+            same = atomic_load_explicit(&s->seg->slot[i].seq, memory_order_relaxed) == seqs[i];
+        }
+        // 2 回目の収集まで 1 つも変わっていない: 1 回目の終わりの瞬間に全部この値だった
+        if (same) return 0;
+    }
+    return 1; // out はスロットごとには一貫している
+}
@@ -0,0 +1,91 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 同じホストのプロセスで共有する G‑Counter (shm_open + mmap)
+// ------------------------------------------------------------
+// 共有メモリのセグメントに、プロセスごとのスロットを 1 キャッシュラインずつ
+// 並べる。各スロットの書き手はそれを claim した 1 プロセスだけで、
+// 読み手はコピーもパイプもなしに全スロットを直接読む。
+//
+// 書き手はスロットごとの seqlock で書く: seq を奇数にする → 値を書く →
+// seq を偶数に戻す。読み手は
+//   - 1 スロット: seq が偶数で前後で変わっていなければその値
+//   - 全スロットの一貫したスナップショット (ある瞬間の全スロットの値):
+//     全スロットの (seq, 値) を集めたあと seq だけもう一度集め、どれも
+//     変わっていなければ成功 (double collect)。書き手はロックも待ちもしない。
+// 値は単調に増えるので、一貫していないスナップショット (スロットごとに
+// 違う瞬間の値) も正しい G‑Counter の状態 (下限) ではある。
+//
+// セグメントは名前 ("/gc-demo" など) で開くので、fork で作った子でなくても
+// gc_shm_attach で同じカウンタに参加できる。スロットを手放しても値は残り、
+// 次に claim したプロセスが続きから足す (G‑Counter の寄与は消せないため)。
+// ------------------------------------------------------------
+#ifndef GC_SHM_H
+#define GC_SHM_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gc_core.h"
+
+#define GC_SHM_MAGIC 0x4d485343u // "CSHM"
+#define GC_SHM_VERSION 1
+#define GC_SHM_TRIES 64          // 一貫したスナップショットを試す回数
+#define GC_SHM_SLOT_TRIES 4096   // 1 スロットの書き終わりを待って読み直す回数
+
+typedef struct {
+    _Alignas(GC_CACHELINE) _Atomic uint64_t seq; // 奇数なら書いている途中
+    _Atomic uint64_t value;
+    _Atomic int32_t owner;                       // claim したプロセスの pid (0 なら空き)
+} gc_shm_slot;
+
+_Static_assert(sizeof(gc_shm_slot) == GC_CACHELINE, "gc_shm_slot must fill exactly one cache line");
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nslots;
+    gc_shm_slot slot[]; // ヘッダの後ろでキャッシュライン境界にそろう
+} gc_shm_seg;
+
+typedef struct {
+    gc_shm_seg *seg;
+    size_t len;
+    int nslots;
+} gc_shm;
+
+// name のセグメントを nslots スロットで作る (すでにあれば EEXIST で -1)
+int gc_shm_create(gc_shm *s, const char *name, int nslots);
+// 既存のセグメントにつなぐ。失敗なら -1
+int gc_shm_attach(gc_shm *s, const char *name);
+void gc_shm_detach(gc_shm *s);
+// 名前を消す (つないでいるプロセスはそのまま使える)
+int gc_shm_unlink(const char *name);
+
+// 空いているスロットを自分 (pid) のものにする。スロット番号か、空きがなければ -1
+int gc_shm_claim(gc_shm *s, int32_t pid);
+void gc_shm_release(gc_shm *s, int id);
+
+// 自分のスロット id に delta を足す (そのスロットの書き手は 1 プロセスだけ)
+static inline void gc_shm_add(gc_shm *s, int id, uint64_t delta) {
+    gc_shm_slot *sl = &s->seg->slot[id];
+    uint64_t q = atomic_load_explicit(&sl->seq, memory_order_relaxed);
+    atomic_store_explicit(&sl->seq, q + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // 奇数の seq が値より先に見える
+    uint64_t v = atomic_load_explicit(&sl->value, memory_order_relaxed);
+    atomic_store_explicit(&sl->value, v + delta, memory_order_relaxed);
+    atomic_store_explicit(&sl->seq, q + 2, memory_order_release);
+}
+
+// スロット id の値 (書き途中なら GC_SHM_SLOT_TRIES 回まで読み直す。
+// それでも終わらなければ、書き手が途中で死んでいても読める atomic な値を返す)
+uint64_t gc_shm_load(const gc_shm *s, int id);
+// 全スロットの合計 (スロットごとには一貫している)
+uint64_t gc_shm_value(const gc_shm *s);
+// 全スロットの一貫したスナップショットを out[nslots] に入れる。
+// GC_SHM_TRIES 回やっても書き手が止まらないか、書き途中のまま止まった
+// スロットがあれば、スロットごとの値 (どれも下限として正しい) を入れて
+// 1 を返す (成功なら 0)
+int gc_shm_snapshot(const gc_shm *s, uint64_t *out);
+
+#endif // GC_SHM_H
@@ -0,0 +1,237 @@
+// -*- coding: utf-8 -*-
+// レプリカベクタ用 SIMD カーネル (説明は gc_simd.h)
+
+#include "gc_simd.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define GC_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+// -------------------- スカラ版 --------------------
+
+static uint64_t max_scalar(uint64_t *dst, const uint64_t *src, size_t n) {
+    uint64_t grown = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (src[i] > dst[i]) {
+            grown += src[i] - dst[i];
+            dst[i] = src[i];
+        }
+    }
+    return grown;
+}
+
+static uint64_t sum_scalar(const uint64_t *src, size_t n) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; ++i) sum += src[i];
+    return sum;
+}
+
+static uint64_t max_batch_scalar(uint64_t *dst, const uint64_t *const srcs[], size_t k, size_t n) {
+    uint64_t grown = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t m = dst[i];
+        for (size_t j = 0; j < k; ++j) {
+            if (srcs[j][i] > m) m = srcs[j][i];
+        }
+        grown += m - dst[i];
+        dst[i] = m;
+    }
+    return grown;
+}
+
+#ifdef GC_SIMD_X86
+// -------------------- AVX2 --------------------
+// AVX2 には 64bit の unsigned max がないので、符号ビットを反転して
+// signed 比較 (cmpgt_epi64) に置き換える
+
+__attribute__((target("avx2"))) static inline __m256i max_epu64_avx2(__m256i a, __m256i b) {
+    const __m256i sign = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+    __m256i gt = _mm256_cmpgt_epi64(_mm256_xor_si256(b, sign), _mm256_xor_si256(a, sign));
+    return _mm256_blendv_epi8(a, b, gt);
+}
+
+// 4 レーンの合計
+__attribute__((target("avx2"))) static inline uint64_t hsum_avx2(__m256i v) {
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, v);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__((target("avx2"))) static uint64_t max_avx2(uint64_t *dst, const uint64_t *src, size_t n) {
+    __m256i grown = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i m = max_epu64_avx2(a, _mm256_loadu_si256((const __m256i *)(src + i)));
+        grown = _mm256_add_epi64(grown, _mm256_sub_epi64(m, a));
+        _mm256_storeu_si256((__m256i *)(dst + i), m);
+    }
+    return hsum_avx2(grown) + max_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) static uint64_t sum_avx2(const uint64_t *src, size_t n) {
+    __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) { // 2 本のアキュムレータで依存を切る
+        acc0 = _mm256_add_epi64(acc0, _mm256_loadu_si256((const __m256i *)(src + i)));
+        acc1 = _mm256_add_epi64(acc1, _mm256_loadu_si256((const __m256i *)(src + i + 4)));
+    }
+    return hsum_avx2(_mm256_add_epi64(acc0, acc1)) + sum_scalar(src + i, n - i);
+}
+
+__attribute__((target("avx2"))) static uint64_t max_batch_avx2(uint64_t *dst, const uint64_t *const srcs[],
+                                                               size_t k, size_t n) {
+    __m256i grown = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i m = a;
+        for (size_t j = 0; j < k; ++j) {
+            m = max_epu64_avx2(m, _mm256_loadu_si256((const __m256i *)(srcs[j] + i)));
+        }
+        grown = _mm256_add_epi64(grown, _mm256_sub_epi64(m, a));
+        _mm256_storeu_si256((__m256i *)(dst + i), m);
+    }
+    uint64_t tail = 0;
+    for (; i < n; ++i) {
+        uint64_t m = dst[i];
+        for (size_t j = 0; j < k; ++j) {
+            if (srcs[j][i] > m) m = srcs[j][i];
+        }
+        tail += m - dst[i];
+        dst[i] = m;
+    }
+    return hsum_avx2(grown) + tail;
+}
+
+// -------------------- AVX‑512 --------------------
+
+__attribute__((target("avx512f"))) static uint64_t max_avx512(uint64_t *dst, const uint64_t *src, size_t n) {
+    __m512i grown = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512i a = _mm512_loadu_si512(dst + i);
+        __m512i m = _mm512_max_epu64(a, _mm512_loadu_si512(src + i));
+        grown = _mm512_add_epi64(grown, _mm512_sub_epi64(m, a));
+        _mm512_storeu_si512(dst + i, m);
+    }
+    if (i < n) { // 端数はマスク付きで 1 回
+        __mmask8 k = (__mmask8)((1u << (n - i)) - 1);
+        __m512i a = _mm512_maskz_loadu_epi64(k, dst + i);
+        __m512i m = _mm512_max_epu64(a, _mm512_maskz_loadu_epi64(k, src + i));
+        grown = _mm512_add_epi64(grown, _mm512_sub_epi64(m, a));
+        _mm512_mask_storeu_epi64(dst + i, k, m);
+    }
+    return (uint64_t)_mm512_reduce_add_epi64(grown);
+}
+
+__attribute__((target("avx512f"))) static uint64_t sum_avx512(const uint64_t *src, size_t n) {
+    __m512i acc0 = _mm512_setzero_si512(), acc1 = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm512_add_epi64(acc0, _mm512_loadu_si512(src + i));
+        acc1 = _mm512_add_epi64(acc1, _mm512_loadu_si512(src + i + 8));
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm512_add_epi64(acc0, _mm512_loadu_si512(src + i));
+    }
+    if (i < n) {
+        __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+        acc1 = _mm512_add_epi64(acc1, _mm512_maskz_loadu_epi64(m, src + i));
+    }
+    return (uint64_t)_mm512_reduce_add_epi64(_mm512_add_epi64(acc0, acc1));
+}
+
+__attribute__((target("avx512f"))) static uint64_t max_batch_avx512(uint64_t *dst, const uint64_t *const srcs[],
+                                                                    size_t k, size_t n) {
+    __m512i grown = _mm512_setzero_si512();
+    for (size_t i = 0; i < n; i += 8) {
+        __mmask8 mk = n - i >= 8 ? (__mmask8)0xff : (__mmask8)((1u << (n - i)) - 1);
+        __m512i a = _mm512_maskz_loadu_epi64(mk, dst + i);
+        __m512i m = a;
+        for (size_t j = 0; j < k; ++j) {
+            m = _mm512_max_epu64(m, _mm512_maskz_loadu_epi64(mk, srcs[j] + i));
+        }
+        grown = _mm512_add_epi64(grown, _mm512_sub_epi64(m, a));
+        _mm512_mask_storeu_epi64(dst + i, mk, m);
+    }
+    return (uint64_t)_mm512_reduce_add_epi64(grown);
+}
+#endif // GC_SIMD_X86
+
+// -------------------- ディスパッチ --------------------
+
+typedef struct {
+    const char *name;
+    uint64_t (*max)(uint64_t *, const uint64_t *, size_t);
+    uint64_t (*sum)(const uint64_t *, size_t);
+    uint64_t (*max_batch)(uint64_t *, const uint64_t *const[], size_t, size_t);
+    int (*supported)(void);
+} simd_impl;
+
+static int always(void) { return 1; }
+#ifdef GC_SIMD_X86
+static int has_avx2(void) { return __builtin_cpu_supports("avx2"); }
+static int has_avx512(void) { return __builtin_cpu_supports("avx512f"); }
+#endif
+
+static const simd_impl impls[] = { // 速い順
+#ifdef GC_SIMD_X86
+    {"avx512", max_avx512, sum_avx512, max_batch_avx512, has_avx512},
+    {"avx2", max_avx2, sum_avx2, max_batch_avx2, has_avx2},
+#endif
+    {"scalar", max_scalar, sum_scalar, max_batch_scalar, always},
+};
+
+// 複数スレッドが同時に初回判定しても同じ値を書くだけなので relaxed でよい
+static _Atomic(const simd_impl *) active;
+
+static const simd_impl *pick(void) {
+    const simd_impl *impl = atomic_load_explicit(&active, memory_order_relaxed);
+    if (!impl) {
+#ifdef GC_SIMD_X86
+        __builtin_cpu_init();
+#endif
+        for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i) {
+            if (impls[i].supported()) {
+                impl = &impls[i];
+                break;
+            }
+        }
+        atomic_store_explicit(&active, impl, memory_order_relaxed);
+    }
+    return impl;
+}
+
+uint64_t gc_vec_max_u64(uint64_t *dst, const uint64_t *src, size_t n) {
+    return pick()->max(dst, src, n);
+}
+
+uint64_t gc_vec_sum_u64(const uint64_t *src, size_t n) {
+    return pick()->sum(src, n);
+}
+
+uint64_t gc_vec_max_batch_u64(uint64_t *dst, const uint64_t *const srcs[], size_t k, size_t n) {
+    return pick()->max_batch(dst, srcs, k, n);
+}
+
+const char *gc_simd_impl(void) {
+    return pick()->name;
+}
+
+int gc_simd_select(const char *name) {
+#ifdef GC_SIMD_X86
+    __builtin_cpu_init();
+#endif
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i) {
+        if (strcmp(impls[i].name, name) == 0 && impls[i].supported()) {
+            atomic_store_explicit(&active, &impls[i], memory_order_relaxed);
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,27 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// レプリカベクタ用の SIMD カーネル (要素ごとの unsigned max と総和)
+// ------------------------------------------------------------
+// 初回呼び出し時に CPU を調べて AVX‑512 → AVX2 → スカラの順に選ぶ。
+// x86 以外や古いコンパイラではスカラ版だけになる。
+// ------------------------------------------------------------
+#ifndef GC_SIMD_H
+#define GC_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// dst[i] = max(dst[i], src[i])。dst が増えた量の合計を返す
+uint64_t gc_vec_max_u64(uint64_t *dst, const uint64_t *src, size_t n);
+// src[0] + ... + src[n-1] (2^64 で折り返す)
+uint64_t gc_vec_sum_u64(const uint64_t *src, size_t n);
+// dst[i] = max(dst[i], srcs[0][i], ..., srcs[k-1][i]) を dst 1 パスで行う。
+// dst が増えた量の合計を返す
+uint64_t gc_vec_max_batch_u64(uint64_t *dst, const uint64_t *const srcs[], size_t k, size_t n);
+
+// 使っている実装名 ("avx512" / "avx2" / "scalar")
+const char *gc_simd_impl(void);
+// 実装を明示的に選ぶ (ベンチ用)。CPU が対応していなければ -1
+int gc_simd_select(const char *name);
+
+#endif // GC_SIMD_H
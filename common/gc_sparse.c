@@ -0,0 +1,181 @@
+// -*- coding: utf-8 -*-
+// 疎な G‑Counter (説明は gc_sparse.h)
+
+#include "gc_sparse.h"
+#include "gc_wire.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void gc_sparse_init(gc_sparse *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+void gc_sparse_free(gc_sparse *s) {
+    free(s->e);
+    free(s->scratch);
+    memset(s, 0, sizeof(*s));
+}
+
+static int reserve(gc_sparse_entry **buf, size_t *cap, size_t need) {
+    if (need <= *cap) return 0;
+    size_t ncap = *cap ? *cap : 8;
+    while (ncap < need) ncap *= 2;
+    gc_sparse_entry *p = realloc(*buf, ncap * sizeof(**buf));
+    if (!p) return -1;
+    *buf = p;
+    *cap = ncap;
+    return 0;
+}
+
+int gc_sparse_copy(gc_sparse *dst, const gc_sparse *src) {
+    if (reserve(&dst->e, &dst->cap, src->n) < 0) return -1;
+    if (src->n > 0) memcpy(dst->e, src->e, src->n * sizeof(*src->e));
+    dst->n = src->n;
+    dst->total = src->total;
+    return 0;
+}
+
+// id 以上の最初の位置
+static size_t lower_bound(const gc_sparse *s, uint64_t id) {
+    size_t lo = 0, hi = s->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (s->e[mid].id < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+uint64_t gc_sparse_get(const gc_sparse *s, uint64_t id) {
+    size_t i = lower_bound(s, id);
+    return i < s->n && s->e[i].id == id ? s->e[i].value : 0;
+}
+
+// id の位置を返す。なければ value=0 で挿入する。メモリ不足なら -1
+static long find_or_insert(gc_sparse *s, uint64_t id) {
+    size_t i = lower_bound(s, id);
+    if (i < s->n && s->e[i].id == id) return (long)i;
+    if (reserve(&s->e, &s->cap, s->n + 1) < 0) return -1;
+    memmove(&s->e[i + 1], &s->e[i], (s->n - i) * sizeof(s->e[0]));
+    s->e[i].id = id;
+    s->e[i].value = 0;
+    s->n++;
+    return (long)i;
+}
+
+int gc_sparse_add(gc_sparse *s, uint64_t id, uint64_t delta) {
+    if (delta == 0) return 0;
+    long i = find_or_insert(s, id);
+    if (i < 0) return -1;
+    s->e[i].value += delta;
+    s->total += delta;
+    return 0;
+}
+
+uint64_t gc_sparse_store_max(gc_sparse *s, uint64_t id, uint64_t val) {
+    if (val == 0) return 0;
+    long i = find_or_insert(s, id);
+    if (i < 0 || val <= s->e[i].value) return 0;
+    uint64_t grown = val - s->e[i].value;
+    s->e[i].value = val;
+    s->total += grown;
+    return grown;
+}
+
+// -------------------- マージジョイン --------------------
+
+// 昇順の入力列を 1 個ずつ取り出すための小さなインタフェース
+typedef struct {
+    const gc_sparse_entry *e; // gc_sparse から読む場合
+    size_t n, i;
+    gc_wire_reader r;         // ワイヤから読む場合 (e == NULL)
+    uint64_t min_id;
+    int bad;
+} source;
+
+static int source_next(source *src, uint64_t *id, uint64_t *val) {
+    if (src->e) {
+        if (src->i >= src->n) return 0;
+        *id = src->e[src->i].id;
+        *val = src->e[src->i].value;
+        src->i++;
+        return 1;
+    }
+    int rc;
+    while ((rc = gc_wire_next(&src->r, id, val)) > 0) {
+        if (*id >= src->min_id && *val > 0) return 1;
+    }
+    if (rc < 0) src->bad = 1;
+    return 0;
+}
+
+// src を dst にマージする。新しい ID がなければその場で更新し、
+// あれば scratch に並べ直して入れ替える
+static int merge_source(gc_sparse *dst, source first_pass, source second_pass, uint64_t *grown_out) {
+    // 1 パス目: 新しい ID の数を数える (同時に既存 ID はその場で max する)
+    size_t fresh = 0, j = 0;
+    uint64_t grown = 0, id, val;
+    while (source_next(&first_pass, &id, &val)) {
+        while (j < dst->n && dst->e[j].id < id) j++;
+        if (j < dst->n && dst->e[j].id == id) {
+            if (val > dst->e[j].value) {
+                grown += val - dst->e[j].value;
+                dst->e[j].value = val;
+            }
+        } else {
+            fresh++;
+        }
+    }
+    if (first_pass.bad) second_pass.bad = 1;
+
+    if (fresh > 0) {
+        // 2 パス目: 既存 (更新済み) と新規を昇順に scratch へ並べる
+        if (reserve(&dst->scratch, &dst->scratch_cap, dst->n + fresh) < 0) {
+            dst->total += grown;
+            *grown_out = grown;
+            return -1;
+        }
+        size_t out = 0;
+        j = 0;
+        while (source_next(&second_pass, &id, &val)) {
+            while (j < dst->n && dst->e[j].id < id) dst->scratch[out++] = dst->e[j++];
+            if (j < dst->n && dst->e[j].id == id) {
+                dst->scratch[out++] = dst->e[j++]; // 1 パス目で max 済み
+            } else {
+                dst->scratch[out].id = id;
+                dst->scratch[out].value = val;
+                out++;
+                grown += val;
+            }
+        }
+        while (j < dst->n) dst->scratch[out++] = dst->e[j++];
+
+        gc_sparse_entry *tmp = dst->e;
+        size_t tmp_cap = dst->cap;
+        dst->e = dst->scratch;
+        dst->cap = dst->scratch_cap;
+        dst->n = out;
+        dst->scratch = tmp;
+        dst->scratch_cap = tmp_cap;
+    }
+    dst->total += grown;
+    *grown_out = grown;
+    return first_pass.bad ? -1 : 0;
+}
+
+int gc_sparse_merge(gc_sparse *dst, const gc_sparse *src, uint64_t *grown) {
+    source a = {.e = src->e, .n = src->n};
+    source b = a;
+    return merge_source(dst, a, b, grown);
+}
+
+int gc_sparse_merge_wire(gc_sparse *s, const void *buf, size_t len, uint64_t min_id, uint64_t *grown) {
+    source a = {.min_id = min_id};
+    if (gc_wire_reader_init(&a.r, buf, len, NULL) < 0) {
+        *grown = 0;
+        return -1;
+    }
+    source b = a; // reader は位置を持つだけなのでコピーすれば 2 回なめられる
+    return merge_source(s, a, b, grown);
+}
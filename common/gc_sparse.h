@@ -0,0 +1,60 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 任意の 64bit レプリカ ID を持てる疎な G‑Counter
+// ------------------------------------------------------------
+// (id, value) を id 昇順に並べた 1 本の配列で持つ。メモリは
+// 実際に値を持っているレプリカ数にだけ比例する (空きスロットがない)。
+// - 1 件の参照・更新は二分探索
+// - 2 つのカウンタのマージは昇順同士のマージジョイン (O(n + m))
+// - ワイヤ形式 (gc_wire.h) も id 昇順なので、受信データも同じく線形にマージする
+// スレッドセーフではない。共有するなら呼び出し側でロックすること。
+// ------------------------------------------------------------
+#ifndef GC_SPARSE_H
+#define GC_SPARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint64_t id;
+    uint64_t value;
+} gc_sparse_entry;
+
+typedef struct {
+    gc_sparse_entry *e;  // id 昇順
+    size_t n;
+    size_t cap;
+    uint64_t total;      // Σ value (増えた量だけ足して維持)
+    gc_sparse_entry *scratch; // マージ用の作業領域 (使い回す)
+    size_t scratch_cap;
+} gc_sparse;
+
+void gc_sparse_init(gc_sparse *s);
+void gc_sparse_free(gc_sparse *s);
+
+// dst を src と同じ中身にする (dst の領域は使い回す)。メモリ不足なら -1
+int gc_sparse_copy(gc_sparse *dst, const gc_sparse *src);
+// id の値 (なければ 0)
+uint64_t gc_sparse_get(const gc_sparse *s, uint64_t id);
+// id に delta を足す。メモリ不足なら -1
+int gc_sparse_add(gc_sparse *s, uint64_t id, uint64_t delta);
+// id を max(val) にする。増えた量を返す (メモリ不足なら 0 で何もしない)
+uint64_t gc_sparse_store_max(gc_sparse *s, uint64_t id, uint64_t val);
+
+// dst := dst ⊔ src。増えた量を *grown に入れる。メモリ不足なら -1
+// (そのときも既存 ID の更新は反映済みで、新しい ID だけが入らない)
+int gc_sparse_merge(gc_sparse *dst, const gc_sparse *src, uint64_t *grown);
+// バイナリ形式のデータグラムをマージする。min_id 未満の ID は飛ばす。
+// 増えた量を *grown に入れる。壊れている / メモリ不足なら -1
+int gc_sparse_merge_wire(gc_sparse *s, const void *buf, size_t len, uint64_t min_id, uint64_t *grown);
+
+static inline uint64_t gc_sparse_value(const gc_sparse *s) {
+    return s->total;
+}
+
+// 使用メモリ (バイト)
+static inline size_t gc_sparse_bytes(const gc_sparse *s) {
+    return sizeof(*s) + (s->cap + s->scratch_cap) * sizeof(gc_sparse_entry);
+}
+
+#endif // GC_SPARSE_H
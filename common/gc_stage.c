@@ -0,0 +1,50 @@
+// -*- coding: utf-8 -*-
+// 受信スレッドごとのステージング (説明は gc_stage.h)
+
+#include "gc_stage.h"
+
+#include <string.h>
+
+#include "gc_wire.h"
+
+void gc_stage_init(gc_stage *st) {
+    memset(st, 0, sizeof(*st));
+}
+
+int gc_stage_merge_buf(gc_stage *st, GCounter *gc, const void *buf, size_t len) {
+    gc_wire_reader r;
+    if (!gc_wire_is_binary(buf, len)) {
+        unsigned long before = gc_total(gc);
+        gc_merge_buf(gc, buf, len); // テキスト形式 (デバッグ用) は直接
+        return gc_total(gc) != before;
+    }
+    if (gc_wire_reader_init(&r, buf, len, NULL) < 0) return -1;
+
+    int grown = 0, rc;
+    uint64_t id, val;
+    while ((rc = gc_wire_next(&r, &id, &val)) > 0) {
+        if (id >= MAX_REPLICAS) {
+            // ID は昇順なので残りは全部 extra 行き。データグラムごと共有状態へ
+            // (前半の密なエントリも入るが max マージなので害はない)
+            unsigned long before = gc_total(gc);
+            rc = gc_merge_buf(gc, buf, len);
+            grown |= gc_total(gc) != before;
+            break;
+        }
+        if (val > st->v[id]) {
+            st->v[id] = val;
+            st->dirty[id / 64] |= 1ULL << (id % 64);
+            st->pending++;
+            grown = 1;
+        }
+    }
+    return rc < 0 ? -1 : grown;
+}
+
+uint64_t gc_stage_fold(gc_stage *st, GCounter *gc) {
+    if (st->pending == 0) return 0;
+    uint64_t grown = gc_merge_dense(gc, st->v, st->dirty);
+    memset(st->dirty, 0, sizeof(st->dirty));
+    st->pending = 0;
+    return grown;
+}
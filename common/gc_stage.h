@@ -0,0 +1,40 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 受信スレッドごとのステージング (あとでまとめて共有状態へ畳み込む)
+// ------------------------------------------------------------
+// 共有の GCounter へのマージはロックフリーだが、スロットが増えるたびに
+// そのキャッシュラインへの CAS、合計 total への fetch_add、peer ごとの
+// dirty ビットの fetch_or が起きる。受信スレッドが何本もあると、これらの
+// 共有キャッシュラインを取り合う。
+//
+// そこで各受信スレッドは自分だけの密な配列 v[] に max マージしておき
+// (共有メモリには触らない)、ときどき gc_stage_fold で変わったスロットだけを
+// 共有状態へ max マージする。同じスロットの更新が何回来ても畳み込みは 1 回で、
+// v[] はクリアしないので、もう知っている値の再送はここで捨てられる。
+//
+// ID が MAX_REPLICAS 以上のエントリとテキスト形式は稀なので、
+// そのデータグラムごと共有状態へ直接マージする。
+// 1 つの gc_stage を使うのは 1 スレッドだけ。
+// ------------------------------------------------------------
+#ifndef GC_STAGE_H
+#define GC_STAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gc.h"
+
+typedef struct {
+    uint64_t v[MAX_REPLICAS];         // このスレッドが見た各スロットの最大値
+    uint64_t dirty[GC_DENSE_WORDS];   // 前回の畳み込みから増えたスロット
+    unsigned pending;                 // 前回の畳み込みから増えた回数
+} gc_stage;
+
+void gc_stage_init(gc_stage *st);
+// データグラムをステージに max マージする。何か増えたら 1、増えなければ 0、
+// 壊れていれば -1 (途中までのエントリは有効)。extra / テキストは gc へ直接
+int gc_stage_merge_buf(gc_stage *st, GCounter *gc, const void *buf, size_t len);
+// 増えたスロットを gc へ畳み込む。共有状態の合計が増えた量を返す
+uint64_t gc_stage_fold(gc_stage *st, GCounter *gc);
+
+#endif // GC_STAGE_H
@@ -0,0 +1,63 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 自レプリカの増分をスレッドごとのセルに分散させるカウンタ
+// ------------------------------------------------------------
+// 同じプロセス内の多数のスレッドが自分のレプリカを同時に増やすと、
+// values[replica_id] の 1 キャッシュラインに書き込みが集中する。
+// そこで増分はスレッドごとのセル (1 セル 1 キャッシュライン) に足しておき、
+// 読むとき (gc_total / gc_serialize) にまとめて自スロットへ畳み込む。
+//
+// セルは単調増加なので合計も単調増加。畳み込み済みの量 folded を
+// CAS で進めたスレッドだけが差分を自スロットに加えるので、
+// 同時に何人が畳み込んでも各増分はちょうど 1 回だけ反映される。
+// ------------------------------------------------------------
+#ifndef GC_STRIPE_H
+#define GC_STRIPE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "gc_core.h"
+
+#define GC_STRIPES 64 // セル数 (これより多いスレッドはセルを共有する)
+
+typedef struct {
+    gc_slot cells[GC_STRIPES];
+    _Alignas(GC_CACHELINE) _Atomic uint64_t folded; // 自スロットに反映済みの合計
+} gc_stripes;
+
+// 初めて増分を入れたときに順番にセルを割り当てる
+static inline unsigned gc_stripe_index(void) {
+    static atomic_uint next;
+    static _Thread_local unsigned idx = ~0u;
+    if (idx == ~0u) {
+        idx = atomic_fetch_add_explicit(&next, 1, memory_order_relaxed) % GC_STRIPES;
+    }
+    return idx;
+}
+
+// seq_cst: このあと見張り (gc_watch.h) の有無を読むのと順序をつける
+// (x86 では relaxed と同じ lock xadd)
+static inline void gc_stripes_add(gc_stripes *st, uint64_t delta) {
+    atomic_fetch_add_explicit(&st->cells[gc_stripe_index()].v, delta, memory_order_seq_cst);
+}
+
+static inline uint64_t gc_stripes_sum(const gc_stripes *st) {
+    return gc_slots_sum(st->cells, GC_STRIPES);
+}
+
+// まだ反映していない増分を slot に加える。加えた量を返す
+static inline uint64_t gc_stripes_fold(gc_stripes *st, gc_slot *slot) {
+    uint64_t sum = gc_stripes_sum(st);
+    uint64_t done = atomic_load_explicit(&st->folded, memory_order_relaxed);
+    while (sum > done) {
+        if (atomic_compare_exchange_weak_explicit(&st->folded, &done, sum, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+            gc_slot_add(slot, sum - done);
+            return sum - done;
+        }
+    }
+    return 0;
+}
+
+#endif // GC_STRIPE_H
@@ -0,0 +1,92 @@
+// -*- coding: utf-8 -*-
+// G‑Counter の同期方式 (説明は gc_sync.h)
+
+#include "gc_sync.h"
+
+// flush までの送信内容。返信は送信の途中 (トランスポートが受信を回収したとき) に
+// 作られることがあるので別にしておく
+static char msgs[GC_SYNC_BATCH][BUF_SIZE];
+static char replies[GC_SYNC_BATCH][BUF_SIZE];
+
+// ゴシップ: ランダムな fanout 個の peer に全状態を pull 要求付きで送る。
+// 全状態なので落ちても次のラウンドで取り戻せる (GC_SYNC_FULL_EVERY はいらない)
+static int gossip_round(gc_sync *s, gc_transport *t, int fanout) {
+    int picked[GC_SYNC_BATCH];
+    if (fanout > GC_SYNC_BATCH) fanout = GC_SYNC_BATCH;
+    size_t len = gc_serialize_pull(s->gc, msgs[0], BUF_SIZE);
+    int k = gossip_pick(s->gossip, fanout, picked);
+    for (int i = 0; i < k; ++i) t->send(t, picked[i], msgs[0], len); // 同じ内容を k 個に
+    t->flush(t);
+    return k;
+}
+
+// peer ごとに変わった分を送る。GC_SYNC_FULL_EVERY 回に 1 回は全状態
+static void broadcast(gc_sync *s, gc_transport *t) {
+    int full = (s->tick % GC_SYNC_FULL_EVERY) == 0;
+    for (int i = 0; i < s->peer_count; ++i) {
+        char *msg = msgs[i % GC_SYNC_BATCH];
+        if (i > 0 && i % GC_SYNC_BATCH == 0) t->flush(t); // msgs を使い回す前に送る
+        size_t len = gc_serialize_for_peer(s->gc, i, full, msg, BUF_SIZE);
+        if (len == 0) continue; // この peer に伝えることはない
+        t->send(t, i, msg, len);
+    }
+    t->flush(t);
+}
+
+void gc_sync_tick(gc_sync *s, gc_transport *t) {
+    if (s->fanout > 0) {
+        gossip_round(s, t, s->fanout);
+    } else {
+        broadcast(s, t);
+    }
+    s->tick++;
+}
+
+int gc_sync_paced(gc_sync *s, gc_transport *t, int full, int budget, int *more) {
+    *more = 0;
+    if (budget <= 0) { // 何か残っているかもしれないので、トークンがたまったらまた呼んでもらう
+        *more = 1;
+        return 0;
+    }
+    if (s->fanout > 0) { // ゴシップは毎回選び直すので、送れなかった分は持ち越さない
+        s->tick++;
+        return gossip_round(s, t, s->fanout < budget ? s->fanout : budget);
+    }
+    if (s->left == 0) { // 新しい回を始める
+        s->left = s->peer_count;
+        s->left_full = full;
+    }
+    int sent = 0, queued = 0;
+    while (s->left > 0 && sent < budget) {
+        int i = s->cursor;
+        s->cursor = (s->cursor + 1) % s->peer_count;
+        s->left--;
+        if (queued == GC_SYNC_BATCH) { // msgs を使い回す前に送る
+            t->flush(t);
+            queued = 0;
+        }
+        size_t len = gc_serialize_for_peer(s->gc, i, s->left_full, msgs[queued], BUF_SIZE);
+        if (len == 0) continue; // この peer に伝えることはない (予算も使わない)
+        t->send(t, i, msgs[queued++], len);
+        sent++;
+    }
+    t->flush(t);
+    *more = s->left > 0;
+    if (!*more) s->tick++;
+    return sent;
+}
+
+void gc_sync_reply(gc_sync *s, gc_transport *t, const void *const bufs[], const size_t lens[], int n) {
+    if (s->fanout <= 0) return;
+    int queued = 0;
+    for (int i = 0; i < n; ++i) {
+        if (queued == GC_SYNC_BATCH) {
+            t->flush(t);
+            queued = 0;
+        }
+        size_t len = gc_serialize_newer(s->gc, bufs[i], lens[i], replies[queued], BUF_SIZE);
+        if (len == 0) continue; // pull 要求でないか、相手の方が新しいか同じ
+        t->reply(t, i, replies[queued++], len);
+    }
+    t->flush(t);
+}
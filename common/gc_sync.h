@@ -0,0 +1,63 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// state‑based G‑Counter の同期方式 (何を誰に送るか)
+// ------------------------------------------------------------
+// 送り方はトランスポート (gc_transport) に任せ、ここでは方式だけを書く。
+// UDPstate はソケット / io_uring のトランスポートで、bench/bench_sim.c は
+// 模擬ネットワーク (netsim.h) のトランスポートで同じコードを動かす。
+//
+//   broadcast (fanout = 0): 毎回 peer ごとに変わった分 (delta) を送り、
+//     GC_SYNC_FULL_EVERY 回に 1 回は全状態を送る (落ちたパケットや再起動した
+//     peer を救う anti‑entropy)
+//   gossip (fanout = k):    ランダムな k 個の peer に全状態を pull 要求付きで
+//     送り、受け取った側は送り主より新しい分だけを返す (gossip.h)
+//
+// gc_sync_tick は一定間隔で呼ぶ前提。gc_sync_paced は送る時刻と全状態を送るか
+// どうかを呼び出し側 (gc_sched.h) が決め、送る数に上限を付けられる。
+// 上限で送り残した peer は次の呼び出しでそこから続けるので、どの peer も
+// 後回しにされ続けることはない。
+//
+// 送信内容はこのモジュールの static なバッファに作るので、スレッドセーフではない。
+// ------------------------------------------------------------
+#ifndef GC_SYNC_H
+#define GC_SYNC_H
+
+#include <stddef.h>
+
+#include "gc.h"
+#include "gossip.h"
+
+#define GC_SYNC_FULL_EVERY 12 // 12 回に 1 回 (5 秒間隔なら約 1 分ごと) は全状態を送る
+#define GC_SYNC_BATCH 64      // この数を送るごとに flush する (バッファを使い回すため)
+
+typedef struct gc_transport gc_transport;
+struct gc_transport {
+    // peer 番号 (0..peer_count-1) に送る。buf は次の flush まで有効。失敗なら -1
+    int (*send)(gc_transport *t, int peer, const void *buf, size_t len);
+    // gc_sync_reply に渡した msg 番目のメッセージの送り主に返す
+    int (*reply)(gc_transport *t, int msg, const void *buf, size_t len);
+    // ためている送信を送り出す
+    void (*flush)(gc_transport *t);
+};
+
+typedef struct {
+    GCounter *gc;
+    int peer_count;
+    int fanout;          // 0 なら broadcast
+    gossip *gossip;      // fanout > 0 のとき (peer_count 個から選ぶ)
+    unsigned long tick;  // gc_sync_tick を呼んだ回数
+    int cursor;          // gc_sync_paced: 次に見る peer
+    int left;            // gc_sync_paced: 今の回でまだ見ていない peer の数
+    int left_full;       // gc_sync_paced: 今の回は全状態を送る
+} gc_sync;
+
+// 1 回分送る (送信間隔ごとに呼ぶ)
+void gc_sync_tick(gc_sync *s, gc_transport *t);
+// 最大 budget 通まで送り、送った数を返す。full なら全状態 (送り残しを
+// 続けている間は無視する)。送り残した peer があれば *more = 1
+int gc_sync_paced(gc_sync *s, gc_transport *t, int full, int budget, int *more);
+// 受け取ってマージしたメッセージ bufs[0..n) のうち pull 要求に返信する
+// (gossip のときだけ。マージ後に呼ぶこと)
+void gc_sync_reply(gc_sync *s, gc_transport *t, const void *const bufs[], const size_t lens[], int n);
+
+#endif // GC_SYNC_H
@@ -0,0 +1,153 @@
+// -*- coding: utf-8 -*-
+// カウンタの変更を待つ (説明は gc_watch.h)
+
+#define _GNU_SOURCE
+#include "gc_watch.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+void gc_watch_init(gc_watch *w) {
+    atomic_init(&w->active, 0);
+    atomic_init(&w->seq, 0);
+    atomic_init(&w->sleepers, 0);
+    atomic_init(&w->tseq, 0);
+    atomic_init(&w->tsleepers, 0);
+    atomic_init(&w->need, UINT64_MAX);
+    atomic_init(&w->nfds, 0);
+    pthread_mutex_init(&w->lock, NULL);
+    for (int i = 0; i < GC_WATCH_FDS; ++i) {
+        w->fds[i] = -1;
+        atomic_init(&w->pending[i], 0);
+    }
+}
+
+void gc_watch_destroy(gc_watch *w) {
+    pthread_mutex_destroy(&w->lock);
+}
+
+void gc_watch_notify(gc_watch *w, _Atomic uint64_t *total) {
+    atomic_fetch_add_explicit(&w->seq, 1, memory_order_seq_cst); // sleepers と対 (gc_watch_sleep)
+    if (atomic_load_explicit(&w->sleepers, memory_order_seq_cst) > 0) {
+        syscall(SYS_futex, &w->seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    }
+    // 合計を増やした後に need を読む (gc_watch_need で登録した後に合計を読むのと対)
+    uint64_t need = atomic_load_explicit(&w->need, memory_order_seq_cst);
+    if (need != UINT64_MAX && atomic_load_explicit(total, memory_order_seq_cst) >= need &&
+        atomic_exchange_explicit(&w->need, UINT64_MAX, memory_order_seq_cst) != UINT64_MAX) {
+        // 空に戻したのが自分のときだけ起こす (登録は tseq を読んだ後なので、起こし損ねない)
+        atomic_fetch_add_explicit(&w->tseq, 1, memory_order_seq_cst);
+        if (atomic_load_explicit(&w->tsleepers, memory_order_seq_cst) > 0) {
+            syscall(SYS_futex, &w->tseq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+        }
+    }
+    if (atomic_load_explicit(&w->nfds, memory_order_seq_cst) == 0) return; // 待っているスレッドだけ
+    pthread_mutex_lock(&w->lock);
+    for (int i = 0; i < GC_WATCH_FDS; ++i) {
+        if (w->fds[i] < 0 || atomic_exchange_explicit(&w->pending[i], 1, memory_order_seq_cst)) continue;
+        uint64_t one = 1;
+        ssize_t rc = write(w->fds[i], &one, sizeof(one)); // 上限 (0xfffffffffffffffe) までは失敗しない
+        (void)rc;
+    }
+    pthread_mutex_unlock(&w->lock);
+}
+
+void gc_watch_enter(gc_watch *w) {
+    atomic_fetch_add_explicit(&w->active, 1, memory_order_seq_cst);
+    atomic_thread_fence(memory_order_seq_cst); // このあと読む値は、active を見落とした変更を含む
+}
+
+void gc_watch_leave(gc_watch *w) {
+    atomic_fetch_sub_explicit(&w->active, 1, memory_order_seq_cst);
+}
+
+// word が seen のままなら眠る。sleepers は起こす側が FUTEX_WAKE を省くのに使う
+static int futex_sleep(_Atomic uint32_t *word, _Atomic uint32_t *sleepers, uint32_t seen,
+                       const struct timespec *deadline) {
+    atomic_fetch_add_explicit(sleepers, 1, memory_order_seq_cst);
+    // FUTEX_WAIT_BITSET の時刻は絶対時刻 (CLOCK_MONOTONIC)
+    long rc = syscall(SYS_futex, word, FUTEX_WAIT_BITSET_PRIVATE, seen, deadline, NULL, FUTEX_BITSET_MATCH_ANY);
+    int e = errno;
+    atomic_fetch_sub_explicit(sleepers, 1, memory_order_relaxed);
+    if (rc < 0 && e == ETIMEDOUT) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return 0; // EAGAIN (もう変わっていた) や EINTR は呼び出し側が値を読み直す
+}
+
+int gc_watch_sleep(gc_watch *w, uint32_t seen, const struct timespec *deadline) {
+    return futex_sleep(&w->seq, &w->sleepers, seen, deadline);
+}
+
+void gc_watch_need(gc_watch *w, uint64_t threshold) {
+    uint64_t cur = atomic_load_explicit(&w->need, memory_order_relaxed);
+    while (threshold < cur &&
+           !atomic_compare_exchange_weak_explicit(&w->need, &cur, threshold, memory_order_seq_cst,
+                                                  memory_order_relaxed)) {
+    }
+    atomic_thread_fence(memory_order_seq_cst); // このあと読む合計は、need を見落とした変更を含む
+}
+
+int gc_watch_sleep_need(gc_watch *w, uint32_t seen, const struct timespec *deadline) {
+    return futex_sleep(&w->tseq, &w->tsleepers, seen, deadline);
+}
+
+int gc_watch_fd_add(gc_watch *w) {
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) return -1;
+    pthread_mutex_lock(&w->lock);
+    int slot = -1;
+    for (int i = 0; i < GC_WATCH_FDS && slot < 0; ++i) {
+        if (w->fds[i] < 0) slot = i;
+    }
+    if (slot >= 0) {
+        w->fds[slot] = fd;
+        atomic_store_explicit(&w->pending[slot], 0, memory_order_relaxed);
+        atomic_fetch_add_explicit(&w->nfds, 1, memory_order_seq_cst);
+        gc_watch_enter(w);
+    }
+    pthread_mutex_unlock(&w->lock);
+    if (slot < 0) {
+        close(fd);
+        errno = ENOSPC;
+        return -1;
+    }
+    return fd;
+}
+
+int gc_watch_fd_remove(gc_watch *w, int fd) {
+    int found = 0;
+    pthread_mutex_lock(&w->lock); // notify が書いている最中には閉じない
+    for (int i = 0; i < GC_WATCH_FDS; ++i) {
+        if (w->fds[i] == fd) {
+            w->fds[i] = -1;
+            found = 1;
+        }
+    }
+    pthread_mutex_unlock(&w->lock);
+    if (!found) {
+        errno = ENOENT;
+        return -1;
+    }
+    atomic_fetch_sub_explicit(&w->nfds, 1, memory_order_seq_cst);
+    gc_watch_leave(w);
+    return close(fd);
+}
+
+void gc_watch_fd_ack(gc_watch *w, int fd) {
+    // 読み切ってから pending を下ろす: 逆だと間に書かれた分を読み捨てて、
+    // pending だけが残る。間の変更は呼び出し側がこのあと読む値に入っている
+    uint64_t n;
+    while (read(fd, &n, sizeof(n)) == (ssize_t)sizeof(n)) {
+    }
+    pthread_mutex_lock(&w->lock);
+    for (int i = 0; i < GC_WATCH_FDS; ++i) {
+        if (w->fds[i] == fd) atomic_store_explicit(&w->pending[i], 0, memory_order_seq_cst);
+    }
+    pthread_mutex_unlock(&w->lock);
+}
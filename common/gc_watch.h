@@ -0,0 +1,89 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// カウンタの変更を待つ (futex / eventfd)
+// ------------------------------------------------------------
+// 値が変わるのを待つのに、mutex で守った値をループで読み続けると
+// (kekeho_CRDTcounter/thread_2.c) 何も起きていない間も 1 コアを使い切る。
+// 代わりに、変更のたびに seq を 1 増やし、
+//   - futex: seq が見た値のままなら眠る。変更した側が FUTEX_WAKE で起こす
+//   - eventfd: 登録した fd に書く。待つ側は自分の epoll などで待てる
+// で知らせる。待っている間は CPU を使わない。
+//
+// 見張る人がいない (active == 0) ときの変更側のコストは、ほとんど書き換わらない
+// キャッシュラインを 1 回読むことだけ。見張る側は active を増やしてから
+// 値を読み、変更側は値を変えてから active を読む (どちらも seq_cst)。
+// これで「見張る側は古い値を読んだのに、変更側は見張りに気づかない」が起きない。
+//
+// eventfd への書き込みは、見張る側が gc_watch_fd_ack で受け取るまで 1 回に
+// まとめる (変更の多いときに書き込みのシステムコールが続かない)。
+//
+// 「合計が閾値に届くまで」待つスレッドは、変更のたびに起こすと起きては
+// 眠り直すだけになる。眠っている閾値のうち一番小さいものを need に置き、
+// 合計がそこに届いたときだけ別の futex のワード tseq で起こす。
+// 起こすときは need を空に戻すので、まだ届いていない側は登録し直して眠る。
+// ------------------------------------------------------------
+#ifndef GC_WATCH_H
+#define GC_WATCH_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "gc_core.h"
+
+#define GC_WATCH_FDS 8 // 登録できる eventfd の数
+
+typedef struct {
+    _Alignas(GC_CACHELINE) _Atomic uint32_t active; // 待っているスレッド + 登録した eventfd の数
+    _Alignas(GC_CACHELINE) _Atomic uint32_t seq;    // 変更のたびに +1 (futex のワード)
+    _Atomic uint32_t sleepers;                      // futex で待っているスレッドの数
+    _Atomic uint32_t tseq;                          // 合計が need に届くたびに +1 (futex のワード)
+    _Atomic uint32_t tsleepers;                     // tseq で待っているスレッドの数
+    _Atomic uint64_t need;                          // 登録された閾値の最小 (なければ UINT64_MAX)
+    _Atomic uint32_t nfds;                          // 登録した eventfd の数
+    pthread_mutex_t lock;                           // fds を守る
+    int fds[GC_WATCH_FDS];                          // -1 なら空き
+    _Atomic int pending[GC_WATCH_FDS];              // 書いたがまだ ack されていない
+} gc_watch;
+
+void gc_watch_init(gc_watch *w);
+void gc_watch_destroy(gc_watch *w);
+
+// 変更を知らせる (遅い経路。gc_watch_changed から呼ぶ)。total は変更後の合計
+void gc_watch_notify(gc_watch *w, _Atomic uint64_t *total);
+
+// 合計 total を増やしたあとに呼ぶ。見張る人がいなければ何もしない
+static inline int gc_watch_active(gc_watch *w) {
+    return atomic_load_explicit(&w->active, memory_order_seq_cst) != 0;
+}
+static inline void gc_watch_changed(gc_watch *w, _Atomic uint64_t *total) {
+    if (gc_watch_active(w)) gc_watch_notify(w, total);
+}
+
+// 待つ側: enter してから seq と値を読み、条件を満たさなければ sleep する。終わったら leave
+void gc_watch_enter(gc_watch *w);
+void gc_watch_leave(gc_watch *w);
+static inline uint32_t gc_watch_seq(gc_watch *w) {
+    return atomic_load_explicit(&w->seq, memory_order_acquire);
+}
+// seq が seen のままなら、変わるか deadline (CLOCK_MONOTONIC。NULL なら無期限) まで眠る。
+// 時間切れなら -1 (errno = ETIMEDOUT)。それ以外 (起こされた・もう変わっていた・シグナル) は 0
+int gc_watch_sleep(gc_watch *w, uint32_t seen, const struct timespec *deadline);
+
+// 閾値を待つ側: enter してから tseq を読み、gc_watch_need で閾値を登録してから
+// 合計を読む。届いていなければ gc_watch_sleep_need で眠る (返り値は gc_watch_sleep と同じ)
+static inline uint32_t gc_watch_tseq(gc_watch *w) {
+    return atomic_load_explicit(&w->tseq, memory_order_acquire);
+}
+void gc_watch_need(gc_watch *w, uint64_t threshold);
+int gc_watch_sleep_need(gc_watch *w, uint32_t seen, const struct timespec *deadline);
+
+// 変更のたびに読めるようになる eventfd (non‑blocking) を作って登録する。失敗なら -1
+int gc_watch_fd_add(gc_watch *w);
+// 登録を外して閉じる。登録されていなければ -1
+int gc_watch_fd_remove(gc_watch *w, int fd);
+// fd を読み切り、次の変更でまた書いてもらう (値を読む前に呼ぶこと)
+void gc_watch_fd_ack(gc_watch *w, int fd);
+
+#endif // GC_WATCH_H
@@ -0,0 +1,109 @@
+// -*- coding: utf-8 -*-
+// G‑Counter バイナリワイヤフォーマットの実装 (説明は gc_wire.h)
+
+#include "gc_wire.h"
+#include "varint.h"
+
+// -------------------- エンコード --------------------
+
+int gc_wire_writer_init(gc_wire_writer *w, void *out, size_t cap, uint64_t sender, uint8_t flags) {
+    w->start = (uint8_t *)out;
+    w->p = w->start;
+    w->end = w->start + cap;
+    w->next_id = 0;
+    w->count = 0;
+    w->full = 0;
+    if (cap < 3) {
+        w->full = 1;
+        return -1;
+    }
+    w->p[0] = GC_WIRE_MAGIC;
+    w->p[1] = GC_WIRE_VERSION;
+    w->p[2] = flags;
+    uint8_t *q = varint_put(w->p + 3, w->end, sender);
+    if (!q) {
+        w->full = 1;
+        return -1;
+    }
+    w->p = q;
+    return 0;
+}
+
+int gc_wire_put(gc_wire_writer *w, uint64_t id, uint64_t value) {
+    if (w->full || id < w->next_id || id > GC_WIRE_ID_MAX) return -1; // 読み手も受け付けない
+    uint8_t *q = varint_put(w->p, w->end, id - w->next_id);
+    if (q) q = varint_put(q, w->end, value);
+    if (!q) {
+        w->full = 1; // 書きかけの分は p を進めないので捨てられる
+        return -1;
+    }
+    w->p = q;
+    w->next_id = id + 1;
+    w->count++;
+    return 0;
+}
+
+size_t gc_wire_finish(const gc_wire_writer *w) {
+    return (size_t)(w->p - w->start);
+}
+
+size_t gc_wire_encode(void *out, size_t cap, uint64_t sender, uint8_t flags,
+                      const unsigned long *values, size_t n) {
+    gc_wire_writer w;
+    if (gc_wire_writer_init(&w, out, cap, sender, flags) < 0) return 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (values[i] == 0) continue; // 0 のエントリは送らない
+        if (gc_wire_put(&w, i, values[i]) < 0) break;
+    }
+    return gc_wire_finish(&w);
+}
+
+// -------------------- デコード --------------------
+
+int gc_wire_reader_init(gc_wire_reader *r, const void *buf, size_t len, gc_wire_header *hdr) {
+    const uint8_t *p = (const uint8_t *)buf;
+    const uint8_t *end = p + len;
+    if (!gc_wire_is_binary(buf, len) || p[1] != GC_WIRE_VERSION) return -1;
+
+    uint64_t sender;
+    const uint8_t *q = varint_get(p + 3, end, &sender);
+    if (!q) return -1;
+    if (hdr) {
+        hdr->version = p[1];
+        hdr->flags = p[2];
+        hdr->sender = sender;
+    }
+    r->p = q;
+    r->end = end;
+    r->next_id = 0;
+    return 0;
+}
+
+int gc_wire_next(gc_wire_reader *r, uint64_t *id, uint64_t *value) {
+    if (r->p == r->end) return 0;
+    uint64_t gap;
+    const uint8_t *q = varint_get(r->p, r->end, &gap);
+    if (!q) return -1;
+    uint64_t cur = r->next_id + gap;
+    if (cur < r->next_id || cur > GC_WIRE_ID_MAX) return -1; // id がオーバーフロー
+    q = varint_get(q, r->end, value);
+    if (!q) return -1;
+    r->p = q;
+    r->next_id = cur + 1;
+    *id = cur;
+    return 1;
+}
+
+int gc_wire_find(const void *buf, size_t len, uint64_t id, uint64_t *value) {
+    gc_wire_reader r;
+    if (gc_wire_reader_init(&r, buf, len, NULL) < 0) return -1;
+    uint64_t cur, v;
+    int rc;
+    while ((rc = gc_wire_next(&r, &cur, &v)) > 0) {
+        if (cur < id) continue;
+        if (cur > id) return 0;
+        *value = v;
+        return 1;
+    }
+    return rc;
+}
@@ -0,0 +1,80 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// G‑Counter 状態のバイナリワイヤフォーマット
+// ------------------------------------------------------------
+// レイアウト (version 1):
+//   [0] magic   0xC7  (ASCII 外なので旧テキスト形式と判別できる)
+//   [1] version 1
+//   [2] flags   GC_WIRE_F_*
+//   varint sender  送信元レプリカ ID
+//   (varint id_gap, varint value) * n   … データグラム末尾まで
+//
+// id は昇順で、id_gap = id - (直前の id + 1) (先頭は id そのもの)。
+// varint は LEB128 (7bit ずつ, 最大 10 バイト)。
+// デコーダはバッファを直接なめるだけで、確保もコピーもしない。
+// ------------------------------------------------------------
+#ifndef GC_WIRE_H
+#define GC_WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GC_WIRE_MAGIC 0xC7
+#define GC_WIRE_VERSION 1
+#define GC_WIRE_HDR_MAX (3 + 10) // 固定ヘッダ + sender varint
+#define GC_WIRE_ENTRY_MAX 20     // id_gap + value の最大長
+#define GC_WIRE_ID_MAX (UINT64_MAX - 1) // 載せられる最大の id (次の id が 0 に戻らないように)
+
+// flags
+#define GC_WIRE_F_DELTA 0x01     // 変更分だけを含む (受信側の扱いは同じ)
+#define GC_WIRE_F_PULL 0x02      // 全状態 + pull 要求: 送り主より新しいエントリを返してほしい
+
+typedef struct {
+    uint8_t *start;
+    uint8_t *p;
+    uint8_t *end;
+    uint64_t next_id; // 次に置ける最小の id
+    size_t count;     // 書いたエントリ数
+    int full;         // 容量不足で put を拒否したら 1
+} gc_wire_writer;
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t next_id;
+} gc_wire_reader;
+
+typedef struct {
+    uint8_t version;
+    uint8_t flags;
+    uint64_t sender;
+} gc_wire_header;
+
+// 先頭バイトでバイナリ形式かどうかを判定する
+static inline int gc_wire_is_binary(const void *buf, size_t len) {
+    return len >= 3 && ((const uint8_t *)buf)[0] == GC_WIRE_MAGIC;
+}
+
+// -------------------- エンコード --------------------
+// 失敗 (ヘッダすら入らない) なら -1
+int gc_wire_writer_init(gc_wire_writer *w, void *out, size_t cap, uint64_t sender, uint8_t flags);
+// id は昇順で渡すこと。入りきらない / 順序違反 / GC_WIRE_ID_MAX より大きい id なら -1
+// (それ以前の内容は有効)
+int gc_wire_put(gc_wire_writer *w, uint64_t id, uint64_t value);
+// 書き込んだバイト数
+size_t gc_wire_finish(const gc_wire_writer *w);
+
+// 密な配列から 0 以外のエントリをまとめてエンコードする
+size_t gc_wire_encode(void *out, size_t cap, uint64_t sender, uint8_t flags,
+                      const unsigned long *values, size_t n);
+
+// -------------------- デコード --------------------
+// ヘッダを検証して reader を初期化する。不正なら -1
+int gc_wire_reader_init(gc_wire_reader *r, const void *buf, size_t len, gc_wire_header *hdr);
+// 1 エントリ読む。1: 取得, 0: 終端, -1: 壊れている
+int gc_wire_next(gc_wire_reader *r, uint64_t *id, uint64_t *value);
+// id のエントリの値を探す (id は昇順なので通り過ぎたら止める)。
+// 1: あった, 0: ない, -1: 壊れている / バイナリ形式でない
+int gc_wire_find(const void *buf, size_t len, uint64_t id, uint64_t *value);
+
+#endif // GC_WIRE_H
@@ -0,0 +1,44 @@
+// -*- coding: utf-8 -*-
+// ゴシップの送り先選び (説明は gossip.h)
+
+#include "gossip.h"
+
+#include <stdlib.h>
+
+static uint64_t next_rand(gossip *g) {
+    uint64_t x = g->rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return g->rng = x;
+}
+
+int gossip_init(gossip *g, int n, uint64_t seed) {
+    g->n = n > 0 ? n : 0;
+    g->perm = malloc((size_t)(g->n ? g->n : 1) * sizeof(int));
+    if (!g->perm) return -1;
+    for (int i = 0; i < g->n; ++i) g->perm[i] = i;
+    // 0 だと xorshift が止まるので混ぜておく
+    g->rng = seed * 0x9e3779b97f4a7c15ULL + 0x2545f4914f6cdd1dULL;
+    if (g->rng == 0) g->rng = 1;
+    return 0;
+}
+
+void gossip_free(gossip *g) {
+    free(g->perm);
+    g->perm = NULL;
+    g->n = 0;
+}
+
+int gossip_pick(gossip *g, int k, int *out) {
+    if (k > g->n) k = g->n;
+    // 先頭 k 個だけシャッフルする。perm は並べ替えのままなので初期化し直さなくてよい
+    for (int j = 0; j < k; ++j) {
+        int r = j + (int)(next_rand(g) % (uint64_t)(g->n - j));
+        int t = g->perm[j];
+        g->perm[j] = g->perm[r];
+        g->perm[r] = t;
+        out[j] = g->perm[j];
+    }
+    return k < 0 ? 0 : k;
+}
@@ -0,0 +1,31 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// ゴシップ (epidemic) の送り先選び
+// ------------------------------------------------------------
+// 毎ラウンド全 peer に送る代わりに、ランダムに選んだ fanout 個の peer とだけ
+// push‑pull でやりとりする:
+//   push: 自分の全状態を GC_WIRE_F_PULL 付きで送る (gc_serialize_pull)
+//   pull: 受け取った側は、送り主より新しいエントリだけを返す (gc_serialize_newer)
+// 1 ノードが 1 ラウンドに送るメッセージは fanout 個 + 返信で、N によらない。
+// 変更は 1 ラウンドごとにおよそ (1 + fanout) 倍のノードに広がるので、
+// 全体に行き渡るのは O(log N) ラウンド (bench/bench_gossip.c で測る)。
+// スレッドセーフではない。
+// ------------------------------------------------------------
+#ifndef GOSSIP_H
+#define GOSSIP_H
+
+#include <stdint.h>
+
+typedef struct {
+    int n;         // peer 数
+    int *perm;     // peer 番号の並べ替え (部分 Fisher–Yates で使い回す)
+    uint64_t rng;  // xorshift64 の状態
+} gossip;
+
+// n 個の peer から選ぶ。seed はノードごとに変えること。失敗なら -1
+int gossip_init(gossip *g, int n, uint64_t seed);
+void gossip_free(gossip *g);
+// 重複なしで min(k, n) 個の peer 番号を out に入れ、その数を返す (O(k))
+int gossip_pick(gossip *g, int k, int *out);
+
+#endif // GOSSIP_H
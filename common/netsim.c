@@ -0,0 +1,206 @@
+// -*- coding: utf-8 -*-
+// 決定的なネットワークシミュレータ (説明は netsim.h)
+
+#include "netsim.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    uint64_t at;
+    uint64_t seq;  // 同じ時刻なら登録順
+    int node;
+    int from;      // -1 ならタイマ
+    size_t len;
+    void *buf;
+} event;
+
+typedef struct {
+    uint64_t start, end;
+    int *group;
+} partition;
+
+struct netsim {
+    int n;
+    netsim_config cfg;
+    netsim_handlers h;
+    void *arg;
+    uint64_t now, seq, rng;
+    event *heap;  // at, seq の二分ヒープ
+    size_t count, cap;
+    partition *parts;
+    int nparts;
+    netsim_stats st;
+};
+
+netsim *netsim_new(int n, const netsim_config *cfg, const netsim_handlers *h, void *arg) {
+    netsim *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    s->n = n;
+    s->cfg = *cfg;
+    s->h = *h;
+    s->arg = arg;
+    // 0 だと xorshift が止まるので混ぜておく (gossip.c と同じ)
+    s->rng = cfg->seed * 0x9e3779b97f4a7c15ULL + 0x2545f4914f6cdd1dULL;
+    if (s->rng == 0) s->rng = 1;
+    return s;
+}
+
+void netsim_free(netsim *s) {
+    if (!s) return;
+    for (size_t i = 0; i < s->count; ++i) free(s->heap[i].buf);
+    for (int i = 0; i < s->nparts; ++i) free(s->parts[i].group);
+    free(s->parts);
+    free(s->heap);
+    free(s);
+}
+
+uint64_t netsim_now(const netsim *s) {
+    return s->now;
+}
+
+uint64_t netsim_rand(netsim *s) {
+    uint64_t x = s->rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return s->rng = x;
+}
+
+double netsim_rand01(netsim *s) {
+    return (double)(netsim_rand(s) >> 11) / (double)(1ULL << 53);
+}
+
+const netsim_stats *netsim_get_stats(const netsim *s) {
+    return &s->st;
+}
+
+// -------------------- イベントのヒープ --------------------
+
+static int before(const event *a, const event *b) {
+    return a->at < b->at || (a->at == b->at && a->seq < b->seq);
+}
+
+static int push(netsim *s, event e) {
+    if (s->count == s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 1024;
+        event *h = realloc(s->heap, cap * sizeof(*h));
+        if (!h) return -1;
+        s->heap = h;
+        s->cap = cap;
+    }
+    e.seq = s->seq++;
+    size_t i = s->count++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!before(&e, &s->heap[parent])) break;
+        s->heap[i] = s->heap[parent];
+        i = parent;
+    }
+    s->heap[i] = e;
+    return 0;
+}
+
+static event pop(netsim *s) {
+    event top = s->heap[0];
+    event last = s->heap[--s->count];
+    size_t i = 0;
+    for (;;) {
+        size_t c = 2 * i + 1;
+        if (c >= s->count) break;
+        if (c + 1 < s->count && before(&s->heap[c + 1], &s->heap[c])) c++;
+        if (!before(&s->heap[c], &last)) break;
+        s->heap[i] = s->heap[c];
+        i = c;
+    }
+    if (s->count > 0) s->heap[i] = last;
+    return top;
+}
+
+// -------------------- 送信とタイマ --------------------
+
+int netsim_timer(netsim *s, int node, uint64_t at) {
+    if (at < s->now) at = s->now;
+    return push(s, (event){.at = at, .node = node, .from = -1});
+}
+
+static int cut_off(const netsim *s, int from, int to) {
+    for (int i = 0; i < s->nparts; ++i) {
+        const partition *p = &s->parts[i];
+        if (s->now >= p->start && s->now < p->end && p->group[from] != p->group[to]) return 1;
+    }
+    return 0;
+}
+
+static uint64_t delay(netsim *s) {
+    uint64_t d = s->cfg.latency_us;
+    if (s->cfg.jitter_us) d += netsim_rand(s) % s->cfg.jitter_us;
+    if (s->cfg.reorder > 0 && s->cfg.reorder_us && netsim_rand01(s) < s->cfg.reorder) {
+        d += netsim_rand(s) % s->cfg.reorder_us;
+    }
+    return d;
+}
+
+static int deliver_later(netsim *s, int from, int to, const void *buf, size_t len) {
+    void *copy = malloc(len ? len : 1);
+    if (!copy) return -1;
+    memcpy(copy, buf, len);
+    if (push(s, (event){.at = s->now + delay(s), .node = to, .from = from, .len = len, .buf = copy}) < 0) {
+        free(copy);
+        return -1;
+    }
+    return 0;
+}
+
+int netsim_send(netsim *s, int from, int to, const void *buf, size_t len) {
+    s->st.sent++;
+    s->st.sent_bytes += len;
+    if (cut_off(s, from, to)) {
+        s->st.partitioned++;
+        return 0;
+    }
+    if (s->cfg.loss > 0 && netsim_rand01(s) < s->cfg.loss) {
+        s->st.lost++;
+        return 0;
+    }
+    if (deliver_later(s, from, to, buf, len) < 0) return -1;
+    if (s->cfg.dup > 0 && netsim_rand01(s) < s->cfg.dup) {
+        s->st.duplicated++;
+        return deliver_later(s, from, to, buf, len);
+    }
+    return 0;
+}
+
+int netsim_partition(netsim *s, uint64_t start, uint64_t end, const int *group) {
+    partition *p = realloc(s->parts, (size_t)(s->nparts + 1) * sizeof(*p));
+    if (!p) return -1;
+    s->parts = p;
+    int *g = malloc((size_t)s->n * sizeof(int));
+    if (!g) return -1;
+    memcpy(g, group, (size_t)s->n * sizeof(int));
+    s->parts[s->nparts++] = (partition){.start = start, .end = end, .group = g};
+    return 0;
+}
+
+// -------------------- 実行 --------------------
+
+int netsim_step(netsim *s) {
+    if (s->count == 0) return 0;
+    event e = pop(s);
+    s->now = e.at;
+    s->st.events++;
+    if (e.from < 0) {
+        s->h.on_timer(s, e.node, s->arg);
+    } else {
+        s->st.delivered++;
+        s->h.on_recv(s, e.node, e.from, e.buf, e.len, s->arg);
+        free(e.buf);
+    }
+    return 1;
+}
+
+int netsim_run(netsim *s, uint64_t until) {
+    while (s->count > 0 && s->heap[0].at < until) netsim_step(s);
+    if (s->now < until) s->now = until;
+    return s->count > 0;
+}
@@ -0,0 +1,75 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 決定的な離散イベントのネットワークシミュレータ
+// ------------------------------------------------------------
+// 1 プロセスの中で n 個のノードを動かす。時刻は µs の整数で、実時間とは
+// 関係なく、イベント (タイマ満了・メッセージ到着) の時刻順に飛んでいく。
+// 同じ時刻のイベントは登録順。乱数は seed から作る xorshift 1 本だけなので、
+// 同じ seed・同じ入力なら何度やっても同じ順番で同じことが起きる。
+//
+// netsim_send はメッセージをコピーして、設定に従って
+//   - loss の確率で落とす
+//   - latency_us + [0, jitter_us) 後に届ける (jitter があれば追い越しも起きる)
+//   - reorder の確率でさらに [0, reorder_us) 遅らせる
+//   - dup の確率でもう 1 通 (別の遅延で) 届ける
+// netsim_partition で時間帯とグループを指定すると、その間は違うグループの
+// ノードへの送信が落ちる (送った時点で判定する)。
+//
+// ノードの中身は知らない。タイマとメッセージ到着でハンドラを呼ぶだけ。
+// スレッドセーフではない。
+// ------------------------------------------------------------
+#ifndef NETSIM_H
+#define NETSIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct netsim netsim;
+
+typedef struct {
+    uint64_t latency_us;  // 片道の基本遅延
+    uint64_t jitter_us;   // 一様に足すゆらぎ
+    double loss;          // 落とす確率
+    double dup;           // 二重に届ける確率
+    double reorder;       // この確率で reorder_us まで余計に遅らせる
+    uint64_t reorder_us;
+    uint64_t seed;
+} netsim_config;
+
+typedef struct {
+    void (*on_timer)(netsim *s, int node, void *arg);
+    // buf はハンドラの間だけ有効
+    void (*on_recv)(netsim *s, int node, int from, const void *buf, size_t len, void *arg);
+} netsim_handlers;
+
+typedef struct {
+    uint64_t events;
+    uint64_t sent, sent_bytes;     // netsim_send された数とバイト数
+    uint64_t delivered;
+    uint64_t lost, partitioned, duplicated;
+} netsim_stats;
+
+netsim *netsim_new(int n, const netsim_config *cfg, const netsim_handlers *h, void *arg);
+void netsim_free(netsim *s);
+
+// 今の時刻 (µs)
+uint64_t netsim_now(const netsim *s);
+// 決定的な乱数 (ワークロードを作る側もこれを使えば全体が再現できる)
+uint64_t netsim_rand(netsim *s);
+double netsim_rand01(netsim *s);
+const netsim_stats *netsim_get_stats(const netsim *s);
+
+// node の on_timer を時刻 at に呼ぶ (1 回だけ。繰り返すならハンドラの中でまた呼ぶ)
+int netsim_timer(netsim *s, int node, uint64_t at);
+// from から to へ送る。落としたときも 0 (UDP と同じで送り手には分からない)
+int netsim_send(netsim *s, int from, int to, const void *buf, size_t len);
+// [start, end) の間、group[a] != group[b] のノード間の送信を落とす (group は n 個, コピーする)
+int netsim_partition(netsim *s, uint64_t start, uint64_t end, const int *group);
+
+// 次のイベントを 1 つ処理する。処理したら 1、イベントがなければ 0
+int netsim_step(netsim *s);
+// 時刻 until より前のイベントを処理して、時刻を until に進める。
+// まだイベントが残っていれば 1、尽きていれば 0
+int netsim_run(netsim *s, uint64_t until);
+
+#endif // NETSIM_H
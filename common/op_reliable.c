@@ -0,0 +1,188 @@
+// -*- coding: utf-8 -*-
+// op‑based 信頼性レイヤ (説明は op_reliable.h)
+
+#include "op_reliable.h"
+#include "varint.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int opr_init(opr *o, uint64_t self, int npeers) {
+    memset(o, 0, sizeof(*o));
+    o->self = self;
+    o->npeers = npeers;
+    o->peers = calloc(npeers > 0 ? (size_t)npeers : 1, sizeof(opr_peer));
+    if (!o->peers) return -1;
+    for (int i = 0; i < npeers; i++) {
+        o->peers[i].next_send = 1;
+        o->peers[i].rto_ms = OPR_RTO_MIN_MS;
+    }
+    return 0;
+}
+
+void opr_free(opr *o) {
+    free(o->peers);
+    o->peers = NULL;
+}
+
+// 全 peer の ack の最小値 (ここまではログから消してよい)
+static uint64_t min_acked(const opr *o) {
+    uint64_t m = o->head;
+    for (int i = 0; i < o->npeers; i++)
+        if (o->peers[i].acked < m) m = o->peers[i].acked;
+    return m;
+}
+
+int opr_idle(const opr *o) {
+    return min_acked(o) == o->head;
+}
+
+int opr_submit(opr *o, uint64_t delta) {
+    if (delta == 0) return 0;
+    if (o->head - min_acked(o) < OPR_LOG) {
+        o->head++;
+        o->log[o->head % OPR_LOG] = delta;
+        return 0;
+    }
+    // ログが一杯: 最後の op をまだ誰にも送っていなければ、それに足す
+    // (カウンタの増分なので 1 個の op にまとめても効果は同じ)。
+    // next_send は RTO で巻き戻るので見ない: 送って届いたが ack だけ落ちた op に
+    // 足すと、再送は重複として捨てられ、足した分が消える
+    for (int i = 0; i < o->npeers; i++)
+        if (o->peers[i].sent_max >= o->head) return -1;
+    o->log[o->head % OPR_LOG] += delta;
+    o->stats.coalesced++;
+    return 0;
+}
+
+// -------------------- 受信 --------------------
+
+static void deliver_one(opr *o, opr_peer *p, int peer, uint64_t delta, opr_deliver_fn deliver, void *arg) {
+    p->delivered++;
+    o->stats.delivered_ops++;
+    deliver(arg, peer, delta);
+}
+
+static void on_op(opr *o, int peer, uint64_t seq, uint64_t delta, opr_deliver_fn deliver, void *arg) {
+    opr_peer *p = &o->peers[peer];
+    if (seq <= p->delivered) {
+        o->stats.dup_ops++;
+        return;
+    }
+    if (seq > p->delivered + OPR_WINDOW) {
+        o->stats.dropped_ops++;
+        return;
+    }
+    if (seq != p->delivered + 1) {
+        size_t i = seq % OPR_WINDOW;
+        if (p->win_seq[i] == seq) {
+            o->stats.dup_ops++;
+        } else {
+            p->win_seq[i] = seq;
+            p->win_delta[i] = delta;
+            o->stats.early_ops++;
+        }
+        return;
+    }
+    deliver_one(o, p, peer, delta, deliver, arg);
+    // 窓にためてある続きを順番に流す
+    for (;;) {
+        size_t i = (p->delivered + 1) % OPR_WINDOW;
+        if (p->win_seq[i] != p->delivered + 1) break;
+        p->win_seq[i] = 0;
+        deliver_one(o, p, peer, p->win_delta[i], deliver, arg);
+    }
+}
+
+int opr_recv(opr *o, int peer, const void *buf, size_t len, opr_deliver_fn deliver, void *arg) {
+    const uint8_t *q = buf, *end = q + len;
+    uint64_t sender, ack, first, count, delta;
+    if (peer < 0 || peer >= o->npeers || len < 5 || q[0] != OPR_MAGIC || q[1] != OPR_VERSION) goto bad;
+    opr_peer *p = &o->peers[peer];
+    if (!(q = varint_get(q + 3, end, &sender)) || !(q = varint_get(q, end, &ack))) goto bad;
+    if (p->known && p->origin != sender) goto bad; // 別のレプリカが同じアドレスを使っている
+    p->origin = sender;
+    p->known = 1;
+
+    // 累積 ack
+    if (ack > p->acked && ack <= o->head) {
+        p->acked = ack;
+        p->rto_ms = OPR_RTO_MIN_MS;
+        p->progress_ms = 0; // 次の tick の時刻で置き直す
+        if (p->next_send <= ack) p->next_send = ack + 1;
+    }
+
+    if (q == end) return 0; // ack だけ
+    if (!(q = varint_get(q, end, &first)) || !(q = varint_get(q, end, &count)) || first == 0) goto bad;
+    p->ack_pending = 1;
+    for (uint64_t i = 0; i < count; i++) {
+        if (!(q = varint_get(q, end, &delta))) goto bad;
+        on_op(o, peer, first + i, delta, deliver, arg);
+    }
+    return q == end ? 0 : -1;
+bad:
+    o->stats.bad_dgrams++;
+    return -1;
+}
+
+// -------------------- 送信 --------------------
+
+// peer に seq = p->next_send から詰められるだけ詰めて 1 データグラム作る
+static size_t build(opr *o, opr_peer *p, uint8_t *buf, uint64_t *nops) {
+    uint8_t *end = buf + OPR_MTU;
+    buf[0] = OPR_MAGIC;
+    buf[1] = OPR_VERSION;
+    buf[2] = 0;
+    uint8_t *q = varint_put(buf + 3, end, o->self);
+    q = varint_put(q, end, p->delivered);
+    *nops = 0;
+    if (p->next_send > o->head) return (size_t)(q - buf);
+
+    // count は後で分かるので最大長 (10 バイト) ぶん空けておき、最後に詰める
+    q = varint_put(q, end, p->next_send);
+    uint8_t *cnt = q, *ops = q + 10, *w = ops;
+    uint64_t n = 0;
+    for (uint64_t seq = p->next_send; seq <= o->head; seq++, n++) {
+        uint8_t *nw = varint_put(w, end, o->log[seq % OPR_LOG]);
+        if (!nw) break;
+        w = nw;
+    }
+    uint8_t tmp[10];
+    size_t clen = (size_t)(varint_put(tmp, tmp + sizeof(tmp), n) - tmp);
+    memcpy(cnt, tmp, clen);
+    memmove(cnt + clen, ops, (size_t)(w - ops));
+    q = cnt + clen + (w - ops);
+    *nops = n;
+    return (size_t)(q - buf);
+}
+
+void opr_tick(opr *o, uint64_t now_ms, opr_send_fn send, void *arg) {
+    uint8_t buf[OPR_MTU];
+    for (int i = 0; i < o->npeers; i++) {
+        opr_peer *p = &o->peers[i];
+        if (p->progress_ms == 0) p->progress_ms = now_ms;
+
+        // RTO の間 ack が進まなければ ack の次から送り直す
+        if (p->acked < p->next_send - 1 && now_ms - p->progress_ms >= p->rto_ms) {
+            p->next_send = p->acked + 1;
+            p->progress_ms = now_ms;
+            p->rto_ms = p->rto_ms * 2 > OPR_RTO_MAX_MS ? OPR_RTO_MAX_MS : p->rto_ms * 2;
+            o->stats.retransmits++;
+        }
+
+        int sent = 0;
+        while (sent < OPR_BURST && (p->next_send <= o->head || p->ack_pending)) {
+            uint64_t nops;
+            size_t len = build(o, p, buf, &nops);
+            if (p->acked == p->next_send - 1 && nops) p->progress_ms = now_ms; // 新たに待ち始める
+            p->next_send += nops;
+            if (p->next_send - 1 > p->sent_max) p->sent_max = p->next_send - 1;
+            p->ack_pending = 0;
+            send(arg, i, buf, len);
+            o->stats.sent_dgrams++;
+            o->stats.sent_bytes += len;
+            o->stats.sent_ops += nops;
+            sent++;
+        }
+    }
+}
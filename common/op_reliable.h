@@ -0,0 +1,100 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// op‑based カウンタのための信頼性レイヤ (UDP の上で exactly‑once の効果を出す)
+// ------------------------------------------------------------
+// 各レプリカは自分の op (増分) に 1, 2, 3, … の通し番号 (seq) を付けて
+// 全 peer に送る。受信側は送信元ごとに
+//   - seq ≤ 適用済み … 重複なので捨てる
+//   - seq = 適用済み + 1 … 適用し、窓にためてある続きもまとめて適用する
+//   - それより先 (OPR_WINDOW 以内) … 窓にためておく
+// とすることで、順番どおり・ちょうど 1 回ずつ適用する。
+// 送信側は全 peer の累積 ack (ここまで受け取った seq) が追いつくまで
+// op を有限のリングバッファ (OPR_LOG 個) に残し、RTO の間 ack が進まなければ
+// ack の次から送り直す (go‑back‑N, RTO は倍々に伸ばす)。
+// 未送信の op はまとめて 1 データグラム (OPR_MTU 以下) に詰める。
+//
+// ソケットには触らない。受け取ったデータグラムを opr_recv() に渡し、
+// opr_tick() を定期的に呼んで、コールバックで渡されるデータグラムを送ること。
+// スレッドセーフではない (呼び出し側でロックする)。
+//
+// データグラム:
+//   [0] OPR_MAGIC  [1] version  [2] flags (0)
+//   varint sender  送信元レプリカ ID
+//   varint ack     受信側として相手の op をここまで適用した (0 = まだ何も)
+//   (varint first_seq, varint count, varint delta * count)  … op があるときだけ
+// ------------------------------------------------------------
+#ifndef OP_RELIABLE_H
+#define OP_RELIABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OPR_MAGIC 0xCA
+#define OPR_VERSION 1
+#define OPR_MTU 1400
+#define OPR_LOG 8192      // 全員の ack 待ちで持っておける op の数
+#define OPR_WINDOW 1024   // 送信元ごとの並べ替え窓
+#define OPR_RTO_MIN_MS 100
+#define OPR_RTO_MAX_MS 3200
+#define OPR_BURST 16      // 1 tick で 1 peer に送るデータグラムの上限
+
+typedef struct {
+    // 送信側 (この peer に送った自分の op)
+    uint64_t acked;         // peer が適用済みと言ってきた最大の seq
+    uint64_t next_send;     // 次に送る seq (RTO で巻き戻る)
+    uint64_t sent_max;      // これまでに 1 度でも送った最大の seq (巻き戻らない)
+    uint64_t progress_ms;   // 最後に ack が進んだ (か最初に送った) 時刻
+    uint32_t rto_ms;
+    // 受信側 (この peer の op)
+    uint64_t origin;        // peer のレプリカ ID (最初のデータグラムで覚える)
+    int known;
+    int ack_pending;        // ack を返す必要がある
+    uint64_t delivered;     // 順番どおりに適用し終えた最大の seq
+    uint64_t win_seq[OPR_WINDOW]; // 0 = 空
+    uint64_t win_delta[OPR_WINDOW];
+} opr_peer;
+
+typedef struct {
+    uint64_t sent_dgrams, sent_bytes, sent_ops;
+    uint64_t retransmits;   // RTO で巻き戻した回数
+    uint64_t delivered_ops; // 適用した op
+    uint64_t dup_ops;       // 重複で捨てた op
+    uint64_t early_ops;     // 窓にためた op
+    uint64_t dropped_ops;   // 窓の外で捨てた op (後で再送される)
+    uint64_t coalesced;     // ログが一杯で未送信の op に足し込んだ回数
+    uint64_t bad_dgrams;
+} opr_stats;
+
+typedef struct {
+    uint64_t self;
+    int npeers;
+    opr_peer *peers;
+    uint64_t head;          // 最後に付けた seq (0 = まだない)
+    uint64_t log[OPR_LOG];  // seq % OPR_LOG に delta
+    opr_stats stats;
+} opr;
+
+// 送信コールバック: peer 番号と中身 (呼び出しの間だけ有効)
+typedef void (*opr_send_fn)(void *arg, int peer, const void *buf, size_t len);
+// 適用コールバック: 送信元 peer 番号と増分
+typedef void (*opr_deliver_fn)(void *arg, int peer, uint64_t delta);
+
+// self のレプリカとして npeers 個の peer と通信する。失敗なら -1
+int opr_init(opr *o, uint64_t self, int npeers);
+void opr_free(opr *o);
+
+// 自分の op を積む。ログが一杯なら、まだどの peer にも 1 度も送っていない
+// 最後の op に足し込み、それもできない (送信済みで ack 待ち) なら -1
+int opr_submit(opr *o, uint64_t delta);
+
+// peer から届いたデータグラムを処理し、新たに適用できた op を deliver に渡す。
+// 壊れていれば -1
+int opr_recv(opr *o, int peer, const void *buf, size_t len, opr_deliver_fn deliver, void *arg);
+
+// 未送信の op・再送・ack を送る。now_ms は単調増加するミリ秒
+void opr_tick(opr *o, uint64_t now_ms, opr_send_fn send, void *arg);
+
+// 全 peer が自分の op を全部受け取ったか
+int opr_idle(const opr *o);
+
+#endif // OP_RELIABLE_H
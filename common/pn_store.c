@@ -0,0 +1,699 @@
+// -*- coding: utf-8 -*-
+// キー付き PN‑Counter ストア (説明は pn_store.h)
+
+#include "pn_store.h"
+#include "varint.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// レプリカ 1 個分の状態。レコード内ではレプリカ ID 昇順に並べる
+typedef struct {
+    uint64_t rid;
+    uint64_t inc;
+    uint64_t dec;
+} pn_entry;
+
+// キー 1 個分のレコード。確保したら動かさない (表はこのアドレスを持つ)
+typedef struct {
+    uint64_t hash;
+    pn_entry *ent;     // 最初は key の直後 (同じブロック) に 1 要素ぶん置く
+    int64_t value;     // Σinc − Σdec (マージのたびに差分で更新)
+    uint32_t n;        // ent の要素数
+    uint8_t cap_log;   // ent の容量 = 1 << cap_log
+    uint8_t dirty;     // dirty リストに載っているか
+    uint16_t klen;
+    char key[];
+} pn_rec;
+
+#define ARENA_CHUNK (4u << 20)
+#define LEAF_LEVEL (PN_MERKLE_LEVELS - 1)
+#define CAP_CLASSES 32
+#define PTR_BITS 48
+#define PTR_MASK ((UINT64_C(1) << PTR_BITS) - 1)
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t used;
+    size_t cap;
+    _Alignas(16) unsigned char data[];
+} arena_chunk;
+
+struct pn_store {
+    uint64_t self;
+
+    // 8 バイトスロットの表: 上位 16bit = ハッシュ下位 16bit のタグ, 下位 48bit = pn_rec*。0 は空。
+    // ホーム位置はハッシュの上位ビット (hash >> shift) なので、表の並びは
+    // ハッシュ順になり、Merkle の葉 1 個分のキーが連続した範囲に集まる
+    uint64_t *slot;
+    size_t mask;
+    unsigned shift;
+    size_t count;
+
+    // Merkle 木: mk[l] は 16^l 個のノード。ノードは子の和、葉はエントリのダイジェストの和
+    uint64_t *mk[PN_MERKLE_LEVELS];
+
+    arena_chunk *chunks;
+    size_t arena_bytes;
+    void *free_ent[CAP_CLASSES]; // 容量 1<<i のエントリ配列のフリーリスト
+
+    pn_rec **dirty;
+    size_t dirty_head, dirty_n, dirty_cap;
+    // dirty[dirty_head] が 1 データグラムに入らず途中まで送ったとき、次に送るエントリの番号。
+    // 途中のあいだにそのレコードが変わったら dirty_again を立て、送り終えたら末尾に積み直す
+    uint32_t dirty_from;
+    uint8_t dirty_again;
+};
+
+// -------------------- ハッシュ --------------------
+
+// 8 バイトずつ乗算と xorshift で混ぜる。暗号用途ではない
+static uint64_t hash_key(const char *k, size_t n) {
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ (n * 0xff51afd7ed558ccdULL);
+    uint64_t v;
+    while (n >= 8) {
+        memcpy(&v, k, 8);
+        h = (h ^ v) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+        k += 8;
+        n -= 8;
+    }
+    v = 0;
+    memcpy(&v, k, n);
+    h = (h ^ v) * 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 29;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline uint64_t fmix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static inline pn_rec *slot_rec(uint64_t v) {
+    return (pn_rec *)(uintptr_t)(v & PTR_MASK);
+}
+
+// タグは下位 16bit (上位ビットはホーム位置と葉番号に使う)
+static inline uint64_t slot_tag(uint64_t h) {
+    return h & 0xFFFF;
+}
+
+static inline size_t home(uint64_t h, unsigned shift) {
+    return (size_t)(h >> shift);
+}
+
+// -------------------- アリーナ --------------------
+
+static void *arena_alloc(pn_store *s, size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    arena_chunk *c = s->chunks;
+    if (!c || c->cap - c->used < size) {
+        size_t cap = size > ARENA_CHUNK ? size : ARENA_CHUNK;
+        c = malloc(sizeof(*c) + cap);
+        if (!c) return NULL;
+        c->next = s->chunks;
+        c->used = 0;
+        c->cap = cap;
+        s->chunks = c;
+        s->arena_bytes += sizeof(*c) + cap;
+    }
+    void *p = c->data + c->used;
+    c->used += size;
+    return p;
+}
+
+// 容量 1<<cap_log のエントリ配列。フリーリストにあればそれを使う
+static pn_entry *ent_alloc(pn_store *s, unsigned cap_log) {
+    void *p = s->free_ent[cap_log];
+    if (p) {
+        memcpy(&s->free_ent[cap_log], p, sizeof(void *));
+        return p;
+    }
+    return arena_alloc(s, sizeof(pn_entry) << cap_log);
+}
+
+static void ent_release(pn_store *s, pn_entry *e, unsigned cap_log) {
+    memcpy(e, &s->free_ent[cap_log], sizeof(void *));
+    s->free_ent[cap_log] = e;
+}
+
+// -------------------- 生成 / 破棄 --------------------
+
+pn_store *pn_store_new(uint64_t self_rid) {
+    pn_store *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    s->self = self_rid;
+    s->mask = 1023;
+    s->shift = 64 - 10;
+    s->slot = calloc(s->mask + 1, sizeof(uint64_t));
+    int ok = s->slot != NULL;
+    for (int l = 0; l < PN_MERKLE_LEVELS; l++) {
+        s->mk[l] = calloc((size_t)1 << (4 * l), sizeof(uint64_t));
+        ok = ok && s->mk[l];
+    }
+    if (!ok) {
+        pn_store_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void pn_store_free(pn_store *s) {
+    if (!s) return;
+    for (arena_chunk *c = s->chunks, *next; c; c = next) {
+        next = c->next;
+        free(c);
+    }
+    free(s->slot);
+    for (int l = 0; l < PN_MERKLE_LEVELS; l++) free(s->mk[l]);
+    free(s->dirty);
+    free(s);
+}
+
+size_t pn_store_keys(const pn_store *s) {
+    return s->count;
+}
+
+size_t pn_store_bytes(const pn_store *s) {
+    size_t mk = 0;
+    for (int l = 0; l < PN_MERKLE_LEVELS; l++) mk += ((size_t)1 << (4 * l)) * sizeof(uint64_t);
+    return sizeof(*s) + s->arena_bytes + (s->mask + 1) * sizeof(uint64_t) +
+           s->dirty_cap * sizeof(pn_rec *) + mk;
+}
+
+size_t pn_store_dirty_count(const pn_store *s) {
+    return s->dirty_n - s->dirty_head;
+}
+
+void pn_store_clear_dirty(pn_store *s) {
+    for (size_t i = s->dirty_head; i < s->dirty_n; i++) s->dirty[i]->dirty = 0;
+    s->dirty_head = s->dirty_n = 0;
+    s->dirty_from = 0;
+    s->dirty_again = 0;
+}
+
+uint64_t pn_store_root(const pn_store *s) {
+    return s->mk[0][0];
+}
+
+// -------------------- 表 --------------------
+
+static pn_rec *lookup(const pn_store *s, const char *key, size_t klen, uint64_t h) {
+    uint64_t tag = slot_tag(h);
+    for (size_t i = home(h, s->shift);; i = (i + 1) & s->mask) {
+        uint64_t v = s->slot[i];
+        if (!v) return NULL;
+        if ((v >> PTR_BITS) == tag) {
+            pn_rec *r = slot_rec(v);
+            if (r->hash == h && r->klen == klen && memcmp(r->key, key, klen) == 0) return r;
+        }
+    }
+}
+
+static void place(uint64_t *slot, size_t mask, unsigned shift, pn_rec *r) {
+    size_t i = home(r->hash, shift);
+    while (slot[i]) i = (i + 1) & mask;
+    slot[i] = slot_tag(r->hash) << PTR_BITS | (uint64_t)(uintptr_t)r;
+}
+
+// 負荷率 3/4 を超えたら 2 倍にする。レコード自体は動かさない
+static int grow_table(pn_store *s) {
+    size_t nmask = s->mask * 2 + 1;
+    uint64_t *ns = calloc(nmask + 1, sizeof(uint64_t));
+    if (!ns) return -1;
+    for (size_t i = 0; i <= s->mask; i++)
+        if (s->slot[i]) place(ns, nmask, s->shift - 1, slot_rec(s->slot[i]));
+    free(s->slot);
+    s->slot = ns;
+    s->mask = nmask;
+    s->shift--;
+    return 0;
+}
+
+static pn_rec *find_or_insert(pn_store *s, const char *key, size_t klen, uint64_t h) {
+    pn_rec *r = lookup(s, key, klen, h);
+    if (r) return r;
+    if (klen == 0 || klen > PN_KEY_MAX) return NULL;
+    if ((s->count + 1) * 4 > (s->mask + 1) * 3 && grow_table(s) < 0) return NULL;
+
+    // レコードと最初のエントリ 1 個を 1 ブロックで確保する
+    size_t hdr = (sizeof(pn_rec) + klen + 7) & ~(size_t)7;
+    r = arena_alloc(s, hdr + sizeof(pn_entry));
+    if (!r) return NULL;
+    if ((uintptr_t)r >> PTR_BITS) return NULL; // 48bit を超えるアドレスは詰められない
+    r->hash = h;
+    r->ent = (pn_entry *)((char *)r + hdr);
+    r->value = 0;
+    r->n = 0;
+    r->cap_log = 0;
+    r->dirty = 0;
+    r->klen = (uint16_t)klen;
+    memcpy(r->key, key, klen);
+    place(s->slot, s->mask, s->shift, r);
+    s->count++;
+    return r;
+}
+
+// -------------------- Merkle 木 --------------------
+
+// エントリ 1 個のダイジェスト。(0, 0) のエントリは無いのと同じなので 0
+static inline uint64_t entry_digest(uint64_t h, uint64_t rid, uint64_t inc, uint64_t dec) {
+    if (!inc && !dec) return 0;
+    return fmix(fmix(h ^ fmix(rid)) + inc * 0x9E3779B97F4A7C15ULL + fmix(dec));
+}
+
+static inline size_t leaf_of(uint64_t h) {
+    return (size_t)(h >> (64 - 4 * LEAF_LEVEL));
+}
+
+// ノードは和なので、エントリが変わったら葉から根まで差分を足すだけでよい
+static void mk_update(pn_store *s, uint64_t h, uint64_t rid, uint64_t oi, uint64_t od, uint64_t ni,
+                      uint64_t nd) {
+    uint64_t d = entry_digest(h, rid, ni, nd) - entry_digest(h, rid, oi, od);
+    size_t idx = leaf_of(h);
+    for (int l = LEAF_LEVEL; l >= 0; l--, idx >>= 4) s->mk[l][idx] += d;
+}
+
+// -------------------- レコード操作 --------------------
+
+static int mark_dirty(pn_store *s, pn_rec *r) {
+    if (r->dirty) {
+        // 途中まで送ったレコード: 送り済みのエントリが変わったかもしれない
+        if (s->dirty_from && s->dirty[s->dirty_head] == r) s->dirty_again = 1;
+        return 0;
+    }
+    if (s->dirty_n == s->dirty_cap) {
+        size_t ncap = s->dirty_cap ? s->dirty_cap * 2 : 1024;
+        pn_rec **p = realloc(s->dirty, ncap * sizeof(*p));
+        if (!p) return -1;
+        s->dirty = p;
+        s->dirty_cap = ncap;
+    }
+    s->dirty[s->dirty_n++] = r;
+    r->dirty = 1;
+    return 0;
+}
+
+// rid のエントリ。なければ 0 で挿入する (容量が足りなければ倍の配列に移す)
+static pn_entry *entry_for(pn_store *s, pn_rec *r, uint64_t rid) {
+    uint32_t i = 0;
+    while (i < r->n && r->ent[i].rid < rid) i++;
+    if (i < r->n && r->ent[i].rid == rid) return &r->ent[i];
+
+    if (r->n == (1u << r->cap_log)) {
+        if (r->cap_log + 1 >= CAP_CLASSES) return NULL;
+        pn_entry *ne = ent_alloc(s, r->cap_log + 1u);
+        if (!ne) return NULL;
+        memcpy(ne, r->ent, r->n * sizeof(pn_entry));
+        ent_release(s, r->ent, r->cap_log);
+        r->ent = ne;
+        r->cap_log++;
+    }
+    memmove(&r->ent[i + 1], &r->ent[i], (r->n - i) * sizeof(pn_entry));
+    r->ent[i].rid = rid;
+    r->ent[i].inc = 0;
+    r->ent[i].dec = 0;
+    r->n++;
+    return &r->ent[i];
+}
+
+static int add_rec(pn_store *s, pn_rec *r, int64_t delta) {
+    if (delta == 0) return 0;
+    pn_entry *e = entry_for(s, r, s->self);
+    if (!e) return -1;
+    uint64_t oi = e->inc, od = e->dec;
+    if (delta > 0) e->inc += (uint64_t)delta;
+    else e->dec += -(uint64_t)delta;
+    mk_update(s, r->hash, e->rid, oi, od, e->inc, e->dec);
+    r->value = (int64_t)((uint64_t)r->value + (uint64_t)delta);
+    return mark_dirty(s, r);
+}
+
+static int merge_rec(pn_store *s, pn_rec *r, uint64_t rid, uint64_t inc, uint64_t dec) {
+    if (inc == 0 && dec == 0) return 0;
+    pn_entry *e = entry_for(s, r, rid);
+    if (!e) return -1;
+    uint64_t gi = inc > e->inc ? inc - e->inc : 0;
+    uint64_t gd = dec > e->dec ? dec - e->dec : 0;
+    if (!gi && !gd) return 0;
+    mk_update(s, r->hash, rid, e->inc, e->dec, e->inc + gi, e->dec + gd);
+    e->inc += gi;
+    e->dec += gd;
+    r->value = (int64_t)((uint64_t)r->value + gi - gd);
+    return mark_dirty(s, r);
+}
+
+// -------------------- 公開 API --------------------
+
+int pn_store_add(pn_store *s, const char *key, size_t klen, int64_t delta) {
+    pn_rec *r = find_or_insert(s, key, klen, hash_key(key, klen));
+    return r ? add_rec(s, r, delta) : -1;
+}
+
+int64_t pn_store_get(const pn_store *s, const char *key, size_t klen, int *found) {
+    const pn_rec *r = lookup(s, key, klen, hash_key(key, klen));
+    if (found) *found = r != NULL;
+    return r ? r->value : 0;
+}
+
+#define BATCH_GROUP 32
+
+size_t pn_store_add_batch(pn_store *s, const pn_op *ops, size_t n) {
+    uint64_t h[BATCH_GROUP];
+    size_t failed = 0;
+    for (size_t base = 0; base < n; base += BATCH_GROUP) {
+        size_t m = n - base < BATCH_GROUP ? n - base : BATCH_GROUP;
+        // 先にハッシュを計算して表のスロットを読み込ませておく
+        for (size_t i = 0; i < m; i++) {
+            h[i] = hash_key(ops[base + i].key, ops[base + i].klen);
+            __builtin_prefetch(&s->slot[home(h[i], s->shift)]);
+        }
+        for (size_t i = 0; i < m; i++) {
+            const pn_op *op = &ops[base + i];
+            pn_rec *r = find_or_insert(s, op->key, op->klen, h[i]);
+            if (!r || add_rec(s, r, op->delta) < 0) failed++;
+        }
+    }
+    return failed;
+}
+
+int pn_store_merge_entry(pn_store *s, const char *key, size_t klen, uint64_t rid,
+                         uint64_t inc, uint64_t dec) {
+    pn_rec *r = find_or_insert(s, key, klen, hash_key(key, klen));
+    return r ? merge_rec(s, r, rid, inc, dec) : -1;
+}
+
+void pn_store_foreach(const pn_store *s, pn_store_visit_fn cb, void *arg) {
+    for (size_t i = 0; i <= s->mask; i++) {
+        if (!s->slot[i]) continue;
+        const pn_rec *r = slot_rec(s->slot[i]);
+        if (cb(arg, r->key, r->klen, r->value)) return;
+    }
+}
+
+// -------------------- データグラム --------------------
+//
+//   [0] PN_STORE_MAGIC  [1] version  [2] flags (0)  varint sender
+//   レコード * n … データグラム末尾まで
+//     varint klen, key[klen], varint n, (varint rid, varint inc, varint dec) * n
+//
+// キーの状態はレプリカ全員分をまとめて送る (キー単位の join)。
+// エントリは 1 個ずつ join されるので、1 データグラムに入らないレコードは
+// エントリの途中で切って、残りを同じキーの別レコードとして次に送ってよい。
+
+// r のエントリ [from, r->n) を入るだけ書き、*upto に書いた次の番号を入れる。
+// 残りのエントリが 1 個も入らなければ NULL
+static uint8_t *put_rec(uint8_t *p, const uint8_t *end, const pn_rec *r, uint32_t from, uint32_t *upto) {
+    p = varint_put(p, end, r->klen);
+    if (!p || (size_t)(end - p) < r->klen) return NULL;
+    memcpy(p, r->key, r->klen);
+    p += r->klen;
+    // 個数は書いてみるまで決まらないので、残り全部の個数の長さだけ空けておく
+    size_t w = varint_len(r->n - from);
+    if ((size_t)(end - p) < w) return NULL;
+    uint8_t *body = p + w, *q = body;
+    uint32_t i = from;
+    for (; i < r->n; i++) {
+        uint8_t *e = varint_put(q, end, r->ent[i].rid);
+        if (e) e = varint_put(e, end, r->ent[i].inc);
+        if (e) e = varint_put(e, end, r->ent[i].dec);
+        if (!e) break;
+        q = e;
+    }
+    if (i == from && from < r->n) return NULL;
+    size_t cw = varint_len(i - from);
+    varint_put(p, end, i - from);
+    if (cw < w) { // 個数が短くなった分を詰める
+        memmove(p + cw, body, (size_t)(q - body));
+        q -= w - cw;
+    }
+    *upto = i;
+    return q;
+}
+
+size_t pn_store_pack_deltas(pn_store *s, void *out, size_t cap) {
+    uint8_t *start = out, *end = start + cap;
+    if (s->dirty_head == s->dirty_n || cap < 4) return 0;
+    start[0] = PN_STORE_MAGIC;
+    start[1] = PN_STORE_VERSION;
+    start[2] = 0;
+    uint8_t *p = varint_put(start + 3, end, s->self);
+    if (!p) return 0;
+    uint8_t *body = p;
+
+    while (s->dirty_head < s->dirty_n) {
+        pn_rec *r = s->dirty[s->dirty_head];
+        uint32_t upto;
+        uint8_t *q = put_rec(p, end, r, s->dirty_from, &upto);
+        if (!q) {
+            if (p != body) break; // 次のデータグラムへ
+            // 空のデータグラムにキーとエントリ 1 個も入らない (cap が小さすぎる)。送れないので捨てる
+            upto = r->n;
+        } else {
+            p = q;
+        }
+        if (upto < r->n) { // 残りのエントリは次のデータグラムで
+            s->dirty_from = upto;
+            break;
+        }
+        s->dirty_from = 0;
+        s->dirty_head++;
+        r->dirty = 0;
+        if (s->dirty_again) { // 送っている間に変わった: 最初から送り直す
+            s->dirty_again = 0;
+            if (mark_dirty(s, r) < 0) break;
+        }
+    }
+    if (s->dirty_head == s->dirty_n) s->dirty_head = s->dirty_n = 0;
+    return p == body ? 0 : (size_t)(p - start);
+}
+
+int pn_store_merge_packet(pn_store *s, const void *buf, size_t len) {
+    const uint8_t *p = buf, *end = p + len;
+    uint64_t sender, klen, n, rid, inc, dec;
+    if (len < 4 || p[0] != PN_STORE_MAGIC || p[1] != PN_STORE_VERSION) return -1;
+    p = varint_get(p + 3, end, &sender);
+    if (!p) return -1;
+    while (p < end) {
+        p = varint_get(p, end, &klen);
+        if (!p || klen == 0 || klen > PN_KEY_MAX || (size_t)(end - p) < klen) return -1;
+        const char *key = (const char *)p;
+        p += klen;
+        p = varint_get(p, end, &n);
+        if (!p) return -1;
+        pn_rec *r = find_or_insert(s, key, klen, hash_key(key, klen));
+        if (!r) return -1;
+        for (uint64_t i = 0; i < n; i++) {
+            if (!(p = varint_get(p, end, &rid)) || !(p = varint_get(p, end, &inc)) ||
+                !(p = varint_get(p, end, &dec)))
+                return -1;
+            if (merge_rec(s, r, rid, inc, dec) < 0) return -1;
+        }
+    }
+    return 0;
+}
+
+int pn_store_merge_packets(pn_store *s, const void *const bufs[], const size_t lens[], int n) {
+    int bad = 0;
+    for (int i = 0; i < n; i++)
+        if (pn_store_merge_packet(s, bufs[i], lens[i]) < 0) bad++;
+    return bad;
+}
+
+// -------------------- Merkle anti‑entropy --------------------
+//
+//   [0] PN_AE_MAGIC  [1] version  [2] type
+//   PN_AE_NODES: varint level, (varint index_gap, digest (8 バイト LE)) * n
+//                「自分の level 段のこれらのノードはこの値」
+//   PN_AE_PULL : (varint leaf_gap) * n
+//                「これらの葉のキーを送ってほしい」
+// index_gap は gc_wire と同じく直前の番号 + 1 からの差。
+//
+// NODES を受けたら自分の値と違うノードだけを見る。葉より上なら違うノードの
+// 子 16 個を NODES で返し (相手が同じ比較をしてさらに下りる)、葉なら
+// その葉のキーの状態 (pn_store_pack_deltas と同じ形式) と PULL を返す。
+// 根から葉まで 4 往復、やり取りは違う部分木の数に比例する。
+
+typedef struct {
+    pn_ae_send_fn send;
+    void *arg;
+    size_t hlen;
+    uint8_t *p;
+    uint64_t next;
+    uint8_t buf[PN_STORE_MTU];
+} ae_out;
+
+static void out_begin(ae_out *o, pn_ae_send_fn send, void *arg, const uint8_t *hdr, size_t hlen) {
+    o->send = send;
+    o->arg = arg;
+    memcpy(o->buf, hdr, hlen);
+    o->hlen = hlen;
+    o->p = o->buf + hlen;
+    o->next = 0;
+}
+
+static void out_flush(ae_out *o) {
+    if (o->p > o->buf + o->hlen) o->send(o->arg, o->buf, (size_t)(o->p - o->buf));
+    o->p = o->buf + o->hlen;
+    o->next = 0;
+}
+
+static uint8_t *put_u64le(uint8_t *p, const uint8_t *end, uint64_t v) {
+    if (!p || end - p < 8) return NULL;
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+    return p + 8;
+}
+
+static uint8_t *put_index(ae_out *o, uint8_t *p, const uint8_t *end, uint64_t idx) {
+    return varint_put(p, end, idx - o->next);
+}
+
+// ノード 1 個 (digest_too = 0 なら葉番号だけ) を足す。入らなければ送ってから足す
+static void out_node(ae_out *o, uint64_t idx, int digest_too, uint64_t digest) {
+    const uint8_t *end = o->buf + sizeof(o->buf);
+    for (int attempt = 0; attempt < 2; attempt++) {
+        uint8_t *q = put_index(o, o->p, end, idx);
+        if (q && digest_too) q = put_u64le(q, end, digest);
+        if (q) {
+            o->p = q;
+            o->next = idx + 1;
+            return;
+        }
+        out_flush(o);
+    }
+}
+
+// レコードを積む。入らなければ送ってから積み、1 データグラムに入らない分は
+// エントリの途中で切って次のデータグラムに続ける
+static void out_rec(ae_out *o, const pn_rec *r) {
+    uint32_t from = 0, upto;
+    do {
+        uint8_t *q = put_rec(o->p, o->buf + sizeof(o->buf), r, from, &upto);
+        if (!q) {
+            if (o->p == o->buf + o->hlen) return; // 空でもエントリ 1 個入らない (キーは PN_KEY_MAX 以下なので起きない)
+            out_flush(o);
+            continue;
+        }
+        o->p = q;
+        from = upto;
+    } while (from < r->n);
+}
+
+// 葉 leaf のレコードを全部 out に積む。表はハッシュ順なので、葉のホーム範囲の
+// 先頭から、範囲を過ぎて最初の空きスロットまでを見ればよい
+static void out_leaf(const pn_store *s, ae_out *o, size_t leaf) {
+    unsigned sh = 64 - 4 * LEAF_LEVEL;
+    uint64_t lo = (uint64_t)leaf << sh, hi = lo | ((UINT64_C(1) << sh) - 1);
+    size_t i = home(lo, s->shift), span = home(hi, s->shift) - i;
+    for (size_t step = 0; step <= s->mask; step++, i = (i + 1) & s->mask) {
+        uint64_t v = s->slot[i];
+        if (!v) {
+            if (step > span) break;
+            continue;
+        }
+        const pn_rec *r = slot_rec(v);
+        if (leaf_of(r->hash) == leaf && r->n) out_rec(o, r);
+    }
+}
+
+static size_t store_hdr(const pn_store *s, uint8_t *hdr) {
+    hdr[0] = PN_STORE_MAGIC;
+    hdr[1] = PN_STORE_VERSION;
+    hdr[2] = 0;
+    return (size_t)(varint_put(hdr + 3, hdr + 16, s->self) - hdr);
+}
+
+size_t pn_store_ae_start(const pn_store *s, void *out, size_t cap) {
+    uint8_t *p = out, *end = p + cap;
+    if (cap < 4) return 0;
+    p[0] = PN_AE_MAGIC;
+    p[1] = PN_STORE_VERSION;
+    p[2] = PN_AE_NODES;
+    uint8_t *q = varint_put(p + 3, end, 0); // level 0
+    if (q) q = varint_put(q, end, 0);       // index 0
+    q = put_u64le(q, end, s->mk[0][0]);
+    return q ? (size_t)(q - p) : 0;
+}
+
+static int handle_nodes(pn_store *s, const uint8_t *p, const uint8_t *end, pn_ae_send_fn send, void *arg) {
+    uint64_t level, gap, next = 0;
+    if (!(p = varint_get(p, end, &level)) || level > LEAF_LEVEL) return -1;
+    size_t width = (size_t)1 << (4 * level);
+    ae_out *a = malloc(2 * sizeof(ae_out)), *b = a + 1; // NODES / レコード, PULL
+    if (!a) return -1;
+    uint8_t hdr[16];
+    if (level < LEAF_LEVEL) {
+        uint8_t *q = hdr;
+        *q++ = PN_AE_MAGIC;
+        *q++ = PN_STORE_VERSION;
+        *q++ = PN_AE_NODES;
+        q = varint_put(q, hdr + sizeof(hdr), level + 1);
+        out_begin(a, send, arg, hdr, (size_t)(q - hdr));
+    } else {
+        out_begin(a, send, arg, hdr, store_hdr(s, hdr));
+        uint8_t pull[3] = {PN_AE_MAGIC, PN_STORE_VERSION, PN_AE_PULL};
+        out_begin(b, send, arg, pull, sizeof(pull));
+    }
+
+    int rc = 0;
+    while (p < end) {
+        if (!(p = varint_get(p, end, &gap)) || end - p < 8 || gap >= width - next) {
+            rc = -1;
+            break;
+        }
+        uint64_t idx = next + gap, digest = 0;
+        for (int i = 0; i < 8; i++) digest |= (uint64_t)p[i] << (8 * i);
+        p += 8;
+        next = idx + 1;
+        if (digest == s->mk[level][idx]) continue;
+        if (level < LEAF_LEVEL) {
+            for (uint64_t c = idx * 16; c < idx * 16 + 16; c++) out_node(a, c, 1, s->mk[level + 1][c]);
+        } else {
+            out_leaf(s, a, (size_t)idx);
+            out_node(b, idx, 0, 0);
+        }
+    }
+    out_flush(a);
+    if (level == LEAF_LEVEL) out_flush(b);
+    free(a);
+    return rc;
+}
+
+static int handle_pull(pn_store *s, const uint8_t *p, const uint8_t *end, pn_ae_send_fn send, void *arg) {
+    uint64_t gap, next = 0, width = (uint64_t)1 << (4 * LEAF_LEVEL);
+    ae_out *o = malloc(sizeof(*o));
+    if (!o) return -1;
+    uint8_t hdr[16];
+    out_begin(o, send, arg, hdr, store_hdr(s, hdr));
+    int rc = 0;
+    while (p < end) {
+        if (!(p = varint_get(p, end, &gap)) || gap >= width - next) {
+            rc = -1;
+            break;
+        }
+        next += gap;
+        out_leaf(s, o, (size_t)next);
+        next++;
+    }
+    out_flush(o);
+    free(o);
+    return rc;
+}
+
+int pn_store_ae_handle(pn_store *s, const void *buf, size_t len, pn_ae_send_fn send, void *arg) {
+    const uint8_t *p = buf, *end = p + len;
+    if (len >= 1 && p[0] == PN_STORE_MAGIC) return pn_store_merge_packet(s, buf, len);
+    if (len < 3 || p[0] != PN_AE_MAGIC || p[1] != PN_STORE_VERSION) return -1;
+    switch (p[2]) {
+    case PN_AE_NODES: return handle_nodes(s, p + 3, end, send, arg);
+    case PN_AE_PULL: return handle_pull(s, p + 3, end, send, arg);
+    default: return -1;
+    }
+}
@@ -0,0 +1,92 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 文字列キー → PN‑Counter のキー付き CRDT ストア
+// ------------------------------------------------------------
+// 1 レプリカの中に何百万個もの PN‑Counter (ユーザごと・エンドポイントごと…)
+// を持つためのもの。
+//
+// - キーごとのレコードと、レプリカごとの (inc, dec) ベクタはアリーナから確保する。
+//   ベクタが伸びたら古いブロックはサイズクラス別のフリーリストに戻して再利用する。
+// - インデックスはオープンアドレス (線形探査) のハッシュ表。1 スロット 8 バイトで、
+//   上位 16bit にハッシュのタグ、下位 48bit にレコードのアドレスを詰めるので、
+//   探査中はタグが一致したときだけレコードを読みに行く。
+// - ハッシュ範囲で切った Merkle 木 (16 分木, 葉 65536 個) を増分で保守する。
+//   2 レプリカは根から違う部分木だけを下りて、違う葉のキーだけを交換する
+//   (pn_store_ae_*)。全状態を送るのと違い、通信量は食い違いの量に比例する。
+// - 変更のあったキーは dirty リストに積み、pn_store_pack_deltas() で
+//   MTU に収まるデータグラムに詰めて送る (キー単位の state‑based delta)。
+// スレッドセーフではない。1 スレッド (イベントループ) から使うこと。
+// ------------------------------------------------------------
+#ifndef PN_STORE_H
+#define PN_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PN_STORE_MAGIC 0xC8   // キー付き delta データグラムの先頭バイト
+#define PN_STORE_VERSION 1
+#define PN_STORE_MTU 1400     // 既定のデータグラム上限 (IP/UDP ヘッダ込みで 1500 未満)
+#define PN_KEY_MAX 512        // キーの最大長
+
+#define PN_AE_MAGIC 0xC9      // anti‑entropy メッセージの先頭バイト
+#define PN_AE_NODES 1
+#define PN_AE_PULL 2
+#define PN_MERKLE_LEVELS 5    // 根 (1 個) … 葉 (16^4 = 65536 個)
+
+typedef struct pn_store pn_store;
+
+// レプリカ self_rid として新しいストアを作る。失敗なら NULL
+pn_store *pn_store_new(uint64_t self_rid);
+void pn_store_free(pn_store *s);
+
+// ローカルの増減 (delta < 0 なら減算)。キーが長すぎる / メモリ不足なら -1
+int pn_store_add(pn_store *s, const char *key, size_t klen, int64_t delta);
+// 現在値。キーがなければ 0 で *found = 0
+int64_t pn_store_get(const pn_store *s, const char *key, size_t klen, int *found);
+
+typedef struct {
+    const char *key;
+    uint32_t klen;
+    int64_t delta;
+} pn_op;
+
+// まとめて増減する。ハッシュを先に全部計算して表をプリフェッチしてから適用する。
+// 失敗した数を返す
+size_t pn_store_add_batch(pn_store *s, const pn_op *ops, size_t n);
+
+// 1 キー・1 レプリカ分の状態をマージする (inc / dec はそれぞれ max)
+int pn_store_merge_entry(pn_store *s, const char *key, size_t klen, uint64_t rid,
+                         uint64_t inc, uint64_t dec);
+
+// dirty なキーを cap バイト以内のデータグラムに詰める。書いたバイト数を返す
+// (送るものがなければ 0)。入りきらなかったキーは次の呼び出しで送る
+size_t pn_store_pack_deltas(pn_store *s, void *out, size_t cap);
+// dirty なキーの数
+size_t pn_store_dirty_count(const pn_store *s);
+// dirty リストを捨てる (anti‑entropy だけで同期するとき)
+void pn_store_clear_dirty(pn_store *s);
+
+// pn_store_pack_deltas の出力をマージする。壊れていれば -1 (途中までは反映済み)
+int pn_store_merge_packet(pn_store *s, const void *buf, size_t len);
+// n 個のデータグラムをまとめてマージする。壊れていた数を返す
+int pn_store_merge_packets(pn_store *s, const void *const bufs[], const size_t lens[], int n);
+
+// ---- Merkle anti‑entropy ----
+// 根のダイジェスト (全エントリのダイジェストの和)。状態が同じなら等しい
+uint64_t pn_store_root(const pn_store *s);
+// セッションの最初のメッセージ (根の NODES) を out に書く。書いたバイト数を返す
+size_t pn_store_ae_start(const pn_store *s, void *out, size_t cap);
+// 相手からのメッセージ (NODES / PULL / キー状態のデータグラム) を処理し、
+// 返信を send で 0 個以上送る (各 PN_STORE_MTU 以下)。壊れていれば -1
+typedef void (*pn_ae_send_fn)(void *arg, const void *buf, size_t len);
+int pn_store_ae_handle(pn_store *s, const void *buf, size_t len, pn_ae_send_fn send, void *arg);
+
+// 統計
+size_t pn_store_keys(const pn_store *s);
+size_t pn_store_bytes(const pn_store *s); // アリーナ + 表 + dirty リスト
+
+// 全キーをなめる (順序は不定)。cb が 0 以外を返したら止める
+typedef int (*pn_store_visit_fn)(void *arg, const char *key, size_t klen, int64_t value);
+void pn_store_foreach(const pn_store *s, pn_store_visit_fn cb, void *arg);
+
+#endif // PN_STORE_H
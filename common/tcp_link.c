@@ -0,0 +1,429 @@
+// -*- coding: utf-8 -*-
+// 長さ付きフレームの TCP 接続 (説明は tcp_link.h)
+
+#define _GNU_SOURCE
+#include "tcp_link.h"
+
+#include <errno.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define BACKOFF_MIN_MS 100
+#define BACKOFF_MAX_MS 5000
+#define IOV_DEFAULT 64
+#define READ_MIN (64u << 10)  // 1 回の read に空けておく量
+#define READS_PER_EVENT 16     // 1 つの接続に居座らないように
+
+typedef struct chunk {
+    struct chunk *next;
+    size_t off, len, cap;   // [off, len) がまだ書いていない部分
+    uint8_t data[];
+} chunk;
+
+enum { ST_DOWN, ST_CONNECTING, ST_UP };
+
+struct tcp_conn {
+    ev_loop *l;
+    int fd;
+    int state;
+    int dialed;
+    struct sockaddr_in addr;
+    int timer;              // つなぎ直し用 (dial のみ)
+    uint32_t backoff_ms;
+    tcp_handlers h;
+    void *arg;
+
+    chunk *head, *tail;
+    size_t pending;
+    int out_armed;          // EPOLLOUT を待っている
+    int blocked;            // EAGAIN で断ったことがある (on_drain を呼ぶ)
+    int iov_max;
+
+    uint8_t *rx;
+    size_t rx_len, rx_cap;
+
+    int busy;               // コールバックの中 (解放を後回しにする)
+    int dead;               // 閉じた / 解放待ち
+    tcp_stats st;
+};
+
+typedef struct {
+    tcp_handlers h;
+    void *arg;
+} listener;
+
+static void on_io(ev_loop *l, int fd, uint32_t events, void *arg);
+
+static tcp_conn *conn_new(ev_loop *l, const tcp_handlers *h, void *arg) {
+    tcp_conn *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->l = l;
+    c->fd = -1;
+    c->timer = -1;
+    c->h = *h;
+    c->arg = arg;
+    c->backoff_ms = BACKOFF_MIN_MS;
+    c->iov_max = IOV_DEFAULT;
+    return c;
+}
+
+static void drop_queue(tcp_conn *c) {
+    for (chunk *k = c->head, *next; k; k = next) {
+        next = k->next;
+        free(k);
+    }
+    c->head = c->tail = NULL;
+    c->pending = 0;
+    c->out_armed = 0;
+}
+
+static void conn_free(tcp_conn *c) {
+    drop_queue(c);
+    free(c->rx);
+    free(c);
+}
+
+static void arm_out(tcp_conn *c, int on) {
+    if (c->out_armed == on || c->fd < 0) return;
+    c->out_armed = on;
+    ev_mod_fd(c->l, c->fd, EPOLLIN | (on ? EPOLLOUT : 0));
+}
+
+// 切れた: キューを捨て、dial した接続ならつなぎ直しを予約する
+static void conn_down(tcp_conn *c) {
+    int was_up = c->state == ST_UP;
+    if (c->fd >= 0) {
+        ev_del_fd(c->l, c->fd);
+        close(c->fd);
+        c->fd = -1;
+    }
+    c->state = ST_DOWN;
+    drop_queue(c);
+    c->rx_len = 0;
+    if (was_up) {
+        c->st.disconnects++;
+        if (c->h.on_state) c->h.on_state(c, 0, c->arg);
+    }
+    if (c->dialed && !c->dead) {
+        ev_set_timer(c->l, c->timer, c->backoff_ms);
+        c->backoff_ms = c->backoff_ms * 2 > BACKOFF_MAX_MS ? BACKOFF_MAX_MS : c->backoff_ms * 2;
+    } else {
+        c->dead = 1; // 受け付けた接続は使い捨て
+    }
+}
+
+static void set_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static void conn_up(tcp_conn *c) {
+    c->state = ST_UP;
+    c->backoff_ms = BACKOFF_MIN_MS;
+    c->st.connects++;
+    arm_out(c, 0);
+    if (c->h.on_state) c->h.on_state(c, 1, c->arg);
+}
+
+// -------------------- dial / listen --------------------
+
+static void try_connect(tcp_conn *c) {
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c->fd < 0) {
+        conn_down(c);
+        return;
+    }
+    set_nodelay(c->fd);
+    int rc = connect(c->fd, (const struct sockaddr *)&c->addr, sizeof(c->addr));
+    if (rc < 0 && errno != EINPROGRESS) {
+        conn_down(c);
+        return;
+    }
+    c->state = ST_CONNECTING;
+    c->out_armed = 1; // つながったら書き込み可能になる
+    if (ev_add_fd(c->l, c->fd, EPOLLIN | EPOLLOUT, on_io, c) < 0) {
+        conn_down(c);
+        return;
+    }
+}
+
+static void on_retry(ev_loop *l, uint64_t expirations, void *arg) {
+    (void)expirations;
+    tcp_conn *c = arg;
+    ev_set_timer(l, c->timer, 0); // 1 回きり
+    if (c->state == ST_DOWN && !c->dead) try_connect(c);
+}
+
+tcp_conn *tcp_dial(ev_loop *l, const struct sockaddr_in *addr, const tcp_handlers *h, void *arg) {
+    tcp_conn *c = conn_new(l, h, arg);
+    if (!c) return NULL;
+    c->dialed = 1;
+    c->addr = *addr;
+    c->timer = ev_add_timer(l, BACKOFF_MIN_MS, on_retry, c);
+    if (c->timer < 0) {
+        conn_free(c);
+        return NULL;
+    }
+    ev_set_timer(l, c->timer, 0);
+    try_connect(c);
+    return c;
+}
+
+static void on_accept(ev_loop *l, int fd, uint32_t events, void *arg) {
+    (void)events;
+    listener *ls = arg;
+    for (;;) {
+        int cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (cfd < 0) return; // EAGAIN など
+        tcp_conn *c = conn_new(l, &ls->h, ls->arg);
+        if (!c) {
+            close(cfd);
+            continue;
+        }
+        set_nodelay(cfd);
+        c->fd = cfd;
+        if (ev_add_fd(l, cfd, EPOLLIN, on_io, c) < 0) {
+            close(cfd);
+            conn_free(c);
+            continue;
+        }
+        conn_up(c);
+    }
+}
+
+int tcp_listen(ev_loop *l, int port, const tcp_handlers *h, void *arg) {
+    listener *ls = malloc(sizeof(*ls)); // 待ち受けはプロセスの終わりまで使う
+    if (!ls) return -1;
+    ls->h = *h;
+    ls->arg = arg;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        free(ls);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in a = {0};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = INADDR_ANY;
+    a.sin_port = htons((unsigned short)port);
+    if (bind(fd, (struct sockaddr *)&a, sizeof(a)) < 0 || listen(fd, 64) < 0 ||
+        ev_add_fd(l, fd, EPOLLIN, on_accept, ls) < 0) {
+        int e = errno;
+        close(fd);
+        free(ls);
+        errno = e;
+        return -1;
+    }
+    return fd;
+}
+
+// -------------------- 送信 --------------------
+
+int tcp_conn_send(tcp_conn *c, const void *buf, size_t len) {
+    if (c->state != ST_UP) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    if (len > TCP_FRAME_MAX) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (c->pending > TCP_TX_HIGH) {
+        c->blocked = 1;
+        errno = EAGAIN;
+        return -1;
+    }
+    size_t need = 4 + len;
+    chunk *k = c->tail;
+    if (!k || k->cap - k->len < need) {
+        size_t cap = need > TCP_CHUNK ? need : TCP_CHUNK;
+        k = malloc(sizeof(*k) + cap);
+        if (!k) return -1;
+        k->next = NULL;
+        k->off = k->len = 0;
+        k->cap = cap;
+        if (c->tail) c->tail->next = k;
+        else c->head = k;
+        c->tail = k;
+    }
+    uint8_t *p = k->data + k->len;
+    p[0] = (uint8_t)(len >> 24);
+    p[1] = (uint8_t)(len >> 16);
+    p[2] = (uint8_t)(len >> 8);
+    p[3] = (uint8_t)len;
+    memcpy(p + 4, buf, len);
+    k->len += need;
+    c->pending += need;
+    c->st.frames_out++;
+    arm_out(c, 1); // 書けるようになったらまとめて書く
+    return 0;
+}
+
+static int flush(tcp_conn *c) {
+    if (c->state != ST_UP) return 0;
+    struct iovec iov[IOV_DEFAULT];
+    int max = c->iov_max < IOV_DEFAULT ? c->iov_max : IOV_DEFAULT;
+    while (c->head) {
+        int n = 0;
+        for (chunk *k = c->head; k && n < max; k = k->next) {
+            iov[n].iov_base = k->data + k->off;
+            iov[n].iov_len = k->len - k->off;
+            n++;
+        }
+        ssize_t w = writev(c->fd, iov, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                arm_out(c, 1);
+                return 0;
+            }
+            conn_down(c);
+            return -1;
+        }
+        c->st.writev_calls++;
+        c->st.bytes_out += (unsigned long long)w;
+        c->pending -= (size_t)w;
+        while (w > 0) {
+            chunk *k = c->head;
+            size_t left = k->len - k->off;
+            if ((size_t)w < left) {
+                k->off += (size_t)w;
+                break;
+            }
+            w -= (ssize_t)left;
+            c->head = k->next;
+            if (!c->head) c->tail = NULL;
+            free(k);
+        }
+    }
+    arm_out(c, 0);
+    if (c->blocked && c->pending <= TCP_TX_LOW) {
+        c->blocked = 0;
+        if (c->h.on_drain) c->h.on_drain(c, c->arg);
+    }
+    return 0;
+}
+
+int tcp_conn_flush(tcp_conn *c) {
+    c->busy++;
+    int rc = flush(c);
+    c->busy--;
+    if (c->dead && !c->busy) conn_free(c); // 受け付けた接続が切れた
+    return rc;
+}
+
+// -------------------- 受信 --------------------
+
+static int reserve_rx(tcp_conn *c, size_t need) {
+    if (c->rx_cap - c->rx_len >= need) return 0;
+    size_t cap = c->rx_cap ? c->rx_cap : READ_MIN * 2;
+    while (cap - c->rx_len < need) cap *= 2;
+    uint8_t *p = realloc(c->rx, cap);
+    if (!p) return -1;
+    c->rx = p;
+    c->rx_cap = cap;
+    return 0;
+}
+
+// 完全なフレームを on_frame に渡す。プロトコル違反なら -1
+static int parse_frames(tcp_conn *c) {
+    size_t off = 0;
+    while (c->rx_len - off >= 4 && !c->dead && c->state == ST_UP) {
+        const uint8_t *p = c->rx + off;
+        size_t len = (size_t)p[0] << 24 | (size_t)p[1] << 16 | (size_t)p[2] << 8 | p[3];
+        if (len > TCP_FRAME_MAX) return -1;
+        if (c->rx_len - off < 4 + len) {
+            // 大きいフレームは丸ごと入るだけ先に空けておく
+            memmove(c->rx, c->rx + off, c->rx_len - off);
+            c->rx_len -= off;
+            return reserve_rx(c, 4 + len - c->rx_len);
+        }
+        c->st.frames_in++;
+        c->h.on_frame(c, p + 4, len, c->arg);
+        off += 4 + len;
+    }
+    if (c->state != ST_UP) return 0; // コールバックの中で閉じられた
+    memmove(c->rx, c->rx + off, c->rx_len - off);
+    c->rx_len -= off;
+    return 0;
+}
+
+static void read_ready(tcp_conn *c) {
+    for (int i = 0; i < READS_PER_EVENT && c->state == ST_UP && !c->dead; i++) {
+        if (reserve_rx(c, READ_MIN) < 0) {
+            conn_down(c);
+            return;
+        }
+        ssize_t r = read(c->fd, c->rx + c->rx_len, c->rx_cap - c->rx_len);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) conn_down(c);
+            return;
+        }
+        if (r == 0) {
+            conn_down(c);
+            return;
+        }
+        c->st.reads++;
+        c->st.bytes_in += (unsigned long long)r;
+        c->rx_len += (size_t)r;
+        if (parse_frames(c) < 0) {
+            conn_down(c);
+            return;
+        }
+        if ((size_t)r < READ_MIN) return; // 読み切った
+    }
+}
+
+static void on_io(ev_loop *l, int fd, uint32_t events, void *arg) {
+    (void)l;
+    (void)fd;
+    tcp_conn *c = arg;
+    c->busy++;
+    if (c->state == ST_CONNECTING) {
+        int err = 0;
+        socklen_t el = sizeof(err);
+        getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &el);
+        if (err || (events & (EPOLLERR | EPOLLHUP))) conn_down(c);
+        else conn_up(c);
+    } else if (c->state == ST_UP) {
+        if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) read_ready(c);
+        if (c->state == ST_UP && (events & EPOLLOUT)) flush(c);
+    }
+    c->busy--;
+    if (c->dead && !c->busy) conn_free(c);
+}
+
+// -------------------- その他 --------------------
+
+size_t tcp_conn_pending(const tcp_conn *c) {
+    return c->pending;
+}
+
+int tcp_conn_up(const tcp_conn *c) {
+    return c->state == ST_UP;
+}
+
+const tcp_stats *tcp_conn_stats(const tcp_conn *c) {
+    return &c->st;
+}
+
+void tcp_conn_set_iov_max(tcp_conn *c, int n) {
+    c->iov_max = n < 1 ? 1 : n;
+}
+
+void tcp_conn_close(tcp_conn *c) {
+    c->dead = 1;
+    conn_down(c);
+    if (c->timer >= 0) {
+        ev_del_timer(c->l, c->timer);
+        c->timer = -1;
+    }
+    if (!c->busy) conn_free(c);
+}
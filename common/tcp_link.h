@@ -0,0 +1,64 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// 長さ付きフレームを流す、つなぎっぱなしの TCP 接続 (evloop の上で動く)
+// ------------------------------------------------------------
+// フレーム: [4 バイト big‑endian の長さ][中身]。中身は gc_wire の
+// メッセージや pn_store のデータグラムなど何でもよく、UDP と違って
+// TCP_FRAME_MAX まで切り詰めずに送れる。
+//
+// 送信: tcp_conn_send() はフレームを送信キューに積むだけ。小さいフレームは
+//       64KB のチャンクに詰め、書き込めるようになったら (または
+//       tcp_conn_flush() で) チャンクの列を 1 回の writev で書く。
+//       キューが TCP_TX_HIGH を超えると tcp_conn_send() は EAGAIN で断る
+//       (背圧)。TCP_TX_LOW まで減ったら on_drain が呼ばれる。
+// 受信: 読めるだけ読み、完全なフレームごとに on_frame を呼ぶ。
+// 接続: tcp_dial() の接続は切れても backoff (100ms〜5s) しながら
+//       つなぎ直す。tcp_listen() で受け付けた接続は切れたら解放する。
+//       切れたときに送信キューに残っていた分は捨てる (上位で再同期すること)。
+// ------------------------------------------------------------
+#ifndef TCP_LINK_H
+#define TCP_LINK_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+
+#include "evloop.h"
+
+#define TCP_FRAME_MAX (16u << 20)
+#define TCP_TX_HIGH (4u << 20)
+#define TCP_TX_LOW (1u << 20)
+#define TCP_CHUNK (64u << 10)
+
+typedef struct tcp_conn tcp_conn;
+
+typedef struct {
+    void (*on_frame)(tcp_conn *c, const void *buf, size_t len, void *arg);
+    void (*on_state)(tcp_conn *c, int up, void *arg);   // つながった / 切れた (NULL 可)
+    void (*on_drain)(tcp_conn *c, void *arg);           // 背圧が解けた (NULL 可)
+} tcp_handlers;
+
+typedef struct {
+    unsigned long frames_in, frames_out;
+    unsigned long long bytes_in, bytes_out;
+    unsigned long writev_calls, reads;
+    unsigned long connects, disconnects;
+} tcp_stats;
+
+// addr へつなぐ (つながるまで、切れてもつなぎ直し続ける)。失敗なら NULL
+tcp_conn *tcp_dial(ev_loop *l, const struct sockaddr_in *addr, const tcp_handlers *h, void *arg);
+// port で待ち受ける。受け付けた接続は h / arg で動く。listen した fd か -1
+int tcp_listen(ev_loop *l, int port, const tcp_handlers *h, void *arg);
+
+// フレームを積む。つながっていなければ ENOTCONN、キューが一杯なら EAGAIN で -1
+int tcp_conn_send(tcp_conn *c, const void *buf, size_t len);
+// 積んであるフレームを今書けるだけ書く。エラーで切れたら -1
+int tcp_conn_flush(tcp_conn *c);
+size_t tcp_conn_pending(const tcp_conn *c); // 送信キューのバイト数
+int tcp_conn_up(const tcp_conn *c);
+const tcp_stats *tcp_conn_stats(const tcp_conn *c);
+// writev 1 回でまとめるチャンク数の上限 (ベンチマークでまとめ書きの効果を見るため。既定 64)
+void tcp_conn_set_iov_max(tcp_conn *c, int n);
+// 閉じて解放する (dial した接続もつなぎ直さない)
+void tcp_conn_close(tcp_conn *c);
+
+#endif // TCP_LINK_H
@@ -0,0 +1,112 @@
+// -*- coding: utf-8 -*-
+// recvmmsg / sendmmsg によるまとめ送受信 (説明は udp_batch.h)
+
+#define _GNU_SOURCE
+#include "udp_batch.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// -------------------- 受信 --------------------
+
+udp_rx_batch *udp_rx_new(void) {
+    udp_rx_batch *b = malloc(sizeof(*b));
+    if (!b) return NULL;
+    memset(b->msgs, 0, sizeof(b->msgs));
+    b->count = 0;
+    for (int i = 0; i < UDP_BATCH_MAX; ++i) {
+        b->iov[i].iov_base = b->bufs[i];
+        b->iov[i].iov_len = sizeof(b->bufs[i]);
+        b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+        b->msgs[i].msg_hdr.msg_iovlen = 1;
+        b->msgs[i].msg_hdr.msg_name = &b->src[i];
+    }
+    return b;
+}
+
+void udp_rx_free(udp_rx_batch *b) {
+    free(b);
+}
+
+int udp_rx_recv(int fd, udp_rx_batch *b, int flags) {
+    // recvmmsg は msg_namelen を書き換えるので毎回戻す
+    for (int i = 0; i < UDP_BATCH_MAX; ++i) {
+        b->msgs[i].msg_hdr.msg_namelen = sizeof(b->src[i]);
+    }
+    int n;
+    do {
+        // 1 個目が届いたら、残りは待たずにその時点でたまっている分だけ取る
+        n = recvmmsg(fd, b->msgs, UDP_BATCH_MAX, flags | MSG_WAITFORONE, NULL);
+    } while (n < 0 && errno == EINTR);
+    b->count = n < 0 ? 0 : n;
+    return n;
+}
+
+// -------------------- 送信 --------------------
+
+// カーネルが受け取った数を返す。送れなかった分は数えない。
+// bytes が NULL でなければ受け取られた分のバイト数を足す
+static int send_all(int fd, struct mmsghdr *msgs, int n, uint64_t *bytes) {
+    int done = 0, sent = 0;
+    while (done < n) {
+        int r = sendmmsg(fd, msgs + done, (unsigned)(n - done), 0);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            // 先頭の 1 個が送れなかった。捨てて続ける (UDP なので再送はしない)
+            done++;
+            continue;
+        }
+        if (bytes) {
+            for (int i = done; i < done + r; ++i) *bytes += msgs[i].msg_len;
+        }
+        done += r;
+        sent += r;
+    }
+    return sent;
+}
+
+int udp_send_fanout(int fd, const void *msg, size_t len,
+                    const struct sockaddr_in *peers, int n) {
+    struct mmsghdr msgs[UDP_BATCH_MAX];
+    struct iovec iov = {(void *)msg, len};
+    int sent = 0;
+    for (int base = 0; base < n; base += UDP_BATCH_MAX) {
+        int k = n - base < UDP_BATCH_MAX ? n - base : UDP_BATCH_MAX;
+        memset(msgs, 0, sizeof(msgs[0]) * (size_t)k);
+        for (int i = 0; i < k; ++i) {
+            msgs[i].msg_hdr.msg_iov = &iov; // 全 peer で同じバッファを共有
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = (void *)&peers[base + i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(peers[base + i]);
+        }
+        sent += send_all(fd, msgs, k, NULL);
+    }
+    return sent;
+}
+
+void udp_tx_init(udp_tx_batch *b) {
+    b->count = 0;
+    b->sent = b->dropped = b->bytes = 0;
+}
+
+void udp_tx_add(int fd, udp_tx_batch *b, const void *buf, size_t len,
+                const struct sockaddr_in *dst) {
+    if (b->count == UDP_BATCH_MAX) udp_tx_flush(fd, b);
+    int i = b->count++;
+    memset(&b->msgs[i], 0, sizeof(b->msgs[i]));
+    b->iov[i].iov_base = (void *)buf;
+    b->iov[i].iov_len = len;
+    b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+    b->msgs[i].msg_hdr.msg_iovlen = 1;
+    b->msgs[i].msg_hdr.msg_name = (void *)dst;
+    b->msgs[i].msg_hdr.msg_namelen = sizeof(*dst);
+}
+
+int udp_tx_flush(int fd, udp_tx_batch *b) {
+    int sent = send_all(fd, b->msgs, b->count, &b->bytes);
+    b->sent += (uint64_t)sent;
+    b->dropped += (uint64_t)(b->count - sent);
+    b->count = 0;
+    return sent;
+}
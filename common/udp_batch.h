@@ -0,0 +1,67 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// recvmmsg / sendmmsg によるまとめ送受信
+// ------------------------------------------------------------
+// 受信: udp_rx_recv() は 1 回の recvmmsg で最大 UDP_BATCH_MAX 個の
+//       データグラムを取り出す (最初の 1 個が来るまではブロック)。
+// 送信: udp_send_fanout() は同じバッファを全 peer に 1 回の sendmmsg で送る。
+//       peer ごとに内容が違う場合は udp_tx_* でためてから一度に送る。
+// ------------------------------------------------------------
+#ifndef UDP_BATCH_H
+#define UDP_BATCH_H
+
+// recvmmsg / sendmmsg / struct mmsghdr は GNU 拡張
+#ifndef _GNU_SOURCE
+#error "udp_batch.h を使うファイルは先頭で _GNU_SOURCE を定義すること"
+#endif
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define UDP_BATCH_MAX 64     // 1 回のシステムコールで扱うデータグラム数
+#define UDP_BATCH_DGRAM 4096 // 受信バッファ 1 個の大きさ
+
+typedef struct {
+    int count;                              // 直近の udp_rx_recv で受け取った数
+    struct mmsghdr msgs[UDP_BATCH_MAX];
+    struct iovec iov[UDP_BATCH_MAX];
+    struct sockaddr_in src[UDP_BATCH_MAX];
+    char bufs[UDP_BATCH_MAX][UDP_BATCH_DGRAM];
+} udp_rx_batch;
+
+typedef struct {
+    int count;                              // たまっている送信数
+    struct mmsghdr msgs[UDP_BATCH_MAX];
+    struct iovec iov[UDP_BATCH_MAX];
+    // これまでの flush (udp_tx_add からの自動の分も) の合計。呼び出し側が読んで 0 に戻してよい
+    uint64_t sent, dropped, bytes;
+} udp_tx_batch;
+
+// 受信バッチを確保する (大きいのでヒープに置く)。失敗なら NULL
+udp_rx_batch *udp_rx_new(void);
+void udp_rx_free(udp_rx_batch *b);
+// データグラムをまとめて受け取る。受け取った数 (エラーなら -1)
+// flags に MSG_DONTWAIT を渡すとブロックしない
+int udp_rx_recv(int fd, udp_rx_batch *b, int flags);
+
+static inline const char *udp_rx_data(const udp_rx_batch *b, int i, size_t *len) {
+    *len = b->msgs[i].msg_len;
+    return b->bufs[i];
+}
+
+// 同じ内容を peers[0..n) に送る。送れた (カーネルが受け取った) 数を返す
+int udp_send_fanout(int fd, const void *msg, size_t len,
+                    const struct sockaddr_in *peers, int n);
+
+// peer ごとに異なる内容をためて一度に送る。buf と dst は flush まで有効であること
+void udp_tx_init(udp_tx_batch *b);
+// たまりきったら自動的に flush する
+void udp_tx_add(int fd, udp_tx_batch *b, const void *buf, size_t len,
+                const struct sockaddr_in *dst);
+// 送れた (カーネルが受け取った) 数を返す。送れなかった分はためた数との差
+int udp_tx_flush(int fd, udp_tx_batch *b);
+
+#endif // UDP_BATCH_H
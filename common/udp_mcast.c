@@ -0,0 +1,52 @@
+// -*- coding: utf-8 -*-
+// IP マルチキャストの送受信 (説明は udp_mcast.h)
+
+#include "udp_mcast.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int udp_mcast_parse(const char *s, struct sockaddr_in *group) {
+    char host[64];
+    const char *colon = strchr(s, ':');
+    if (!colon || (size_t)(colon - s) >= sizeof(host)) return -1;
+    memcpy(host, s, (size_t)(colon - s));
+    host[colon - s] = '\0';
+    int port = atoi(colon + 1);
+    memset(group, 0, sizeof(*group));
+    group->sin_family = AF_INET;
+    group->sin_port = htons((unsigned short)port);
+    if (port <= 0 || port > 65535 || inet_pton(AF_INET, host, &group->sin_addr) <= 0) return -1;
+    return IN_MULTICAST(ntohl(group->sin_addr.s_addr)) ? 0 : -1;
+}
+
+int udp_mcast_join(const struct sockaddr_in *group, struct in_addr iface) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    // グループのアドレスに bind する (同じポートの別グループや unicast は受けない)
+    struct ip_mreq mreq = {.imr_multiaddr = group->sin_addr, .imr_interface = iface};
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        bind(fd, (const struct sockaddr *)group, sizeof(*group)) < 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    return fd;
+}
+
+int udp_mcast_sender(int fd, struct in_addr iface) {
+    unsigned char ttl = UDP_MCAST_TTL, loop = 1;
+    if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) < 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,31 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// IP マルチキャストで全 peer に 1 回で送る
+// ------------------------------------------------------------
+// 全 peer に同じ状態を送るなら、peer ごとに sendto (sendmmsg でも 1 通ずつ
+// カーネルを通る) する代わりに、全レプリカが同じグループに参加しておき、
+// グループ宛てに 1 回だけ送ればよい。コピーはカーネル (ループバック) か
+// スイッチがする。マージは冪等なので、重複や自分の送信が返ってきても困らない。
+//
+// 受信ソケットはグループのアドレスとポートに SO_REUSEADDR で bind するので、
+// 1 台のホストの上で何個でも参加できる (loopback で試せる)。送信は
+// いつものソケットからグループ宛てに送る (送信元が listen_port のままなので
+// 受信側は peer を見分けられる)。
+// インタフェースの既定は 127.0.0.1 (同じホストの中だけ)。LAN に流すなら
+// そのインタフェースのアドレスを渡す。
+// ------------------------------------------------------------
+#ifndef UDP_MCAST_H
+#define UDP_MCAST_H
+
+#include <netinet/in.h>
+
+#define UDP_MCAST_TTL 1 // LAN の外 (ルータの先) には出さない
+
+// "239.1.2.3:9100" を group に。マルチキャストのアドレスでなければ -1
+int udp_mcast_parse(const char *s, struct sockaddr_in *group);
+// group に iface で参加した受信ソケット (non‑blocking ではない)。失敗なら -1
+int udp_mcast_join(const struct sockaddr_in *group, struct in_addr iface);
+// fd からのマルチキャスト送信を iface に出し、同じホストの参加者にも届ける。失敗なら -1
+int udp_mcast_sender(int fd, struct in_addr iface);
+
+#endif // UDP_MCAST_H
@@ -0,0 +1,125 @@
+// -*- coding: utf-8 -*-
+// SO_REUSEPORT の受信スレッド (説明は udp_shard.h)
+
+#define _GNU_SOURCE
+#include "udp_shard.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "evloop.h"
+
+int udp_shard_socket(int port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons((unsigned short)port);
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0 ||
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    return fd;
+}
+
+static int peer_index(const udp_shard *s, const struct sockaddr_in *src) {
+    for (int i = 0; i < s->peer_count; ++i) {
+        if (s->peers[i].sin_port == src->sin_port && s->peers[i].sin_addr.s_addr == src->sin_addr.s_addr) return i;
+    }
+    return -1;
+}
+
+static void merge_batch(udp_shard *s, int n) {
+    uint64_t now = s->metrics ? gc_metrics_now() : 0;
+    int bad = 0, changed = 0;
+    uint64_t bytes = 0;
+    for (int i = 0; i < n; ++i) {
+        size_t len;
+        const char *buf = udp_rx_data(s->rx, i, &len);
+        int grown;
+        if (s->direct) {
+            unsigned long before = gc_total(s->gc);
+            grown = gc_merge_buf(s->gc, buf, len) < 0 ? -1 : gc_total(s->gc) != before;
+        } else {
+            grown = gc_stage_merge_buf(s->stage, s->gc, buf, len);
+        }
+        bad += grown < 0;
+        changed += grown > 0; // ステージ (このスレッドが見た中) で新しかった
+        bytes += len;
+        if (s->metrics) {
+            int p = peer_index(s, &s->rx->src[i]);
+            if (p >= 0) gc_metrics_heard(s->metrics, p, now, grown > 0);
+        }
+    }
+    if (!s->mt) return;
+    gc_metrics_add(s->mt, GC_M_RX_PACKETS, (uint64_t)n);
+    gc_metrics_add(s->mt, GC_M_RX_BYTES, bytes);
+    gc_metrics_add(s->mt, GC_M_MERGES, (uint64_t)(n - bad));
+    gc_metrics_add(s->mt, GC_M_MERGES_CHANGED, (uint64_t)changed);
+    if (bad) gc_metrics_add(s->mt, GC_M_PARSE_ERRORS, (uint64_t)bad);
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static void *shard_main(void *arg) {
+    udp_shard *s = arg;
+    if (s->cpu >= 0) ev_pin_cpu(s->cpu); // 失敗しても (CPU が少ないなど) 動きはする
+    uint64_t last_fold = now_us();
+    while (!atomic_load_explicit(&s->stop, memory_order_relaxed)) {
+        int n = udp_rx_recv(s->fd, s->rx, 0); // SO_RCVTIMEO で UDP_SHARD_WAIT_MS ごとに戻る
+        if (n > 0) merge_batch(s, n);
+        // 読み切った (バッチが埋まらなかった) か、しばらく畳み込んでいなければ畳み込む
+        uint64_t t = now_us();
+        if (!s->direct && (n < UDP_BATCH_MAX || t - last_fold >= UDP_SHARD_FOLD_US)) {
+            gc_stage_fold(s->stage, s->gc);
+            last_fold = t;
+        }
+    }
+    if (!s->direct) gc_stage_fold(s->stage, s->gc);
+    return NULL;
+}
+
+int udp_shard_start(udp_shard *s) {
+    struct timeval tv = {0, UDP_SHARD_WAIT_MS * 1000};
+    if (setsockopt(s->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) return -1;
+    s->rx = udp_rx_new();
+    s->stage = malloc(sizeof(*s->stage)); // MAX_REPLICAS * 8 バイトあるのでヒープに
+    if (!s->rx || !s->stage) {
+        udp_rx_free(s->rx);
+        free(s->stage);
+        return -1;
+    }
+    gc_stage_init(s->stage);
+    atomic_store(&s->stop, 0);
+    int rc = pthread_create(&s->th, NULL, shard_main, s);
+    if (rc) {
+        udp_rx_free(s->rx);
+        free(s->stage);
+        errno = rc;
+        return -1;
+    }
+    return 0;
+}
+
+void udp_shard_stop(udp_shard *s) {
+    atomic_store(&s->stop, 1);
+    pthread_join(s->th, NULL);
+    udp_rx_free(s->rx);
+    free(s->stage);
+    s->rx = NULL;
+    s->stage = NULL;
+    close(s->fd);
+}
@@ -0,0 +1,55 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// SO_REUSEPORT で受信を複数スレッドに分ける
+// ------------------------------------------------------------
+// 同じポートに SO_REUSEPORT を付けたソケットを何本も bind すると、
+// カーネルが送信元 (4 タプルのハッシュ) ごとにどれか 1 本へ振り分ける。
+// 受信スレッド (udp_shard) は自分のソケットを CPU に固定したスレッドで読み、
+// ステージ (gc_stage.h) にマージして、ソケットを読み切ったときか
+// UDP_SHARD_FOLD_US ごとに共有の GCounter へ畳み込む。
+//
+// 1 つの peer からのパケットはいつも同じソケットに来るので、受信側が
+// スケールするのは peer (送信元) が受信スレッドより十分多いときだけ。
+// 受信スレッドはマージするだけで返信は送らない (pull 要求には答えない)。
+// ------------------------------------------------------------
+#ifndef UDP_SHARD_H
+#define UDP_SHARD_H
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "gc.h"
+#include "gc_metrics.h"
+#include "gc_stage.h"
+#include "udp_batch.h"
+
+#define UDP_SHARD_MAX 16
+#define UDP_SHARD_FOLD_US 1000 // 読み続けていてもこの間隔で畳み込む
+#define UDP_SHARD_WAIT_MS 50   // 受信がなくても止まる指示を見に行く間隔
+
+typedef struct {
+    int fd;
+    int cpu;                  // 固定する CPU (-1 なら固定しない)
+    GCounter *gc;
+    int direct;               // 1 ならステージを使わず直接マージする (比較用)
+    // メトリクス (NULL なら数えない)
+    gc_metrics *metrics;
+    gc_metrics_thread *mt;
+    const struct sockaddr_in *peers; // peer ごとの最終受信時刻を付ける相手
+    int peer_count;
+
+    pthread_t th;
+    _Atomic int stop;
+    udp_rx_batch *rx;
+    gc_stage *stage;
+} udp_shard;
+
+// SO_REUSEPORT を付けて port に bind した UDP ソケット。失敗なら -1
+int udp_shard_socket(int port);
+// s の fd / cpu / gc (とメトリクス) を埋めてから呼ぶ。スレッドを起こす。失敗なら -1
+int udp_shard_start(udp_shard *s);
+// スレッドを止めて待ち、残りを畳み込んでソケットを閉じる
+void udp_shard_stop(udp_shard *s);
+
+#endif // UDP_SHARD_H
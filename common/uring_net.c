@@ -0,0 +1,371 @@
+// -*- coding: utf-8 -*-
+// io_uring による UDP 送受信 (説明は uring_net.h)
+
+#define _GNU_SOURCE
+#include "uring_net.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define RING_ENTRIES 256
+#define BGID 1
+#define UD_RECV 1ULL      // user_data: multishot recv
+#define UD_SEND 2ULL      // user_data: 送信 (上位 32bit に枠番号)
+// 受信バッファ 1 個: カーネルは recvmsg_out と送信元アドレスを先に書き、残りにペイロードを書く
+#define RX_SLOT (sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + URING_NET_BUF)
+
+typedef struct {
+    struct msghdr msg;
+    struct iovec iov;
+    struct sockaddr_in dst;
+    char buf[URING_NET_BUF];
+} tx_slot;
+
+struct uring_net {
+    int sock;
+    int ring;
+
+    // SQ / CQ (mmap したカーネルとの共有メモリ)
+    void *sq_ptr, *cq_ptr;
+    size_t sq_sz, cq_sz;
+    struct io_uring_sqe *sqes;
+    size_t sqes_sz;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned sq_entries;
+    unsigned to_submit;
+
+    // 受信
+    struct io_uring_buf_ring *br;
+    size_t br_sz;
+    char *bufs;               // URING_NET_BUFS * RX_SLOT
+    struct msghdr rx_msg;     // multishot recvmsg の間ずっと有効であること
+    int recv_armed;
+
+    // 送信
+    tx_slot *tx;
+    int tx_free[URING_NET_TX];
+    int n_free;
+
+    uring_net_stats st;
+};
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned op, void *arg, unsigned nr) {
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+// -------------------- SQ / CQ --------------------
+
+static struct io_uring_sqe *get_sqe(uring_net *u) {
+    unsigned tail = *u->sq_tail;
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if (tail - head >= u->sq_entries) {
+        uring_net_flush(u); // SQ が一杯なら先に投げる
+        head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+        if (tail - head >= u->sq_entries) return NULL;
+    }
+    struct io_uring_sqe *sqe = &u->sqes[tail & *u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static void commit_sqe(uring_net *u) {
+    unsigned tail = *u->sq_tail;
+    u->sq_array[tail & *u->sq_mask] = tail & *u->sq_mask;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    u->to_submit++;
+}
+
+int uring_net_flush(uring_net *u) {
+    if (!u->to_submit) return 0;
+    int n;
+    do {
+        n = sys_enter(u->ring, u->to_submit, 0, 0);
+    } while (n < 0 && errno == EINTR);
+    u->st.enters++;
+    if (n > 0) u->to_submit -= (unsigned)n;
+    return n;
+}
+
+int uring_net_wait(uring_net *u) {
+    int n;
+    do {
+        n = sys_enter(u->ring, u->to_submit, 1, IORING_ENTER_GETEVENTS);
+    } while (n < 0 && errno == EINTR);
+    u->st.enters++;
+    if (n > 0) u->to_submit -= (unsigned)n;
+    return n;
+}
+
+// -------------------- 受信 --------------------
+
+static void recycle(uring_net *u, unsigned bid, unsigned offset) {
+    unsigned mask = URING_NET_BUFS - 1;
+    struct io_uring_buf *b = &u->br->bufs[(u->br->tail + offset) & mask];
+    b->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)bid * RX_SLOT);
+    b->len = RX_SLOT;
+    b->bid = (uint16_t)bid;
+}
+
+static void publish(uring_net *u, unsigned count) {
+    __atomic_store_n(&u->br->tail, (uint16_t)(u->br->tail + count), __ATOMIC_RELEASE);
+}
+
+static int arm_recv(uring_net *u) {
+    struct io_uring_sqe *sqe = get_sqe(u);
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = u->sock;
+    sqe->addr = (uint64_t)(uintptr_t)&u->rx_msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BGID;
+    sqe->user_data = UD_RECV;
+    commit_sqe(u);
+    u->recv_armed = 1;
+    return 0;
+}
+
+// -------------------- 生成 / 破棄 --------------------
+
+uring_net *uring_net_new(int fd) {
+    uring_net *u = calloc(1, sizeof(*u));
+    if (!u) return NULL;
+    u->sock = fd;
+    u->ring = -1;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    u->ring = sys_setup(RING_ENTRIES, &p);
+    if (u->ring < 0) goto fail;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        errno = ENOSYS;
+        goto fail;
+    }
+    u->sq_entries = p.sq_entries;
+    u->sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (u->cq_sz > u->sq_sz) u->sq_sz = u->cq_sz;
+    u->sq_ptr = mmap(NULL, u->sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring,
+                     IORING_OFF_SQ_RING);
+    if (u->sq_ptr == MAP_FAILED) {
+        u->sq_ptr = NULL;
+        goto fail;
+    }
+    u->cq_ptr = u->sq_ptr; // SINGLE_MMAP: SQ と CQ は同じ領域
+    u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring,
+                   IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        goto fail;
+    }
+    char *sq = u->sq_ptr, *cq = u->cq_ptr;
+    u->sq_head = (unsigned *)(sq + p.sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *)(sq + p.sq_off.array);
+    u->cq_head = (unsigned *)(cq + p.cq_off.head);
+    u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // 受信バッファリングを登録する
+    u->br_sz = URING_NET_BUFS * sizeof(struct io_uring_buf);
+    u->br = mmap(NULL, u->br_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    u->bufs = malloc((size_t)URING_NET_BUFS * RX_SLOT);
+    u->tx = calloc(URING_NET_TX, sizeof(tx_slot));
+    if (u->br == MAP_FAILED || !u->bufs || !u->tx) {
+        if (u->br == MAP_FAILED) u->br = NULL;
+        errno = ENOMEM;
+        goto fail;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)u->br;
+    reg.ring_entries = URING_NET_BUFS;
+    reg.bgid = BGID;
+    if (sys_register(u->ring, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) goto fail;
+    u->br->tail = 0;
+    for (unsigned i = 0; i < URING_NET_BUFS; i++) recycle(u, i, i);
+    publish(u, URING_NET_BUFS);
+
+    // recvmsg_out の後ろに送信元アドレスを書かせる
+    u->rx_msg.msg_namelen = sizeof(struct sockaddr_in);
+
+    for (int i = 0; i < URING_NET_TX; i++) u->tx_free[i] = URING_NET_TX - 1 - i;
+    u->n_free = URING_NET_TX;
+
+    if (arm_recv(u) < 0 || uring_net_flush(u) < 0) goto fail;
+    return u;
+
+fail: {
+    int e = errno;
+    uring_net_free(u);
+    errno = e;
+    return NULL;
+}
+}
+
+void uring_net_free(uring_net *u) {
+    if (!u) return;
+    if (u->ring >= 0) close(u->ring); // 投げてある recv / send もここで取り消される
+    if (u->sqes) munmap(u->sqes, u->sqes_sz);
+    if (u->sq_ptr) munmap(u->sq_ptr, u->sq_sz);
+    if (u->br) munmap(u->br, u->br_sz);
+    free(u->bufs);
+    free(u->tx);
+    free(u);
+}
+
+int uring_net_fd(const uring_net *u) {
+    return u->ring;
+}
+
+const uring_net_stats *uring_net_get_stats(const uring_net *u) {
+    return &u->st;
+}
+
+// -------------------- 完了の回収 --------------------
+
+int uring_net_poll(uring_net *u, uring_net_rx_fn cb, void *arg) {
+    const void *bufs[URING_NET_BATCH];
+    size_t lens[URING_NET_BATCH];
+    struct sockaddr_in srcs[URING_NET_BATCH];
+    unsigned bids[URING_NET_BATCH];
+    int total = 0;
+
+    for (;;) {
+        unsigned head = *u->cq_head;
+        unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) break;
+        int n = 0;
+        for (; head != tail && n < URING_NET_BATCH; head++) {
+            const struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+            if ((cqe->user_data & 0xffffffffULL) == UD_SEND) {
+                u->tx_free[u->n_free++] = (int)(cqe->user_data >> 32);
+                if (cqe->res < 0) u->st.tx_errors++;
+                else u->st.tx++;
+                continue;
+            }
+            // multishot recv
+            if (!(cqe->flags & IORING_CQE_F_MORE)) u->recv_armed = 0; // 止まった: 後で投げ直す
+            if (cqe->res < 0) {
+                if (cqe->res == -ENOBUFS) u->st.rx_nobufs++;
+                continue;
+            }
+            if (!(cqe->flags & IORING_CQE_F_BUFFER)) continue;
+            unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            const char *b = u->bufs + (size_t)bid * RX_SLOT;
+            const struct io_uring_recvmsg_out *out = (const void *)b;
+            bids[n] = bid;
+            if ((size_t)cqe->res < sizeof(*out) + u->rx_msg.msg_namelen) {
+                lens[n] = 0; // 壊れた完了: バッファだけ返す
+                bufs[n] = b;
+            } else if (out->flags & MSG_TRUNC) {
+                // 途中で切れたデータグラムを渡すと、末尾のエントリだけが届かないまま
+                // 前半がマージされる。丸ごと捨てる
+                lens[n] = 0;
+                bufs[n] = b;
+                u->st.rx_trunc++;
+            } else {
+                memcpy(&srcs[n], b + sizeof(*out), sizeof(srcs[n]));
+                bufs[n] = b + sizeof(*out) + u->rx_msg.msg_namelen + out->controllen;
+                lens[n] = out->payloadlen;
+            }
+            n++;
+        }
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+        if (n > 0) {
+            // 空のものは詰めてから渡す
+            int m = 0;
+            for (int i = 0; i < n; i++) {
+                if (!lens[i]) continue;
+                bufs[m] = bufs[i];
+                lens[m] = lens[i];
+                srcs[m] = srcs[i];
+                m++;
+            }
+            if (m) cb(arg, bufs, lens, srcs, m);
+            for (int i = 0; i < n; i++) recycle(u, bids[i], (unsigned)i);
+            publish(u, (unsigned)n);
+            u->st.rx += (uint64_t)m;
+            total += m;
+        }
+    }
+    if (!u->recv_armed) {
+        u->st.rearms++;
+        if (arm_recv(u) == 0) uring_net_flush(u);
+    }
+    return total;
+}
+
+// -------------------- 送信 --------------------
+
+int uring_net_send(uring_net *u, const void *buf, size_t len, const struct sockaddr_in *dst) {
+    if (len > URING_NET_BUF) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    while (u->n_free == 0) { // 送信枠が空くまで完了を待つ
+        if (uring_net_wait(u) < 0) return -1;
+        unsigned head = *u->cq_head;
+        unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+        // CQ は先頭からしか進められないので、先頭に続く送信の完了だけを回収する
+        while (head != tail) {
+            const struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+            if ((cqe->user_data & 0xffffffffULL) != UD_SEND) break;
+            u->tx_free[u->n_free++] = (int)(cqe->user_data >> 32);
+            if (cqe->res < 0) u->st.tx_errors++;
+            else u->st.tx++;
+            head++;
+        }
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+        if (u->n_free == 0 && head != tail) {
+            errno = EAGAIN; // 先頭に受信の完了がある: 呼び出し側が poll すること
+            return -1;
+        }
+    }
+    int slot = u->tx_free[--u->n_free];
+    tx_slot *t = &u->tx[slot];
+    memcpy(t->buf, buf, len);
+    t->dst = *dst;
+    t->iov.iov_base = t->buf;
+    t->iov.iov_len = len;
+    memset(&t->msg, 0, sizeof(t->msg));
+    t->msg.msg_name = &t->dst;
+    t->msg.msg_namelen = sizeof(t->dst);
+    t->msg.msg_iov = &t->iov;
+    t->msg.msg_iovlen = 1;
+
+    struct io_uring_sqe *sqe = get_sqe(u);
+    if (!sqe) {
+        u->tx_free[u->n_free++] = slot;
+        errno = EBUSY;
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = u->sock;
+    sqe->addr = (uint64_t)(uintptr_t)&t->msg;
+    sqe->len = 1;
+    sqe->user_data = UD_SEND | ((uint64_t)slot << 32);
+    commit_sqe(u);
+    return 0;
+}
@@ -0,0 +1,62 @@
+// -*- coding: utf-8 -*-
+// ------------------------------------------------------------
+// io_uring による UDP 送受信 (udp_batch の代わりに使える)
+// ------------------------------------------------------------
+// 受信: 登録したバッファリング (provided buffer ring) に multishot recvmsg で
+//       受け取る。1 回投げておけば、データグラムごとの SQE もシステムコールも
+//       いらない。uring_net_poll() は完了キューを見るだけ (システムコールなし)。
+// 送信: uring_net_send() は SENDMSG の SQE を積むだけで、uring_net_flush() の
+//       1 回の io_uring_enter でまとめて投げる。
+// liburing は使わず、io_uring_setup / io_uring_enter / io_uring_register を
+// 直接呼ぶ。カーネルが対応していない (古い・無効化されている) ときは
+// uring_net_new() が NULL を返すので、呼び出し側はソケットの経路に戻ること。
+//
+// リングの fd は完了があると読み込み可能になるので、evloop に登録できる。
+// 1 スレッドから使うこと。
+// ------------------------------------------------------------
+#ifndef URING_NET_H
+#define URING_NET_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define URING_NET_BUFS 256    // 受信バッファの数 (2 のべき)
+#define URING_NET_BUF 4096    // 送受信できるデータグラムの最大長 (BUF_SIZE と同じ)。
+                              // 受信バッファ 1 個はこれに recvmsg_out と送信元アドレスを足した大きさ
+#define URING_NET_TX 256      // 同時に投げておける送信の数
+#define URING_NET_BATCH 64    // uring_net_poll がまとめて渡すデータグラム数
+
+typedef struct uring_net uring_net;
+
+typedef struct {
+    uint64_t enters;      // io_uring_enter を呼んだ回数
+    uint64_t rx, tx;      // 受け取った / 送り終えたデータグラム
+    uint64_t rearms;      // multishot recv を投げ直した回数
+    uint64_t rx_nobufs;   // バッファ切れで止まった回数
+    uint64_t rx_trunc;    // URING_NET_BUF より長くて切れたので捨てたデータグラム
+    uint64_t tx_errors;
+} uring_net_stats;
+
+// UDP ソケット fd で送受信する。使えなければ NULL (errno)
+uring_net *uring_net_new(int fd);
+void uring_net_free(uring_net *u);
+// epoll に登録する fd (完了があると EPOLLIN)
+int uring_net_fd(const uring_net *u);
+const uring_net_stats *uring_net_get_stats(const uring_net *u);
+
+// 届いたデータグラムを最大 URING_NET_BATCH 個ずつ cb に渡す (バッファは cb の間だけ有効)。
+// 渡した数を返す。送信の完了もここで回収する。ブロックしない
+typedef void (*uring_net_rx_fn)(void *arg, const void *const bufs[], const size_t lens[],
+                                const struct sockaddr_in *srcs, int n);
+int uring_net_poll(uring_net *u, uring_net_rx_fn cb, void *arg);
+
+// len バイトを dst へ送る SQE を積む (buf はコピーする)。送信枠が一杯なら
+// flush して空くまで待つ。失敗なら -1
+int uring_net_send(uring_net *u, const void *buf, size_t len, const struct sockaddr_in *dst);
+// 積んである SQE を 1 回の io_uring_enter で投げる。投げた数を返す
+int uring_net_flush(uring_net *u);
+// 完了が 1 個以上来るまで待つ (ベンチマーク用)
+int uring_net_wait(uring_net *u);
+
+#endif // URING_NET_H
@@ -0,0 +1,47 @@
+// -*- coding: utf-8 -*-
+// LEB128 varint (7bit ずつ, 最大 10 バイト)。ワイヤ形式で共通に使う
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// p に v を書く。end を超えるなら NULL
+static inline uint8_t *varint_put(uint8_t *p, const uint8_t *end, uint64_t v) {
+    while (v >= 0x80) {
+        if (p >= end) return NULL;
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    if (p >= end) return NULL;
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// v を書いたときのバイト数
+static inline size_t varint_len(uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+// p から読む。途中で切れている / 64bit を超えるなら NULL
+static inline const uint8_t *varint_get(const uint8_t *p, const uint8_t *end, uint64_t *out) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p >= end) return NULL;
+        uint8_t b = *p++;
+        if (shift == 63 && b > 1) return NULL;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *out = v;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+#endif // VARINT_H
@@ -3,12 +3,16 @@
  *
  * – Concurrent‑safe across up to MAX_REPLICAS replicas
  * – Associative, commutative, idempotent merge (eventual consistency)
+ * – merge / value use the vector kernels in ../common/gc_simd.c
+ *   (AVX‑512 / AVX2 picked at runtime, scalar fallback elsewhere)
+ * – running sums of inc/dec are kept up to date by increment and merge,
+ *   so pn_value is O(1); pn_value_recompute re‑sums for checking
  *
  * Build demo (default, includes main):
- *     gcc -std=c11 -Wall -o pn_counter crdt_pn_counter.c
+ *     gcc -std=c11 -Wall -I../common -o pn_counter PN-Counter.c ../common/gc_simd.c
  *
  * Build as library (exclude main):
- *     gcc -std=c11 -Wall -DPN_COUNTER_LIB -c crdt_pn_counter.c
+ *     gcc -std=c11 -Wall -I../common -DPN_COUNTER_LIB -c PN-Counter.c
  */
 
 #include <stdio.h>
@@ -17,6 +21,8 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "gc_simd.h"
+
 #ifndef MAX_REPLICAS
 #define MAX_REPLICAS 8
 #endif
@@ -25,6 +31,8 @@
 typedef struct {
     uint64_t inc[MAX_REPLICAS];
     uint64_t dec[MAX_REPLICAS];
+    uint64_t sum_inc;   /* = Σ inc[i], maintained incrementally */
+    uint64_t sum_dec;   /* = Σ dec[i], maintained incrementally */
 } pn_counter;
 
 /* Initialise all components to zero */
@@ -34,29 +42,46 @@ static inline void pn_init(pn_counter *c) {
 
 /* Local replica r increments by delta (≥ 0) */
 static inline void pn_increment(pn_counter *c, uint32_t r, uint64_t delta) {
-    if (r < MAX_REPLICAS) c->inc[r] += delta;
+    if (r < MAX_REPLICAS) {
+        c->inc[r] += delta;
+        c->sum_inc += delta;
+    }
 }
 
 /* Local replica r decrements by delta (≥ 0) */
 static inline void pn_decrement(pn_counter *c, uint32_t r, uint64_t delta) {
-    if (r < MAX_REPLICAS) c->dec[r] += delta;
+    if (r < MAX_REPLICAS) {
+        c->dec[r] += delta;
+        c->sum_dec += delta;
+    }
 }
 
-/* Join‑merge: A := A ⊔ B */
+/* Join‑merge: A := A ⊔ B  (element‑wise unsigned max) */
 static inline void pn_merge(pn_counter *a, const pn_counter *b) {
-    for (uint32_t i = 0; i < MAX_REPLICAS; ++i) {
-        if (b->inc[i] > a->inc[i]) a->inc[i] = b->inc[i];
-        if (b->dec[i] > a->dec[i]) a->dec[i] = b->dec[i];
+    a->sum_inc += gc_vec_max_u64(a->inc, b->inc, MAX_REPLICAS);
+    a->sum_dec += gc_vec_max_u64(a->dec, b->dec, MAX_REPLICAS);
+}
+
+/* Join‑merge of k states in one pass: A := A ⊔ B[0] ⊔ … ⊔ B[k‑1] */
+static inline void pn_merge_batch(pn_counter *a, const pn_counter *const *b, size_t k) {
+    const uint64_t *incs[k ? k : 1], *decs[k ? k : 1];
+    for (size_t j = 0; j < k; ++j) {
+        incs[j] = b[j]->inc;
+        decs[j] = b[j]->dec;
     }
+    a->sum_inc += gc_vec_max_batch_u64(a->inc, incs, k, MAX_REPLICAS);
+    a->sum_dec += gc_vec_max_batch_u64(a->dec, decs, k, MAX_REPLICAS);
 }
 
-/* Current counter value */
+/* Current counter value — O(1) from the running sums */
 static inline int64_t pn_value(const pn_counter *c) {
-    uint64_t sum_inc = 0, sum_dec = 0;
-    for (uint32_t i = 0; i < MAX_REPLICAS; ++i) {
-        sum_inc += c->inc[i];
-        sum_dec += c->dec[i];
-    }
+    return (int64_t)(c->sum_inc - c->sum_dec);
+}
+
+/* Same value re‑summed from the vectors (for checking the running sums) */
+static inline int64_t pn_value_recompute(const pn_counter *c) {
+    uint64_t sum_inc = gc_vec_sum_u64(c->inc, MAX_REPLICAS);
+    uint64_t sum_dec = gc_vec_sum_u64(c->dec, MAX_REPLICAS);
     return (int64_t)(sum_inc - sum_dec);
 }
 
@@ -1,4 +1,7 @@
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
 #include <netinet/in.h>
 /*
 #include <netinet/in.h>の中で以下のように定義されている。
@@ -16,23 +19,55 @@ int main (void) {
     int sock0;
     struct sockaddr_in addr; /*strunct IPv4インターネット用ソケットアドレス構造体 変数名*/
     struct sockaddr_in client;
+    socklen_t len; /*acceptに渡すアドレスの長さ*/
+    int sock; /*acceptが返す、クライアントとつながったソケット*/
 
     /*ソケットの作成 int socket(プロトコルファミリー、ソケットのタイプ、使用するプロトコル)*/
     sock0 = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock0 < 0) {
+        perror("socket");
+        return 1;
+    }
 
     /*ソケットの設定*/
+    memset(&addr, 0, sizeof(addr)); /*sin_zeroなども含めて0で埋めておく*/
     addr.sin_family = AF_INET; /*インターネットプロトコルを指定*/
     addr.sin_port = htons(12345); /*ポートを指定*/
-    addr.sin_addr.s_addr = INADDR_ANY; /* */
-    addr.sin_len = sizeof(addr); /*addrの使うバイト数*/
+    addr.sin_addr.s_addr = INADDR_ANY; /*どのインターフェースに来た接続も受け付ける*/
+    /* addr.sin_len はBSD(macOS)にしかない。Linuxにはないので設定しない。 */
+
+    /*ソケットにアドレスとポートを割り当てる*/
+    if (bind(sock0, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("bind");
+        close(sock0);
+        return 1;
+    }
 
     /* TCPクライアントからの接続要求を待てる状態にする */
-    listen(sock0, 5); /*最大5件までの接続要求をキューに溜めておけるようにする。*/
+    if (listen(sock0, 5) != 0) { /*最大5件までの接続要求をキューに溜めておけるようにする。*/
+        perror("listen");
+        close(sock0);
+        return 1;
+    }
 
     /* TCPクライアントからの接続要求を受け付ける */
     len = sizeof(client);
     sock = accept(sock0, (struct sockaddr *)&client, &len); /*接続要求を受け取り、新しいソケットをsockに返す。*/
+    if (sock < 0) {
+        perror("accept");
+        close(sock0);
+        return 1;
+    }
+
+    /*クライアントに文字列を送る*/
+    write(sock, "HELLO\n", 6);
+
+    /*TCPセッションの終了*/
+    close(sock);
+
+    /*listenするソケットの終了*/
+    close(sock0);
 
     return 0;
 
-}
\ No newline at end of file
+}
@@ -2,20 +2,31 @@
  * Interactive state‑based G‑Counter (CvRDT) — multi‑process demo only
  *
  * Build:
- *   gcc -std=c11 -Wall -Wextra -pthread gcounter.c -o demo
+ *   gcc -std=c11 -Wall -Wextra -pthread -I../common gcounter.c ../common/gc_shm.c -o demo
  * Run:
- *   ./demo
+ *   ./demo        子がスナップショットをパイプで送り、親がマージする
+ *   ./demo shm    共有メモリ (../common/gc_shm.h): 子は自分のスロットに直接足し、
+ *                 親はコピーせずに全スロットを読む
  *   → すべてのレプリカについてインクリメント回数を入力すると集計結果が表示される。
+ *
+ * Build as library (exclude main, e.g. for ../bench/bench_suite.c):
+ *   gcc -std=c11 -Wall -I../common -DGCOUNTER_LIB -c gcounter.c
  */
 
+#ifndef _POSIX_C_SOURCE
 #define _POSIX_C_SOURCE 200112L
+#endif
 #include <stdatomic.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/wait.h>
 
+#include "gc_core.h"   /* ロックフリーなスロット (UDPstate と共通) */
+#include "gc_shm.h"    /* 共有メモリのセグメント */
+
 #ifndef N_REPLICAS
 #define N_REPLICAS 3   /* フォークするレプリカ数（コンパイル時に -DN_REPLICAS=5 などで変更可） */
 #endif
@@ -26,32 +37,63 @@
 
 typedef struct {
     int id;                                         /* このレプリカの ID */
-    atomic_uint_least64_t state[N_REPLICAS];        /* 各レプリカの累積値 */
+    gc_slot state[N_REPLICAS];                      /* 各レプリカの累積値（1 キャッシュラインに 1 個） */
 } GCounter;
 
 /* ---------------- CRDT 基本操作 ---------------- */
-static void gcounter_inc(GCounter *g) {
-    atomic_fetch_add_explicit(&g->state[g->id], 1, memory_order_relaxed);
+static inline void gcounter_inc(GCounter *g) {
+    gc_slot_add(&g->state[g->id], 1);
 }
 
-static void gcounter_snapshot(const GCounter *g, uint64_t out[N_REPLICAS]) {
-    for (size_t i = 0; i < N_REPLICAS; ++i)
-        out[i] = atomic_load_explicit(&g->state[i], memory_order_relaxed);
+static inline void gcounter_snapshot(const GCounter *g, uint64_t out[N_REPLICAS]) {
+    gc_slots_snapshot(g->state, out, N_REPLICAS);
 }
 
-static void gcounter_merge_raw(GCounter *g, const uint64_t snap[N_REPLICAS]) {
-    for (size_t i = 0; i < N_REPLICAS; ++i) {
-        uint64_t local = atomic_load_explicit(&g->state[i], memory_order_relaxed);
-        if (snap[i] > local)
-            atomic_store_explicit(&g->state[i], snap[i], memory_order_relaxed);
-    }
+/* CAS による store‑max なので、並行マージでもスロットが巻き戻らない */
+static inline void gcounter_merge_raw(GCounter *g, const uint64_t snap[N_REPLICAS]) {
+    gc_slots_merge(g->state, snap, N_REPLICAS);
+}
+
+static inline uint64_t gcounter_value(const GCounter *g) {
+    return gc_slots_sum(g->state, N_REPLICAS);
 }
 
-static uint64_t gcounter_value(const GCounter *g) {
-    uint64_t sum = 0;
-    for (size_t i = 0; i < N_REPLICAS; ++i)
-        sum += atomic_load_explicit(&g->state[i], memory_order_relaxed);
-    return sum;
+#ifndef GCOUNTER_LIB  /* demo harness — compiled unless GCOUNTER_LIB is defined */
+/* ------------------------------------------------------------------
+ * 共有メモリ版
+ * 親がセグメントを作り、子は fork で受け継いだマップの自分のスロットに
+ * 直接足す。パイプもコピーもマージもいらず、親は全スロットを読むだけ
+ * (子が動いている最中でも読める)。
+ * ------------------------------------------------------------------*/
+static int run_shm(const int incr[N_REPLICAS]) {
+    char name[64];
+    snprintf(name, sizeof name, "/gc-demo-%d", (int)getpid());
+    gc_shm shm;
+    if (gc_shm_create(&shm, name, N_REPLICAS) < 0) { perror("gc_shm_create"); return 1; }
+    gc_shm_unlink(name);           /* 名前はもういらない (マップは残る) */
+
+    pid_t pids[N_REPLICAS] = {0};
+    for (int i = 0; i < N_REPLICAS; ++i) {
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork"); return 1; }
+        if (pid == 0) {            /* ---- child ---- */
+            int id = gc_shm_claim(&shm, (int32_t)getpid());
+            for (int k = 0; k < incr[i]; ++k)
+                gc_shm_add(&shm, id, 1);
+            printf("[child %d] slot %d = %llu\n", i, id, (unsigned long long)gc_shm_load(&shm, id));
+            _Exit(0);
+        }
+        pids[i] = pid;
+    }
+    for (int i = 0; i < N_REPLICAS; ++i) waitpid(pids[i], NULL, 0);
+
+    uint64_t snap[N_REPLICAS];
+    gc_shm_snapshot(&shm, snap);   /* 全スロットの一貫したスナップショット */
+    uint64_t total = 0;
+    for (int i = 0; i < N_REPLICAS; ++i) total += snap[i];
+    printf("[parent] aggregated total = %llu (shared memory)\n", (unsigned long long)total);
+    gc_shm_detach(&shm);
+    return 0;
 }
 
 /* ------------------------------------------------------------------
@@ -60,8 +102,10 @@ static uint64_t gcounter_value(const GCounter *g) {
  * 2. fork() で N_REPLICAS 個の子プロセスを生成。
  * 3. 各子が自分の回数だけ gcounter_inc し、スナップショットをパイプ送信。
  * 4. 親がすべてのスナップショットをマージし、合計値を表示。
+ *    (引数に shm を付けると 3〜4 を共有メモリで行う: run_shm)
  * ------------------------------------------------------------------*/
-int main(void) {
+int main(int argc, char *argv[]) {
+    int use_shm = argc > 1 && strcmp(argv[1], "shm") == 0;
     int incr[N_REPLICAS] = {0};
     printf("=== G‑Counter interactive demo (%d replicas) ===\n", N_REPLICAS);
     for (int i = 0; i < N_REPLICAS; ++i) {
@@ -72,6 +116,7 @@ int main(void) {
             return 1;
         }
     }
+    if (use_shm) return run_shm(incr);
 
     int pipes[N_REPLICAS][2];
     pid_t pids[N_REPLICAS] = {0};
@@ -115,3 +160,4 @@ int main(void) {
     printf("[parent] aggregated total = %llu\n", (unsigned long long)total);
     return 0;
 }
+#endif /* GCOUNTER_LIB */
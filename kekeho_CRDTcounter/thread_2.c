@@ -1,42 +1,33 @@
 /*共有メモリにアクセス*/
+// reader は値が変わるまで眠る (gc_wait_change)。以前は mutex で守った x を
+// ループで読み続けていたので、writer が sleep している間も 1 コアを使い切っていた。
+//   $ gcc -pthread -I../common thread_2.c ../common/gc.c ../common/gc_wire.c ../common/gc_sparse.c ../common/gc_watch.c
 
 #include <stdio.h>
 #include <pthread.h>
 #include <unistd.h>   // sleep()
 
+#include "gc.h"
+
 #define MAX_WRITES 2  // writer updates x twice (10, 20)
 
-static int x    = 0;  // shared variable
-static int done = 0;  // signals writer completion
-static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+static GCounter x;    // shared counter (only grows: 10, 20)
 
 void *writer(void *arg) {
     for (int i = 1; i <= MAX_WRITES; ++i) {
         sleep(2);                 // emulate work (2‑second interval)
-        pthread_mutex_lock(&mtx);
-        x = i * 10;               // 10, 20, ...
-        printf("#Writer: Set x = %d\n", x);
-        pthread_mutex_unlock(&mtx);
+        gc_increment(&x, 10);     // 10, 20, ... (wakes the reader)
+        printf("#Writer: Set x = %d\n", i * 10);
     }
-    pthread_mutex_lock(&mtx);
-    done = 1;                     // let reader know we're finished
-    pthread_mutex_unlock(&mtx);
     return NULL;
 }
 
 void *reader(void *arg) {
-    int last = -1;                // track last printed value
-    while (1) {
-        pthread_mutex_lock(&mtx);
-        int val      = x;
-        int finished = done;
-        pthread_mutex_unlock(&mtx);
-
-        if (val != last) {        // value changed → print
-            printf("#Reader: Read x = %d\n", val);
-            last = val;
-        }
-        if (finished && last == val) break; // exit after final value
+    unsigned long val = gc_total(&x);
+    printf("#Reader: Read x = %lu\n", val);
+    while (val < MAX_WRITES * 10) {  // exit after final value
+        gc_wait_change(&x, &val, -1); // sleeps until x changes (no spinning)
+        printf("#Reader: Read x = %lu\n", val);
     }
     return NULL;
 }
@@ -44,6 +35,10 @@ void *reader(void *arg) {
 int main(void) {
     pthread_t tid_reader, tid_writer;
 
+    if (gc_init(&x, 0, 0) < 0) {
+        return 1;
+    }
+
     // spawn threads
     if (pthread_create(&tid_writer, NULL, writer, NULL) != 0) {
         return 1;
@@ -55,5 +50,6 @@ int main(void) {
     // wait for both to finish
     pthread_join(tid_writer, NULL);
     pthread_join(tid_reader, NULL);
+    gc_destroy(&x);
     return 0;
 }